@@ -0,0 +1,313 @@
+/*
+ *     benchbit2.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     benchbit2
+ *
+ *     This program times the two Bit2 layouts, row-major and 8x8 tiles,
+ *     on the same random page: a row-major map, a column-major map, a
+ *     run map, a parallel row-major map, a flood fill from the border
+ *     that only uses Bit2_get and Bit2_put, the bulk Bit2_count,
+ *     Bit2_hash and Bit2_transpose, and a 3x3 opening with Bit2_morph. It
+ *     checks that both layouts give the same answers and that Bit2_count,
+ *     the run map and the parallel map agree with the per-pixel maps.
+ *     The column-major map through transposed strips is timed against
+ *     Bit2_map_col_major by benchcolmap.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "assert.h"
+#include "bit2.h"
+
+/* The layouts being compared */
+static const struct {
+        const char *name;
+        Bit2_layout layout;
+} layouts[] = {
+        { "row-major", BIT2_ROW_MAJOR },
+        { "tiled",     BIT2_TILED },
+};
+
+static Bit2_T random_page(int size, int percent, unsigned seed,
+                          Bit2_layout layout);
+static void   count_black(int row, int col, Bit2_T bit2, int value,
+                          void *cl);
+static void   count_run(int row, int col, int len, int value, void *cl);
+static void   add_count(void *cl, const void *part);
+static long   flood_border(Bit2_T bitmap);
+static double now_ms(void);
+
+/*
+*  name:        main
+*  purpose:     Times the per-pixel, run and parallel maps, Bit2_count, an
+*               opening and a flood fill on both Bit2 layouts.
+*  arguments:   Optionally the side length of the square page.
+*  return type: Integer (EXIT_SUCCESS, or EXIT_FAILURE if the layouts
+*               disagree).
+*  effect:      Prints which bulk kernels are in use, then one table row
+*               per layout and access pattern.
+*  expects:     The argument, if given, is a positive integer.
+*/
+int main(int argc, char *argv[])
+{
+        int size = (argc > 1) ? atoi(argv[1]) : 4096;
+        assert(size > 0);
+        int count = sizeof(layouts) / sizeof(layouts[0]);
+        long results[2][8];
+
+        printf("bulk kernels: %s\n", Bit2_kernels());
+        printf("%-10s %-10s %12s %12s\n", "layout", "access", "ms",
+               "result");
+        for (int i = 0; i < count; i++) {
+                Bit2_T page = random_page(size, 60, 1, layouts[i].layout);
+
+                long black = 0;
+                double start = now_ms();
+                Bit2_map_row_major(page, count_black, &black);
+                double elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "row map", elapsed, black);
+                results[i][0] = black;
+
+                black = 0;
+                start = now_ms();
+                Bit2_map_col_major(page, count_black, &black);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "col map", elapsed, black);
+                results[i][1] = black;
+
+                black = 0;
+                start = now_ms();
+                Bit2_map_runs(page, count_run, &black);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "run map", elapsed, black);
+                results[i][4] = black;
+
+                black = 0;
+                start = now_ms();
+                Bit2_map_row_major_parallel(page, count_black, &black,
+                                            sizeof(black), add_count, 0);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "par map", elapsed, black);
+                results[i][5] = black;
+
+                start = now_ms();
+                black = Bit2_count(page);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "popcount", elapsed, black);
+                results[i][3] = black;
+
+                start = now_ms();
+                long hash = (long)(Bit2_hash(page, 0) >> 24);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12lx\n", layouts[i].name,
+                       "hash", elapsed, hash);
+                results[i][7] = hash;
+
+                start = now_ms();
+                Bit2_T flipped = Bit2_transpose(page);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "transpose", elapsed, (long)Bit2_count(flipped));
+                Bit2_free(&flipped);
+
+                Bit2_T opened = Bit2_new_layout(size, size,
+                                                layouts[i].layout);
+                Bit2_combine(opened, page, BIT2_OR);
+                start = now_ms();
+                Bit2_morph(opened, BIT2_OPEN, BIT2_SE_SQUARE3, NULL);
+                elapsed = now_ms() - start;
+                black = Bit2_count(opened);
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "open 3x3", elapsed, black);
+                results[i][6] = black;
+                Bit2_free(&opened);
+
+                start = now_ms();
+                long cleared = flood_border(page);
+                elapsed = now_ms() - start;
+                printf("%-10s %-10s %12.2f %12ld\n", layouts[i].name,
+                       "flood", elapsed, cleared);
+                results[i][2] = cleared;
+
+                Bit2_free(&page);
+        }
+
+        for (int i = 0; i < count; i++) {
+                if (results[i][3] != results[i][0] ||
+                    results[i][4] != results[i][0] ||
+                    results[i][5] != results[i][0]) {
+                        fprintf(stderr, "%s: Bit2_count, the run map or "
+                                "the parallel map disagrees with the map\n",
+                                layouts[i].name);
+                        return EXIT_FAILURE;
+                }
+                for (int j = 0; i > 0 && j < 8; j++) {
+                        if (results[i][j] != results[0][j]) {
+                                fprintf(stderr, "%s disagrees with %s\n",
+                                        layouts[i].name, layouts[0].name);
+                                return EXIT_FAILURE;
+                        }
+                }
+        }
+        return EXIT_SUCCESS;
+}
+
+/*
+*  name:        random_page
+*  purpose:     Makes a square page where each pixel is black with the
+*               given probability.
+*  arguments:   The side length, the percentage of black, a seed and the
+*               layout to store it in.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      Reseeds rand(), so the same seed gives the same pixels in
+*               either layout.
+*  expects:     size > 0 and 0 <= percent <= 100.
+*/
+static Bit2_T random_page(int size, int percent, unsigned seed,
+                          Bit2_layout layout)
+{
+        Bit2_T page = Bit2_new_layout(size, size, layout);
+        srand(seed);
+        for (int row = 0; row < size; row++) {
+                for (int col = 0; col < size; col++) {
+                        Bit2_put(page, row, col, rand() % 100 < percent);
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        count_black
+*  purpose:     Map callback that counts black pixels.
+*  arguments:   The position, the bitmap, the pixel and a long counter.
+*  return type: None.
+*  effect:      Adds the pixel to the counter.
+*  expects:     cl points to a long.
+*/
+static void count_black(int row, int col, Bit2_T bit2, int value, void *cl)
+{
+        (void)row;
+        (void)col;
+        (void)bit2;
+        *(long *)cl += value;
+}
+
+/*
+*  name:        count_run
+*  purpose:     Bit2_map_runs callback that counts black pixels.
+*  arguments:   The run's position and length, its bit and a long counter.
+*  return type: None.
+*  effect:      Adds the run's length to the counter if it is black.
+*  expects:     cl points to a long.
+*/
+static void count_run(int row, int col, int len, int value, void *cl)
+{
+        (void)row;
+        (void)col;
+        if (value) {
+                *(long *)cl += len;
+        }
+}
+
+/*
+*  name:        add_count
+*  purpose:     Reduce callback that adds one thread's count to the total.
+*  arguments:   The total and one thread's count, both longs.
+*  return type: None.
+*  effect:      Adds part to cl.
+*  expects:     Both point to longs.
+*/
+static void add_count(void *cl, const void *part)
+{
+        *(long *)cl += *(const long *)part;
+}
+
+/*
+*  name:        flood_border
+*  purpose:     Clears every black pixel connected to the border, reading
+*               and writing only through Bit2_get and Bit2_put.
+*  arguments:   A bitmap.
+*  return type: The number of pixels cleared.
+*  effect:      Uses a growable array of packed (row, col) positions as a
+*               depth-first stack, so the access pattern is the same
+*               neighbour-by-neighbour walk as the reference engine.
+*  expects:     bitmap is not NULL.
+*/
+static long flood_border(Bit2_T bitmap)
+{
+        int height = Bit2_height(bitmap);
+        int width = Bit2_width(bitmap);
+        size_t capacity = 1024, top = 0;
+        uint64_t *stack = malloc(capacity * sizeof(uint64_t));
+        assert(stack != NULL);
+        long cleared = 0;
+
+        for (int row = 0; row < height; row++) {
+                for (int col = 0; col < width; col++) {
+                        if (row != 0 && row != height - 1 && col != 0 &&
+                            col != width - 1) {
+                                col = width - 2; /* jump to the last one */
+                                continue;
+                        }
+                        if (Bit2_put(bitmap, row, col, 0) == 0) {
+                                continue;
+                        }
+                        cleared++;
+                        stack[top++] = ((uint64_t)row << 32) | col;
+
+                        while (top > 0) {
+                                uint64_t at = stack[--top];
+                                int r = at >> 32;
+                                int c = at & 0xffffffff;
+                                int dr[4] = { -1, 1, 0, 0 };
+                                int dc[4] = { 0, 0, -1, 1 };
+                                for (int k = 0; k < 4; k++) {
+                                        int nr = r + dr[k], nc = c + dc[k];
+                                        if (nr < 0 || nr >= height ||
+                                            nc < 0 || nc >= width ||
+                                            Bit2_put(bitmap, nr, nc, 0)
+                                            == 0) {
+                                                continue;
+                                        }
+                                        cleared++;
+                                        if (top == capacity) {
+                                                capacity *= 2;
+                                                stack = realloc(stack,
+                                                        capacity
+                                                        * sizeof(uint64_t));
+                                                assert(stack != NULL);
+                                        }
+                                        stack[top++] = ((uint64_t)nr << 32)
+                                                       | nc;
+                                }
+                        }
+                }
+        }
+        free(stack);
+        return cleared;
+}
+
+/*
+*  name:        now_ms
+*  purpose:     Reads a monotonic clock.
+*  arguments:   None.
+*  return type: Milliseconds as a double.
+*  effect:      None.
+*  expects:     None.
+*/
+static double now_ms(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
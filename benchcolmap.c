@@ -0,0 +1,237 @@
+/*
+ *     benchcolmap.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     benchcolmap
+ *
+ *     This program times the two column-major maps of Bit2 against each
+ *     other: Bit2_map_col_major, which reads every bit live down each
+ *     column, and Bit2_map_col_major_strips, which copies 64 columns at a
+ *     time through transposed 64x64 blocks. It first checks that both
+ *     visit the same bits in the same order with the same values, on a
+ *     row-major page, a tiled page and a view that starts mid-word. Then
+ *     it sweeps row-major pages from 8x8 up and reports the size from
+ *     which the strips win, which is the crossover bit2.h quotes.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "assert.h"
+#include "bit2.h"
+
+/* One of the maps being compared */
+typedef void Map(Bit2_T bit2, void apply(int row, int col, Bit2_T bit2,
+                                         int value, void *cl), void *cl);
+
+static int    same_order(Bit2_T bitmap);
+static void   sweep_maps(int max_size);
+static double time_map(Bit2_T page, Map map, long *black);
+static Bit2_T random_page(int size, int percent, unsigned seed,
+                          Bit2_layout layout);
+static void   count_black(int row, int col, Bit2_T bit2, int value,
+                          void *cl);
+static void   hash_visit(int row, int col, Bit2_T bit2, int value,
+                         void *cl);
+static double now_ms(void);
+
+/*
+*  name:        main
+*  purpose:     Checks the two column-major maps agree, then times them.
+*  arguments:   Optionally the largest side length of the sweep.
+*  return type: Integer (EXIT_SUCCESS, or EXIT_FAILURE if the maps
+*               disagree).
+*  effect:      Prints the sweep table and the crossover size.
+*  expects:     The argument, if given, is a positive integer.
+*/
+int main(int argc, char *argv[])
+{
+        int size = (argc > 1) ? atoi(argv[1]) : 4096;
+        assert(size > 0);
+
+        Bit2_T rows = random_page(200, 50, 3, BIT2_ROW_MAJOR);
+        Bit2_T tiles = random_page(200, 50, 3, BIT2_TILED);
+        Bit2_T view = Bit2_view(rows, 5, 37, 150, 131);
+        int ok = same_order(rows) && same_order(tiles) && same_order(view);
+        Bit2_free(&view);
+        Bit2_free(&tiles);
+        Bit2_free(&rows);
+        if (!ok) {
+                fprintf(stderr, "the column-major maps disagree\n");
+                return EXIT_FAILURE;
+        }
+
+        sweep_maps(size);
+        return EXIT_SUCCESS;
+}
+
+/*
+*  name:        same_order
+*  purpose:     Tells whether both column-major maps make the same calls.
+*  arguments:   A bitmap that neither map changes.
+*  return type: Integer, 1 if they agree and 0 if not.
+*  effect:      Hashes every (row, col, value) each map passes, in order.
+*  expects:     bitmap is not NULL.
+*/
+static int same_order(Bit2_T bitmap)
+{
+        uint64_t live = 0, strips = 0;
+        Bit2_map_col_major(bitmap, hash_visit, &live);
+        Bit2_map_col_major_strips(bitmap, hash_visit, &strips);
+        return live == strips;
+}
+
+/*
+*  name:        sweep_maps
+*  purpose:     Finds the smallest row-major page on which the strips beat
+*               the live column walk.
+*  arguments:   The largest side length.
+*  return type: None.
+*  effect:      For square row-major pages from 8x8 up to the given size,
+*               prints the time of the row-major map, Bit2_map_col_major
+*               and Bit2_map_col_major_strips, and the strips' time over
+*               the live walk's. Then prints the smallest size from which
+*               the strips are ahead at every larger size too.
+*  expects:     max_size > 0.
+*/
+static void sweep_maps(int max_size)
+{
+        int wins_from = 0; /* 0 while the strips lose at the last size */
+        printf("%-8s %12s %12s %12s %14s\n", "size", "row map ms",
+               "live ms", "strips ms", "strips/live");
+        for (int size = 8; size <= max_size; size *= 2) {
+                Bit2_T page = random_page(size, 50, 2, BIT2_ROW_MAJOR);
+                long black[3] = { 0, 0, 0 };
+                double row_ms = time_map(page, Bit2_map_row_major,
+                                         &black[0]);
+                double live_ms = time_map(page, Bit2_map_col_major,
+                                          &black[1]);
+                double strips_ms = time_map(page, Bit2_map_col_major_strips,
+                                            &black[2]);
+                assert(black[1] == black[0] && black[2] == black[0]);
+
+                printf("%-8d %12.4f %12.4f %12.4f %14.2f\n", size, row_ms,
+                       live_ms, strips_ms, strips_ms / live_ms);
+                if (strips_ms >= live_ms) {
+                        wins_from = 0;
+                } else if (wins_from == 0) {
+                        wins_from = size;
+                }
+                Bit2_free(&page);
+        }
+        if (wins_from == 0) {
+                printf("the strips do not win up to %dx%d\n", max_size,
+                       max_size);
+        } else {
+                printf("the strips win from %dx%d (%ld bits) up\n",
+                       wins_from, wins_from, (long)wins_from * wins_from);
+        }
+}
+
+/*
+*  name:        time_map
+*  purpose:     Times one way of mapping a page, counting its black pixels.
+*  arguments:   The page, the map to time and the count to add to.
+*  return type: The milliseconds one map took, as the best of five trials.
+*  effect:      Each trial repeats the map enough times to run for a few
+*               milliseconds even on small pages; the black pixels of one
+*               map are added to *black.
+*  expects:     page and black are not NULL.
+*/
+static double time_map(Bit2_T page, Map map, long *black)
+{
+        long bits = (long)Bit2_width(page) * Bit2_height(page);
+        int reps = 1 + (1 << 22) / bits;
+        double best = 0;
+        for (int trial = 0; trial < 5; trial++) {
+                long count = 0;
+                double start = now_ms();
+                for (int i = 0; i < reps; i++) {
+                        map(page, count_black, &count);
+                }
+                double elapsed = (now_ms() - start) / reps;
+                if (trial == 0 || elapsed < best) {
+                        best = elapsed;
+                }
+                if (trial == 0) {
+                        *black += count / reps;
+                }
+        }
+        return best;
+}
+
+/*
+*  name:        random_page
+*  purpose:     Makes a square page where each pixel is black with the
+*               given probability.
+*  arguments:   The side length, the percentage of black, a seed and the
+*               layout to store it in.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      Reseeds rand(), so the same seed gives the same pixels in
+*               either layout.
+*  expects:     size > 0 and 0 <= percent <= 100.
+*/
+static Bit2_T random_page(int size, int percent, unsigned seed,
+                          Bit2_layout layout)
+{
+        Bit2_T page = Bit2_new_layout(size, size, layout);
+        srand(seed);
+        for (int row = 0; row < size; row++) {
+                for (int col = 0; col < size; col++) {
+                        Bit2_put(page, row, col, rand() % 100 < percent);
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        count_black
+*  purpose:     Map callback that counts black pixels.
+*  arguments:   The position, the bitmap, the pixel and a long counter.
+*  return type: None.
+*  effect:      Adds the pixel to the counter.
+*  expects:     cl points to a long.
+*/
+static void count_black(int row, int col, Bit2_T bit2, int value, void *cl)
+{
+        (void)row;
+        (void)col;
+        (void)bit2;
+        *(long *)cl += value;
+}
+
+/*
+*  name:        hash_visit
+*  purpose:     Map callback that folds every call into a hash.
+*  arguments:   The position, the bitmap, the pixel and a uint64_t hash.
+*  return type: None.
+*  effect:      Mixes the position and pixel into the hash, so two maps
+*               hash the same only if they make the same calls in order.
+*  expects:     cl points to a uint64_t.
+*/
+static void hash_visit(int row, int col, Bit2_T bit2, int value, void *cl)
+{
+        (void)bit2;
+        uint64_t *hash = cl;
+        uint64_t visit = ((uint64_t)row << 33) ^ ((uint64_t)col << 1)
+                         ^ (uint64_t)value;
+        *hash = (*hash ^ visit) * 0x100000001b3ull;
+}
+
+/*
+*  name:        now_ms
+*  purpose:     Reads a monotonic clock.
+*  arguments:   None.
+*  return type: Milliseconds as a double.
+*  effect:      None.
+*  expects:     None.
+*/
+static double now_ms(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
@@ -0,0 +1,493 @@
+/*
+ *     benchedges.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     benchedges
+ *
+ *     This program times the unblackedges engines on synthetic pages
+ *     and checks that they all agree with the original stack engine.
+ *
+ *     The thread sweep gets a page of its own, 32768x32768 (a gigapixel,
+ *     128 MB) unless told otherwise, since on a page the size of the
+ *     others starting the threads costs about as much as the work and the
+ *     speedups say nothing about scaling. Its pixels come from xorshift
+ *     instead of rand() so the page takes seconds, not minutes, to make.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "edgepar.h"
+#include "edgeinc.h"
+#include "edgestack.h"
+
+typedef void (*Engine)(Bit2_T bitmap, Edgefill_stats *stats);
+
+static void stack_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void parallel_one(Bit2_T bitmap, Edgefill_stats *stats);
+static void claim_four(Bit2_T bitmap, Edgefill_stats *stats);
+
+/* The engines being compared. The first is the one the others are
+ * checked against. */
+static const struct {
+        const char *name;
+        Engine run;
+} engines[] = {
+        { "stack",    stack_engine },
+        { "worklist", edgefill_worklist },
+        { "bitpar",   edgefill_bitpar },
+        { "span",     edgefill_span },
+        { "rle",      edgefill_rle },
+        { "parallel", parallel_one },
+        { "claim",    claim_four },
+        { "label",    edgefill_label },
+};
+
+static Bit2_T random_page(int size, int percent, unsigned seed);
+static Bit2_T big_random_page(int size, int percent, uint64_t seed);
+static Bit2_T swirl_page(int size);
+static Bit2_T table_page(int size);
+static Bit2_T copy_page(Bit2_T page);
+static int    same_page(Bit2_T a, Bit2_T b);
+static double now_ms(void);
+static void   bench_page(const char *label, Bit2_T page);
+static void   bench_threads(int size, int max_threads);
+static void   stress_claim(int rounds, int max_threads);
+static void   bench_incremental(const char *label, Bit2_T page, int edits);
+
+/*
+*  name:        main
+*  purpose:     Runs every engine on a set of synthetic pages and prints
+*               how long each one took.
+*  arguments:   Optionally the side length of the square pages, the
+*               largest thread count for the parallel engine sweep and the
+*               side length of the sweep's page.
+*  return type: Integer (EXIT_SUCCESS, or EXIT_FAILURE if any engine
+*               disagrees with the reference).
+*  effect:      Prints one table row per page and engine to stdout, then
+*               the parallel engine's time for 1, 2, 4... threads on a
+*               60% page of its own, then checks the concurrent flood fill
+*               on many small pages, then times single-pixel edits with
+*               edgeinc.
+*  expects:     The arguments, if given, are positive integers.
+*/
+int main(int argc, char *argv[])
+{
+        int size = (argc > 1) ? atoi(argv[1]) : 2000;
+        int max_threads = (argc > 2) ? atoi(argv[2]) : 32;
+        int thread_size = (argc > 3) ? atoi(argv[3]) : 32768;
+        assert(size > 0 && max_threads > 0 && thread_size > 0);
+
+        Bit2_T pages[6];
+        const char *labels[6] = { "random 45%", "random 60%", "random 70%",
+                                  "swirl", "table", "random 3%" };
+        pages[0] = random_page(size, 45, 1);
+        pages[1] = random_page(size, 60, 2);
+        pages[2] = random_page(size, 70, 3);
+        pages[3] = swirl_page(size);
+        pages[4] = table_page(size);
+        pages[5] = random_page(size, 3, 4);
+
+        printf("%-12s %-10s %12s %14s\n", "page", "engine", "ms",
+               "peak bytes");
+        for (int i = 0; i < 6; i++) {
+                bench_page(labels[i], pages[i]);
+        }
+        bench_threads(thread_size, max_threads);
+        stress_claim(200, max_threads);
+        printf("\n%-12s %8s %12s %12s %12s\n", "page", "edits",
+               "ms / edit", "full ms", "px / edit");
+        for (int i = 0; i < 6; i++) {
+                bench_incremental(labels[i], pages[i], 1000);
+        }
+        for (int i = 0; i < 6; i++) {
+                Bit2_free(&pages[i]);
+        }
+        return EXIT_SUCCESS;
+}
+
+/*
+*  name:        bench_page
+*  purpose:     Times every engine on a copy of one page.
+*  arguments:   A label for the page and the page itself.
+*  return type: None.
+*  effect:      Prints the results; exits with EXIT_FAILURE if an engine's
+*               output differs from the first engine's.
+*  expects:     page is not NULL.
+*/
+static void bench_page(const char *label, Bit2_T page)
+{
+        int count = sizeof(engines) / sizeof(engines[0]);
+        Bit2_T reference = NULL;
+
+        for (int i = 0; i < count; i++) {
+                Bit2_T work = copy_page(page);
+                Edgefill_stats stats = { 0 };
+                double start = now_ms();
+                engines[i].run(work, &stats);
+                double elapsed = now_ms() - start;
+
+                printf("%-12s %-10s %12.2f %14zu\n", label, engines[i].name,
+                       elapsed, stats.peak_bytes);
+                if (reference == NULL) {
+                        reference = work;
+                        continue;
+                }
+                if (!same_page(reference, work)) {
+                        fprintf(stderr, "%s disagrees with %s on %s\n",
+                                engines[i].name, engines[0].name, label);
+                        exit(EXIT_FAILURE);
+                }
+                Bit2_free(&work);
+        }
+        Bit2_free(&reference);
+}
+
+/*
+*  name:        stack_engine
+*  purpose:     Runs the original unblackedges() so it fits in the engines
+*               table.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Calls unblackedges(). Its per-pixel mallocs are not
+*               tracked, so peak_bytes is 0.
+*  expects:     The bitmap pointer is not NULL.
+*/
+static void stack_engine(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        unblackedges(bitmap);
+        if (stats != NULL) {
+                stats->peak_bytes = 0;
+        }
+}
+
+/*
+*  name:        parallel_one
+*  purpose:     Runs the parallel engine on a single thread so it fits in
+*               the engines table.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Calls edgepar_run with one thread.
+*  expects:     The bitmap pointer is not NULL.
+*/
+static void parallel_one(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        edgepar_run(bitmap, 1, stats);
+}
+
+/*
+*  name:        claim_four
+*  purpose:     Runs the concurrent flood fill on four threads so it fits
+*               in the engines table.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Calls edgepar_claim with four threads.
+*  expects:     The bitmap pointer is not NULL.
+*/
+static void claim_four(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        edgepar_claim(bitmap, 4, stats);
+}
+
+/*
+*  name:        bench_threads
+*  purpose:     Shows how the parallel engine scales with thread count.
+*  arguments:   The side length of the page to use and the largest thread
+*               count to try.
+*  return type: None.
+*  effect:      Makes a 60% random page of that size, times edgepar_run on
+*               a copy of it for 1, 2, 4... up to max_threads threads and
+*               prints each time with its speedup over one thread. Holds
+*               three copies of the page at once. Exits with EXIT_FAILURE
+*               if a result differs from the one thread result.
+*  expects:     size > 0 and max_threads >= 1.
+*/
+static void bench_threads(int size, int max_threads)
+{
+        Bit2_T page = big_random_page(size, 60, 2);
+        Bit2_T reference = NULL;
+        double base = 0;
+
+        printf("\nparallel engine, %dx%d random 60%% page\n", size, size);
+        printf("%-8s %12s %8s\n", "threads", "ms", "speedup");
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+                Bit2_T work = copy_page(page);
+                double start = now_ms();
+                edgepar_run(work, threads, NULL);
+                double elapsed = now_ms() - start;
+                if (reference == NULL) {
+                        reference = work;
+                        base = elapsed;
+                } else {
+                        if (!same_page(reference, work)) {
+                                fprintf(stderr, "parallel with %d threads "
+                                        "disagrees with 1 thread\n", threads);
+                                exit(EXIT_FAILURE);
+                        }
+                        Bit2_free(&work);
+                }
+                printf("%-8d %12.2f %8.2f\n", threads, elapsed,
+                       base / elapsed);
+        }
+        Bit2_free(&reference);
+        Bit2_free(&page);
+}
+
+/*
+*  name:        stress_claim
+*  purpose:     Checks the concurrent flood fill against the serial one on
+*               many small pages, where threads collide most often.
+*  arguments:   The number of pages and the largest thread count to try.
+*  return type: None.
+*  effect:      Every page gets a random size and density and is cleaned
+*               by the stack engine and by edgepar_claim with 2, 4...
+*               threads. Prints a summary line; exits with EXIT_FAILURE at
+*               the first page where they differ.
+*  expects:     rounds >= 0 and max_threads >= 1.
+*/
+static void stress_claim(int rounds, int max_threads)
+{
+        int checks = 0;
+        for (int round = 0; round < rounds; round++) {
+                srand(1000 + round);
+                int size = 1 + rand() % 300;
+                int percent = 40 + rand() % 40;
+                Bit2_T page = random_page(size, percent, 1000 + round);
+                Bit2_T reference = copy_page(page);
+                unblackedges(reference);
+                for (int threads = 2; threads <= max_threads; threads *= 2) {
+                        Bit2_T work = copy_page(page);
+                        edgepar_claim(work, threads, NULL);
+                        if (!same_page(reference, work)) {
+                                fprintf(stderr, "claim with %d threads "
+                                        "disagrees with stack on a "
+                                        "%dx%d %d%% page\n", threads, size,
+                                        size, percent);
+                                exit(EXIT_FAILURE);
+                        }
+                        Bit2_free(&work);
+                        checks++;
+                }
+                Bit2_free(&reference);
+                Bit2_free(&page);
+        }
+        printf("\nclaim stress: %d pages, %d runs, all match\n", rounds,
+               checks);
+}
+
+/*
+*  name:        bench_incremental
+*  purpose:     Times edgeinc_update on single-pixel edits against
+*               cleaning the whole page again.
+*  arguments:   A label for the page, the page and the number of edits.
+*  return type: None.
+*  effect:      Flips random pixels of the page one update at a time and
+*               prints the mean time and pixels looked at per update next
+*               to the time of one full edgefill_worklist. Exits with
+*               EXIT_FAILURE if the final result differs from cleaning the
+*               edited page from scratch with the stack engine.
+*  expects:     page is not NULL and edits >= 1.
+*/
+static void bench_incremental(const char *label, Bit2_T page, int edits)
+{
+        int height = Bit2_height(page);
+        int width = Bit2_width(page);
+        Edgeinc_T inc = edgeinc_new(page);
+        srand(77);
+        size_t touched = 0;
+        double start = now_ms();
+        for (int i = 0; i < edits; i++) {
+                Edgeinc_edit edit = { rand() % height, rand() % width, 1, 1,
+                                      0 };
+                edit.bit = !Bit2_get(edgeinc_original(inc), edit.row,
+                                     edit.col);
+                touched += edgeinc_update(inc, &edit, 1);
+        }
+        double elapsed = now_ms() - start;
+
+        Bit2_T full_page = copy_page(edgeinc_original(inc));
+        start = now_ms();
+        edgefill_worklist(full_page, NULL);
+        double full = now_ms() - start;
+        Bit2_free(&full_page);
+
+        Bit2_T reference = copy_page(edgeinc_original(inc));
+        unblackedges(reference);
+        if (!same_page(reference, edgeinc_result(inc))) {
+                fprintf(stderr, "edgeinc disagrees with stack on %s\n",
+                        label);
+                exit(EXIT_FAILURE);
+        }
+        printf("%-12s %8d %12.4f %12.2f %12.1f\n", label, edits,
+               elapsed / edits, full, (double)touched / edits);
+        Bit2_free(&reference);
+        edgeinc_free(&inc);
+}
+
+/*
+*  name:        random_page
+*  purpose:     Makes a square page where each pixel is black with the
+*               given probability.
+*  arguments:   The side length, the percentage of black and a seed.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      Reseeds rand().
+*  expects:     size > 0 and 0 <= percent <= 100.
+*/
+static Bit2_T random_page(int size, int percent, unsigned seed)
+{
+        Bit2_T page = Bit2_new(size, size);
+        srand(seed);
+        for (int row = 0; row < size; row++) {
+                uint64_t *words = Bit2_row(page, row);
+                for (int col = 0; col < size; col++) {
+                        Bit2_word_put(words, col, rand() % 100 < percent);
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        big_random_page
+*  purpose:     Makes a large square page where each pixel is black with
+*               the given probability, quickly.
+*  arguments:   The side length, the percentage of black and a nonzero
+*               seed.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      Draws every pixel from a xorshift64* generator instead of
+*               rand(), so it does not touch rand()'s state.
+*  expects:     size > 0, 0 <= percent <= 100 and seed != 0.
+*/
+static Bit2_T big_random_page(int size, int percent, uint64_t seed)
+{
+        Bit2_T page = Bit2_new(size, size);
+        uint64_t state = seed;
+        uint64_t threshold = ((uint64_t)percent << 32) / 100;
+        for (int row = 0; row < size; row++) {
+                uint64_t *words = Bit2_row(page, row);
+                for (int col = 0; col < size; col++) {
+                        state ^= state >> 12;
+                        state ^= state << 25;
+                        state ^= state >> 27;
+                        uint32_t draw = (state * 0x2545f4914f6cdd1dull)
+                                        >> 32;
+                        Bit2_word_put(words, col, draw < threshold);
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        swirl_page
+*  purpose:     Makes a square page holding one long spiral like test4.pbm,
+*               which starts at the border and winds in to the centre.
+*  arguments:   The side length.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      The spiral is one pixel wide with one pixel of white
+*               between its turns, so all of it is edge-connected.
+*  expects:     size > 0.
+*/
+static Bit2_T swirl_page(int size)
+{
+        Bit2_T page = Bit2_new(size, size);
+        int drow[4] = { 0, 1, 0, -1 }; /* right, down, left, up */
+        int dcol[4] = { 1, 0, -1, 0 };
+        int row = 0, col = 0, dir = 0;
+        int length = size - 1;
+
+        Bit2_put(page, row, col, 1);
+        for (int leg = 0; length > 0; leg++) {
+                for (int step = 0; step < length; step++) {
+                        row += drow[dir];
+                        col += dcol[dir];
+                        Bit2_put(page, row, col, 1);
+                }
+                dir = (dir + 1) % 4;
+                if (leg >= 2 && leg % 2 == 0) { /* after legs 3, 5, 7... */
+                        length -= 2;
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        table_page
+*  purpose:     Makes a square page that looks like a ruled form: thick
+*               horizontal rules every 16 rows and a vertical rule every
+*               256 columns, all joined to the border.
+*  arguments:   The side length.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      None.
+*  expects:     size > 0.
+*/
+static Bit2_T table_page(int size)
+{
+        Bit2_T page = Bit2_new(size, size);
+        for (int row = 0; row < size; row++) {
+                uint64_t *words = Bit2_row(page, row);
+                int rule = (row % 16) < 3;
+                for (int col = 0; col < size; col++) {
+                        Bit2_word_put(words, col, rule || col % 256 < 2);
+                }
+        }
+        return page;
+}
+
+/*
+*  name:        copy_page
+*  purpose:     Duplicates a page.
+*  arguments:   The page to copy.
+*  return type: A new Bit2_T the caller must free.
+*  effect:      Copies the packed rows word by word.
+*  expects:     page is not NULL.
+*/
+static Bit2_T copy_page(Bit2_T page)
+{
+        int height = Bit2_height(page);
+        Bit2_T copy = Bit2_new(height, Bit2_width(page));
+        for (int row = 0; row < height; row++) {
+                memcpy(Bit2_row(copy, row), Bit2_row(page, row),
+                       Bit2_row_words(page) * sizeof(uint64_t));
+        }
+        return copy;
+}
+
+/*
+*  name:        same_page
+*  purpose:     Compares two pages of the same size.
+*  arguments:   The two pages.
+*  return type: Integer, 1 if every pixel matches and 0 otherwise.
+*  effect:      None.
+*  expects:     Both pages are not NULL and have the same size.
+*/
+static int same_page(Bit2_T a, Bit2_T b)
+{
+        for (int row = 0; row < Bit2_height(a); row++) {
+                if (memcmp(Bit2_row(a, row), Bit2_row(b, row),
+                           Bit2_row_words(a) * sizeof(uint64_t)) != 0) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/*
+*  name:        now_ms
+*  purpose:     Reads a monotonic clock.
+*  arguments:   None.
+*  return type: Milliseconds as a double.
+*  effect:      None.
+*  expects:     None.
+*/
+static double now_ms(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
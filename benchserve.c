@@ -0,0 +1,386 @@
+/*
+ *     benchserve.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     benchserve
+ *
+ *     This program is a load generator for the unblackedges server. A
+ *     number of client threads send the same image over their own
+ *     connections, every reply is checked against the first one, and the
+ *     latency percentiles and requests per second are printed. With -x
+ *     the same load is run by starting a fresh unblackedges process per
+ *     image, for comparison.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "assert.h"
+#include "edgeserve.h"
+
+/* What every client thread is given */
+typedef struct {
+        const char *socket_path;
+        const char *program;       /* run per image instead, if not NULL */
+        const char *path;          /* the input's absolute path */
+        const unsigned char *payload;
+        size_t len;
+        int kind, flags;
+        const Edgeserve_reply *expected;
+} Load;
+
+/* One client thread: its share of the requests and what it saw */
+typedef struct {
+        const Load *load;
+        double *latency;           /* ms, one per request */
+        int count;
+        int failed;
+} Client;
+
+static int    run_load(const char *mode, const Load *load, int clients,
+                       int requests);
+static void  *client(void *cl);
+static int    spawn_one(const Load *load);
+static int    compare_doubles(const void *a, const void *b);
+static unsigned char *read_all(const char *filename, size_t *len);
+static double now_ms(void);
+static void   usage(void);
+
+/*
+*  name:        main
+*  purpose:     Runs the load against a server, and optionally against
+*               one process per image.
+*  arguments:   The command line: ./benchserve socket input.pbm
+*               [-c clients] [-n requests] [-r] [-p] [-x program] [-q].
+*  return type: EXIT_SUCCESS, or EXIT_FAILURE if any request failed.
+*  effect:      -c sets the number of client threads (default 4) and -n
+*               the total number of requests (default 2000). -r asks for
+*               raw P4 replies and -p sends the input's path instead of
+*               its bytes (the server needs -P with a root above it).
+*               -x program also times running "program [-r]
+*               input" once per request with its output thrown away. -q
+*               tells the server to quit at the end. Prints one line per
+*               mode.
+*  expects:     A server is listening on the socket.
+*/
+int main(int argc, char *argv[])
+{
+        const char *socket_path = NULL;
+        const char *filename = NULL;
+        Load load = { NULL, NULL, NULL, NULL, 0, EDGESERVE_IMAGE, 0, NULL };
+        int clients = 4;
+        int requests = 2000;
+        int quit = 0;
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+                        clients = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+                        requests = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+                        load.program = argv[++i];
+                } else if (strcmp(argv[i], "-r") == 0) {
+                        load.flags = EDGESERVE_RAW;
+                } else if (strcmp(argv[i], "-p") == 0) {
+                        load.kind = EDGESERVE_PATH;
+                } else if (strcmp(argv[i], "-q") == 0) {
+                        quit = 1;
+                } else if (socket_path == NULL) {
+                        socket_path = argv[i];
+                } else if (filename == NULL) {
+                        filename = argv[i];
+                } else {
+                        usage();
+                }
+        }
+        if (filename == NULL || clients < 1 || requests < clients) {
+                usage();
+        }
+
+        char path[PATH_MAX];
+        if (realpath(filename, path) == NULL) {
+                fprintf(stderr, "%s: no such file\n", filename);
+                exit(EXIT_FAILURE);
+        }
+        unsigned char *image = read_all(filename, &load.len);
+        load.socket_path = socket_path;
+        load.path = path;
+        load.payload = image;
+        if (load.kind == EDGESERVE_PATH) {
+                load.payload = (const unsigned char *)path;
+                load.len = strlen(path);
+        }
+
+        /* the first reply is the one every other must match */
+        Edgeserve_reply expected;
+        int fd = edgeserve_connect(socket_path);
+        if (fd < 0 || !edgeserve_call(fd, load.kind, load.flags,
+                                      load.payload, load.len, &expected) ||
+            expected.status != EDGESERVE_OK) {
+                fprintf(stderr, "%s: no server, or it rejected %s\n",
+                        socket_path, filename);
+                exit(EXIT_FAILURE);
+        }
+        close(fd);
+        load.expected = &expected;
+
+        printf("%-10s %7s %8s %10s %8s %8s %8s %8s %6s\n", "mode",
+               "clients", "requests", "req/s", "p50 ms", "p90 ms",
+               "p99 ms", "max ms", "failed");
+        const char *program = load.program;
+        load.program = NULL;
+        int failed = run_load("server", &load, clients, requests);
+        if (program != NULL) {
+                load.program = program;
+                failed += run_load("process", &load, clients, requests);
+        }
+
+        if (quit) {
+                Edgeserve_reply reply;
+                fd = edgeserve_connect(socket_path);
+                if (fd >= 0 && edgeserve_call(fd, EDGESERVE_QUIT, 0, NULL,
+                                              0, &reply)) {
+                        free(reply.data);
+                }
+                if (fd >= 0) {
+                        close(fd);
+                }
+        }
+        free(expected.data);
+        free(image);
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+*  name:        run_load
+*  purpose:     Runs one mode and prints its line.
+*  arguments:   The mode's name, the load, the number of client threads
+*               and the total number of requests.
+*  return type: The number of requests that failed.
+*  effect:      Splits the requests between client threads as evenly as
+*               possible, runs them all at once and prints the requests
+*               per second over the whole run, the 50th, 90th and 99th
+*               percentile and largest latency, and the failures.
+*  expects:     load is set up, 1 <= clients <= requests.
+*/
+static int run_load(const char *mode, const Load *load, int clients,
+                    int requests)
+{
+        double *latency = malloc(requests * sizeof(double));
+        pthread_t *tids = malloc(clients * sizeof(pthread_t));
+        Client *pool = malloc(clients * sizeof(Client));
+        assert(latency != NULL && tids != NULL && pool != NULL);
+
+        int first = 0;
+        for (int i = 0; i < clients; i++) {
+                pool[i].load = load;
+                pool[i].latency = latency + first;
+                pool[i].count = requests / clients +
+                                (i < requests % clients);
+                pool[i].failed = 0;
+                first += pool[i].count;
+        }
+        double start = now_ms();
+        for (int i = 0; i < clients; i++) {
+                int err = pthread_create(&tids[i], NULL, client, &pool[i]);
+                assert(err == 0);
+        }
+        int failed = 0;
+        for (int i = 0; i < clients; i++) {
+                pthread_join(tids[i], NULL);
+                failed += pool[i].failed;
+        }
+        double elapsed = now_ms() - start;
+
+        qsort(latency, requests, sizeof(double), compare_doubles);
+        printf("%-10s %7d %8d %10.1f %8.3f %8.3f %8.3f %8.3f %6d\n", mode,
+               clients, requests, requests / (elapsed / 1000.0),
+               latency[(requests - 1) / 2],
+               latency[(int)((requests - 1) * 0.90)],
+               latency[(int)((requests - 1) * 0.99)],
+               latency[requests - 1], failed);
+        fflush(stdout);
+        free(pool);
+        free(tids);
+        free(latency);
+        return failed;
+}
+
+/*
+*  name:        client
+*  purpose:     The body of every client thread.
+*  arguments:   A Client pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Sends its requests one after another, over one connection
+*               or one process each, timing every one. A reply that is not
+*               EDGESERVE_OK or differs from the expected one, a process
+*               that fails, or a lost connection counts as failed (a lost
+*               connection fails the rest of the share).
+*  expects:     cl is a Client set up by run_load.
+*/
+static void *client(void *cl)
+{
+        Client *self = cl;
+        const Load *load = self->load;
+        int fd = -1;
+        if (load->program == NULL) {
+                fd = edgeserve_connect(load->socket_path);
+        }
+
+        for (int i = 0; i < self->count; i++) {
+                double start = now_ms();
+                int ok;
+                if (load->program != NULL) {
+                        ok = spawn_one(load);
+                } else {
+                        Edgeserve_reply reply;
+                        ok = fd >= 0 &&
+                             edgeserve_call(fd, load->kind, load->flags,
+                                            load->payload, load->len,
+                                            &reply);
+                        if (ok) {
+                                ok = reply.status == EDGESERVE_OK &&
+                                     reply.len == load->expected->len &&
+                                     memcmp(reply.data,
+                                            load->expected->data,
+                                            reply.len) == 0;
+                                free(reply.data);
+                        } else if (fd >= 0) {
+                                close(fd);
+                                fd = -1;
+                        }
+                }
+                self->latency[i] = now_ms() - start;
+                self->failed += !ok;
+        }
+
+        if (fd >= 0) {
+                close(fd);
+        }
+        return NULL;
+}
+
+/*
+*  name:        spawn_one
+*  purpose:     Cleans the input once with a new process.
+*  arguments:   The load; its program and path are used.
+*  return type: 1 if the process exited with status 0, else 0.
+*  effect:      Runs "program [-r] path" with stdout sent to /dev/null and
+*               waits for it.
+*  expects:     load->program and load->path are not NULL.
+*/
+static int spawn_one(const Load *load)
+{
+        extern char **environ;
+        char *args[4];
+        int n = 0;
+        args[n++] = (char *)load->program;
+        if (load->flags & EDGESERVE_RAW) {
+                args[n++] = "-r";
+        }
+        args[n++] = (char *)load->path;
+        args[n] = NULL;
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                         "/dev/null", O_WRONLY, 0);
+        pid_t pid;
+        int err = posix_spawn(&pid, load->program, &actions, NULL, args,
+                              environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (err != 0) {
+                return 0;
+        }
+        int status;
+        if (waitpid(pid, &status, 0) != pid) {
+                return 0;
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+*  name:        compare_doubles
+*  purpose:     Orders two latencies for qsort.
+*  arguments:   Pointers to two double elements.
+*  return type: Negative, zero or positive.
+*  effect:      None.
+*  expects:     None.
+*/
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a;
+        double y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/*
+*  name:        read_all
+*  purpose:     Reads a whole file into memory.
+*  arguments:   The file name and where to put the length.
+*  return type: A malloced buffer the caller frees.
+*  effect:      Exits with EXIT_FAILURE if the file cannot be read.
+*  expects:     filename and len are not NULL.
+*/
+static unsigned char *read_all(const char *filename, size_t *len)
+{
+        FILE *in = fopen(filename, "rb");
+        if (in == NULL) {
+                fprintf(stderr, "Cannot read %s\n", filename);
+                exit(EXIT_FAILURE);
+        }
+        size_t capacity = 1 << 16;
+        unsigned char *data = malloc(capacity);
+        assert(data != NULL);
+        *len = 0;
+        size_t got;
+        while ((got = fread(data + *len, 1, capacity - *len, in)) > 0) {
+                *len += got;
+                if (*len == capacity) {
+                        capacity *= 2;
+                        data = realloc(data, capacity);
+                        assert(data != NULL);
+                }
+        }
+        fclose(in);
+        return data;
+}
+
+/*
+*  name:        now_ms
+*  purpose:     Reads a monotonic clock.
+*  arguments:   None.
+*  return type: Milliseconds as a double.
+*  effect:      None.
+*  expects:     None.
+*/
+static double now_ms(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+/*
+*  name:        usage
+*  purpose:     Prints how to run the program and exits.
+*  arguments:   None.
+*  return type: None.
+*  effect:      Exits with EXIT_FAILURE.
+*  expects:     None.
+*/
+static void usage(void)
+{
+        fprintf(stderr, "Usage: ./benchserve socket input.pbm [-c clients] "
+                "[-n requests] [-r] [-p] [-x program] [-q]\n");
+        exit(EXIT_FAILURE);
+}
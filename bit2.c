@@ -6,21 +6,197 @@
  *
  *     This program should be able to hold a 2D bit array that
  *     represents a pbm file
+ *
+ *     A bitmap is stored in one of two layouts, picked when it is made.
+ *     BIT2_ROW_MAJOR keeps each row as its own run of words. BIT2_TILED
+ *     packs every 8x8 block of bits into one word, row by row inside the
+ *     block (bit (row % 8) * 8 + col % 8), with the blocks themselves in
+ *     row-major order. A step down a column then stays in the same word
+ *     for 8 rows, so column-major walks and 2D-local algorithms touch far
+ *     fewer cache lines on wide images.
+ *
+ *     The bulk operations (Bit2_combine, Bit2_fill, Bit2_count and their
+ *     _rect forms) work a word at a time and hand long runs of whole
+ *     words to a kernel. The kernels come in AVX2, SSE2 (with POPCNT)
+ *     and portable versions; the best one the CPU supports is picked the
+ *     first time one is needed. Build with -DBIT2_NO_SIMD to always use
+ *     the portable ones.
+ *
+ *     Transposes work on 64x64 blocks of a row-major bitmap (64 words,
+ *     transposed in place by swapping ever smaller sub-blocks) or on the
+ *     8x8 tiles of a tiled one (one word each).
+ *
+ *     Each side is an int, but every offset into the words is computed as
+ *     a size_t, so a bitmap may hold far more than 2^31 bits. The words
+ *     come from Hugemem_alloc, which backs large bitmaps with huge pages.
+ *
+ *     Bit2_map_row_major_parallel runs a row-major map on the shared
+ *     Mappool threads, one band of rows at a time.
+ *
+ *     A view (Bit2_view) is a Bit2_T of its own that shares the words of
+ *     the bitmap it was cut from. It keeps the root's layout, row_words
+ *     and tile_cols and adds its offsets wherever it touches a bit, so
+ *     single-bit calls work unchanged. The word-level paths either pass
+ *     the rectangle on to the root (fill, count, spans, run maps) or go
+ *     through Bit2_read_span and Bit2_write_span, since a view's rows
+ *     need not start on a word and the bits past its last column are
+ *     the root's, not padding.
+ *
+ *     Bit2_hash follows XXH64's structure over whole words: four
+ *     independent multiply-rotate lanes (so neighbouring words' multiplies
+ *     overlap), merged and mixed at the end with the bitmap's shape. It
+ *     reads the row-major image of the bits, so a bitmap hashes the same
+ *     whatever its layout and whether or not it is a view.
+ *
+ *     The atomic calls (Bit2_test_and_set and friends) treat a word as a
+ *     C11 _Atomic uint64_t, which has the same size and alignment as a
+ *     plain one on every target we build for; the static assert below
+ *     checks the size.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "assert.h"
 #include "bit2.h"
-#include "bit.h"
+#include "hugemem.h"
+#include "mappool.h"
 
-/* This struct represents a 2D bitmap using a 1D bit array from Hanson */
+_Static_assert(sizeof(_Atomic uint64_t) == sizeof(uint64_t),
+               "atomic words must overlay the bitmap's words");
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BIT2_NO_SIMD)
+#define BIT2_X86 1
+#include <immintrin.h>
+#endif
+
+/* This struct represents a 2D bitmap as rows of packed 64-bit words. Each
+ * row starts on a fresh word so rows can be handed out as plain arrays. */
 struct Bit2_T {
         int rows;
         int cols;
-        Bit_T bit_arr;
+        Bit2_layout layout;
+        int row_words;  /* words per row, BIT2_ROW_MAJOR only */
+        int tile_cols;  /* 8x8 tiles per row of tiles, BIT2_TILED only */
+        size_t capacity; /* words allocated, may be more than in use */
+        uint64_t *words;
+        Bit2_T root;     /* bitmap that owns the words, NULL if this one */
+        int row_off;     /* where a view's (0, 0) is in root */
+        int col_off;
 };
 
+/* mask of the low n bits of a word, 1 <= n <= 64 */
+static inline uint64_t low_mask(int n)
+{
+        return n >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+}
+
+/* index of the tile word holding (row, col) in a BIT2_TILED bitmap */
+static inline size_t tile_index(const struct Bit2_T *bit2, int row, int col)
+{
+        return (size_t)(row >> 3) * bit2->tile_cols + (col >> 3);
+}
+
+/* position of (row, col) inside its tile word */
+static inline int tile_bit(int row, int col)
+{
+        return ((row & 7) << 3) | (col & 7);
+}
+
+/* word kernels for the bulk operations, one set per instruction set */
+typedef struct {
+        const char *name;
+        void (*combine)(uint64_t *dst, const uint64_t *src, size_t n,
+                        Bit2_op op);
+        uint64_t (*count)(const uint64_t *words, size_t n);
+} Kernels;
+
+static const Kernels *kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/* A Bit2_map_row_major_parallel call, shared by its workers */
+typedef struct {
+        Bit2_T bit2;
+        void (*apply)(int row, int col, Bit2_T bit2, int value, void *cl);
+        void *cl;
+        char *slots;    /* one closure copy per worker, or NULL */
+        size_t stride;  /* bytes between copies, whole cache lines */
+        int band_rows;
+        int shift;      /* rows the first band is short by */
+        int threads;
+} Par_map;
+
+/* Bit2_hash's running state; n counts the words seen so far */
+typedef struct {
+        uint64_t lane[4];
+        uint64_t n;
+} Hash_state;
+
+#define HASH_P1 0x9e3779b185ebca87u
+#define HASH_P2 0xc2b2ae3d27d4eb4fu
+#define HASH_P3 0x165667b19e3779f9u
+#define HASH_P4 0x85ebca77c2b2ae63u
+
+/* one lane step: add the word's product, rotate, multiply */
+static inline uint64_t hash_round(uint64_t lane, uint64_t word)
+{
+        lane += word * HASH_P2;
+        lane = (lane << 31) | (lane >> 33);
+        return lane * HASH_P1;
+}
+
+/* A Bit2_map_runs_rect call on a view, passed on to its root */
+typedef struct {
+        void (*apply)(int row, int col, int len, int value, void *cl);
+        void *cl;
+        int row_off, col_off;
+} View_runs;
+
+static size_t   set_shape(Bit2_T bit2, int rows, int cols);
+static void     map_rows(Bit2_T bit2, int first, int last, void apply(
+                         int row, int col, Bit2_T bit2, int value,
+                         void *cl), void *cl);
+static void     map_band(int band, int worker, void *cl);
+static void     view_run(int row, int col, int len, int value, void *cl);
+static void     combine_spans(Bit2_T dst, Bit2_T src, Bit2_op op, int row,
+                              int col, int height, int width);
+static void     morph_once(Bit2_T bit2, int erode, Bit2_se se,
+                           Bit2_T scratch);
+static void     morph_rows(Bit2_T src, Bit2_T dst, int lo, int hi,
+                           int erode, Bit2_T mask);
+static void     morph_cols(Bit2_T src, Bit2_T dst, int lo, int hi,
+                           int erode);
+static const uint64_t *row_image(Bit2_T bit2, int row, uint64_t *buf);
+static int      get_bit(Bit2_T bit2, int row, int col);
+static void     put_bit(Bit2_T bit2, int row, int col, int bit);
+static size_t   word_count(Bit2_T bit2);
+static int      next_change(const uint64_t *words, int end, int pos,
+                            int value);
+static void     gather_row(Bit2_T bit2, int row, uint64_t *dst);
+static _Atomic uint64_t *atomic_bit(Bit2_T bit2, int row, int col,
+                                    uint64_t *mask);
+static _Atomic uint64_t *atomic_word(Bit2_T bit2, int row, int word);
+static void     check_rect(Bit2_T bit2, int row, int col, int height,
+                           int width);
+static void     hash_words(Hash_state *hash, const uint64_t *words,
+                           size_t count);
+static void     clear_padding(Bit2_T bit2);
+static uint64_t combine_word(uint64_t dst, uint64_t src, Bit2_op op);
+static void     load_block(Bit2_T bit2, int block_row, int block_col,
+                           uint64_t block[64]);
+static void     store_block(Bit2_T bit2, int block_row, int block_col,
+                            const uint64_t block[64]);
+static void     transpose64(uint64_t block[64]);
+static uint64_t transpose8(uint64_t tile);
+static const Kernels *get_kernels(void);
+static void     pick_kernels(void);
+static void     combine_portable(uint64_t *dst, const uint64_t *src,
+                                 size_t n, Bit2_op op);
+static uint64_t count_portable(const uint64_t *words, size_t n);
+
 /* 
 *  name:        Bit2_new
 *  purpose:     This function initializes and llocates space for a 2D bit map.
@@ -28,23 +204,75 @@ struct Bit2_T {
 *               wanted, and the other specifies the number of columns
 *  return type: Pointer to a 2D bit map
 *  effect:      This function allocates memory so the user needs to free it 
-*               later.
+*               later. The bitmap uses the BIT2_ROW_MAJOR layout.
 *  expects:     The arguments must be greater than zero or else an assert
 *               fails, meaning there is a runtime error.
 */
 Bit2_T Bit2_new(int rows, int cols) 
+{
+        return Bit2_new_layout(rows, cols, BIT2_ROW_MAJOR);
+}
+
+/*
+*  name:        Bit2_new_layout
+*  purpose:     Makes a bitmap with a chosen storage layout.
+*  arguments:   The number of rows and columns, and BIT2_ROW_MAJOR or
+*               BIT2_TILED.
+*  return type: Pointer to a 2D bit map with every bit 0.
+*  effect:      Allocates memory the user must free with Bit2_free. A
+*               tiled bitmap is rounded up to whole 8x8 tiles. Storage of
+*               4 MB or more is huge-page aligned (see hugemem.c).
+*  expects:     Both sizes are greater than zero.
+*/
+Bit2_T Bit2_new_layout(int rows, int cols, Bit2_layout layout)
 {
         assert(rows > 0 && cols > 0);
+        assert(layout == BIT2_ROW_MAJOR || layout == BIT2_TILED);
         Bit2_T bit2 = malloc(sizeof(*bit2)); // malloc space
         assert(bit2 != NULL);
-        bit2->bit_arr = Bit_new(rows * cols); // use hanson bit
-        assert( bit2->bit_arr != NULL);
-        bit2->rows = rows;
-        bit2->cols = cols;
+        bit2->layout = layout;
+        bit2->capacity = set_shape(bit2, rows, cols);
+        bit2->words = Hugemem_alloc(bit2->capacity
+                                    * sizeof(uint64_t)); // all bits start at 0
+        bit2->root = NULL;
+        bit2->row_off = 0;
+        bit2->col_off = 0;
 
         return bit2;
 }
 
+/*
+*  name:        Bit2_view
+*  purpose:     Makes a bitmap that is a window onto a rectangle of
+*               another one, without copying any bits.
+*  arguments:   The bitmap to look into (itself possibly a view), and the
+*               top row, left column, height and width of the rectangle.
+*               The column need not be a multiple of 64.
+*  return type: A new Bit2_T whose (0, 0) is (row, col) of the parent.
+*  effect:      Allocates only the view's header. Reads and writes through
+*               the view are reads and writes of the parent. A view of a
+*               view refers straight to the bitmap that owns the words.
+*               Bit2_free on the view frees only the header.
+*  expects:     The parent is not NULL and the rectangle lies inside it.
+*               The bitmap owning the words outlives the view and is not
+*               resized while the view exists.
+*/
+Bit2_T Bit2_view(Bit2_T parent, int row, int col, int height, int width)
+{
+        assert(parent != NULL);
+        check_rect(parent, row, col, height, width);
+        Bit2_T view = malloc(sizeof(*view));
+        assert(view != NULL);
+        *view = *parent;
+        view->root = parent->root != NULL ? parent->root : parent;
+        view->row_off = parent->row_off + row;
+        view->col_off = parent->col_off + col;
+        view->rows = height;
+        view->cols = width;
+        view->capacity = 0;
+        return view;
+}
+
 /*
 *  name:        Bit2_put
 *  purpose:     Stores a bit at the specified row and column in the 2D bit 
@@ -61,8 +289,8 @@ int Bit2_put(Bit2_T bit2, int row, int col, int bit)
         assert(bit2 != NULL);
         // make sure bounds are valid
         assert(valid_index(bit2, row, col));
-        int index = row * bit2->cols + col;
-        int last_bit = Bit_put(bit2->bit_arr, index, bit);
+        int last_bit = get_bit(bit2, row, col);
+        put_bit(bit2, row, col, bit);
     
         return last_bit;
 }
@@ -82,8 +310,7 @@ int Bit2_get(Bit2_T bit2, int row, int col)
         assert(bit2 != NULL);
         // make sure bounds are valid
         assert(valid_index(bit2, row, col));
-        int index = row * bit2->cols + col;
-        int curr_bit = Bit_get(bit2->bit_arr, index);
+        int curr_bit = get_bit(bit2, row, col);
     
         return curr_bit;
 }
@@ -94,21 +321,71 @@ int Bit2_get(Bit2_T bit2, int row, int col)
 *  arguments:   A pointer to a Bit2_T (Bit2_T *) that will be freed.
 *  return type: None.
 *  effect:      Deallocates memory, sets the pointer to NULL to prevent 
-*               use-after-free errors.
+*               use-after-free errors. Freeing a view frees only the view;
+*               the bits stay with the bitmap it looks into.
 *  expects:     The pointer to Bit2_T is not NULL, and it contains 
 *               a valid allocated bitmap.
 */
 void Bit2_free(Bit2_T *bit2)
 {
-        assert(bit2 != NULL || *bit2 != NULL);
-        if ((*bit2)->bit_arr != NULL) { // check before freeing
-                Bit_free(&(*bit2)->bit_arr);
+        assert(bit2 != NULL && *bit2 != NULL);
+        if ((*bit2)->root == NULL) {
+                Hugemem_free((*bit2)->words,
+                             (*bit2)->capacity * sizeof(uint64_t));
         }
 
         free(*bit2);
         *bit2 = NULL;
 }
 
+/*
+*  name:        Bit2_resize
+*  purpose:     Gives a bitmap new dimensions so it can be reused for another
+*               image instead of freeing it and making a new one.
+*  arguments:   A Bit2_T, and the new number of rows and columns.
+*  return type: None.
+*  effect:      Every bit becomes 0. The words are only reallocated when
+*               the new size needs more than have ever been allocated, so
+*               a bitmap that is reused for images of similar size stops
+*               allocating after the first few. Row pointers from Bit2_row
+*               are no longer valid. The layout stays the same.
+*  expects:     The bitmap pointer is not NULL and is not a view, and both
+*               sizes are greater than zero.
+*/
+void Bit2_resize(Bit2_T bit2, int rows, int cols)
+{
+        assert(bit2 != NULL && bit2->root == NULL);
+        assert(rows > 0 && cols > 0);
+        size_t needed = set_shape(bit2, rows, cols);
+        if (needed > bit2->capacity) {
+                Hugemem_free(bit2->words, bit2->capacity * sizeof(uint64_t));
+                bit2->words = Hugemem_alloc(needed * sizeof(uint64_t));
+                bit2->capacity = needed;
+                return; /* fresh memory is already zero */
+        }
+        memset(bit2->words, 0, needed * sizeof(uint64_t));
+}
+
+/*
+*  name:        set_shape
+*  purpose:     Records a bitmap's dimensions and works out its storage.
+*  arguments:   A Bit2_T with its layout set, and the rows and columns.
+*  return type: The number of words the bitmap needs.
+*  effect:      Sets rows, cols, row_words and tile_cols.
+*  expects:     Both sizes are greater than zero.
+*/
+static size_t set_shape(Bit2_T bit2, int rows, int cols)
+{
+        bit2->rows = rows;
+        bit2->cols = cols;
+        bit2->row_words = (cols + 63) / 64;
+        bit2->tile_cols = (cols + 7) / 8;
+        if (bit2->layout == BIT2_TILED) {
+                return ((size_t)rows + 7) / 8 * bit2->tile_cols;
+        }
+        return (size_t)rows * bit2->row_words;
+}
+
 /*
 *  name:        Bit2_width
 *  purpose:     Returns the number of columns in the bitmap.
@@ -152,9 +429,146 @@ void Bit2_map_row_major(Bit2_T bit2, void apply(
     int row, int col, Bit2_T bit2, int value, void *cl), void *cl) 
 {
         assert(bit2 != NULL);
-        for (int r = 0; r < bit2->rows; r++) {
+        map_rows(bit2, 0, bit2->rows, apply, cl);
+}
+
+/*
+*  name:        Bit2_map_row_major_parallel
+*  purpose:     Applies a function to every bit like Bit2_map_row_major,
+*               but on several threads.
+*  arguments:   A Bit2_T, the apply function, a closure, the closure's
+*               size in bytes, a reduce function and the thread count (0
+*               or less for one per online CPU).
+*  return type: None.
+*  effect:      Cuts the rows into bands and maps them on the shared
+*               Mappool threads. Inside a band the order is row-major;
+*               bands run in no fixed order. Bands hold whole rows (whole
+*               rows of tiles for BIT2_TILED) and start on a cache line,
+*               so apply may Bit2_put the bit it is given without two
+*               threads ever writing the same word or line.
+*               When cl_size is 0 every thread is handed cl itself. When
+*               it is positive, each thread gets its own cache-line-aligned
+*               copy of *cl, and once all bands are done reduce(cl, copy)
+*               is called on the calling thread for every copy. *cl should
+*               therefore start as reduce's identity (zero for a sum).
+*  expects:     The bitmap and apply are not NULL. reduce is not NULL when
+*               cl_size > 0; it must be associative and commutative. With
+*               cl_size 0, apply must be safe to call from several threads
+*               on the same cl.
+*/
+void Bit2_map_row_major_parallel(Bit2_T bit2, void apply(
+    int row, int col, Bit2_T bit2, int value, void *cl), void *cl,
+    size_t cl_size, void reduce(void *cl, const void *part), int threads)
+{
+        assert(bit2 != NULL && apply != NULL);
+        assert(cl_size == 0 || (cl != NULL && reduce != NULL));
+        Par_map job;
+        job.bit2 = bit2;
+        job.apply = apply;
+        job.cl = cl;
+        job.threads = Mappool_threads(threads);
+        if (bit2->layout == BIT2_TILED) {
+                job.band_rows = Mappool_band_rows(bit2->rows,
+                                                  bit2->tile_cols, 8,
+                                                  job.threads);
+        } else {
+                job.band_rows = Mappool_band_rows(bit2->rows,
+                                                  bit2->row_words
+                                                  * sizeof(uint64_t), 1,
+                                                  job.threads);
+        }
+        /* a view's bands end where the root's would, so no two bands of
+         * a tiled view share a tile */
+        job.shift = bit2->row_off % job.band_rows;
+        int bands = (job.shift + bit2->rows + job.band_rows - 1)
+                    / job.band_rows;
+
+        job.slots = NULL;
+        job.stride = (cl_size + MAPPOOL_LINE - 1) / MAPPOOL_LINE
+                     * MAPPOOL_LINE;
+        if (cl_size > 0) {
+                job.slots = aligned_alloc(MAPPOOL_LINE,
+                                          job.stride * job.threads);
+                assert(job.slots != NULL);
+                for (int i = 0; i < job.threads; i++) {
+                        memcpy(job.slots + i * job.stride, cl, cl_size);
+                }
+        }
+
+        Mappool_run(bands, job.threads, map_band, &job);
+
+        if (cl_size > 0) {
+                for (int i = 0; i < job.threads; i++) {
+                        reduce(cl, job.slots + i * job.stride);
+                }
+                free(job.slots);
+        }
+}
+
+/*
+*  name:        map_band
+*  purpose:     Maps one band of a Bit2_map_row_major_parallel call.
+*  arguments:   The band number, the worker running it and the Par_map.
+*  return type: None.
+*  effect:      Calls apply on the band's rows with the worker's closure.
+*               Bands are counted from shift rows above row 0.
+*  expects:     Called by Mappool_run.
+*/
+static void map_band(int band, int worker, void *cl)
+{
+        Par_map *job = cl;
+        int first = band * job->band_rows - job->shift;
+        int last = first + job->band_rows;
+        if (first < 0) {
+                first = 0;
+        }
+        if (last > job->bit2->rows) {
+                last = job->bit2->rows;
+        }
+        void *slot = job->slots == NULL ? job->cl
+                                        : job->slots + worker * job->stride;
+        map_rows(job->bit2, first, last, job->apply, slot);
+}
+
+/*
+*  name:        map_rows
+*  purpose:     Applies a function to every bit of rows first..last - 1 in
+*               row-major order.
+*  arguments:   A Bit2_T, the first row and one past the last, the apply
+*               function and its closure.
+*  return type: None.
+*  effect:      Reads tiled rows straight from their tiles and a view's
+*               bits through get_bit. Every bit is read just before apply
+*               gets it, so a view maps exactly as the bitmap it covers.
+*  expects:     0 <= first <= last <= rows.
+*/
+static void map_rows(Bit2_T bit2, int first, int last, void apply(
+    int row, int col, Bit2_T bit2, int value, void *cl), void *cl)
+{
+        if (bit2->root != NULL) {
+                for (int r = first; r < last; r++) {
+                        for (int c = 0; c < bit2->cols; c++) {
+                                apply(r, c, bit2, get_bit(bit2, r, c), cl);
+                        }
+                }
+                return;
+        }
+        if (bit2->layout == BIT2_TILED) {
+                for (int r = first; r < last; r++) {
+                        const uint64_t *tiles = bit2->words
+                                                + tile_index(bit2, r, 0);
+                        for (int c = 0; c < bit2->cols; c++) {
+                                int value = (tiles[c >> 3]
+                                             >> tile_bit(r, c)) & 1;
+                                apply(r, c, bit2, value, cl);
+                        }
+                }
+                return;
+        }
+        for (int r = first; r < last; r++) {
+                const uint64_t *words = Bit2_row(bit2, r);
                 for (int c = 0; c < bit2->cols; c++) {
-                        int value = Bit2_get(bit2, r, c);
+                        int value = Bit2_word_get(words, c);
                         // pointer to a function
                         apply(r, c, bit2, value, cl);
                 }
@@ -169,22 +583,201 @@ void Bit2_map_row_major(Bit2_T bit2, void apply(
 *               that takes row, column, bitmap, value, and a closure pointer, 
 *               and a void pointer cl for additional arguments.
 *  return type: None.
-*  effect:      Calls apply on each bit in column-major order.
+*  effect:      Calls apply on each bit in column-major order, passing the
+*               bit as it is when apply is called, so changes apply makes
+*               to bits not visited yet are seen. Bit2_map_col_major_strips
+*               is the faster form for callers that do not need that.
 *  expects:     The bitmap pointer is not NULL, and apply is a valid function.
 */
 void Bit2_map_col_major(Bit2_T bit2, void apply(
     int row, int col, Bit2_T bit2, int value, void *cl), void *cl) 
 {
         assert(bit2 != NULL);
+        if (bit2->root != NULL) {
+                for (int c = 0; c < bit2->cols; c++) {
+                        for (int r = 0; r < bit2->rows; r++) {
+                                apply(r, c, bit2, get_bit(bit2, r, c), cl);
+                        }
+                }
+                return;
+        }
+        if (bit2->layout == BIT2_TILED) {
+                for (int c = 0; c < bit2->cols; c++) {
+                        const uint64_t *tiles = bit2->words + (c >> 3);
+                        for (int r = 0; r < bit2->rows; r++) {
+                                int value = (tiles[(size_t)(r >> 3)
+                                                   * bit2->tile_cols]
+                                             >> tile_bit(r, c)) & 1;
+                                apply(r, c, bit2, value, cl);
+                        }
+                }
+                return;
+        }
         for (int c = 0; c < bit2->cols; c++) {
                 for (int r = 0; r < bit2->rows; r++) {
-                        int value = Bit2_get(bit2, r, c);
+                        int value = Bit2_word_get(Bit2_row(bit2, r), c);
                         // pointer to a function
                         apply(r, c, bit2, value, cl);
                 }
         }
 }
 
+/*
+*  name:        Bit2_map_col_major_strips
+*  purpose:     A column-major map that reads the bitmap a 64-column strip
+*               at a time instead of a bit at a time.
+*  arguments:   The same as Bit2_map_col_major.
+*  return type: None.
+*  effect:      Before the first column of each strip of 64 columns is
+*               visited, the strip is copied into a buffer of rows * 8
+*               bytes with each column's bits consecutive, and every value
+*               passed to apply comes from that copy. So a change apply
+*               makes to a later column of the same strip is not seen; one
+*               to a later strip is. A row-major bitmap is copied in 64x64
+*               blocks with transpose64, so every word is read once
+*               instead of once per bit; a tiled bitmap or a view is
+*               copied a bit at a time.
+*  expects:     The bitmap pointer is not NULL, and apply is a valid function.
+*/
+void Bit2_map_col_major_strips(Bit2_T bit2, void apply(
+    int row, int col, Bit2_T bit2, int value, void *cl), void *cl)
+{
+        assert(bit2 != NULL);
+        int block_rows = (bit2->rows + 63) / 64;
+        int strips = (bit2->cols + 63) / 64;
+        int by_blocks = bit2->root == NULL && bit2->layout == BIT2_ROW_MAJOR;
+        uint64_t *strip = malloc((size_t)64 * block_rows * sizeof(uint64_t));
+        assert(strip != NULL);
+        uint64_t block[64];
+
+        for (int bc = 0; bc < strips; bc++) {
+                int width = bit2->cols - 64 * bc < 64 ?
+                            bit2->cols - 64 * bc : 64;
+                if (by_blocks) {
+                        for (int br = 0; br < block_rows; br++) {
+                                load_block(bit2, br, bc, block);
+                                transpose64(block);
+                                for (int j = 0; j < 64; j++) {
+                                        strip[(size_t)j * block_rows + br] =
+                                                block[j];
+                                }
+                        }
+                } else {
+                        memset(strip, 0, (size_t)64 * block_rows
+                                         * sizeof(uint64_t));
+                        for (int j = 0; j < width; j++) {
+                                uint64_t *column = strip
+                                                   + (size_t)j * block_rows;
+                                for (int r = 0; r < bit2->rows; r++) {
+                                        if (get_bit(bit2, r, 64 * bc + j)) {
+                                                Bit2_word_put(column, r, 1);
+                                        }
+                                }
+                        }
+                }
+                for (int j = 0; j < width; j++) {
+                        const uint64_t *column = strip
+                                                 + (size_t)j * block_rows;
+                        for (int r = 0; r < bit2->rows; r++) {
+                                apply(r, 64 * bc + j, bit2,
+                                      Bit2_word_get(column, r), cl);
+                        }
+                }
+        }
+        free(strip);
+}
+
+/*
+*  name:        Bit2_map_runs
+*  purpose:     Applies a function once to every run of equal bits, row by
+*               row, instead of once per bit.
+*  arguments:   A Bit2_T, a function that takes the row, the first column
+*               of the run, its length, its bit and a closure pointer, and
+*               the closure.
+*  return type: None.
+*  effect:      Same as Bit2_map_runs_rect on the whole bitmap.
+*  expects:     The bitmap pointer is not NULL and apply is a valid function.
+*/
+void Bit2_map_runs(Bit2_T bit2, void apply(
+    int row, int col, int len, int value, void *cl), void *cl)
+{
+        assert(bit2 != NULL);
+        Bit2_map_runs_rect(bit2, apply, cl, 0, 0, bit2->rows, bit2->cols);
+}
+
+/*
+*  name:        Bit2_map_runs_rect
+*  purpose:     Applies a function once to every run of equal bits inside
+*               a rectangle.
+*  arguments:   A Bit2_T, the function and closure as for Bit2_map_runs,
+*               and the top row, left column, height and width of the
+*               rectangle.
+*  return type: None.
+*  effect:      Within each row, runs alternate between 0 and 1 and cover
+*               the rectangle's columns from left to right; runs are cut
+*               at the rectangle's edges and never span rows. The end of
+*               each run is found with count-trailing-zeros on whole words,
+*               so a white or black word costs one compare. Rows of a tiled
+*               bitmap are first gathered into row-major words, one byte
+*               per tile.
+*  expects:     The bitmap is not NULL, the rectangle lies inside it and
+*               apply does not change the bitmap.
+*/
+void Bit2_map_runs_rect(Bit2_T bit2, void apply(
+    int row, int col, int len, int value, void *cl), void *cl, int row,
+    int col, int height, int width)
+{
+        assert(bit2 != NULL && apply != NULL);
+        check_rect(bit2, row, col, height, width);
+        if (bit2->root != NULL) {
+                View_runs shift = { apply, cl, bit2->row_off, bit2->col_off };
+                Bit2_map_runs_rect(bit2->root, view_run, &shift,
+                                   row + bit2->row_off, col + bit2->col_off,
+                                   height, width);
+                return;
+        }
+        uint64_t *scratch = NULL;
+        if (bit2->layout != BIT2_ROW_MAJOR) {
+                scratch = malloc(bit2->row_words * sizeof(uint64_t));
+                assert(scratch != NULL);
+        }
+
+        for (int r = row; r < row + height; r++) {
+                const uint64_t *words;
+                if (scratch == NULL) {
+                        words = Bit2_row(bit2, r);
+                } else {
+                        gather_row(bit2, r, scratch);
+                        words = scratch;
+                }
+                int end = col + width;
+                int pos = col;
+                int value = Bit2_word_get(words, pos);
+                while (pos < end) {
+                        int next = next_change(words, end, pos, value);
+                        apply(r, pos, next - pos, value, cl);
+                        pos = next;
+                        value ^= 1;
+                }
+        }
+        free(scratch);
+}
+
+/*
+*  name:        view_run
+*  purpose:     Passes a run of a view's root on to the view's apply.
+*  arguments:   The run as the root sees it and the View_runs.
+*  return type: None.
+*  effect:      Moves the run back into the view's coordinates.
+*  expects:     Called by Bit2_map_runs_rect.
+*/
+static void view_run(int row, int col, int len, int value, void *cl)
+{
+        View_runs *shift = cl;
+        shift->apply(row - shift->row_off, col - shift->col_off, len, value,
+                     shift->cl);
+}
+
 /*
 *  name:        valid_index
 *  purpose:     Checks whether a given row and column index are within the 
@@ -198,6 +791,1452 @@ void Bit2_map_col_major(Bit2_T bit2, void apply(
 int valid_index(Bit2_T bit2, int row, int col)
 {
         assert(bit2 != NULL);
-        return (row >= 0 && row < Bit2_height(bit2) &&
-                col >= 0 && col < Bit2_width(bit2));
+        return (row >= 0 && row < bit2->rows &&
+                col >= 0 && col < bit2->cols);
+}
+
+/*
+*  name:        Bit2_row_words
+*  purpose:     Returns how many 64-bit words each row of the bitmap uses.
+*  arguments:   A Bit2_T representing the bitmap.
+*  return type: Integer, (width + 63) / 64.
+*  effect:      None.
+*  expects:     The bitmap pointer is not NULL, uses BIT2_ROW_MAJOR and is
+*               not a view.
+*/
+int Bit2_row_words(Bit2_T bit2)
+{
+        assert(bit2 != NULL && bit2->layout == BIT2_ROW_MAJOR);
+        assert(bit2->root == NULL);
+        return bit2->row_words;
+}
+
+/*
+*  name:        Bit2_row
+*  purpose:     Gives direct access to the packed words of one row.
+*  arguments:   A Bit2_T representing the bitmap and a row index.
+*  return type: Pointer to Bit2_row_words(bit2) words holding the row.
+*  effect:      None. Writes through the pointer change the bitmap.
+*  expects:     The bitmap pointer is not NULL, uses BIT2_ROW_MAJOR, is not
+*               a view and the row is in bounds. Writers must leave the
+*               bits past the last column at 0.
+*/
+uint64_t *Bit2_row(Bit2_T bit2, int row)
+{
+        assert(bit2 != NULL && bit2->layout == BIT2_ROW_MAJOR);
+        assert(bit2->root == NULL);
+        assert(row >= 0 && row < bit2->rows);
+        return bit2->words + (size_t)row * bit2->row_words;
+}
+
+/*
+*  name:        Bit2_read_span
+*  purpose:     Copies len bits of a row, starting at col, into packed
+*               words so that bit i of the span is bit i % 64 of dst[i / 64].
+*  arguments:   A Bit2_T, a row index, the first column, the number of bits
+*               and a destination array of at least (len + 63) / 64 words.
+*  return type: None.
+*  effect:      Fills dst; unused high bits of the last word are zeroed.
+*               A tiled bitmap is read a tile byte at a time for a whole
+*               row and one bit at a time otherwise.
+*  expects:     The bitmap and dst are not NULL, len > 0 and the span
+*               [col, col + len) lies inside the row.
+*/
+void Bit2_read_span(Bit2_T bit2, int row, int col, int len, uint64_t *dst)
+{
+        assert(dst != NULL && len > 0);
+        assert(col >= 0 && col + len <= Bit2_width(bit2));
+        if (bit2->root != NULL) {
+                assert(row >= 0 && row < bit2->rows);
+                Bit2_read_span(bit2->root, row + bit2->row_off,
+                               col + bit2->col_off, len, dst);
+                return;
+        }
+        if (bit2->layout == BIT2_TILED) {
+                assert(row >= 0 && row < bit2->rows);
+                if (col == 0 && len == bit2->cols) {
+                        gather_row(bit2, row, dst);
+                        return;
+                }
+                memset(dst, 0, (len + 63) / 64 * sizeof(uint64_t));
+                for (int i = 0; i < len; i++) {
+                        dst[i >> 6] |= (uint64_t)get_bit(bit2, row, col + i)
+                                       << (i & 63);
+                }
+                return;
+        }
+        const uint64_t *words = Bit2_row(bit2, row);
+        int shift = col & 63;
+        int first = col >> 6;
+        int last = (col + len - 1) >> 6; // last source word we may touch
+        int n = (len + 63) / 64;
+
+        for (int i = 0; i < n; i++) {
+                int w = first + i;
+                uint64_t value = words[w] >> shift;
+                if (shift != 0 && w + 1 <= last) {
+                        value |= words[w + 1] << (64 - shift);
+                }
+                dst[i] = value;
+        }
+        dst[n - 1] &= low_mask(len - 64 * (n - 1));
+}
+
+/*
+*  name:        Bit2_write_span
+*  purpose:     Stores len packed bits from src into a row starting at col.
+*               This is the inverse of Bit2_read_span.
+*  arguments:   A Bit2_T, a row index, the first column, the number of bits
+*               and a source array of at least (len + 63) / 64 words.
+*  return type: None.
+*  effect:      Overwrites columns [col, col + len) of the row; the rest of
+*               the row is left untouched. A tiled bitmap is written one
+*               bit at a time.
+*  expects:     The bitmap and src are not NULL, len > 0 and the span
+*               lies inside the row.
+*/
+void Bit2_write_span(Bit2_T bit2, int row, int col, int len,
+                     const uint64_t *src)
+{
+        assert(src != NULL && len > 0);
+        assert(col >= 0 && col + len <= Bit2_width(bit2));
+        if (bit2->root != NULL) {
+                assert(row >= 0 && row < bit2->rows);
+                Bit2_write_span(bit2->root, row + bit2->row_off,
+                                col + bit2->col_off, len, src);
+                return;
+        }
+        if (bit2->layout == BIT2_TILED) {
+                assert(row >= 0 && row < bit2->rows);
+                for (int i = 0; i < len; i++) {
+                        put_bit(bit2, row, col + i,
+                                (int)((src[i >> 6] >> (i & 63)) & 1));
+                }
+                return;
+        }
+        uint64_t *words = Bit2_row(bit2, row);
+        int shift = col & 63;
+        int n = (len + 63) / 64;
+
+        for (int i = 0; i < n; i++) {
+                int bits = (i == n - 1) ? len - 64 * i : 64;
+                uint64_t mask = low_mask(bits);
+                uint64_t value = src[i] & mask;
+                int w = (col >> 6) + i;
+
+                words[w] = (words[w] & ~(mask << shift)) | (value << shift);
+                if (shift != 0 && shift + bits > 64) { // spills over
+                        words[w + 1] = (words[w + 1] & ~(mask >> (64 - shift)))
+                                       | (value >> (64 - shift));
+                }
+        }
+}
+
+/*
+*  name:        Bit2_test_and_set
+*  purpose:     Atomically sets a bit and reports what it was.
+*  arguments:   A Bit2_T, a row index and a column index.
+*  return type: The bit before the call (0 or 1).
+*  effect:      One atomic fetch-or on the word holding the bit, with
+*               memory_order_acq_rel: the thread that turns the bit on
+*               sees every write made before the word's earlier atomic
+*               updates, and its own earlier writes are visible to the
+*               next thread that updates the word.
+*  expects:     The bitmap is not NULL and the index is in bounds. Every
+*               thread writing the bitmap at the same time uses only the
+*               atomic calls.
+*/
+int Bit2_test_and_set(Bit2_T bit2, int row, int col)
+{
+        assert(bit2 != NULL && valid_index(bit2, row, col));
+        uint64_t mask;
+        _Atomic uint64_t *word = atomic_bit(bit2, row, col, &mask);
+        return (atomic_fetch_or_explicit(word, mask, memory_order_acq_rel)
+                & mask) != 0;
+}
+
+/*
+*  name:        Bit2_test_and_clear
+*  purpose:     Atomically clears a bit and reports what it was, so of
+*               several threads clearing the same 1 bit exactly one gets 1.
+*  arguments:   A Bit2_T, a row index and a column index.
+*  return type: The bit before the call (0 or 1).
+*  effect:      One atomic fetch-and on the word holding the bit, with
+*               memory_order_acq_rel as for Bit2_test_and_set.
+*  expects:     The bitmap is not NULL and the index is in bounds. Every
+*               thread writing the bitmap at the same time uses only the
+*               atomic calls.
+*/
+int Bit2_test_and_clear(Bit2_T bit2, int row, int col)
+{
+        assert(bit2 != NULL && valid_index(bit2, row, col));
+        uint64_t mask;
+        _Atomic uint64_t *word = atomic_bit(bit2, row, col, &mask);
+        return (atomic_fetch_and_explicit(word, ~mask, memory_order_acq_rel)
+                & mask) != 0;
+}
+
+/*
+*  name:        Bit2_fetch_or_word
+*  purpose:     Atomically ORs a mask into one word of a row.
+*  arguments:   A Bit2_T, a row index, a word index within the row and the
+*               mask (bit i is column 64 * word + i).
+*  return type: The word before the call.
+*  effect:      One atomic fetch-or with memory_order_acq_rel. Mask bits
+*               past the last column are dropped so the padding stays 0.
+*  expects:     The bitmap is not NULL and uses BIT2_ROW_MAJOR, and row and
+*               word are in bounds.
+*/
+uint64_t Bit2_fetch_or_word(Bit2_T bit2, int row, int word, uint64_t mask)
+{
+        _Atomic uint64_t *at = atomic_word(bit2, row, word);
+        if (word == bit2->row_words - 1) {
+                mask &= low_mask(bit2->cols - 64 * word);
+        }
+        return atomic_fetch_or_explicit(at, mask, memory_order_acq_rel);
+}
+
+/*
+*  name:        Bit2_fetch_and_word
+*  purpose:     Atomically ANDs a mask into one word of a row.
+*  arguments:   A Bit2_T, a row index, a word index within the row and the
+*               mask.
+*  return type: The word before the call.
+*  effect:      One atomic fetch-and with memory_order_acq_rel; the bits
+*               that are 0 in the mask are cleared.
+*  expects:     The bitmap is not NULL and uses BIT2_ROW_MAJOR, and row and
+*               word are in bounds.
+*/
+uint64_t Bit2_fetch_and_word(Bit2_T bit2, int row, int word, uint64_t mask)
+{
+        _Atomic uint64_t *at = atomic_word(bit2, row, word);
+        return atomic_fetch_and_explicit(at, mask, memory_order_acq_rel);
+}
+
+/*
+*  name:        Bit2_load_word
+*  purpose:     Atomically reads one word of a row while other threads may
+*               be changing it.
+*  arguments:   A Bit2_T, a row index and a word index within the row.
+*  return type: The word.
+*  effect:      One atomic load with memory_order_acquire, which pairs with
+*               the release half of the fetch operations above.
+*  expects:     The bitmap is not NULL and uses BIT2_ROW_MAJOR, and row and
+*               word are in bounds.
+*/
+uint64_t Bit2_load_word(Bit2_T bit2, int row, int word)
+{
+        return atomic_load_explicit(atomic_word(bit2, row, word),
+                                    memory_order_acquire);
+}
+
+/*
+*  name:        Bit2_combine
+*  purpose:     Combines two whole bitmaps a word at a time.
+*  arguments:   The destination, the source and the operation.
+*  return type: None.
+*  effect:      Sets every bit of dst to dst AND src, dst OR src,
+*               dst XOR src, dst AND NOT src, or NOT src, depending on op.
+*               src is not changed; dst and src may be the same bitmap.
+*  expects:     Both bitmaps are not NULL and have the same dimensions.
+*/
+void Bit2_combine(Bit2_T dst, Bit2_T src, Bit2_op op)
+{
+        assert(dst != NULL && src != NULL);
+        assert(dst->rows == src->rows && dst->cols == src->cols);
+        if (dst->layout != src->layout || dst->root != NULL ||
+            src->root != NULL || (dst->layout == BIT2_ROW_MAJOR &&
+                                  dst->cols % 64 != 0)) {
+                Bit2_combine_rect(dst, src, op, 0, 0, dst->rows, dst->cols);
+                return;
+        }
+
+        /* same word layout and no padding inside a row: one long run */
+        get_kernels()->combine(dst->words, src->words, word_count(dst), op);
+        if (op == BIT2_NOT) {
+                clear_padding(dst);
+        }
+}
+
+/*
+*  name:        Bit2_combine_rect
+*  purpose:     Combines the same rectangle of two bitmaps.
+*  arguments:   The destination, the source, the operation, and the top
+*               row, left column, height and width of the rectangle.
+*  return type: None.
+*  effect:      Like Bit2_combine, but only for the bits inside the
+*               rectangle; the rest of dst is left alone. Row-major
+*               bitmaps go a word at a time, views a span at a time, and
+*               anything else a bit at a time.
+*  expects:     Both bitmaps are not NULL, have the same dimensions and
+*               the rectangle lies inside them.
+*/
+void Bit2_combine_rect(Bit2_T dst, Bit2_T src, Bit2_op op, int row, int col,
+                       int height, int width)
+{
+        assert(dst != NULL && src != NULL);
+        assert(dst->rows == src->rows && dst->cols == src->cols);
+        check_rect(dst, row, col, height, width);
+        if (dst->root != NULL || src->root != NULL) {
+                combine_spans(dst, src, op, row, col, height, width);
+                return;
+        }
+        if (dst->layout != BIT2_ROW_MAJOR || src->layout != BIT2_ROW_MAJOR) {
+                for (int r = row; r < row + height; r++) {
+                        for (int c = col; c < col + width; c++) {
+                                put_bit(dst, r, c, (int)(combine_word(
+                                        get_bit(dst, r, c),
+                                        get_bit(src, r, c), op) & 1));
+                        }
+                }
+                return;
+        }
+
+        const Kernels *k = get_kernels();
+        int first = col >> 6;
+        int last = (col + width - 1) >> 6;
+        uint64_t head = ~(uint64_t)0 << (col & 63);
+        uint64_t tail = low_mask(((col + width - 1) & 63) + 1);
+        if (first == last) {
+                head &= tail;
+        }
+        for (int r = row; r < row + height; r++) {
+                uint64_t *d = Bit2_row(dst, r);
+                const uint64_t *s = Bit2_row(src, r);
+                uint64_t value = combine_word(d[first], s[first], op);
+                d[first] = (d[first] & ~head) | (value & head);
+                if (first == last) {
+                        continue;
+                }
+                if (last - first > 1) {
+                        k->combine(d + first + 1, s + first + 1,
+                                   last - first - 1, op);
+                }
+                value = combine_word(d[last], s[last], op);
+                d[last] = (d[last] & ~tail) | (value & tail);
+        }
+}
+
+/*
+*  name:        combine_spans
+*  purpose:     Combines a rectangle of two bitmaps when either is a view.
+*  arguments:   As Bit2_combine_rect.
+*  return type: None.
+*  effect:      Reads each row of the rectangle out of both bitmaps with
+*               Bit2_read_span, combines the words with the kernel and
+*               writes the result back with Bit2_write_span, so neither
+*               side has to start on a word boundary.
+*  expects:     As Bit2_combine_rect.
+*/
+static void combine_spans(Bit2_T dst, Bit2_T src, Bit2_op op, int row,
+                          int col, int height, int width)
+{
+        size_t n = ((size_t)width + 63) / 64;
+        uint64_t *d = malloc(2 * n * sizeof(uint64_t));
+        assert(d != NULL);
+        uint64_t *s = d + n;
+        const Kernels *k = get_kernels();
+        for (int r = row; r < row + height; r++) {
+                Bit2_read_span(dst, r, col, width, d);
+                Bit2_read_span(src, r, col, width, s);
+                k->combine(d, s, n, op);
+                Bit2_write_span(dst, r, col, width, d);
+        }
+        free(d);
+}
+
+/*
+*  name:        Bit2_fill
+*  purpose:     Sets every bit of a bitmap to the same value.
+*  arguments:   A Bit2_T and the bit (0 clears, 1 fills).
+*  return type: None.
+*  effect:      Overwrites every bit; the padding stays 0.
+*  expects:     The bitmap pointer is not NULL.
+*/
+void Bit2_fill(Bit2_T bit2, int bit)
+{
+        assert(bit2 != NULL);
+        if (bit2->root != NULL) {
+                Bit2_fill_rect(bit2, bit, 0, 0, bit2->rows, bit2->cols);
+                return;
+        }
+        memset(bit2->words, bit ? 0xff : 0,
+               word_count(bit2) * sizeof(uint64_t));
+        if (bit) {
+                clear_padding(bit2);
+        }
+}
+
+/*
+*  name:        Bit2_fill_rect
+*  purpose:     Sets every bit of a rectangle to the same value.
+*  arguments:   A Bit2_T, the bit, and the top row, left column, height and
+*               width of the rectangle.
+*  return type: None.
+*  effect:      Overwrites the bits inside the rectangle only. Whole words
+*               inside a row are set with memset.
+*  expects:     The bitmap is not NULL and the rectangle lies inside it.
+*/
+void Bit2_fill_rect(Bit2_T bit2, int bit, int row, int col, int height,
+                    int width)
+{
+        assert(bit2 != NULL);
+        check_rect(bit2, row, col, height, width);
+        if (bit2->root != NULL) {
+                Bit2_fill_rect(bit2->root, bit, row + bit2->row_off,
+                               col + bit2->col_off, height, width);
+                return;
+        }
+        if (bit2->layout != BIT2_ROW_MAJOR) {
+                for (int r = row; r < row + height; r++) {
+                        for (int c = col; c < col + width; c++) {
+                                put_bit(bit2, r, c, bit);
+                        }
+                }
+                return;
+        }
+
+        uint64_t fill = bit ? ~(uint64_t)0 : 0;
+        int first = col >> 6;
+        int last = (col + width - 1) >> 6;
+        uint64_t head = ~(uint64_t)0 << (col & 63);
+        uint64_t tail = low_mask(((col + width - 1) & 63) + 1);
+        if (first == last) {
+                head &= tail;
+        }
+        for (int r = row; r < row + height; r++) {
+                uint64_t *words = Bit2_row(bit2, r);
+                words[first] = (words[first] & ~head) | (fill & head);
+                if (first == last) {
+                        continue;
+                }
+                memset(words + first + 1, bit ? 0xff : 0,
+                       (last - first - 1) * sizeof(uint64_t));
+                words[last] = (words[last] & ~tail) | (fill & tail);
+        }
+}
+
+/*
+*  name:        Bit2_count
+*  purpose:     Counts the 1 bits of a whole bitmap.
+*  arguments:   A Bit2_T.
+*  return type: The number of 1 bits.
+*  effect:      None. Since the padding is always 0, every word is counted
+*               in one run.
+*  expects:     The bitmap pointer is not NULL.
+*/
+uint64_t Bit2_count(Bit2_T bit2)
+{
+        assert(bit2 != NULL);
+        if (bit2->root != NULL) {
+                return Bit2_count_rect(bit2, 0, 0, bit2->rows, bit2->cols);
+        }
+        return get_kernels()->count(bit2->words, word_count(bit2));
+}
+
+/*
+*  name:        Bit2_count_rect
+*  purpose:     Counts the 1 bits inside a rectangle.
+*  arguments:   A Bit2_T, and the top row, left column, height and width of
+*               the rectangle.
+*  return type: The number of 1 bits.
+*  effect:      None.
+*  expects:     The bitmap is not NULL and the rectangle lies inside it.
+*/
+uint64_t Bit2_count_rect(Bit2_T bit2, int row, int col, int height,
+                         int width)
+{
+        assert(bit2 != NULL);
+        check_rect(bit2, row, col, height, width);
+        if (bit2->root != NULL) {
+                return Bit2_count_rect(bit2->root, row + bit2->row_off,
+                                       col + bit2->col_off, height, width);
+        }
+        uint64_t total = 0;
+        if (bit2->layout != BIT2_ROW_MAJOR) {
+                for (int r = row; r < row + height; r++) {
+                        for (int c = col; c < col + width; c++) {
+                                total += get_bit(bit2, r, c);
+                        }
+                }
+                return total;
+        }
+
+        const Kernels *k = get_kernels();
+        int first = col >> 6;
+        int last = (col + width - 1) >> 6;
+        uint64_t head = ~(uint64_t)0 << (col & 63);
+        uint64_t tail = low_mask(((col + width - 1) & 63) + 1);
+        if (first == last) {
+                head &= tail;
+        }
+        for (int r = row; r < row + height; r++) {
+                const uint64_t *words = Bit2_row(bit2, r);
+                uint64_t edges = words[first] & head;
+                total += count_portable(&edges, 1);
+                if (first == last) {
+                        continue;
+                }
+                if (last - first > 1) {
+                        total += k->count(words + first + 1,
+                                          last - first - 1);
+                }
+                edges = words[last] & tail;
+                total += count_portable(&edges, 1);
+        }
+        return total;
+}
+
+/*
+*  name:        Bit2_hash
+*  purpose:     Computes a 64-bit non-cryptographic hash of a bitmap's
+*               shape and bits, for use as a content key.
+*  arguments:   A Bit2_T and a seed; different seeds give unrelated hashes
+*               of the same bitmap.
+*  return type: The hash.
+*  effect:      Reads every word once. A row-major bitmap that is not a
+*               view is hashed straight from its words in one pass; any
+*               other is read a row at a time through row_image, which
+*               gives the same words, so equal bitmaps hash equal.
+*  expects:     The bitmap pointer is not NULL.
+*/
+uint64_t Bit2_hash(Bit2_T bit2, uint64_t seed)
+{
+        assert(bit2 != NULL);
+        Hash_state hash = {
+                { seed + HASH_P1 + HASH_P2, seed + HASH_P2, seed,
+                  seed - HASH_P1 },
+                0
+        };
+        if (bit2->layout == BIT2_ROW_MAJOR && bit2->root == NULL) {
+                hash_words(&hash, bit2->words, word_count(bit2));
+        } else {
+                int row_words = (bit2->cols + 63) / 64;
+                uint64_t *buf = malloc(row_words * sizeof(uint64_t));
+                assert(buf != NULL);
+                for (int r = 0; r < bit2->rows; r++) {
+                        hash_words(&hash, row_image(bit2, r, buf),
+                                   row_words);
+                }
+                free(buf);
+        }
+
+        uint64_t h = ((hash.lane[0] << 1) | (hash.lane[0] >> 63)) +
+                     ((hash.lane[1] << 7) | (hash.lane[1] >> 57)) +
+                     ((hash.lane[2] << 12) | (hash.lane[2] >> 52)) +
+                     ((hash.lane[3] << 18) | (hash.lane[3] >> 46));
+        for (int i = 0; i < 4; i++) {
+                h = (h ^ hash_round(0, hash.lane[i])) * HASH_P1 + HASH_P4;
+        }
+        h += hash.n * sizeof(uint64_t);
+        uint64_t shape = (uint64_t)(uint32_t)bit2->rows << 32 |
+                         (uint32_t)bit2->cols;
+        h = (h ^ hash_round(0, shape)) * HASH_P1 + HASH_P4;
+        h ^= h >> 33;
+        h *= HASH_P2;
+        h ^= h >> 29;
+        h *= HASH_P3;
+        h ^= h >> 32;
+        return h;
+}
+
+/*
+*  name:        hash_words
+*  purpose:     Feeds words into Bit2_hash's state.
+*  arguments:   The state, and the words with their count.
+*  return type: None.
+*  effect:      Word i of the whole stream goes into lane i % 4, so the
+*               result does not depend on how the stream is cut up. Whole
+*               groups of four run the lanes side by side.
+*  expects:     words is not NULL if count > 0.
+*/
+static void hash_words(Hash_state *hash, const uint64_t *words,
+                       size_t count)
+{
+        size_t i = 0;
+        while (i < count && (hash->n & 3) != 0) {
+                hash->lane[hash->n & 3] = hash_round(hash->lane[hash->n & 3],
+                                                     words[i++]);
+                hash->n++;
+        }
+        uint64_t a = hash->lane[0], b = hash->lane[1];
+        uint64_t c = hash->lane[2], d = hash->lane[3];
+        for (; i + 4 <= count; i += 4) {
+                a = hash_round(a, words[i]);
+                b = hash_round(b, words[i + 1]);
+                c = hash_round(c, words[i + 2]);
+                d = hash_round(d, words[i + 3]);
+                hash->n += 4;
+        }
+        hash->lane[0] = a;
+        hash->lane[1] = b;
+        hash->lane[2] = c;
+        hash->lane[3] = d;
+        while (i < count) {
+                hash->lane[hash->n & 3] = hash_round(hash->lane[hash->n & 3],
+                                                     words[i++]);
+                hash->n++;
+        }
+}
+
+/*
+*  name:        Bit2_transpose
+*  purpose:     Makes the transpose of a bitmap.
+*  arguments:   A Bit2_T.
+*  return type: A new Bit2_T with the same layout, Bit2_width(bit2) rows
+*               and Bit2_height(bit2) columns, whose bit (c, r) is bit
+*               (r, c) of the original. The caller frees it.
+*  effect:      Row-major bitmaps are done in 64x64 blocks, tiled ones a
+*               tile at a time. A view is copied out first.
+*  expects:     The bitmap pointer is not NULL.
+*/
+Bit2_T Bit2_transpose(Bit2_T bit2)
+{
+        assert(bit2 != NULL);
+        if (bit2->root != NULL) {
+                Bit2_T copy = Bit2_new_layout(bit2->rows, bit2->cols,
+                                              bit2->layout);
+                Bit2_combine(copy, bit2, BIT2_OR);
+                Bit2_T result = Bit2_transpose(copy);
+                Bit2_free(&copy);
+                return result;
+        }
+        Bit2_T result = Bit2_new_layout(bit2->cols, bit2->rows,
+                                        bit2->layout);
+        if (bit2->layout == BIT2_TILED) {
+                int tile_rows = (bit2->rows + 7) / 8;
+                for (int tr = 0; tr < tile_rows; tr++) {
+                        for (int tc = 0; tc < bit2->tile_cols; tc++) {
+                                result->words[(size_t)tc * result->tile_cols
+                                              + tr] = transpose8(
+                                        bit2->words[(size_t)tr
+                                                    * bit2->tile_cols + tc]);
+                        }
+                }
+                return result;
+        }
+
+        uint64_t block[64];
+        int block_rows = (bit2->rows + 63) / 64;
+        for (int br = 0; br < block_rows; br++) {
+                for (int bc = 0; bc < bit2->row_words; bc++) {
+                        load_block(bit2, br, bc, block);
+                        transpose64(block);
+                        store_block(result, bc, br, block);
+                }
+        }
+        return result;
+}
+
+/*
+*  name:        Bit2_transpose_square
+*  purpose:     Transposes a square bitmap in place.
+*  arguments:   A Bit2_T with as many rows as columns.
+*  return type: None.
+*  effect:      Swaps every block (or tile) above the diagonal with its
+*               mirror below it, transposing both, and transposes the ones
+*               on the diagonal where they are. Needs only two 64-word
+*               buffers. A view is transposed a bit pair at a time.
+*  expects:     The bitmap pointer is not NULL and the bitmap is square.
+*/
+void Bit2_transpose_square(Bit2_T bit2)
+{
+        assert(bit2 != NULL && bit2->rows == bit2->cols);
+        if (bit2->root != NULL) {
+                for (int r = 0; r < bit2->rows; r++) {
+                        for (int c = r + 1; c < bit2->cols; c++) {
+                                int a = get_bit(bit2, r, c);
+                                put_bit(bit2, r, c, get_bit(bit2, c, r));
+                                put_bit(bit2, c, r, a);
+                        }
+                }
+                return;
+        }
+        if (bit2->layout == BIT2_TILED) {
+                int n = bit2->tile_cols;
+                for (int tr = 0; tr < n; tr++) {
+                        for (int tc = tr; tc < n; tc++) {
+                                uint64_t *a = &bit2->words[(size_t)tr * n
+                                                           + tc];
+                                uint64_t *b = &bit2->words[(size_t)tc * n
+                                                           + tr];
+                                uint64_t t = transpose8(*a);
+                                *a = transpose8(*b);
+                                *b = t;
+                        }
+                }
+                return;
+        }
+
+        uint64_t upper[64], lower[64];
+        int n = bit2->row_words;
+        for (int br = 0; br < n; br++) {
+                for (int bc = br; bc < n; bc++) {
+                        load_block(bit2, br, bc, upper);
+                        transpose64(upper);
+                        if (bc != br) {
+                                load_block(bit2, bc, br, lower);
+                                transpose64(lower);
+                                store_block(bit2, br, bc, lower);
+                        }
+                        store_block(bit2, bc, br, upper);
+                }
+        }
+}
+
+/*
+*  name:        Bit2_morph
+*  purpose:     Erodes, dilates, opens or closes a bitmap in place.
+*  arguments:   The bitmap, the operation, the structuring element and a
+*               scratch bitmap of the same size, or NULL.
+*  return type: None.
+*  effect:      Erosion keeps a 1 where every bit under the element is 1;
+*               dilation sets a bit wherever the element, placed on a 1,
+*               covers it. Opening is an erosion then a dilation (it
+*               removes specks smaller than the element), closing the
+*               reverse (it fills small holes and gaps). The element's
+*               origin is at row height / 2, column width / 2. Bits past
+*               the edges count as 1 when eroding and 0 when dilating, so
+*               the edges neither eat into nor grow shapes.
+*               Rows are worked on a word at a time: the element's width
+*               by shifting words along the row, its height by combining
+*               whole rows with the Bit2_combine kernels. The result of the
+*               first pass goes to scratch and the second pass writes back
+*               into bit2, so no more than one extra bitmap is ever used.
+*               scratch is overwritten; with NULL a row-major one is
+*               allocated for the call.
+*  expects:     bit2 is not NULL. se's sides are between 1 and
+*               BIT2_MORPH_MAX. scratch, if given, has bit2's dimensions
+*               and shares no bits with it. Either may be a view or tiled.
+*/
+void Bit2_morph(Bit2_T bit2, Bit2_morph_op op, Bit2_se se, Bit2_T scratch)
+{
+        assert(bit2 != NULL && scratch != bit2);
+        assert(se.shape == BIT2_SE_RECT || se.shape == BIT2_SE_CROSS);
+        assert(se.height >= 1 && se.height <= BIT2_MORPH_MAX);
+        assert(se.width >= 1 && se.width <= BIT2_MORPH_MAX);
+        Bit2_T owned = NULL;
+        if (scratch == NULL) {
+                owned = Bit2_new(bit2->rows, bit2->cols);
+                scratch = owned;
+        }
+        assert(scratch->rows == bit2->rows && scratch->cols == bit2->cols);
+
+        switch (op) {
+        case BIT2_ERODE:
+                morph_once(bit2, 1, se, scratch);
+                break;
+        case BIT2_DILATE:
+                morph_once(bit2, 0, se, scratch);
+                break;
+        case BIT2_OPEN:
+                morph_once(bit2, 1, se, scratch);
+                morph_once(bit2, 0, se, scratch);
+                break;
+        case BIT2_CLOSE:
+                morph_once(bit2, 0, se, scratch);
+                morph_once(bit2, 1, se, scratch);
+                break;
+        default:
+                assert(0);
+        }
+        if (owned != NULL) {
+                Bit2_free(&owned);
+        }
+}
+
+/*
+*  name:        morph_once
+*  purpose:     Erodes or dilates a bitmap in place by one element.
+*  arguments:   The bitmap, 1 to erode or 0 to dilate, the element and the
+*               scratch bitmap.
+*  return type: None.
+*  effect:      A rectangle is separable: the row pass goes into scratch
+*               and the column pass brings it back. A cross is the union
+*               of its two arms, so the column pass of the original goes
+*               into scratch and the row pass folds it in while writing
+*               each row back. Erosion by B looks at x + b for every b in
+*               B and dilation at x - b, which keeps an opening idempotent
+*               when the element is not symmetric.
+*  expects:     As Bit2_morph.
+*/
+static void morph_once(Bit2_T bit2, int erode, Bit2_se se, Bit2_T scratch)
+{
+        /* offsets of the element from its origin, flipped for dilation */
+        int up = se.height / 2, down = se.height - 1 - up;
+        int left = se.width / 2, right = se.width - 1 - left;
+        int row_lo = erode ? -up : -down, row_hi = erode ? down : up;
+        int col_lo = erode ? -left : -right, col_hi = erode ? right : left;
+
+        if (se.shape == BIT2_SE_CROSS) {
+                morph_cols(bit2, scratch, row_lo, row_hi, erode);
+                morph_rows(bit2, bit2, col_lo, col_hi, erode, scratch);
+        } else if (se.height == 1) {
+                morph_rows(bit2, bit2, col_lo, col_hi, erode, NULL);
+        } else {
+                morph_rows(bit2, scratch, col_lo, col_hi, erode, NULL);
+                morph_cols(scratch, bit2, row_lo, row_hi, erode);
+        }
+}
+
+/*
+*  name:        morph_rows
+*  purpose:     Erodes or dilates every row of a bitmap along the row.
+*  arguments:   The source and destination (which may be the same bitmap),
+*               the smallest and largest column offset to look at, 1 to
+*               erode or 0 to dilate, and an optional mask bitmap.
+*  return type: None.
+*  effect:      Bit c of a destination row is the AND (erode) or OR
+*               (dilate) of source bits c + lo..c + hi of the same row.
+*               The row is copied between two guard words, and it and the
+*               bits past its end are set to 1 when eroding, so each output
+*               word is one shifted pair of words per offset. When mask is
+*               given, the output row is then ANDed (erode) or ORed
+*               (dilate) with the mask's row.
+*  expects:     -64 < lo <= 0 <= hi < 64 and all bitmaps are the same
+*               size. Each row is read before it is written.
+*/
+static void morph_rows(Bit2_T src, Bit2_T dst, int lo, int hi, int erode,
+                       Bit2_T mask)
+{
+        int n = (src->cols + 63) / 64;
+        uint64_t guard = erode ? ~(uint64_t)0 : 0;
+        Bit2_op op = erode ? BIT2_AND : BIT2_OR;
+        uint64_t *buf = malloc((3 * (size_t)n + 2) * sizeof(uint64_t));
+        assert(buf != NULL);
+        uint64_t *out = buf + n + 2;
+        uint64_t *spare = out + n;
+        const Kernels *k = get_kernels();
+
+        for (int r = 0; r < src->rows; r++) {
+                Bit2_read_span(src, r, 0, src->cols, buf + 1);
+                buf[0] = guard;
+                buf[n + 1] = guard;
+                buf[n] |= guard & ~low_mask(src->cols - 64 * (n - 1));
+                for (int i = 1; i <= n; i++) {
+                        uint64_t acc = guard;
+                        for (int d = lo; d <= hi; d++) {
+                                uint64_t w = buf[i];
+                                if (d > 0) {
+                                        w = (w >> d) | (buf[i + 1]
+                                                        << (64 - d));
+                                } else if (d < 0) {
+                                        w = (w << -d) | (buf[i - 1]
+                                                         >> (64 + d));
+                                }
+                                acc = erode ? acc & w : acc | w;
+                        }
+                        out[i - 1] = acc;
+                }
+                if (mask != NULL) {
+                        k->combine(out, row_image(mask, r, spare), n, op);
+                }
+                Bit2_write_span(dst, r, 0, dst->cols, out);
+        }
+        free(buf);
+}
+
+/*
+*  name:        morph_cols
+*  purpose:     Erodes or dilates a bitmap down its columns.
+*  arguments:   The source and a different destination, the smallest and
+*               largest row offset to look at and 1 to erode or 0 to
+*               dilate.
+*  return type: None.
+*  effect:      Row r of the destination is the AND (erode) or OR
+*               (dilate) of source rows r + lo..r + hi that exist, one
+*               whole-row kernel call per row. Rows past the edges are
+*               left out, which is the same as counting them as 1 when
+*               eroding and 0 when dilating.
+*  expects:     lo <= 0 <= hi, src and dst are the same size and share no
+*               bits.
+*/
+static void morph_cols(Bit2_T src, Bit2_T dst, int lo, int hi, int erode)
+{
+        int n = (src->cols + 63) / 64;
+        Bit2_op op = erode ? BIT2_AND : BIT2_OR;
+        uint64_t *acc = malloc(2 * (size_t)n * sizeof(uint64_t));
+        assert(acc != NULL);
+        uint64_t *spare = acc + n;
+        const Kernels *k = get_kernels();
+
+        for (int r = 0; r < src->rows; r++) {
+                memcpy(acc, row_image(src, r, spare),
+                       n * sizeof(uint64_t));
+                for (int d = lo; d <= hi; d++) {
+                        int from = r + d;
+                        if (d != 0 && from >= 0 && from < src->rows) {
+                                k->combine(acc, row_image(src, from, spare),
+                                           n, op);
+                        }
+                }
+                Bit2_write_span(dst, r, 0, dst->cols, acc);
+        }
+        free(acc);
+}
+
+/*
+*  name:        row_image
+*  purpose:     Gets a whole row of a bitmap as row-major words.
+*  arguments:   A Bit2_T, a row and a buffer of enough words for the row.
+*  return type: The row's own words for a row-major bitmap that is not a
+*               view, otherwise buf holding a copy.
+*  effect:      Copies the row into buf when it has to.
+*  expects:     The row is in bounds. The result is only read.
+*/
+static const uint64_t *row_image(Bit2_T bit2, int row, uint64_t *buf)
+{
+        if (bit2->layout == BIT2_ROW_MAJOR && bit2->root == NULL) {
+                return Bit2_row(bit2, row);
+        }
+        Bit2_read_span(bit2, row, 0, bit2->cols, buf);
+        return buf;
+}
+
+/*
+*  name:        Bit2_kernels
+*  purpose:     Tells which word kernels the bulk operations use.
+*  arguments:   None.
+*  return type: "avx2", "sse2" or "portable".
+*  effect:      Picks the kernels if that has not happened yet.
+*  expects:     None.
+*/
+const char *Bit2_kernels(void)
+{
+        return get_kernels()->name;
+}
+
+/*
+*  name:        get_bit
+*  purpose:     Reads one bit in either layout.
+*  arguments:   A Bit2_T, a row index and a column index.
+*  return type: The bit (0 or 1).
+*  effect:      None.
+*  expects:     The index is in bounds.
+*/
+static int get_bit(Bit2_T bit2, int row, int col)
+{
+        row += bit2->row_off;
+        col += bit2->col_off;
+        if (bit2->layout == BIT2_TILED) {
+                return (int)((bit2->words[tile_index(bit2, row, col)]
+                              >> tile_bit(row, col)) & 1);
+        }
+        return Bit2_word_get(bit2->words + (size_t)row * bit2->row_words,
+                             col);
+}
+
+/*
+*  name:        put_bit
+*  purpose:     Writes one bit in either layout.
+*  arguments:   A Bit2_T, a row index, a column index and the bit.
+*  return type: None.
+*  effect:      Sets or clears the bit.
+*  expects:     The index is in bounds.
+*/
+static void put_bit(Bit2_T bit2, int row, int col, int bit)
+{
+        row += bit2->row_off;
+        col += bit2->col_off;
+        if (bit2->layout == BIT2_TILED) {
+                uint64_t mask = (uint64_t)1 << tile_bit(row, col);
+                uint64_t *word = &bit2->words[tile_index(bit2, row, col)];
+                if (bit) {
+                        *word |= mask;
+                } else {
+                        *word &= ~mask;
+                }
+                return;
+        }
+        Bit2_word_put(bit2->words + (size_t)row * bit2->row_words, col, bit);
+}
+
+/*
+*  name:        atomic_bit
+*  purpose:     Finds the word and mask of one bit for an atomic update.
+*  arguments:   A Bit2_T, an in-bounds row and column and where to store
+*               the mask.
+*  return type: The word holding the bit, seen as an atomic.
+*  effect:      Stores the bit's mask.
+*  expects:     The index is in bounds.
+*/
+static _Atomic uint64_t *atomic_bit(Bit2_T bit2, int row, int col,
+                                    uint64_t *mask)
+{
+        size_t index;
+        row += bit2->row_off;
+        col += bit2->col_off;
+        if (bit2->layout == BIT2_TILED) {
+                index = tile_index(bit2, row, col);
+                *mask = (uint64_t)1 << tile_bit(row, col);
+        } else {
+                index = (size_t)row * bit2->row_words + (col >> 6);
+                *mask = (uint64_t)1 << (col & 63);
+        }
+        return (_Atomic uint64_t *)&bit2->words[index];
+}
+
+/*
+*  name:        atomic_word
+*  purpose:     Finds one word of a row for an atomic update.
+*  arguments:   A Bit2_T, a row index and a word index within the row.
+*  return type: The word, seen as an atomic.
+*  effect:      None.
+*  expects:     The bitmap is not NULL and uses BIT2_ROW_MAJOR, and row and
+*               word are in bounds.
+*/
+static _Atomic uint64_t *atomic_word(Bit2_T bit2, int row, int word)
+{
+        assert(bit2 != NULL && bit2->layout == BIT2_ROW_MAJOR);
+        assert(bit2->root == NULL);
+        assert(row >= 0 && row < bit2->rows);
+        assert(word >= 0 && word < bit2->row_words);
+        return (_Atomic uint64_t *)&bit2->words[(size_t)row
+                                                * bit2->row_words + word];
+}
+
+/*
+*  name:        next_change
+*  purpose:     Finds where a run of equal bits ends.
+*  arguments:   The words of a row, the column to stop at, the column the
+*               run starts at and its bit.
+*  return type: The first column at or after pos whose bit differs from
+*               value, or end if there is none before it.
+*  effect:      None. Inverts the words when looking for a 0 so both cases
+*               are a count-trailing-zeros.
+*  expects:     pos < end and bit pos of words is value.
+*/
+static int next_change(const uint64_t *words, int end, int pos, int value)
+{
+        uint64_t flip = value ? ~(uint64_t)0 : 0;
+        int w = pos >> 6;
+        int last = (end - 1) >> 6;
+        uint64_t diff = (words[w] ^ flip) & (~(uint64_t)0 << (pos & 63));
+        while (diff == 0) {
+                if (++w > last) {
+                        return end;
+                }
+                diff = words[w] ^ flip;
+        }
+        int found = 64 * w + __builtin_ctzll(diff);
+        return found < end ? found : end;
+}
+
+/*
+*  name:        gather_row
+*  purpose:     Copies a row of a tiled bitmap out as row-major words.
+*  arguments:   A BIT2_TILED Bit2_T, a row and row_words destination words.
+*  return type: None.
+*  effect:      Each tile holds 8 bits of the row in one byte, so the row
+*               is put together a byte at a time. The padding stays 0.
+*  expects:     The row is in bounds.
+*/
+static void gather_row(Bit2_T bit2, int row, uint64_t *dst)
+{
+        const uint64_t *tiles = bit2->words + tile_index(bit2, row, 0);
+        int shift = tile_bit(row, 0);
+        memset(dst, 0, bit2->row_words * sizeof(uint64_t));
+        for (int t = 0; t < bit2->tile_cols; t++) {
+                dst[t >> 3] |= ((tiles[t] >> shift) & 0xff) << (8 * (t & 7));
+        }
+}
+
+/*
+*  name:        word_count
+*  purpose:     Tells how many words a bitmap's image is stored in.
+*  arguments:   A Bit2_T.
+*  return type: The number of words in use (not the capacity).
+*  effect:      None.
+*  expects:     bit2 is not NULL.
+*/
+static size_t word_count(Bit2_T bit2)
+{
+        if (bit2->layout == BIT2_TILED) {
+                return ((size_t)bit2->rows + 7) / 8 * bit2->tile_cols;
+        }
+        return (size_t)bit2->rows * bit2->row_words;
+}
+
+/*
+*  name:        check_rect
+*  purpose:     Asserts that a rectangle is non-empty and inside a bitmap.
+*  arguments:   A Bit2_T, and the top row, left column, height and width.
+*  return type: None.
+*  effect:      None.
+*  expects:     bit2 is not NULL.
+*/
+static void check_rect(Bit2_T bit2, int row, int col, int height, int width)
+{
+        assert(height > 0 && width > 0);
+        assert(row >= 0 && row <= bit2->rows - height);
+        assert(col >= 0 && col <= bit2->cols - width);
+}
+
+/*
+*  name:        clear_padding
+*  purpose:     Zeroes the bits that lie outside the image.
+*  arguments:   A Bit2_T.
+*  return type: None.
+*  effect:      For row-major, the bits past the last column of every row.
+*               For tiled, the columns and rows of the last tiles that are
+*               past the edge of the image.
+*  expects:     bit2 is not NULL.
+*/
+static void clear_padding(Bit2_T bit2)
+{
+        if (bit2->layout == BIT2_ROW_MAJOR) {
+                if (bit2->cols % 64 == 0) {
+                        return;
+                }
+                uint64_t keep = low_mask(bit2->cols % 64);
+                for (int r = 0; r < bit2->rows; r++) {
+                        Bit2_row(bit2, r)[bit2->row_words - 1] &= keep;
+                }
+                return;
+        }
+
+        int tile_rows = (bit2->rows + 7) / 8;
+        if (bit2->cols % 8 != 0) { /* same columns in all 8 tile rows */
+                uint64_t keep = low_mask(bit2->cols % 8)
+                                * 0x0101010101010101ull;
+                for (int t = 0; t < tile_rows; t++) {
+                        bit2->words[(size_t)t * bit2->tile_cols
+                                    + bit2->tile_cols - 1] &= keep;
+                }
+        }
+        if (bit2->rows % 8 != 0) {
+                uint64_t keep = low_mask(8 * (bit2->rows % 8));
+                uint64_t *last = bit2->words
+                                 + (size_t)(tile_rows - 1) * bit2->tile_cols;
+                for (int t = 0; t < bit2->tile_cols; t++) {
+                        last[t] &= keep;
+                }
+        }
+}
+
+/*
+*  name:        combine_word
+*  purpose:     Applies a bulk operation to one word.
+*  arguments:   The destination word, the source word and the operation.
+*  return type: The new destination word.
+*  effect:      None.
+*  expects:     op is a Bit2_op.
+*/
+static uint64_t combine_word(uint64_t dst, uint64_t src, Bit2_op op)
+{
+        switch (op) {
+        case BIT2_AND:
+                return dst & src;
+        case BIT2_OR:
+                return dst | src;
+        case BIT2_XOR:
+                return dst ^ src;
+        case BIT2_ANDNOT:
+                return dst & ~src;
+        default:
+                return ~src;
+        }
+}
+
+/*
+*  name:        combine_portable
+*  purpose:     Combines n words in plain C.
+*  arguments:   The destination and source words, the count and the op.
+*  return type: None.
+*  effect:      dst[i] = dst[i] op src[i] for every i.
+*  expects:     Both arrays hold n words.
+*/
+static void combine_portable(uint64_t *dst, const uint64_t *src, size_t n,
+                             Bit2_op op)
+{
+        for (size_t i = 0; i < n; i++) {
+                dst[i] = combine_word(dst[i], src[i], op);
+        }
+}
+
+/*
+*  name:        count_portable
+*  purpose:     Counts the 1 bits of n words in plain C.
+*  arguments:   The words and the count.
+*  return type: The number of 1 bits.
+*  effect:      None. Each word is counted with the usual add-in-place
+*               bit tricks, 2 then 4 then 8 bits at a time.
+*  expects:     words holds n words.
+*/
+static uint64_t count_portable(const uint64_t *words, size_t n)
+{
+        uint64_t total = 0;
+        for (size_t i = 0; i < n; i++) {
+                uint64_t x = words[i];
+                x = x - ((x >> 1) & 0x5555555555555555ull);
+                x = (x & 0x3333333333333333ull)
+                    + ((x >> 2) & 0x3333333333333333ull);
+                x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+                total += (x * 0x0101010101010101ull) >> 56;
+        }
+        return total;
+}
+
+#ifdef BIT2_X86
+
+/*
+*  name:        combine_sse2
+*  purpose:     Combines n words, two at a time with SSE2.
+*  arguments:   The destination and source words, the count and the op.
+*  return type: None.
+*  effect:      Same as combine_portable.
+*  expects:     Both arrays hold n words.
+*/
+__attribute__((target("sse2")))
+static void combine_sse2(uint64_t *dst, const uint64_t *src, size_t n,
+                         Bit2_op op)
+{
+        const __m128i ones = _mm_set1_epi32(-1);
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+                __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+                __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+                switch (op) {
+                case BIT2_AND:
+                        d = _mm_and_si128(d, s);
+                        break;
+                case BIT2_OR:
+                        d = _mm_or_si128(d, s);
+                        break;
+                case BIT2_XOR:
+                        d = _mm_xor_si128(d, s);
+                        break;
+                case BIT2_ANDNOT:
+                        d = _mm_andnot_si128(s, d);
+                        break;
+                default:
+                        d = _mm_xor_si128(s, ones);
+                        break;
+                }
+                _mm_storeu_si128((__m128i *)(dst + i), d);
+        }
+        combine_portable(dst + i, src + i, n - i, op);
+}
+
+/*
+*  name:        count_popcnt
+*  purpose:     Counts the 1 bits of n words with the POPCNT instruction.
+*  arguments:   The words and the count.
+*  return type: The number of 1 bits.
+*  effect:      None.
+*  expects:     words holds n words.
+*/
+__attribute__((target("popcnt")))
+static uint64_t count_popcnt(const uint64_t *words, size_t n)
+{
+        uint64_t total = 0;
+        for (size_t i = 0; i < n; i++) {
+                total += _mm_popcnt_u64(words[i]);
+        }
+        return total;
+}
+
+/*
+*  name:        combine_avx2
+*  purpose:     Combines n words, four at a time with AVX2.
+*  arguments:   The destination and source words, the count and the op.
+*  return type: None.
+*  effect:      Same as combine_portable.
+*  expects:     Both arrays hold n words.
+*/
+__attribute__((target("avx2")))
+static void combine_avx2(uint64_t *dst, const uint64_t *src, size_t n,
+                         Bit2_op op)
+{
+        const __m256i ones = _mm256_set1_epi32(-1);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+                __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+                switch (op) {
+                case BIT2_AND:
+                        d = _mm256_and_si256(d, s);
+                        break;
+                case BIT2_OR:
+                        d = _mm256_or_si256(d, s);
+                        break;
+                case BIT2_XOR:
+                        d = _mm256_xor_si256(d, s);
+                        break;
+                case BIT2_ANDNOT:
+                        d = _mm256_andnot_si256(s, d);
+                        break;
+                default:
+                        d = _mm256_xor_si256(s, ones);
+                        break;
+                }
+                _mm256_storeu_si256((__m256i *)(dst + i), d);
+        }
+        combine_portable(dst + i, src + i, n - i, op);
+}
+
+/*
+*  name:        count_avx2
+*  purpose:     Counts the 1 bits of n words, four at a time with AVX2.
+*  arguments:   The words and the count.
+*  return type: The number of 1 bits.
+*  effect:      None. Each byte's count is looked up a nibble at a time
+*               with a byte shuffle, and the byte counts are summed into
+*               four 64-bit lanes with a sum of absolute differences.
+*  expects:     words holds n words.
+*/
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_avx2(const uint64_t *words, size_t n)
+{
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                               1, 2, 2, 3, 2, 3, 3, 4,
+                                               0, 1, 1, 2, 1, 2, 2, 3,
+                                               1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i sums = zero;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(words + i));
+                __m256i lo = _mm256_and_si256(v, nibble);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4),
+                                              nibble);
+                __m256i bytes = _mm256_add_epi8(
+                        _mm256_shuffle_epi8(table, lo),
+                        _mm256_shuffle_epi8(table, hi));
+                sums = _mm256_add_epi64(sums, _mm256_sad_epu8(bytes, zero));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, sums);
+        uint64_t total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        for (; i < n; i++) {
+                total += _mm_popcnt_u64(words[i]);
+        }
+        return total;
+}
+
+#endif /* BIT2_X86 */
+
+/*
+*  name:        get_kernels
+*  purpose:     Returns the word kernels for this CPU.
+*  arguments:   None.
+*  return type: Pointer to the chosen Kernels.
+*  effect:      Picks them on the first call from any thread; pthread_once
+*               makes concurrent first calls safe.
+*  expects:     None.
+*/
+static const Kernels *get_kernels(void)
+{
+        pthread_once(&kernels_once, pick_kernels);
+        return kernels;
+}
+
+/*
+*  name:        pick_kernels
+*  purpose:     Chooses the fastest kernels the CPU can run.
+*  arguments:   None.
+*  return type: None.
+*  effect:      Sets kernels to AVX2, else SSE2 with POPCNT, else portable.
+*  expects:     Only called through get_kernels.
+*/
+static void pick_kernels(void)
+{
+        static const Kernels portable = { "portable", combine_portable,
+                                          count_portable };
+        kernels = &portable;
+#ifdef BIT2_X86
+        static const Kernels sse2 = { "sse2", combine_sse2, count_popcnt };
+        static const Kernels avx2 = { "avx2", combine_avx2, count_avx2 };
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("popcnt")) {
+                kernels = &avx2;
+        } else if (__builtin_cpu_supports("popcnt")) {
+                kernels = &sse2;
+        }
+#endif
+}
+
+/*
+*  name:        load_block
+*  purpose:     Copies one 64x64 block of a row-major bitmap.
+*  arguments:   The bitmap, the block's row and column (in blocks) and a
+*               64-word buffer.
+*  return type: None.
+*  effect:      block[i] is word block_col of row 64 * block_row + i, or 0
+*               for rows past the bottom of the bitmap.
+*  expects:     The block is inside the bitmap.
+*/
+static void load_block(Bit2_T bit2, int block_row, int block_col,
+                       uint64_t block[64])
+{
+        int first = 64 * block_row;
+        for (int i = 0; i < 64; i++) {
+                block[i] = first + i < bit2->rows ?
+                           Bit2_row(bit2, first + i)[block_col] : 0;
+        }
+}
+
+/*
+*  name:        store_block
+*  purpose:     The inverse of load_block.
+*  arguments:   The bitmap, the block's row and column (in blocks) and the
+*               64 words to store.
+*  return type: None.
+*  effect:      Overwrites word block_col of each row in the block; words
+*               for rows past the bottom are dropped.
+*  expects:     The words hold no bits past the last column.
+*/
+static void store_block(Bit2_T bit2, int block_row, int block_col,
+                        const uint64_t block[64])
+{
+        int first = 64 * block_row;
+        for (int i = 0; i < 64 && first + i < bit2->rows; i++) {
+                Bit2_row(bit2, first + i)[block_col] = block[i];
+        }
+}
+
+/*
+*  name:        transpose64
+*  purpose:     Transposes a 64x64 bit matrix held as 64 words, bit j of
+*               word i being entry (i, j).
+*  arguments:   The 64 words.
+*  return type: None.
+*  effect:      Swaps the top-right and bottom-left 32x32 quarters, then
+*               does the same inside every quarter with 16x16 pieces, and
+*               so on down to single bits: 6 rounds of 32 word pairs.
+*  expects:     block is not NULL.
+*/
+static void transpose64(uint64_t block[64])
+{
+        uint64_t mask = 0x00000000ffffffffull;
+        for (int j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+                for (int k = 0; k < 64; k = (k + j + 1) & ~j) {
+                        uint64_t t = ((block[k] >> j) ^ block[k + j]) & mask;
+                        block[k] ^= t << j;
+                        block[k + j] ^= t;
+                }
+        }
+}
+
+/*
+*  name:        transpose8
+*  purpose:     Transposes one 8x8 tile, bit 8 * r + c being entry (r, c).
+*  arguments:   The tile.
+*  return type: The transposed tile.
+*  effect:      None. Swaps 1x1, then 2x2, then 4x4 pieces across the
+*               diagonal with three shift-and-mask steps.
+*  expects:     None.
+*/
+static uint64_t transpose8(uint64_t tile)
+{
+        uint64_t t;
+        t = (tile ^ (tile >> 7)) & 0x00aa00aa00aa00aaull;
+        tile ^= t ^ (t << 7);
+        t = (tile ^ (tile >> 14)) & 0x0000cccc0000ccccull;
+        tile ^= t ^ (t << 14);
+        t = (tile ^ (tile >> 28)) & 0x00000000f0f0f0f0ull;
+        tile ^= t ^ (t << 28);
+        return tile;
 }
@@ -1,27 +1,137 @@
 /*
  *     bit2.h
- *     Darius-Stefan Iavorschi, Evren Uluer, 
+ *     Darius-Stefan Iavorschi, Evren Uluer,
  *     1/28/25
  *     bit2
  *
  *     This file holds the interface for a bit map
+ *
+ *     Every row is stored as its own run of packed 64-bit words. Column c
+ *     of a row lives in word c / 64 at bit position c % 64 (least
+ *     significant bit first). Bits past the last column of a row are
+ *     always zero; clients writing through Bit2_row must keep them so.
+ *
+ *     Bit2_new_layout can instead store the bits in 8x8 tiles, one tile
+ *     per word, which suits column-major and 2D-local access. Everything
+ *     but the word-level row access below works on both layouts.
+ *
+ *     Bit2_view makes a bitmap that looks into a rectangle of another
+ *     one without copying it; the rectangle may start at any column.
+ *     Every call but the word-level row access and Bit2_resize takes a
+ *     view, and freeing a view leaves the bits it looked at alone.
  */
 
 #ifndef BIT2_INCLUDED
 #define BIT2_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct Bit2_T *Bit2_T;
 
+typedef enum { BIT2_ROW_MAJOR, BIT2_TILED } Bit2_layout;
+
+/* dst = dst AND src, dst OR src, dst XOR src, dst AND NOT src, NOT src */
+typedef enum { BIT2_AND, BIT2_OR, BIT2_XOR, BIT2_ANDNOT, BIT2_NOT } Bit2_op;
+
+/* binary morphology; a structuring element is a filled rectangle or a
+ * cross of one row and one column, at most BIT2_MORPH_MAX on a side */
+typedef enum {
+        BIT2_ERODE, BIT2_DILATE, BIT2_OPEN, BIT2_CLOSE
+} Bit2_morph_op;
+typedef enum { BIT2_SE_RECT, BIT2_SE_CROSS } Bit2_se_shape;
+typedef struct {
+        Bit2_se_shape shape;
+        int height, width;
+} Bit2_se;
+
+#define BIT2_MORPH_MAX 64
+#define BIT2_SE_SQUARE3 ((Bit2_se){ BIT2_SE_RECT, 3, 3 })
+#define BIT2_SE_CROSS3  ((Bit2_se){ BIT2_SE_CROSS, 3, 3 })
+
 extern Bit2_T Bit2_new(int rows, int cols);
+extern Bit2_T Bit2_new_layout(int rows, int cols, Bit2_layout layout);
+extern Bit2_T Bit2_view(Bit2_T parent, int row, int col, int height,
+                        int width);
 extern int Bit2_put(Bit2_T bit2, int row, int col, int bit);
 extern int Bit2_get(Bit2_T bit2, int row, int col);
 extern void Bit2_free(Bit2_T *bit2);
+extern void Bit2_resize(Bit2_T bit2, int rows, int cols);
 extern int Bit2_width(Bit2_T bit2);
 extern int Bit2_height(Bit2_T bit2);
 extern void Bit2_map_row_major(Bit2_T bit2, void apply(
             int row, int col, Bit2_T bit2, int value, void *cl), void *cl);
 extern void Bit2_map_col_major(Bit2_T bit2, void apply(
             int row, int col, Bit2_T bit2, int value, void *cl), void *cl);
+/* Column-major too, but each value comes from a copy of its 64-column
+ * strip made before the strip's first column is visited, so apply does
+ * not see its own changes to later columns of the strip. On row-major
+ * bitmaps it beats Bit2_map_col_major from about 32x32 up (benchcolmap). */
+extern void Bit2_map_col_major_strips(Bit2_T bit2, void apply(
+            int row, int col, Bit2_T bit2, int value, void *cl), void *cl);
+extern void Bit2_map_row_major_parallel(Bit2_T bit2, void apply(
+            int row, int col, Bit2_T bit2, int value, void *cl), void *cl,
+            size_t cl_size, void reduce(void *cl, const void *part),
+            int threads);
+extern void Bit2_map_runs(Bit2_T bit2, void apply(
+            int row, int col, int len, int value, void *cl), void *cl);
+extern void Bit2_map_runs_rect(Bit2_T bit2, void apply(
+            int row, int col, int len, int value, void *cl), void *cl,
+            int row, int col, int height, int width);
 int valid_index(Bit2_T bit2, int row, int col);
 
+/* bulk operations on whole bitmaps or on a rectangle (row, col, height,
+ * width) at the same place in both */
+extern void Bit2_combine(Bit2_T dst, Bit2_T src, Bit2_op op);
+extern void Bit2_combine_rect(Bit2_T dst, Bit2_T src, Bit2_op op, int row,
+                              int col, int height, int width);
+extern void Bit2_fill(Bit2_T bit2, int bit);
+extern void Bit2_fill_rect(Bit2_T bit2, int bit, int row, int col,
+                           int height, int width);
+extern uint64_t Bit2_count(Bit2_T bit2);
+extern uint64_t Bit2_count_rect(Bit2_T bit2, int row, int col, int height,
+                                int width);
+extern uint64_t Bit2_hash(Bit2_T bit2, uint64_t seed);
+extern const char *Bit2_kernels(void);
+
+extern Bit2_T Bit2_transpose(Bit2_T bit2);
+extern void Bit2_transpose_square(Bit2_T bit2);
+extern void Bit2_morph(Bit2_T bit2, Bit2_morph_op op, Bit2_se se,
+                       Bit2_T scratch);
+
+/* word-level row access; Bit2_row and Bit2_row_words need BIT2_ROW_MAJOR
+ * and a bitmap that is not a view */
+extern int Bit2_row_words(Bit2_T bit2);
+extern uint64_t *Bit2_row(Bit2_T bit2, int row);
+extern void Bit2_read_span(Bit2_T bit2, int row, int col, int len,
+                           uint64_t *dst);
+extern void Bit2_write_span(Bit2_T bit2, int row, int col, int len,
+                            const uint64_t *src);
+
+/* atomic updates for several threads writing one bitmap; the word
+ * calls need BIT2_ROW_MAJOR and a bitmap that is not a view */
+extern int Bit2_test_and_set(Bit2_T bit2, int row, int col);
+extern int Bit2_test_and_clear(Bit2_T bit2, int row, int col);
+extern uint64_t Bit2_fetch_or_word(Bit2_T bit2, int row, int word,
+                                   uint64_t mask);
+extern uint64_t Bit2_fetch_and_word(Bit2_T bit2, int row, int word,
+                                    uint64_t mask);
+extern uint64_t Bit2_load_word(Bit2_T bit2, int row, int word);
+
+/* unchecked accessors on a row returned by Bit2_row */
+static inline int Bit2_word_get(const uint64_t *words, int col)
+{
+        return (int)((words[col >> 6] >> (col & 63)) & 1);
+}
+
+static inline void Bit2_word_put(uint64_t *words, int col, int bit)
+{
+        uint64_t mask = (uint64_t)1 << (col & 63);
+        if (bit) {
+                words[col >> 6] |= mask;
+        } else {
+                words[col >> 6] &= ~mask;
+        }
+}
+
 #endif
@@ -0,0 +1,480 @@
+/*
+ *     bitlabel.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     bitlabel
+ *
+ *     This program labels the connected components of a bitmap in two
+ *     passes over its runs rather than its pixels, in the manner of the
+ *     scan-plus-union-find labelers (SAUF).
+ *
+ *     The first pass takes the runs of 1 bits from Bit2_map_runs, which
+ *     finds them a word at a time. A run that touches a run of the row
+ *     above (sharing a column, or a corner when 8-connected) joins that
+ *     run's provisional label, and a run touching several of them merges
+ *     their labels in a union-find forest. Each provisional label keeps
+ *     its own area, bounding box and coordinate sums, and a merge adds
+ *     the loser's into the winner's, so the statistics are done when the
+ *     first pass is. The second pass only walks the labels: every root
+ *     gets the next final number, which is raster order since a root is
+ *     always the oldest label in its set. Runs are kept only when the
+ *     caller wants a label plane or border blobs cleared; otherwise just
+ *     two rows of them are held at a time.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "assert.h"
+#include "bit2.h"
+#include "uarray2.h"
+#include "bitlabel.h"
+
+#define START_RUNS 256  /* runs allocated at first */
+#define START_IDS  64   /* provisional labels allocated at first */
+
+/* One run of 1 bits and the provisional label it was given */
+typedef struct {
+        int row, first, last;
+        int id;
+} Run;
+
+/* What a provisional label has gathered so far */
+typedef struct {
+        uint64_t area;
+        int64_t row_sum, col_sum;
+        int top, left, bottom, right;
+} Acc;
+
+/* The state of the first pass, handed to Bit2_map_runs as its closure */
+typedef struct {
+        Run *runs;
+        int count, capacity;
+        int keep;                 /* keep every run, not just two rows */
+        int reach;                /* 0 when 4-connected, 1 when 8 */
+        int row;                  /* row being scanned, -1 before any */
+        int prev_first, prev_end; /* runs of the row above */
+        int cur_first;            /* where this row's runs start */
+        int scan;                 /* first run above that may still touch */
+        int *parent;              /* union-find forest of labels */
+        Acc *acc;
+        int ids, id_capacity;
+        size_t peak_bytes;
+} Pass;
+
+/* This struct holds the blobs of a bitmap and, optionally, its labels */
+struct Bitlabel_T {
+        int rows, cols;
+        int count;
+        Bitlabel_blob *blobs;
+        UArray2_T plane;          /* NULL unless BITLABEL_PLANE */
+        size_t bytes;
+};
+
+static void add_run(int row, int col, int len, int value, void *cl);
+static void next_row(Pass *pass, int row);
+static int  new_id(Pass *pass, int row);
+static int  find(int *parent, int id);
+static int  unite(Pass *pass, int a, int b);
+static void note_bytes(Pass *pass);
+static int *resolve(Pass *pass, Bitlabel_T labels, int clear_border);
+
+/*
+*  name:        Bitlabel_new
+*  purpose:     Labels the connected components of the 1 bits of a bitmap
+*               and measures each one.
+*  arguments:   The bitmap, 4 or 8 for the connectivity, and flags:
+*               BITLABEL_PLANE to keep a label for every pixel, and
+*               BITLABEL_CLEAR_BORDER to clear every blob that touches an
+*               edge of the bitmap and leave it out of the result.
+*  return type: A new Bitlabel_T the caller must free with Bitlabel_free.
+*  effect:      Two passes over the runs, as described above. With
+*               BITLABEL_CLEAR_BORDER and connectivity 4 the bitmap ends up
+*               as unblackedges() leaves it, and the blobs are exactly the
+*               ones that survive.
+*  expects:     The bitmap is not NULL and connectivity is 4 or 8.
+*/
+Bitlabel_T Bitlabel_new(Bit2_T bit2, int connectivity, int flags)
+{
+        assert(bit2 != NULL);
+        assert(connectivity == 4 || connectivity == 8);
+        int clear_border = (flags & BITLABEL_CLEAR_BORDER) != 0;
+        Pass pass;
+        pass.capacity = START_RUNS;
+        pass.runs = malloc(pass.capacity * sizeof(Run));
+        pass.id_capacity = START_IDS;
+        pass.parent = malloc(pass.id_capacity * sizeof(int));
+        pass.acc = malloc(pass.id_capacity * sizeof(Acc));
+        assert(pass.runs != NULL && pass.parent != NULL && pass.acc != NULL);
+        pass.count = 0;
+        pass.keep = (flags & (BITLABEL_PLANE | BITLABEL_CLEAR_BORDER)) != 0;
+        pass.reach = connectivity == 8;
+        pass.row = -1;
+        pass.prev_first = pass.prev_end = pass.cur_first = pass.scan = 0;
+        pass.ids = 0;
+        pass.peak_bytes = 0;
+        note_bytes(&pass);
+        Bit2_map_runs(bit2, add_run, &pass);
+
+        Bitlabel_T labels = malloc(sizeof(*labels));
+        assert(labels != NULL);
+        labels->rows = Bit2_height(bit2);
+        labels->cols = Bit2_width(bit2);
+        labels->plane = NULL;
+        labels->bytes = pass.peak_bytes;
+        int *final = resolve(&pass, labels, clear_border);
+
+        if (flags & BITLABEL_PLANE) {
+                labels->plane = UArray2_new(labels->cols, labels->rows,
+                                            sizeof(int)); /* all 0 */
+        }
+        for (int i = 0; pass.keep && i < pass.count; i++) {
+                const Run *run = &pass.runs[i];
+                int label = final[run->id];
+                if (label == 0) {
+                        Bit2_fill_rect(bit2, 0, run->row, run->first, 1,
+                                       run->last - run->first + 1);
+                } else if (labels->plane != NULL) {
+                        for (int c = run->first; c <= run->last; c++) {
+                                *(int *)UArray2_at(labels->plane, c,
+                                                   run->row) = label;
+                        }
+                }
+        }
+
+        free(final);
+        free(pass.runs);
+        free(pass.parent);
+        free(pass.acc);
+        return labels;
+}
+
+/*
+*  name:        Bitlabel_free
+*  purpose:     Frees a Bitlabel_T with its blobs and label plane.
+*  arguments:   A pointer to the Bitlabel_T.
+*  return type: None.
+*  effect:      Frees the memory and sets the pointer to NULL.
+*  expects:     labels and *labels are not NULL.
+*/
+void Bitlabel_free(Bitlabel_T *labels)
+{
+        assert(labels != NULL && *labels != NULL);
+        if ((*labels)->plane != NULL) {
+                UArray2_free(&(*labels)->plane);
+        }
+        free((*labels)->blobs);
+        free(*labels);
+        *labels = NULL;
+}
+
+/*
+*  name:        Bitlabel_count
+*  purpose:     Tells how many blobs were found.
+*  arguments:   A Bitlabel_T.
+*  return type: The number of blobs; their labels are 1 to the count.
+*  effect:      None.
+*  expects:     labels is not NULL.
+*/
+int Bitlabel_count(Bitlabel_T labels)
+{
+        assert(labels != NULL);
+        return labels->count;
+}
+
+/*
+*  name:        Bitlabel_blobs
+*  purpose:     Gives the statistics of every blob.
+*  arguments:   A Bitlabel_T.
+*  return type: An array of Bitlabel_count entries; entry i is the blob
+*               labeled i + 1.
+*  effect:      None. The array belongs to labels.
+*  expects:     labels is not NULL.
+*/
+const Bitlabel_blob *Bitlabel_blobs(Bitlabel_T labels)
+{
+        assert(labels != NULL);
+        return labels->blobs;
+}
+
+/*
+*  name:        Bitlabel_get
+*  purpose:     Gives the label of one pixel.
+*  arguments:   A Bitlabel_T, a row and a column.
+*  return type: The pixel's blob label, or 0 for the background (and for
+*               cleared border blobs).
+*  effect:      None.
+*  expects:     labels was made with BITLABEL_PLANE and the pixel is in
+*               bounds.
+*/
+int Bitlabel_get(Bitlabel_T labels, int row, int col)
+{
+        assert(labels != NULL && labels->plane != NULL);
+        assert(row >= 0 && row < labels->rows);
+        assert(col >= 0 && col < labels->cols);
+        return *(int *)UArray2_at(labels->plane, col, row);
+}
+
+/*
+*  name:        Bitlabel_plane
+*  purpose:     Gives the whole label plane.
+*  arguments:   A Bitlabel_T.
+*  return type: A UArray2_T of ints, width by height of the bitmap, or
+*               NULL if BITLABEL_PLANE was not asked for.
+*  effect:      None. The plane belongs to labels.
+*  expects:     labels is not NULL.
+*/
+UArray2_T Bitlabel_plane(Bitlabel_T labels)
+{
+        assert(labels != NULL);
+        return labels->plane;
+}
+
+/*
+*  name:        Bitlabel_bytes
+*  purpose:     Tells how much scratch memory the labeling needed.
+*  arguments:   A Bitlabel_T.
+*  return type: The most bytes of runs and labels held at one time during
+*               the first pass.
+*  effect:      None.
+*  expects:     labels is not NULL.
+*/
+size_t Bitlabel_bytes(Bitlabel_T labels)
+{
+        assert(labels != NULL);
+        return labels->bytes;
+}
+
+/*
+*  name:        add_run
+*  purpose:     Takes one run from Bit2_map_runs during the first pass.
+*  arguments:   The run's row, first column, length and value, and the
+*               Pass.
+*  return type: None.
+*  effect:      Ignores runs of 0. A run of 1 bits is checked against the
+*               runs above it from the first one that can still touch it:
+*               the first touching run lends it its label and any others
+*               are merged in. With none it gets a new label. The run is
+*               then added to its label's statistics and stored.
+*  expects:     Called by Bit2_map_runs in row-major order.
+*/
+static void add_run(int row, int col, int len, int value, void *cl)
+{
+        Pass *pass = cl;
+        if (value == 0) {
+                return;
+        }
+        if (row != pass->row) {
+                next_row(pass, row);
+        }
+        int first = col;
+        int last = col + len - 1;
+
+        int j = pass->scan;
+        while (j < pass->prev_end && pass->runs[j].last < first - pass->reach) {
+                j++;
+        }
+        pass->scan = j; /* later runs of this row start further right */
+        int id = -1;
+        for (; j < pass->prev_end &&
+               pass->runs[j].first <= last + pass->reach; j++) {
+                int other = pass->runs[j].id;
+                id = id < 0 ? find(pass->parent, other)
+                            : unite(pass, id, other);
+        }
+        if (id < 0) {
+                id = new_id(pass, row);
+        }
+
+        Acc *acc = &pass->acc[id];
+        acc->area += len;
+        acc->row_sum += (int64_t)row * len;
+        acc->col_sum += (int64_t)(first + last) * len / 2;
+        acc->left = first < acc->left ? first : acc->left;
+        acc->right = last > acc->right ? last : acc->right;
+        acc->bottom = row;
+
+        if (pass->count == pass->capacity) {
+                pass->capacity *= 2;
+                pass->runs = realloc(pass->runs,
+                                     pass->capacity * sizeof(Run));
+                assert(pass->runs != NULL);
+                note_bytes(pass);
+        }
+        pass->runs[pass->count++] = (Run){ row, first, last, id };
+}
+
+/*
+*  name:        next_row
+*  purpose:     Moves the first pass on to a new row.
+*  arguments:   The Pass and the row its next run is on.
+*  return type: None.
+*  effect:      The runs of the row just finished become the row above,
+*               unless rows were skipped, in which case there is nothing
+*               above. When not keeping every run, the older ones are
+*               dropped by moving the last row's runs to the front.
+*  expects:     row is greater than pass->row.
+*/
+static void next_row(Pass *pass, int row)
+{
+        if (!pass->keep) {
+                memmove(pass->runs, pass->runs + pass->cur_first,
+                        (pass->count - pass->cur_first) * sizeof(Run));
+                pass->count -= pass->cur_first;
+                pass->cur_first = 0;
+        }
+        if (row == pass->row + 1) {
+                pass->prev_first = pass->cur_first;
+        } else {
+                pass->prev_first = pass->count;
+        }
+        pass->prev_end = pass->count;
+        pass->cur_first = pass->count;
+        pass->scan = pass->prev_first;
+        pass->row = row;
+}
+
+/*
+*  name:        new_id
+*  purpose:     Makes a new provisional label.
+*  arguments:   The Pass and the row of the run that needs it.
+*  return type: The new label, which is its own root.
+*  effect:      Grows the label arrays when they are full. The label's
+*               statistics start empty with its top at row.
+*  expects:     None.
+*/
+static int new_id(Pass *pass, int row)
+{
+        if (pass->ids == pass->id_capacity) {
+                assert(pass->id_capacity < INT32_MAX / 2);
+                pass->id_capacity *= 2;
+                pass->parent = realloc(pass->parent,
+                                       pass->id_capacity * sizeof(int));
+                pass->acc = realloc(pass->acc,
+                                    pass->id_capacity * sizeof(Acc));
+                assert(pass->parent != NULL && pass->acc != NULL);
+                note_bytes(pass);
+        }
+        int id = pass->ids++;
+        pass->parent[id] = id;
+        pass->acc[id] = (Acc){ 0, 0, 0, row, INT32_MAX, row, -1 };
+        return id;
+}
+
+/*
+*  name:        find
+*  purpose:     Finds the root of a label's set.
+*  arguments:   The parent array and a label.
+*  return type: The root label.
+*  effect:      Halves the path on the way up so later finds are shorter.
+*  expects:     id is a label that has been made.
+*/
+static int find(int *parent, int id)
+{
+        while (parent[id] != id) {
+                parent[id] = parent[parent[id]];
+                id = parent[id];
+        }
+        return id;
+}
+
+/*
+*  name:        unite
+*  purpose:     Merges the sets of two labels.
+*  arguments:   The Pass and the two labels.
+*  return type: The root of the merged set.
+*  effect:      The older root wins, so a root is always the first label
+*               of its blob in raster order. The loser's statistics are
+*               added into the winner's.
+*  expects:     Both labels have been made.
+*/
+static int unite(Pass *pass, int a, int b)
+{
+        a = find(pass->parent, a);
+        b = find(pass->parent, b);
+        if (a == b) {
+                return a;
+        }
+        if (b < a) {
+                int swap = a;
+                a = b;
+                b = swap;
+        }
+        pass->parent[b] = a;
+        Acc *win = &pass->acc[a];
+        const Acc *lose = &pass->acc[b];
+        win->area += lose->area;
+        win->row_sum += lose->row_sum;
+        win->col_sum += lose->col_sum;
+        win->top = lose->top < win->top ? lose->top : win->top;
+        win->left = lose->left < win->left ? lose->left : win->left;
+        win->bottom = lose->bottom > win->bottom ? lose->bottom
+                                                 : win->bottom;
+        win->right = lose->right > win->right ? lose->right : win->right;
+        return a;
+}
+
+/*
+*  name:        note_bytes
+*  purpose:     Keeps track of the first pass's largest footprint.
+*  arguments:   The Pass.
+*  return type: None.
+*  effect:      Raises peak_bytes to the bytes now allocated if larger.
+*  expects:     None.
+*/
+static void note_bytes(Pass *pass)
+{
+        size_t bytes = pass->capacity * sizeof(Run)
+                       + pass->id_capacity * (sizeof(int) + sizeof(Acc));
+        if (bytes > pass->peak_bytes) {
+                pass->peak_bytes = bytes;
+        }
+}
+
+/*
+*  name:        resolve
+*  purpose:     The second pass: numbers the blobs and fills in their
+*               statistics.
+*  arguments:   The finished Pass, the Bitlabel_T being built and whether
+*               blobs touching an edge are dropped.
+*  return type: A malloced array giving the final label of every
+*               provisional one, 0 for a dropped blob.
+*  effect:      Sets labels->count and labels->blobs. Labels are visited
+*               in the order they were made, so every root is numbered
+*               before the labels under it.
+*  expects:     Bit2_map_runs has finished with pass.
+*/
+static int *resolve(Pass *pass, Bitlabel_T labels, int clear_border)
+{
+        int *final = malloc((pass->ids > 0 ? pass->ids : 1) * sizeof(int));
+        labels->blobs = malloc((pass->ids > 0 ? pass->ids : 1)
+                               * sizeof(Bitlabel_blob));
+        assert(final != NULL && labels->blobs != NULL);
+        labels->count = 0;
+
+        for (int id = 0; id < pass->ids; id++) {
+                int root = find(pass->parent, id);
+                if (root != id) {
+                        final[id] = final[root];
+                        continue;
+                }
+                const Acc *acc = &pass->acc[id];
+                if (clear_border && (acc->top == 0 || acc->left == 0 ||
+                                     acc->bottom == labels->rows - 1 ||
+                                     acc->right == labels->cols - 1)) {
+                        final[id] = 0;
+                        continue;
+                }
+                Bitlabel_blob *blob = &labels->blobs[labels->count];
+                final[id] = ++labels->count;
+                blob->label = labels->count;
+                blob->area = acc->area;
+                blob->top = acc->top;
+                blob->left = acc->left;
+                blob->bottom = acc->bottom;
+                blob->right = acc->right;
+                blob->row = (double)acc->row_sum / acc->area;
+                blob->col = (double)acc->col_sum / acc->area;
+        }
+        return final;
+}
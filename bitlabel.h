@@ -0,0 +1,45 @@
+/*
+ *     bitlabel.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     bitlabel
+ *
+ *     This file holds the interface for labeling the connected components
+ *     (blobs) of the 1 bits of a Bit2_T
+ *
+ *     Blobs are numbered 1, 2... in the order their first pixel comes in
+ *     row-major order; 0 is the background. Every blob gets its area,
+ *     bounding box and centroid, and a label per pixel can be kept too.
+ */
+
+#ifndef BITLABEL_INCLUDED
+#define BITLABEL_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bit2.h"
+#include "uarray2.h"
+
+typedef struct Bitlabel_T *Bitlabel_T;
+
+/* Flags for Bitlabel_new */
+#define BITLABEL_PLANE        1 /* keep a label for every pixel */
+#define BITLABEL_CLEAR_BORDER 2 /* clear blobs touching an edge, skip them */
+
+/* What is known about one blob; rows and columns are inclusive */
+typedef struct {
+        int label;
+        uint64_t area;           /* pixels */
+        int top, left, bottom, right;
+        double row, col;         /* centroid */
+} Bitlabel_blob;
+
+extern Bitlabel_T Bitlabel_new(Bit2_T bit2, int connectivity, int flags);
+extern void Bitlabel_free(Bitlabel_T *labels);
+extern int Bitlabel_count(Bitlabel_T labels);
+extern const Bitlabel_blob *Bitlabel_blobs(Bitlabel_T labels);
+extern int Bitlabel_get(Bitlabel_T labels, int row, int col);
+extern UArray2_T Bitlabel_plane(Bitlabel_T labels);
+extern size_t Bitlabel_bytes(Bitlabel_T labels);
+
+#endif
@@ -0,0 +1,536 @@
+/*
+ *     bitrle.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     bitrle
+ *
+ *     This program holds a 2D bit array as one list of runs per row,
+ *     for pages that are almost all white. Each list is a growable array
+ *     of (first, last) column pairs kept sorted, with at least one 0 bit
+ *     between neighbouring runs. Looking up a bit is a binary search of
+ *     its row; setting or clearing one grows, shrinks, joins or splits at
+ *     most two runs.
+ *
+ *     Converting from a Bit2_T skips whole white words with one compare,
+ *     and only the runs themselves are ever allocated, so both the time
+ *     and the memory of a mostly white page go with how much ink it has.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "assert.h"
+#include "bit2.h"
+#include "bitrle.h"
+
+#define ROW_START 4 /* runs allocated for a row's first run */
+
+/* The runs of one row */
+typedef struct {
+        Bitrle_run *runs;
+        int count;
+        int capacity;
+} Row;
+
+/* This struct represents a 2D bitmap as one run list per row */
+struct Bitrle_T {
+        int rows;
+        int cols;
+        Row *lines;
+};
+
+static int  find_run(const Row *line, int col);
+static void insert_run(Row *line, int at, int first, int last);
+static void remove_run(Row *line, int at);
+static void reserve(Row *line, int count);
+static int  scan_runs(const uint64_t *words, int width, Bitrle_run *runs);
+
+/*
+*  name:        Bitrle_new
+*  purpose:     Creates an all-zero run-length bitmap.
+*  arguments:   The number of rows and columns.
+*  return type: A new Bitrle_T the caller must free with Bitrle_free.
+*  effect:      Allocates one empty run list per row; no runs yet.
+*  expects:     Both sizes are greater than zero.
+*/
+Bitrle_T Bitrle_new(int rows, int cols)
+{
+        assert(rows > 0 && cols > 0);
+        Bitrle_T rle = malloc(sizeof(*rle));
+        assert(rle != NULL);
+        rle->rows = rows;
+        rle->cols = cols;
+        rle->lines = calloc(rows, sizeof(Row)); /* every row empty */
+        assert(rle->lines != NULL);
+        return rle;
+}
+
+/*
+*  name:        Bitrle_free
+*  purpose:     Frees all memory of a run-length bitmap.
+*  arguments:   A pointer to a Bitrle_T.
+*  return type: None.
+*  effect:      Frees every run list and sets the pointer to NULL.
+*  expects:     rle and *rle are not NULL.
+*/
+void Bitrle_free(Bitrle_T *rle)
+{
+        assert(rle != NULL && *rle != NULL);
+        for (int row = 0; row < (*rle)->rows; row++) {
+                free((*rle)->lines[row].runs);
+        }
+        free((*rle)->lines);
+        free(*rle);
+        *rle = NULL;
+}
+
+/*
+*  name:        Bitrle_width
+*  purpose:     Returns the number of columns.
+*  arguments:   A Bitrle_T.
+*  return type: Integer.
+*  effect:      None.
+*  expects:     rle is not NULL.
+*/
+int Bitrle_width(Bitrle_T rle)
+{
+        assert(rle != NULL);
+        return rle->cols;
+}
+
+/*
+*  name:        Bitrle_height
+*  purpose:     Returns the number of rows.
+*  arguments:   A Bitrle_T.
+*  return type: Integer.
+*  effect:      None.
+*  expects:     rle is not NULL.
+*/
+int Bitrle_height(Bitrle_T rle)
+{
+        assert(rle != NULL);
+        return rle->rows;
+}
+
+/*
+*  name:        Bitrle_put
+*  purpose:     Stores a bit at the given row and column.
+*  arguments:   A Bitrle_T, the row, the column and the bit (0 or 1).
+*  return type: The bit that was there before.
+*  effect:      Setting a bit grows the run next to it, joins the two runs
+*               on either side or starts a new run. Clearing one shrinks
+*               its run, splits it in two or removes it.
+*  expects:     rle is not NULL and the position is in bounds.
+*/
+int Bitrle_put(Bitrle_T rle, int row, int col, int bit)
+{
+        assert(rle != NULL);
+        assert(row >= 0 && row < rle->rows && col >= 0 && col < rle->cols);
+        Row *line = &rle->lines[row];
+        int at = find_run(line, col);
+        int old = at < line->count && line->runs[at].first <= col;
+
+        if (bit && !old) {
+                int left = at > 0 && line->runs[at - 1].last == col - 1;
+                int right = at < line->count
+                            && line->runs[at].first == col + 1;
+                if (left && right) {
+                        line->runs[at - 1].last = line->runs[at].last;
+                        remove_run(line, at);
+                } else if (left) {
+                        line->runs[at - 1].last = col;
+                } else if (right) {
+                        line->runs[at].first = col;
+                } else {
+                        insert_run(line, at, col, col);
+                }
+        } else if (!bit && old) {
+                Bitrle_run run = line->runs[at];
+                if (run.first == run.last) {
+                        remove_run(line, at);
+                } else if (col == run.first) {
+                        line->runs[at].first++;
+                } else if (col == run.last) {
+                        line->runs[at].last--;
+                } else {
+                        line->runs[at].last = col - 1;
+                        insert_run(line, at + 1, col + 1, run.last);
+                }
+        }
+        return old;
+}
+
+/*
+*  name:        Bitrle_get
+*  purpose:     Reads the bit at the given row and column.
+*  arguments:   A Bitrle_T, the row and the column.
+*  return type: The bit (0 or 1).
+*  effect:      None. Binary searches the row's runs.
+*  expects:     rle is not NULL and the position is in bounds.
+*/
+int Bitrle_get(Bitrle_T rle, int row, int col)
+{
+        assert(rle != NULL);
+        assert(row >= 0 && row < rle->rows && col >= 0 && col < rle->cols);
+        const Row *line = &rle->lines[row];
+        int at = find_run(line, col);
+        return at < line->count && line->runs[at].first <= col;
+}
+
+/*
+*  name:        Bitrle_map_row_major
+*  purpose:     Applies a function to every bit in row-major order.
+*  arguments:   A Bitrle_T, the function (row, column, bitmap, value,
+*               closure) and the closure.
+*  return type: None.
+*  effect:      Calls apply once per bit, walking each row's runs instead
+*               of searching for every bit.
+*  expects:     rle is not NULL. apply must not change the bitmap.
+*/
+void Bitrle_map_row_major(Bitrle_T rle, void apply(
+            int row, int col, Bitrle_T rle, int value, void *cl), void *cl)
+{
+        assert(rle != NULL && apply != NULL);
+        for (int row = 0; row < rle->rows; row++) {
+                const Row *line = &rle->lines[row];
+                int at = 0;
+                for (int col = 0; col < rle->cols; col++) {
+                        if (at < line->count && line->runs[at].last < col) {
+                                at++;
+                        }
+                        int value = at < line->count
+                                    && line->runs[at].first <= col;
+                        apply(row, col, rle, value, cl);
+                }
+        }
+}
+
+/*
+*  name:        Bitrle_map_col_major
+*  purpose:     Applies a function to every bit in column-major order.
+*  arguments:   A Bitrle_T, the function (row, column, bitmap, value,
+*               closure) and the closure.
+*  return type: None.
+*  effect:      Calls apply once per bit. Keeps one run cursor per row so
+*               each step down a column is a compare, not a search.
+*  expects:     rle is not NULL. apply must not change the bitmap.
+*/
+void Bitrle_map_col_major(Bitrle_T rle, void apply(
+            int row, int col, Bitrle_T rle, int value, void *cl), void *cl)
+{
+        assert(rle != NULL && apply != NULL);
+        int *cursor = calloc(rle->rows, sizeof(int));
+        assert(cursor != NULL);
+        for (int col = 0; col < rle->cols; col++) {
+                for (int row = 0; row < rle->rows; row++) {
+                        const Row *line = &rle->lines[row];
+                        int at = cursor[row];
+                        if (at < line->count && line->runs[at].last < col) {
+                                cursor[row] = ++at;
+                        }
+                        int value = at < line->count
+                                    && line->runs[at].first <= col;
+                        apply(row, col, rle, value, cl);
+                }
+        }
+        free(cursor);
+}
+
+/*
+*  name:        Bitrle_count
+*  purpose:     Counts the 1 bits.
+*  arguments:   A Bitrle_T.
+*  return type: The number of 1 bits.
+*  effect:      None. Adds up run lengths.
+*  expects:     rle is not NULL.
+*/
+uint64_t Bitrle_count(Bitrle_T rle)
+{
+        assert(rle != NULL);
+        uint64_t total = 0;
+        for (int row = 0; row < rle->rows; row++) {
+                const Row *line = &rle->lines[row];
+                for (int i = 0; i < line->count; i++) {
+                        total += line->runs[i].last - line->runs[i].first
+                                 + 1;
+                }
+        }
+        return total;
+}
+
+/*
+*  name:        Bitrle_bytes
+*  purpose:     Reports how much memory a run-length bitmap holds.
+*  arguments:   A Bitrle_T.
+*  return type: The bytes allocated for it, including unused run slots.
+*  effect:      None.
+*  expects:     rle is not NULL.
+*/
+size_t Bitrle_bytes(Bitrle_T rle)
+{
+        assert(rle != NULL);
+        size_t bytes = sizeof(*rle) + (size_t)rle->rows * sizeof(Row);
+        for (int row = 0; row < rle->rows; row++) {
+                bytes += (size_t)rle->lines[row].capacity
+                         * sizeof(Bitrle_run);
+        }
+        return bytes;
+}
+
+/*
+*  name:        Bitrle_from_bit2
+*  purpose:     Makes the run-length form of a dense bitmap.
+*  arguments:   A Bit2_T in either layout.
+*  return type: A new Bitrle_T the caller must free.
+*  effect:      Reads each row as packed words and finds its runs with
+*               count-trailing-zeros, skipping whole white and whole black
+*               words at a time. Each row gets exactly as many run slots
+*               as it has runs; white rows get none.
+*  expects:     bit2 is not NULL.
+*/
+Bitrle_T Bitrle_from_bit2(Bit2_T bit2)
+{
+        assert(bit2 != NULL);
+        int rows = Bit2_height(bit2);
+        int cols = Bit2_width(bit2);
+        Bitrle_T rle = Bitrle_new(rows, cols);
+        uint64_t *words = malloc(((size_t)cols + 63) / 64
+                                 * sizeof(uint64_t));
+        Bitrle_run *runs = malloc(((size_t)cols / 2 + 1)
+                                  * sizeof(Bitrle_run));
+        assert(words != NULL && runs != NULL);
+
+        for (int row = 0; row < rows; row++) {
+                Bit2_read_span(bit2, row, 0, cols, words);
+                int count = scan_runs(words, cols, runs);
+                if (count > 0) {
+                        Bitrle_set_row(rle, row, runs, count);
+                }
+        }
+        free(words);
+        free(runs);
+        return rle;
+}
+
+/*
+*  name:        Bitrle_to_bit2
+*  purpose:     Makes the dense form of a run-length bitmap.
+*  arguments:   A Bitrle_T.
+*  return type: A new row-major Bit2_T the caller must free.
+*  effect:      Fills every run into a fresh all-zero bitmap with word
+*               masks, so white space costs only the allocation.
+*  expects:     rle is not NULL.
+*/
+Bit2_T Bitrle_to_bit2(Bitrle_T rle)
+{
+        assert(rle != NULL);
+        Bit2_T bit2 = Bit2_new(rle->rows, rle->cols);
+        for (int row = 0; row < rle->rows; row++) {
+                const Row *line = &rle->lines[row];
+                for (int i = 0; i < line->count; i++) {
+                        Bitrle_run run = line->runs[i];
+                        Bit2_fill_rect(bit2, 1, row, run.first, 1,
+                                       run.last - run.first + 1);
+                }
+        }
+        return bit2;
+}
+
+/*
+*  name:        Bitrle_row
+*  purpose:     Gives direct access to the runs of a row.
+*  arguments:   A Bitrle_T, the row and where to store the run count.
+*  return type: Pointer to the row's runs, left to right (NULL when the
+*               row has never had a run).
+*  effect:      Stores the count. Writes through the pointer change the
+*               bitmap; to shrink the row, write the kept runs to the front
+*               and pass the pointer back to Bitrle_set_row.
+*  expects:     rle and count are not NULL and the row is in bounds.
+*/
+Bitrle_run *Bitrle_row(Bitrle_T rle, int row, int *count)
+{
+        assert(rle != NULL && count != NULL);
+        assert(row >= 0 && row < rle->rows);
+        *count = rle->lines[row].count;
+        return rle->lines[row].runs;
+}
+
+/*
+*  name:        Bitrle_set_row
+*  purpose:     Replaces all the runs of a row.
+*  arguments:   A Bitrle_T, the row, the new runs and how many there are.
+*  return type: None.
+*  effect:      Copies the runs in, growing the row to fit exactly if it
+*               needs more room. runs may point into the row itself.
+*  expects:     rle is not NULL, the row is in bounds, count >= 0 and the
+*               runs are sorted, in bounds and separated by a 0 bit.
+*/
+void Bitrle_set_row(Bitrle_T rle, int row, const Bitrle_run *runs,
+                    int count)
+{
+        assert(rle != NULL && count >= 0 && (runs != NULL || count == 0));
+        assert(row >= 0 && row < rle->rows);
+        Row *line = &rle->lines[row];
+        for (int i = 0; i < count; i++) {
+                assert(runs[i].first <= runs[i].last);
+                assert(i == 0 || runs[i - 1].last + 1 < runs[i].first);
+        }
+        assert(count == 0 || (runs[0].first >= 0
+                              && runs[count - 1].last < rle->cols));
+
+        if (count > line->capacity) {
+                Bitrle_run *fresh = malloc(count * sizeof(Bitrle_run));
+                assert(fresh != NULL);
+                memcpy(fresh, runs, count * sizeof(Bitrle_run));
+                free(line->runs);
+                line->runs = fresh;
+                line->capacity = count;
+        } else if (count > 0) {
+                memmove(line->runs, runs, count * sizeof(Bitrle_run));
+        }
+        line->count = count;
+}
+
+/*
+*  name:        Bitrle_map_runs
+*  purpose:     Applies a function to every run of 1 bits.
+*  arguments:   A Bitrle_T, the function (row, run, closure) and the
+*               closure.
+*  return type: None.
+*  effect:      Calls apply once per run, rows top to bottom and runs left
+*               to right. White space is never visited.
+*  expects:     rle is not NULL. apply must not change the bitmap.
+*/
+void Bitrle_map_runs(Bitrle_T rle, void apply(
+            int row, Bitrle_run run, void *cl), void *cl)
+{
+        assert(rle != NULL && apply != NULL);
+        for (int row = 0; row < rle->rows; row++) {
+                const Row *line = &rle->lines[row];
+                for (int i = 0; i < line->count; i++) {
+                        apply(row, line->runs[i], cl);
+                }
+        }
+}
+
+/*
+*  name:        find_run
+*  purpose:     Finds the first run of a row that ends at or after a
+*               column.
+*  arguments:   A row and a column.
+*  return type: Index of that run, or the run count if there is none. The
+*               column is set exactly when the run also starts at or
+*               before it.
+*  effect:      None. Binary search.
+*  expects:     line is not NULL.
+*/
+static int find_run(const Row *line, int col)
+{
+        int low = 0, high = line->count;
+        while (low < high) {
+                int mid = low + (high - low) / 2;
+                if (line->runs[mid].last < col) {
+                        low = mid + 1;
+                } else {
+                        high = mid;
+                }
+        }
+        return low;
+}
+
+/*
+*  name:        insert_run
+*  purpose:     Inserts a run into a row at a given index.
+*  arguments:   The row, the index and the run's first and last column.
+*  return type: None.
+*  effect:      Shifts later runs right, growing the row if needed.
+*  expects:     0 <= at <= count and the result stays sorted.
+*/
+static void insert_run(Row *line, int at, int first, int last)
+{
+        reserve(line, line->count + 1);
+        memmove(&line->runs[at + 1], &line->runs[at],
+                (line->count - at) * sizeof(Bitrle_run));
+        line->runs[at].first = first;
+        line->runs[at].last = last;
+        line->count++;
+}
+
+/*
+*  name:        remove_run
+*  purpose:     Removes the run at a given index from a row.
+*  arguments:   The row and the index.
+*  return type: None.
+*  effect:      Shifts later runs left. The row keeps its capacity.
+*  expects:     0 <= at < count.
+*/
+static void remove_run(Row *line, int at)
+{
+        memmove(&line->runs[at], &line->runs[at + 1],
+                (line->count - at - 1) * sizeof(Bitrle_run));
+        line->count--;
+}
+
+/*
+*  name:        reserve
+*  purpose:     Makes sure a row has room for a number of runs.
+*  arguments:   The row and the number of runs.
+*  return type: None.
+*  effect:      Doubles the capacity (from ROW_START) until it is enough.
+*  expects:     count > 0.
+*/
+static void reserve(Row *line, int count)
+{
+        if (count <= line->capacity) {
+                return;
+        }
+        int capacity = line->capacity > 0 ? line->capacity : ROW_START;
+        while (capacity < count) {
+                capacity *= 2;
+        }
+        line->runs = realloc(line->runs, capacity * sizeof(Bitrle_run));
+        assert(line->runs != NULL);
+        line->capacity = capacity;
+}
+
+/*
+*  name:        scan_runs
+*  purpose:     Lists the runs of 1 bits in a row of packed words.
+*  arguments:   The words, the width in bits and an output array with room
+*               for width / 2 + 1 runs.
+*  return type: Integer, the number of runs written.
+*  effect:      Skips whole 0 or whole 1 words with one compare each.
+*  expects:     Bits past the width are 0.
+*/
+static int scan_runs(const uint64_t *words, int width, Bitrle_run *runs)
+{
+        int n = 0;
+        int col = 0;
+        while (col < width) {
+                uint64_t bits = words[col >> 6] >> (col & 63);
+                if (bits == 0) {
+                        col = (col | 63) + 1;
+                        continue;
+                }
+                col += __builtin_ctzll(bits);
+                runs[n].first = col;
+                for (;;) {
+                        uint64_t zeros = ~words[col >> 6] >> (col & 63);
+                        if (zeros == 0) {
+                                col = (col | 63) + 1;
+                                if (col >= width) {
+                                        break;
+                                }
+                                continue;
+                        }
+                        col += __builtin_ctzll(zeros);
+                        break;
+                }
+                if (col > width) {
+                        col = width;
+                }
+                runs[n].last = col - 1;
+                n++;
+        }
+        return n;
+}
@@ -0,0 +1,54 @@
+/*
+ *     bitrle.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     bitrle
+ *
+ *     This file holds the interface for a run-length encoded bit map
+ *
+ *     Every row is kept as a sorted list of its runs of 1 bits. Runs in
+ *     a row never overlap or touch, so a white row costs nothing and a
+ *     page costs memory in proportion to its ink rather than its area.
+ *     Get, put and the maps behave like their Bit2 counterparts.
+ */
+
+#ifndef BITRLE_INCLUDED
+#define BITRLE_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bit2.h"
+
+typedef struct Bitrle_T *Bitrle_T;
+
+/* One run of 1 bits, columns first..last inclusive */
+typedef struct {
+        int first, last;
+} Bitrle_run;
+
+extern Bitrle_T Bitrle_new(int rows, int cols);
+extern void Bitrle_free(Bitrle_T *rle);
+extern int Bitrle_width(Bitrle_T rle);
+extern int Bitrle_height(Bitrle_T rle);
+extern int Bitrle_put(Bitrle_T rle, int row, int col, int bit);
+extern int Bitrle_get(Bitrle_T rle, int row, int col);
+extern void Bitrle_map_row_major(Bitrle_T rle, void apply(
+            int row, int col, Bitrle_T rle, int value, void *cl), void *cl);
+extern void Bitrle_map_col_major(Bitrle_T rle, void apply(
+            int row, int col, Bitrle_T rle, int value, void *cl), void *cl);
+extern uint64_t Bitrle_count(Bitrle_T rle);
+extern size_t Bitrle_bytes(Bitrle_T rle);
+
+/* conversion to and from the dense form */
+extern Bitrle_T Bitrle_from_bit2(Bit2_T bit2);
+extern Bit2_T Bitrle_to_bit2(Bitrle_T rle);
+
+/* run-level access; writers must keep a row's runs sorted, in bounds and
+ * separated by at least one 0 bit */
+extern Bitrle_run *Bitrle_row(Bitrle_T rle, int row, int *count);
+extern void Bitrle_set_row(Bitrle_T rle, int row, const Bitrle_run *runs,
+                           int count);
+extern void Bitrle_map_runs(Bitrle_T rle, void apply(
+            int row, Bitrle_run run, void *cl), void *cl);
+
+#endif
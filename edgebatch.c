@@ -0,0 +1,468 @@
+/*
+ *     edgebatch.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgebatch
+ *
+ *     This program removes edge-connected black pixels from a list of PBM
+ *     files, writing each result under the same name in an output
+ *     directory. A pool of threads takes files off a shared counter until
+ *     the list is used up.
+ *
+ *     Every worker keeps one Pbmio reader and one Bit2_T for its whole
+ *     life, so after the first few files a page costs no reader setup
+ *     and, as long as the pages are about the same size, no bitmap
+ *     allocation. A file that cannot be opened, read or written is
+ *     reported on stderr and skipped; the rest of the batch goes on.
+ *     Workers read with Pbmio_load and never raise (see pbmio.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "pbmio.h"
+#include "edgebatch.h"
+
+/* Everything the workers share */
+typedef struct {
+        char **inputs;
+        int ninputs;
+        const char *outdir;
+        void (*engine)(Bit2_T bitmap, Edgefill_stats *stats);
+        int raw;
+        atomic_int next; /* next input to hand out */
+} Job;
+
+/* An input's base name and where it is in the input list, for finding
+ * inputs that would be written to the same file */
+typedef struct {
+        const char *base;
+        int index;
+} Output_name;
+
+/* What one worker thread gets, and what it did */
+typedef struct {
+        Job *job;
+        int pages, failed;
+        uint64_t pixels;
+} Worker;
+
+static void  *work(void *cl);
+static int    clean_file(Job *job, const char *path, Pbmio_T *reader,
+                         Bit2_T *bitmap, uint64_t *pixels);
+static char  *output_path(const char *outdir, const char *path);
+static const char *base_name(const char *path);
+static int    drop_collisions(char **inputs, int *count);
+static int    compare_outputs(const void *a, const void *b);
+static int    add_inputs(const char *path, char ***inputs, int *count,
+                         int *capacity);
+static void   add_input(char *path, char ***inputs, int *count,
+                        int *capacity);
+static int    compare_names(const void *a, const void *b);
+static double now_seconds(void);
+
+/*
+*  name:        edgebatch_run
+*  purpose:     Removes edge-connected black pixels from many PBM files.
+*  arguments:   The input paths and how many there are, the output
+*               directory, the engine to run on each image, the number of
+*               worker threads and whether to write raw P4 (nonzero) or
+*               plain P1.
+*  return type: An Edgebatch_report with the page, failure and pixel
+*               counts and the elapsed time.
+*  effect:      A path that names a directory stands for the regular files
+*               in it (not its subdirectories), in name order. Each input
+*               is written to outdir under its own base name. When several
+*               inputs share a base name (or one is given twice) only the
+*               first is cleaned; every later one is a failure, found
+*               before any work starts so no two workers write one file.
+*               Starts threads - 1 pthreads (the caller is the last one).
+*               Failures are printed to stderr as "path: reason".
+*  expects:     paths and outdir are not NULL, outdir exists and
+*               threads >= 1.
+*/
+Edgebatch_report edgebatch_run(char **paths, int npaths, const char *outdir,
+                               void engine(Bit2_T bitmap,
+                                           Edgefill_stats *stats),
+                               int threads, int raw)
+{
+        assert(paths != NULL && outdir != NULL && threads >= 1);
+        double start = now_seconds();
+        Edgebatch_report report = { 0, 0, 0, 0.0 };
+
+        Job job;
+        job.inputs = NULL;
+        job.ninputs = 0;
+        int capacity = 0;
+        for (int i = 0; i < npaths; i++) {
+                if (!add_inputs(paths[i], &job.inputs, &job.ninputs,
+                                &capacity)) {
+                        fprintf(stderr, "%s: cannot list directory\n",
+                                paths[i]);
+                        report.failed++;
+                }
+        }
+        report.failed += drop_collisions(job.inputs, &job.ninputs);
+        job.outdir = outdir;
+        job.engine = engine;
+        job.raw = raw;
+        atomic_init(&job.next, 0);
+
+        if (threads > job.ninputs) {
+                threads = job.ninputs > 0 ? job.ninputs : 1;
+        }
+        pthread_t *tids = malloc(threads * sizeof(pthread_t));
+        Worker *workers = malloc(threads * sizeof(Worker));
+        assert(tids != NULL && workers != NULL);
+        for (int i = 0; i < threads; i++) {
+                workers[i].job = &job;
+                workers[i].pages = 0;
+                workers[i].failed = 0;
+                workers[i].pixels = 0;
+        }
+        for (int i = 1; i < threads; i++) {
+                int err = pthread_create(&tids[i], NULL, work, &workers[i]);
+                assert(err == 0);
+        }
+        work(&workers[0]);
+        for (int i = 1; i < threads; i++) {
+                pthread_join(tids[i], NULL);
+        }
+
+        for (int i = 0; i < threads; i++) {
+                report.pages += workers[i].pages;
+                report.failed += workers[i].failed;
+                report.pixels += workers[i].pixels;
+        }
+        report.seconds = now_seconds() - start;
+
+        for (int i = 0; i < job.ninputs; i++) {
+                free(job.inputs[i]);
+        }
+        free(job.inputs);
+        free(workers);
+        free(tids);
+        return report;
+}
+
+/*
+*  name:        work
+*  purpose:     The body of every worker thread.
+*  arguments:   A Worker pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Takes inputs off the shared counter and cleans them until
+*               none are left, counting pages, failures and pixels in the
+*               worker. The reader and bitmap are made on the first file
+*               and freed at the end.
+*  expects:     cl is a Worker whose job is set up.
+*/
+static void *work(void *cl)
+{
+        Worker *self = cl;
+        Job *job = self->job;
+        Pbmio_T reader = NULL;
+        Bit2_T bitmap = NULL;
+
+        int i;
+        while ((i = atomic_fetch_add(&job->next, 1)) < job->ninputs) {
+                uint64_t pixels = 0;
+                if (clean_file(job, job->inputs[i], &reader, &bitmap,
+                               &pixels)) {
+                        self->pages++;
+                        self->pixels += pixels;
+                } else {
+                        self->failed++;
+                }
+        }
+
+        if (reader != NULL) {
+                Pbmio_free(&reader);
+        }
+        if (bitmap != NULL) {
+                Bit2_free(&bitmap);
+        }
+        return NULL;
+}
+
+/*
+*  name:        clean_file
+*  purpose:     Reads one PBM file, removes the edge-connected black pixels
+*               of every image in it and writes them to the output
+*               directory.
+*  arguments:   The job, the input path, the worker's reader and bitmap,
+*               either of which may still be NULL, and where to put the
+*               number of pixels cleaned.
+*  return type: 1 if the output was written, 0 if the file failed.
+*  effect:      Makes the reader and bitmap if needed and reuses them
+*               otherwise. The cleaned images are written in order, as
+*               unblackedges writes a multi-image stream. A file that goes
+*               bad after its first image leaves no output behind. Prints
+*               the reason for a failure to stderr.
+*  expects:     reader, bitmap and pixels are not NULL.
+*/
+static int clean_file(Job *job, const char *path, Pbmio_T *reader,
+                      Bit2_T *bitmap, uint64_t *pixels)
+{
+        FILE *in = fopen(path, "rb");
+        if (in == NULL) {
+                fprintf(stderr, "%s: cannot open for reading\n", path);
+                return 0;
+        }
+        if (*reader == NULL) {
+                *reader = Pbmio_new(in);
+        } else {
+                Pbmio_reset(*reader, in);
+        }
+        Pbmio_status status = Pbmio_load(*reader, bitmap);
+        if (status != PBMIO_IMAGE) {
+                fclose(in);
+                fprintf(stderr, "%s: %s\n", path,
+                        status == PBMIO_END ? "empty file" :
+                        status == PBMIO_COUNT ? "image data ends early" :
+                        "not a PBM image");
+                return 0;
+        }
+
+        char *name = output_path(job->outdir, path);
+        FILE *out = fopen(name, "wb");
+        if (out == NULL) {
+                fclose(in);
+                fprintf(stderr, "%s: cannot create %s\n", path, name);
+                free(name);
+                return 0;
+        }
+        int images = 0;
+        do {
+                job->engine(*bitmap, NULL);
+                Pbmio_write(out, *bitmap, job->raw);
+                *pixels += (uint64_t)Bit2_width(*bitmap)
+                           * Bit2_height(*bitmap);
+                images++;
+        } while ((status = Pbmio_load(*reader, bitmap)) == PBMIO_IMAGE);
+        fclose(in);
+
+        int ok = ferror(out) == 0;
+        ok = fclose(out) == 0 && ok;
+        if (status != PBMIO_END) {
+                fprintf(stderr, "%s: image %d: %s\n", path, images + 1,
+                        status == PBMIO_COUNT ? "image data ends early" :
+                        "not a PBM image");
+                remove(name);
+                ok = 0;
+        } else if (!ok) {
+                fprintf(stderr, "%s: cannot write %s\n", path, name);
+        }
+        free(name);
+        return ok;
+}
+
+/*
+*  name:        output_path
+*  purpose:     Builds the name an input is written to.
+*  arguments:   The output directory and the input path.
+*  return type: A malloced string the caller frees.
+*  effect:      Joins outdir and the base name of path with a '/'.
+*  expects:     Neither argument is NULL.
+*/
+static char *output_path(const char *outdir, const char *path)
+{
+        const char *base = base_name(path);
+        size_t len = strlen(outdir) + 1 + strlen(base) + 1;
+        char *name = malloc(len);
+        assert(name != NULL);
+        snprintf(name, len, "%s/%s", outdir, base);
+        return name;
+}
+
+/*
+*  name:        base_name
+*  purpose:     Finds the base name of a path.
+*  arguments:   The path.
+*  return type: A pointer into path after its last '/', or path itself.
+*  effect:      None.
+*  expects:     path is not NULL.
+*/
+static const char *base_name(const char *path)
+{
+        const char *slash = strrchr(path, '/');
+        return slash == NULL ? path : slash + 1;
+}
+
+/*
+*  name:        drop_collisions
+*  purpose:     Removes inputs that would overwrite an earlier input's
+*               output.
+*  arguments:   The input list and its count.
+*  return type: The number of inputs removed.
+*  effect:      Sorts the base names (ties by list position) so inputs
+*               with the same one sit together, keeps the first of each
+*               and prints "path: same output name as first" (or "listed
+*               more than once") to stderr for the rest. They are freed
+*               and the list is closed up in its original order.
+*  expects:     count is not NULL, and inputs is not NULL if *count > 0.
+*/
+static int drop_collisions(char **inputs, int *count)
+{
+        if (*count < 2) {
+                return 0;
+        }
+        Output_name *names = malloc(*count * sizeof(Output_name));
+        assert(names != NULL);
+        for (int i = 0; i < *count; i++) {
+                names[i].base = base_name(inputs[i]);
+                names[i].index = i;
+        }
+        qsort(names, *count, sizeof(Output_name), compare_outputs);
+
+        int dropped = 0;
+        int first = 0;
+        for (int i = 1; i < *count; i++) {
+                if (strcmp(names[i].base, names[first].base) != 0) {
+                        first = i;
+                        continue;
+                }
+                const char *path = inputs[names[i].index];
+                const char *kept = inputs[names[first].index];
+                if (strcmp(path, kept) == 0) {
+                        fprintf(stderr, "%s: listed more than once\n",
+                                path);
+                } else {
+                        fprintf(stderr, "%s: same output name as %s\n",
+                                path, kept);
+                }
+                free(inputs[names[i].index]);
+                inputs[names[i].index] = NULL;
+                dropped++;
+        }
+        free(names);
+
+        int kept = 0;
+        for (int i = 0; i < *count; i++) {
+                if (inputs[i] != NULL) {
+                        inputs[kept++] = inputs[i];
+                }
+        }
+        *count = kept;
+        return dropped;
+}
+
+/*
+*  name:        compare_outputs
+*  purpose:     Orders two Output_names for qsort: by base name, then by
+*               position in the input list.
+*  arguments:   Pointers to two Output_name elements.
+*  return type: Negative, zero or positive, as strcmp.
+*  effect:      None.
+*  expects:     None.
+*/
+static int compare_outputs(const void *a, const void *b)
+{
+        const Output_name *x = a;
+        const Output_name *y = b;
+        int order = strcmp(x->base, y->base);
+        if (order != 0) {
+                return order;
+        }
+        return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+*  name:        add_inputs
+*  purpose:     Adds a command-line path to the input list.
+*  arguments:   The path, and the list with its count and capacity.
+*  return type: 0 if path is a directory that cannot be read, 1 otherwise.
+*  effect:      A directory adds its regular files, skipping names that
+*               start with '.', sorted by name. Anything else is added as
+*               given, so a missing file is reported when it is processed.
+*  expects:     None of the pointers are NULL.
+*/
+static int add_inputs(const char *path, char ***inputs, int *count,
+                      int *capacity)
+{
+        struct stat info;
+        if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode)) {
+                add_input(strdup(path), inputs, count, capacity);
+                return 1;
+        }
+
+        DIR *dir = opendir(path);
+        if (dir == NULL) {
+                return 0;
+        }
+        int first = *count;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] == '.') {
+                        continue;
+                }
+                char *name = output_path(path, entry->d_name);
+                if (stat(name, &info) == 0 && S_ISREG(info.st_mode)) {
+                        add_input(name, inputs, count, capacity);
+                } else {
+                        free(name);
+                }
+        }
+        closedir(dir);
+        qsort(*inputs + first, *count - first, sizeof(char *),
+              compare_names);
+        return 1;
+}
+
+/*
+*  name:        add_input
+*  purpose:     Appends one malloced path to the input list.
+*  arguments:   The path, and the list with its count and capacity.
+*  return type: None.
+*  effect:      Doubles the list with realloc when it is full. The list
+*               owns the path from now on.
+*  expects:     path is not NULL.
+*/
+static void add_input(char *path, char ***inputs, int *count, int *capacity)
+{
+        assert(path != NULL);
+        if (*count == *capacity) {
+                *capacity = *capacity == 0 ? 64 : 2 * *capacity;
+                *inputs = realloc(*inputs, *capacity * sizeof(char *));
+                assert(*inputs != NULL);
+        }
+        (*inputs)[(*count)++] = path;
+}
+
+/*
+*  name:        compare_names
+*  purpose:     Orders two paths for qsort.
+*  arguments:   Pointers to two char * elements.
+*  return type: Negative, zero or positive, as strcmp.
+*  effect:      None.
+*  expects:     None.
+*/
+static int compare_names(const void *a, const void *b)
+{
+        return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+*  name:        now_seconds
+*  purpose:     Reads a monotonic clock.
+*  arguments:   None.
+*  return type: Seconds as a double.
+*  effect:      None.
+*  expects:     None.
+*/
+static double now_seconds(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec + now.tv_nsec / 1e9;
+}
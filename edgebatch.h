@@ -0,0 +1,32 @@
+/*
+ *     edgebatch.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgebatch
+ *
+ *     This file holds the interface for removing edge-connected black
+ *     pixels from many PBM files in one process, several files at a time.
+ */
+
+#ifndef EDGEBATCH_INCLUDED
+#define EDGEBATCH_INCLUDED
+
+#include <stdint.h>
+#include "bit2.h"
+#include "edgefill.h"
+
+/* What a batch did, for the throughput line */
+typedef struct {
+        int pages;       /* files written */
+        int failed;      /* files skipped with an error */
+        uint64_t pixels; /* pixels in the written files */
+        double seconds;  /* wall-clock time of the whole batch */
+} Edgebatch_report;
+
+extern Edgebatch_report edgebatch_run(char **paths, int npaths,
+                                      const char *outdir,
+                                      void engine(Bit2_T bitmap,
+                                                  Edgefill_stats *stats),
+                                      int threads, int raw);
+
+#endif
@@ -0,0 +1,665 @@
+/*
+ *     edgecache.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgecache
+ *
+ *     This program keeps cleaned pages in a directory so that a page seen
+ *     before is read back instead of cleaned again. Each result is a raw
+ *     P4 file named after its key and size, KEY-WIDTHxHEIGHT.pbm, where
+ *     the key is the caller's hash of the page before cleaning (see
+ *     Bit2_hash). The size in the name guards against a key shared by
+ *     pages of different shapes; a 64-bit key makes any other collision
+ *     far less likely than a disk error.
+ *
+ *     The cache holds an index of its files, built from the directory when
+ *     it is opened: a chained hash table from key to entry, and a doubly
+ *     linked list of the entries from most to least recently used. A hit
+ *     moves its entry to the front and touches the file's modification
+ *     time, so the order survives to the next run; a store adds to the
+ *     front and then evicts from the back until the files fit in the
+ *     limit. Another process sharing the directory is not seen until the
+ *     next open, so the bound holds for what this process knows of.
+ *
+ *     Results are written to a temporary name and renamed into place, so
+ *     a reader never sees half a file. A hit is read into a spare bitmap
+ *     first and copied over the caller's only once it has been read
+ *     whole, so a damaged file costs a miss rather than a wrong page.
+ *     Spare readers and bitmaps are kept for reuse. All calls may be made
+ *     from several threads at once.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "bit2.h"
+#include "pbmio.h"
+#include "edgecache.h"
+
+#define NAME_MAX_LEN 64 /* longest file name the cache makes */
+#define BUCKETS_START 256
+
+/* One cached result. prev and next link the recency list (or, for a
+ * free entry, next links the free list) and chain links the bucket; all
+ * are entry indices, -1 at the end. generation is different for every
+ * entry ever added, so a reader that let go of the lock can tell whether
+ * the entry it looked up is still the one there. */
+typedef struct {
+        uint64_t key;
+        int width, height;
+        uint64_t bytes;
+        uint64_t generation;
+        struct timespec used; /* modification time, only used at open */
+        int prev, next;
+        int chain;
+} Entry;
+
+/* A reader and bitmap a hit is read through, kept for the next hit */
+typedef struct Spare {
+        Pbmio_T reader;
+        Bit2_T bitmap;
+        struct Spare *next;
+} Spare;
+
+struct Edgecache_T {
+        char *dir;
+        uint64_t max_bytes;
+        pthread_mutex_t lock;
+        Entry *entries;
+        int capacity;
+        int free_list;
+        int head, tail;     /* most and least recently used */
+        int *buckets;       /* first entry of each chain, or -1 */
+        int bucket_count;   /* a power of two */
+        Spare *spares;
+        uint64_t temp_count;
+        uint64_t generations; /* the next entry's generation */
+        Edgecache_stats stats;
+};
+
+static int      scan_dir(Edgecache_T cache);
+static int      compare_used(const void *a, const void *b);
+static int      find(Edgecache_T cache, uint64_t key, int width,
+                     int height);
+static int      add_entry(Edgecache_T cache, uint64_t key, int width,
+                          int height, uint64_t bytes);
+static void     remove_entry(Edgecache_T cache, int i);
+static void     link_front(Edgecache_T cache, int i);
+static void     unlink_entry(Edgecache_T cache, int i);
+static void     grow_buckets(Edgecache_T cache);
+static void     evict(Edgecache_T cache);
+static char    *entry_name(Edgecache_T cache, uint64_t key, int width,
+                           int height);
+static size_t   bucket_of(Edgecache_T cache, uint64_t key);
+static void     drop(Edgecache_T cache, uint64_t key, int width, int height,
+                     uint64_t generation);
+
+/*
+*  name:        edgecache_open
+*  purpose:     Opens a cache directory.
+*  arguments:   The directory, made if it does not exist, and the most
+*               bytes its results may take.
+*  return type: A new Edgecache_T the caller closes, or NULL if the
+*               directory cannot be made or read.
+*  effect:      Indexes the results already in the directory, least
+*               recently used last by modification time, and evicts down to
+*               max_bytes. Other files are left alone.
+*  expects:     dir is not NULL.
+*/
+Edgecache_T edgecache_open(const char *dir, uint64_t max_bytes)
+{
+        assert(dir != NULL);
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+                return NULL;
+        }
+        Edgecache_T cache = malloc(sizeof(*cache));
+        assert(cache != NULL);
+        cache->dir = strdup(dir);
+        assert(cache->dir != NULL);
+        cache->max_bytes = max_bytes;
+        pthread_mutex_init(&cache->lock, NULL);
+        cache->entries = NULL;
+        cache->capacity = 0;
+        cache->free_list = -1;
+        cache->head = -1;
+        cache->tail = -1;
+        cache->bucket_count = BUCKETS_START;
+        cache->buckets = malloc(cache->bucket_count * sizeof(int));
+        assert(cache->buckets != NULL);
+        memset(cache->buckets, 0xff, cache->bucket_count * sizeof(int));
+        cache->spares = NULL;
+        cache->temp_count = 0;
+        cache->generations = 0;
+        cache->stats = (Edgecache_stats){ 0, 0, 0, 0, 0 };
+
+        if (!scan_dir(cache)) {
+                edgecache_close(&cache);
+                return NULL;
+        }
+        evict(cache);
+        return cache;
+}
+
+/*
+*  name:        edgecache_close
+*  purpose:     Frees a cache.
+*  arguments:   A pointer to an Edgecache_T.
+*  return type: None.
+*  effect:      Frees the index and the spares and sets *cache to NULL.
+*               The files stay for the next open.
+*  expects:     cache and *cache are not NULL and no call is running.
+*/
+void edgecache_close(Edgecache_T *cache)
+{
+        assert(cache != NULL && *cache != NULL);
+        Spare *spare = (*cache)->spares;
+        while (spare != NULL) {
+                Spare *next = spare->next;
+                Pbmio_free(&spare->reader);
+                if (spare->bitmap != NULL) {
+                        Bit2_free(&spare->bitmap);
+                }
+                free(spare);
+                spare = next;
+        }
+        pthread_mutex_destroy(&(*cache)->lock);
+        free((*cache)->buckets);
+        free((*cache)->entries);
+        free((*cache)->dir);
+        free(*cache);
+        *cache = NULL;
+}
+
+/*
+*  name:        edgecache_get
+*  purpose:     Looks up the cleaned version of a page.
+*  arguments:   The cache, the page's key and the page itself.
+*  return type: 1 on a hit, with the page replaced by its cleaned version,
+*               0 on a miss, with the page untouched.
+*  effect:      A hit becomes the most recently used result and its file's
+*               modification time is set to now. A file that has gone
+*               missing or cannot be read whole counts as a miss and is
+*               dropped from the index (and the disk), unless another
+*               thread has evicted or stored the key again while it was
+*               being read, in which case the index is left as it is.
+*  expects:     cache and bitmap are not NULL; bitmap is BIT2_ROW_MAJOR and
+*               not a view.
+*/
+int edgecache_get(Edgecache_T cache, uint64_t key, Bit2_T bitmap)
+{
+        assert(cache != NULL && bitmap != NULL);
+        int width = Bit2_width(bitmap);
+        int height = Bit2_height(bitmap);
+
+        pthread_mutex_lock(&cache->lock);
+        int i = find(cache, key, width, height);
+        if (i < 0) {
+                cache->stats.misses++;
+                pthread_mutex_unlock(&cache->lock);
+                return 0;
+        }
+        uint64_t generation = cache->entries[i].generation;
+        unlink_entry(cache, i);
+        link_front(cache, i);
+        Spare *spare = cache->spares;
+        if (spare != NULL) {
+                cache->spares = spare->next;
+        }
+        pthread_mutex_unlock(&cache->lock);
+
+        char *name = entry_name(cache, key, width, height);
+        FILE *in = fopen(name, "rb");
+        free(name);
+        int ok = 0;
+        if (in != NULL) {
+                futimens(fileno(in), NULL);
+                if (spare == NULL) {
+                        spare = malloc(sizeof(*spare));
+                        assert(spare != NULL);
+                        spare->reader = Pbmio_new(in);
+                        spare->bitmap = NULL;
+                } else {
+                        Pbmio_reset(spare->reader, in);
+                }
+                ok = Pbmio_load(spare->reader, &spare->bitmap) ==
+                     PBMIO_IMAGE &&
+                     Bit2_width(spare->bitmap) == width &&
+                     Bit2_height(spare->bitmap) == height;
+                fclose(in);
+        }
+        if (ok) {
+                size_t row_bytes = Bit2_row_words(bitmap) * sizeof(uint64_t);
+                for (int r = 0; r < height; r++) {
+                        memcpy(Bit2_row(bitmap, r),
+                               Bit2_row(spare->bitmap, r), row_bytes);
+                }
+        }
+
+        pthread_mutex_lock(&cache->lock);
+        if (spare != NULL) {
+                spare->next = cache->spares;
+                cache->spares = spare;
+        }
+        if (ok) {
+                cache->stats.hits++;
+        } else {
+                cache->stats.misses++;
+                drop(cache, key, width, height, generation);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return ok;
+}
+
+/*
+*  name:        edgecache_put
+*  purpose:     Stores the cleaned version of a page.
+*  arguments:   The cache, the key of the page before cleaning and the
+*               cleaned page.
+*  return type: None.
+*  effect:      Writes the page as raw P4 under a temporary name and
+*               renames it into place, then makes it the most recently
+*               used result and evicts from the least recently used end
+*               until the results fit in the limit (which may evict this
+*               one, if it is bigger than the limit on its own). Does
+*               nothing if the key is already stored, or if the file
+*               cannot be written.
+*  expects:     cache and bitmap are not NULL.
+*/
+void edgecache_put(Edgecache_T cache, uint64_t key, Bit2_T bitmap)
+{
+        assert(cache != NULL && bitmap != NULL);
+        int width = Bit2_width(bitmap);
+        int height = Bit2_height(bitmap);
+
+        pthread_mutex_lock(&cache->lock);
+        int present = find(cache, key, width, height) >= 0;
+        uint64_t temp = cache->temp_count++;
+        pthread_mutex_unlock(&cache->lock);
+        if (present) {
+                return;
+        }
+
+        size_t size = strlen(cache->dir) + NAME_MAX_LEN;
+        char *temp_name = malloc(size);
+        assert(temp_name != NULL);
+        snprintf(temp_name, size, "%s/.tmp-%ld-%" PRIu64, cache->dir,
+                 (long)getpid(), temp);
+        char *name = entry_name(cache, key, width, height);
+
+        FILE *out = fopen(temp_name, "wb");
+        int ok = out != NULL;
+        off_t bytes = 0;
+        if (ok) {
+                Pbmio_write(out, bitmap, 1);
+                bytes = ftello(out);
+                ok = ferror(out) == 0;
+                ok = fclose(out) == 0 && ok;
+                ok = ok && rename(temp_name, name) == 0;
+                if (!ok) {
+                        unlink(temp_name);
+                }
+        }
+
+        if (ok) {
+                pthread_mutex_lock(&cache->lock);
+                if (find(cache, key, width, height) < 0) {
+                        link_front(cache, add_entry(cache, key, width,
+                                                    height, bytes));
+                        evict(cache);
+                }
+                pthread_mutex_unlock(&cache->lock);
+        }
+        free(name);
+        free(temp_name);
+}
+
+/*
+*  name:        edgecache_stats
+*  purpose:     Reports what a cache has done and holds.
+*  arguments:   The cache.
+*  return type: A copy of its counters.
+*  effect:      None.
+*  expects:     cache is not NULL.
+*/
+Edgecache_stats edgecache_stats(Edgecache_T cache)
+{
+        assert(cache != NULL);
+        pthread_mutex_lock(&cache->lock);
+        Edgecache_stats stats = cache->stats;
+        pthread_mutex_unlock(&cache->lock);
+        return stats;
+}
+
+/*
+*  name:        scan_dir
+*  purpose:     Builds the index from the files in the directory.
+*  arguments:   A new, empty cache.
+*  return type: 1 on success, 0 if the directory cannot be read.
+*  effect:      Collects every regular file named like a result, sorts
+*               them oldest first and adds each at the front of the
+*               recency list, so the newest ends up there.
+*  expects:     cache is not NULL.
+*/
+static int scan_dir(Edgecache_T cache)
+{
+        DIR *dir = opendir(cache->dir);
+        if (dir == NULL) {
+                return 0;
+        }
+        size_t size = strlen(cache->dir) + NAME_MAX_LEN;
+        char *name = malloc(size);
+        assert(name != NULL);
+        Entry *found = NULL;
+        int count = 0, capacity = 0;
+        struct dirent *file;
+        while ((file = readdir(dir)) != NULL) {
+                Entry entry;
+                int end = 0;
+                if (strlen(file->d_name) >= NAME_MAX_LEN ||
+                    sscanf(file->d_name, "%16" SCNx64 "-%dx%d.pbm%n",
+                           &entry.key, &entry.width, &entry.height,
+                           &end) != 3 ||
+                    end == 0 || file->d_name[end] != '\0') {
+                        continue;
+                }
+                snprintf(name, size, "%s/%s", cache->dir, file->d_name);
+                struct stat info;
+                if (stat(name, &info) != 0 || !S_ISREG(info.st_mode)) {
+                        continue;
+                }
+                entry.bytes = info.st_size;
+                entry.used = info.st_mtim;
+                if (count == capacity) {
+                        capacity = capacity == 0 ? 64 : 2 * capacity;
+                        found = realloc(found, capacity * sizeof(Entry));
+                        assert(found != NULL);
+                }
+                found[count++] = entry;
+        }
+        closedir(dir);
+        free(name);
+
+        if (count > 0) {
+                qsort(found, count, sizeof(Entry), compare_used);
+        }
+        for (int i = 0; i < count; i++) {
+                link_front(cache, add_entry(cache, found[i].key,
+                                            found[i].width, found[i].height,
+                                            found[i].bytes));
+        }
+        free(found);
+        return 1;
+}
+
+/*
+*  name:        compare_used
+*  purpose:     Orders two entries oldest first for qsort.
+*  arguments:   Pointers to two Entry elements.
+*  return type: Negative, zero or positive.
+*  effect:      None.
+*  expects:     None.
+*/
+static int compare_used(const void *a, const void *b)
+{
+        const struct timespec *x = &((const Entry *)a)->used;
+        const struct timespec *y = &((const Entry *)b)->used;
+        if (x->tv_sec != y->tv_sec) {
+                return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+        }
+        return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/*
+*  name:        find
+*  purpose:     Looks up the entry of a key and page size.
+*  arguments:   The cache, the key and the page's width and height.
+*  return type: The entry's index, or -1 if there is none.
+*  effect:      None.
+*  expects:     The caller holds the lock (or is opening the cache).
+*/
+static int find(Edgecache_T cache, uint64_t key, int width, int height)
+{
+        int i = cache->buckets[bucket_of(cache, key)];
+        while (i >= 0) {
+                Entry *entry = &cache->entries[i];
+                if (entry->key == key && entry->width == width &&
+                    entry->height == height) {
+                        return i;
+                }
+                i = entry->chain;
+        }
+        return -1;
+}
+
+/*
+*  name:        add_entry
+*  purpose:     Adds an entry to the hash table, not yet to the list.
+*  arguments:   The cache, the key, the page size and the file's bytes.
+*  return type: The new entry's index.
+*  effect:      Reuses a free entry or doubles the array; doubles the
+*               buckets when there are more entries than buckets. Counts
+*               the entry and its bytes in the stats.
+*  expects:     The caller holds the lock and the key is not present.
+*/
+static int add_entry(Edgecache_T cache, uint64_t key, int width,
+                     int height, uint64_t bytes)
+{
+        if (cache->free_list < 0) {
+                int old = cache->capacity;
+                cache->capacity = old == 0 ? 64 : 2 * old;
+                cache->entries = realloc(cache->entries,
+                                         cache->capacity * sizeof(Entry));
+                assert(cache->entries != NULL);
+                for (int i = cache->capacity - 1; i >= old; i--) {
+                        cache->entries[i].next = cache->free_list;
+                        cache->free_list = i;
+                }
+        }
+        int i = cache->free_list;
+        Entry *entry = &cache->entries[i];
+        cache->free_list = entry->next;
+        entry->key = key;
+        entry->width = width;
+        entry->height = height;
+        entry->bytes = bytes;
+        entry->generation = cache->generations++;
+        entry->prev = entry->next = -1;
+        size_t b = bucket_of(cache, key);
+        entry->chain = cache->buckets[b];
+        cache->buckets[b] = i;
+        cache->stats.entries++;
+        cache->stats.bytes += bytes;
+        if (cache->stats.entries > (uint64_t)cache->bucket_count) {
+                grow_buckets(cache);
+        }
+        return i;
+}
+
+/*
+*  name:        remove_entry
+*  purpose:     Takes an entry out of the index.
+*  arguments:   The cache and the entry's index.
+*  return type: None.
+*  effect:      Unlinks it from the list and its chain, frees it and takes
+*               it out of the stats. The file is left alone.
+*  expects:     The caller holds the lock and the entry is in the list.
+*/
+static void remove_entry(Edgecache_T cache, int i)
+{
+        Entry *entry = &cache->entries[i];
+        unlink_entry(cache, i);
+        int *link = &cache->buckets[bucket_of(cache, entry->key)];
+        while (*link != i) {
+                link = &cache->entries[*link].chain;
+        }
+        *link = entry->chain;
+        cache->stats.entries--;
+        cache->stats.bytes -= entry->bytes;
+        entry->next = cache->free_list;
+        cache->free_list = i;
+}
+
+/*
+*  name:        link_front
+*  purpose:     Makes an entry the most recently used.
+*  arguments:   The cache and an entry that is not in the list.
+*  return type: None.
+*  effect:      Links it in at the head.
+*  expects:     The caller holds the lock.
+*/
+static void link_front(Edgecache_T cache, int i)
+{
+        Entry *entry = &cache->entries[i];
+        entry->prev = -1;
+        entry->next = cache->head;
+        if (cache->head >= 0) {
+                cache->entries[cache->head].prev = i;
+        } else {
+                cache->tail = i;
+        }
+        cache->head = i;
+}
+
+/*
+*  name:        unlink_entry
+*  purpose:     Takes an entry out of the recency list.
+*  arguments:   The cache and an entry that is in the list.
+*  return type: None.
+*  effect:      Joins its neighbours, moving the head or tail if needed.
+*  expects:     The caller holds the lock.
+*/
+static void unlink_entry(Edgecache_T cache, int i)
+{
+        Entry *entry = &cache->entries[i];
+        if (entry->prev >= 0) {
+                cache->entries[entry->prev].next = entry->next;
+        } else {
+                cache->head = entry->next;
+        }
+        if (entry->next >= 0) {
+                cache->entries[entry->next].prev = entry->prev;
+        } else {
+                cache->tail = entry->prev;
+        }
+        entry->prev = entry->next = -1;
+}
+
+/*
+*  name:        grow_buckets
+*  purpose:     Doubles the hash table.
+*  arguments:   The cache.
+*  return type: None.
+*  effect:      Rechains every entry in use (those reachable from the old
+*               buckets) into twice as many buckets.
+*  expects:     The caller holds the lock.
+*/
+static void grow_buckets(Edgecache_T cache)
+{
+        int old_count = cache->bucket_count;
+        int *old = cache->buckets;
+        cache->bucket_count = 2 * old_count;
+        cache->buckets = malloc(cache->bucket_count * sizeof(int));
+        assert(cache->buckets != NULL);
+        memset(cache->buckets, 0xff, cache->bucket_count * sizeof(int));
+        for (int b = 0; b < old_count; b++) {
+                int i = old[b];
+                while (i >= 0) {
+                        int next = cache->entries[i].chain;
+                        size_t nb = bucket_of(cache, cache->entries[i].key);
+                        cache->entries[i].chain = cache->buckets[nb];
+                        cache->buckets[nb] = i;
+                        i = next;
+                }
+        }
+        free(old);
+}
+
+/*
+*  name:        evict
+*  purpose:     Brings the cache back under its limit.
+*  arguments:   The cache.
+*  return type: None.
+*  effect:      Deletes the least recently used results, file and entry,
+*               while their bytes add up to more than max_bytes.
+*  expects:     The caller holds the lock (or is opening the cache).
+*/
+static void evict(Edgecache_T cache)
+{
+        while (cache->stats.bytes > cache->max_bytes && cache->tail >= 0) {
+                Entry *entry = &cache->entries[cache->tail];
+                char *name = entry_name(cache, entry->key, entry->width,
+                                        entry->height);
+                unlink(name);
+                free(name);
+                remove_entry(cache, cache->tail);
+                cache->stats.evictions++;
+        }
+}
+
+/*
+*  name:        drop
+*  purpose:     Forgets a result that could not be read.
+*  arguments:   The cache, the key and the page size, and the generation
+*               of the entry that was looked up.
+*  return type: None.
+*  effect:      Deletes the file and the entry, if the entry is still the
+*               one looked up. If it was evicted, or evicted and stored
+*               again, while the lock was let go, nothing is touched: the
+*               file now on disk may be a fresh result.
+*  expects:     The caller holds the lock.
+*/
+static void drop(Edgecache_T cache, uint64_t key, int width, int height,
+                 uint64_t generation)
+{
+        int i = find(cache, key, width, height);
+        if (i >= 0 && cache->entries[i].generation == generation) {
+                char *name = entry_name(cache, key, width, height);
+                unlink(name);
+                free(name);
+                remove_entry(cache, i);
+        }
+}
+
+/*
+*  name:        entry_name
+*  purpose:     Builds the path of a result.
+*  arguments:   The cache, the key and the page size.
+*  return type: A malloced string the caller frees.
+*  effect:      None.
+*  expects:     cache is not NULL.
+*/
+static char *entry_name(Edgecache_T cache, uint64_t key, int width,
+                        int height)
+{
+        size_t size = strlen(cache->dir) + NAME_MAX_LEN;
+        char *name = malloc(size);
+        assert(name != NULL);
+        snprintf(name, size, "%s/%016" PRIx64 "-%dx%d.pbm", cache->dir, key,
+                 width, height);
+        return name;
+}
+
+/*
+*  name:        bucket_of
+*  purpose:     Picks the bucket of a key.
+*  arguments:   The cache and the key.
+*  return type: A bucket index.
+*  effect:      None. The key is already a hash, so its low bits are used
+*               as they are.
+*  expects:     cache is not NULL.
+*/
+static size_t bucket_of(Edgecache_T cache, uint64_t key)
+{
+        return (size_t)key & (size_t)(cache->bucket_count - 1);
+}
@@ -0,0 +1,35 @@
+/*
+ *     edgecache.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgecache
+ *
+ *     This file holds the interface for an on-disk cache of cleaned pages,
+ *     keyed by a hash of the page before cleaning and bounded in size by
+ *     evicting the least recently used results.
+ */
+
+#ifndef EDGECACHE_INCLUDED
+#define EDGECACHE_INCLUDED
+
+#include <stdint.h>
+#include "bit2.h"
+
+typedef struct Edgecache_T *Edgecache_T;
+
+/* What a cache has done since it was opened, and what it holds now */
+typedef struct {
+        uint64_t hits, misses, evictions;
+        uint64_t entries;
+        uint64_t bytes;
+} Edgecache_stats;
+
+extern Edgecache_T edgecache_open(const char *dir, uint64_t max_bytes);
+extern void        edgecache_close(Edgecache_T *cache);
+extern int         edgecache_get(Edgecache_T cache, uint64_t key,
+                                 Bit2_T bitmap);
+extern void        edgecache_put(Edgecache_T cache, uint64_t key,
+                                 Bit2_T bitmap);
+extern Edgecache_stats edgecache_stats(Edgecache_T cache);
+
+#endif
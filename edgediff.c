@@ -0,0 +1,307 @@
+/*
+ *     edgediff.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgediff
+ *
+ *     This program writes and applies the diffs described in edgediff.h.
+ *     The writer is handed a bitmap of the changed pixels (the original
+ *     XOR the result), turns it into runs with Bitrle_from_bit2, which
+ *     skips unchanged words with one compare each, and prints only the
+ *     rows that have runs, so what it writes grows with the change and
+ *     not with the page.
+ *
+ *     Applying reads the original images with Pbmio and their diffs in
+ *     step, flips each run in the row's words a whole word at a time and
+ *     writes the result. A diff that does not match its image (size, rows
+ *     out of order, runs that overlap or leave the row) or a stream with
+ *     more or fewer diffs than images is reported as a bad format, after
+ *     the images before it have been written.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include "assert.h"
+#include "bit2.h"
+#include "bitrle.h"
+#include "pbmio.h"
+#include "edgediff.h"
+
+static void put_number(FILE *out, unsigned value);
+static int  get_number(FILE *diff);
+static int  text_number(FILE *diff);
+static int  apply_one(FILE *diff, Bit2_T bitmap);
+static void flip_run(uint64_t *words, int first, int last);
+
+/*
+*  name:        edgediff_write
+*  purpose:     Writes the diff of one image.
+*  arguments:   The output stream, a bitmap whose 1 bits are the changed
+*               pixels and the format flag (nonzero for E4, else E1).
+*  return type: None.
+*  effect:      Writes the header and one entry per row with changes.
+*  expects:     out and changed are not NULL.
+*/
+void edgediff_write(FILE *out, Bit2_T changed, int raw)
+{
+        assert(out != NULL && changed != NULL);
+        Bitrle_T runs = Bitrle_from_bit2(changed);
+        int height = Bitrle_height(runs);
+        int rows = 0;
+        for (int r = 0; r < height; r++) {
+                int count;
+                Bitrle_row(runs, r, &count);
+                rows += count > 0;
+        }
+        fprintf(out, "%s\n%d %d %d\n", raw ? "E4" : "E1",
+                Bitrle_width(runs), height, rows);
+
+        int next_row = 0;
+        for (int r = 0; r < height; r++) {
+                int count;
+                const Bitrle_run *run = Bitrle_row(runs, r, &count);
+                if (count == 0) {
+                        continue;
+                }
+                if (raw) {
+                        put_number(out, r - next_row);
+                        put_number(out, count);
+                } else {
+                        fprintf(out, "%d %d", r, count);
+                }
+                int next_col = 0;
+                for (int i = 0; i < count; i++) {
+                        int len = run[i].last - run[i].first + 1;
+                        if (raw) {
+                                put_number(out, run[i].first - next_col);
+                                put_number(out, len - 1);
+                        } else {
+                                fprintf(out, " %d %d", run[i].first, len);
+                        }
+                        next_col = run[i].last + 2;
+                }
+                if (!raw) {
+                        putc('\n', out);
+                }
+                next_row = r + 1;
+        }
+        Bitrle_free(&runs);
+}
+
+/*
+*  name:        edgediff_apply
+*  purpose:     Rebuilds cleaned images from their originals and diffs.
+*  arguments:   The stream of original PBM images, the diff stream, the
+*               output stream, whether to write raw P4 (nonzero) or plain
+*               P1, and where to store how many images were written.
+*  return type: PBMIO_END when every image had its diff and both streams
+*               ended together, PBMIO_COUNT when an image ended early,
+*               PBMIO_BADFORMAT for a bad image, a bad diff, or a diff
+*               stream longer or shorter than the images.
+*  effect:      Writes each rebuilt image before reading the next. The
+*               diff may be E1 or E4, and may change from image to image.
+*  expects:     None of the pointers are NULL.
+*/
+Pbmio_status edgediff_apply(FILE *in, FILE *diff, FILE *out, int raw,
+                            int *images)
+{
+        assert(in != NULL && diff != NULL && out != NULL && images != NULL);
+        Pbmio_T reader = Pbmio_new(in);
+        Bit2_T bitmap = NULL;
+        Pbmio_status status;
+        *images = 0;
+        while ((status = Pbmio_load(reader, &bitmap)) == PBMIO_IMAGE) {
+                if (!apply_one(diff, bitmap)) {
+                        status = PBMIO_BADFORMAT;
+                        break;
+                }
+                Pbmio_write(out, bitmap, raw);
+                (*images)++;
+        }
+        if (status == PBMIO_END) {
+                int c;
+                while ((c = getc(diff)) != EOF && isspace(c)) {
+                }
+                if (c != EOF) {
+                        status = PBMIO_BADFORMAT; /* diffs left over */
+                }
+        }
+
+        fflush(out);
+        Pbmio_free(&reader);
+        if (bitmap != NULL) {
+                Bit2_free(&bitmap);
+        }
+        return status;
+}
+
+/*
+*  name:        apply_one
+*  purpose:     Reads the next diff and flips its runs in an image.
+*  arguments:   The diff stream and the image.
+*  return type: 1 if the diff was read whole and fits the image, else 0.
+*  effect:      Consumes the diff. On failure the image may be partly
+*               changed.
+*  expects:     bitmap is BIT2_ROW_MAJOR and not a view.
+*/
+static int apply_one(FILE *diff, Bit2_T bitmap)
+{
+        int c;
+        while ((c = getc(diff)) != EOF && isspace(c)) {
+        }
+        int kind = getc(diff);
+        if (c != 'E' || (kind != '1' && kind != '4')) {
+                return 0;
+        }
+        int raw = kind == '4';
+        int width = text_number(diff);
+        int height = text_number(diff);
+        int rows = text_number(diff);
+        if (width != Bit2_width(bitmap) || height != Bit2_height(bitmap) ||
+            rows < 0 || rows > height) {
+                return 0;
+        }
+
+        /* text_number took the newline, so E4 data starts here */
+        int next_row = 0;
+        for (int k = 0; k < rows; k++) {
+                int row = raw ? get_number(diff) : text_number(diff);
+                int count = raw ? get_number(diff) : text_number(diff);
+                if (row < 0 || count < 1 || count > (width + 1) / 2) {
+                        return 0;
+                }
+                if (raw) {
+                        row += next_row;
+                }
+                if (row < next_row || row >= height) {
+                        return 0;
+                }
+                uint64_t *words = Bit2_row(bitmap, row);
+                int next_col = 0;
+                for (int i = 0; i < count; i++) {
+                        int first = raw ? get_number(diff)
+                                        : text_number(diff);
+                        int len = raw ? get_number(diff)
+                                      : text_number(diff);
+                        if (first < 0 || len < 0 || (!raw && len == 0)) {
+                                return 0;
+                        }
+                        if (raw) {
+                                first += next_col; /* gap, then len - 1 */
+                                len++;
+                        }
+                        if (first < next_col || first >= width ||
+                            len > width - first) {
+                                return 0;
+                        }
+                        flip_run(words, first, first + len - 1);
+                        next_col = first + len + 1;
+                }
+                next_row = row + 1;
+        }
+        return 1;
+}
+
+/*
+*  name:        flip_run
+*  purpose:     Flips columns first..last of a row.
+*  arguments:   The row's words and the first and last column.
+*  return type: None.
+*  effect:      XORs the run's bits: masks on the end words and a NOT on
+*               every whole word between them.
+*  expects:     0 <= first <= last < the row's width.
+*/
+static void flip_run(uint64_t *words, int first, int last)
+{
+        int lo = first >> 6;
+        int hi = last >> 6;
+        uint64_t head = ~(uint64_t)0 << (first & 63);
+        uint64_t tail = ~(uint64_t)0 >> (63 - (last & 63));
+        if (lo == hi) {
+                words[lo] ^= head & tail;
+                return;
+        }
+        words[lo] ^= head;
+        for (int w = lo + 1; w < hi; w++) {
+                words[w] = ~words[w];
+        }
+        words[hi] ^= tail;
+}
+
+/*
+*  name:        put_number
+*  purpose:     Writes a number of an E4 diff.
+*  arguments:   The output stream and the number.
+*  return type: None.
+*  effect:      Writes unsigned LEB128: seven bits a byte, low bits first,
+*               the top bit set on every byte but the last.
+*  expects:     out is not NULL.
+*/
+static void put_number(FILE *out, unsigned value)
+{
+        while (value >= 0x80) {
+                putc((int)(value & 0x7f) | 0x80, out);
+                value >>= 7;
+        }
+        putc((int)value, out);
+}
+
+/*
+*  name:        get_number
+*  purpose:     Reads a number of an E4 diff.
+*  arguments:   The diff stream.
+*  return type: The number, or -1 if the stream ends or it is larger than
+*               INT_MAX.
+*  effect:      Consumes its bytes.
+*  expects:     diff is not NULL.
+*/
+static int get_number(FILE *diff)
+{
+        long long value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+                int c = getc(diff);
+                if (c == EOF) {
+                        return -1;
+                }
+                value |= (long long)(c & 0x7f) << shift;
+                if ((c & 0x80) == 0) {
+                        return value <= INT_MAX ? (int)value : -1;
+                }
+        }
+        return -1;
+}
+
+/*
+*  name:        text_number
+*  purpose:     Reads a decimal number of a diff header or an E1 diff.
+*  arguments:   The diff stream.
+*  return type: The number, or -1 if there is none or it is larger than
+*               INT_MAX.
+*  effect:      Skips white space before the number and consumes its
+*               digits and the one character after them.
+*  expects:     diff is not NULL.
+*/
+static int text_number(FILE *diff)
+{
+        int c;
+        while ((c = getc(diff)) != EOF && isspace(c)) {
+        }
+        if (c == EOF || !isdigit(c)) {
+                return -1;
+        }
+        long long value = 0;
+        while (c != EOF && isdigit(c)) {
+                value = 10 * value + (c - '0');
+                if (value > INT_MAX) {
+                        return -1;
+                }
+                c = getc(diff);
+        }
+        if (c != EOF && !isspace(c)) {
+                return -1;
+        }
+        return (int)value;
+}
@@ -0,0 +1,34 @@
+/*
+ *     edgediff.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgediff
+ *
+ *     This file holds the interface for writing the pixels unblackedges
+ *     changed as run lists instead of whole images, and for rebuilding
+ *     the cleaned images from the originals and those lists.
+ *
+ *     A diff stream holds one diff per image, in image order. Each starts
+ *     like a PBM header, "E1" (text) or "E4" (binary), a newline, then
+ *     "width height rows" and a newline, where rows is the number of rows
+ *     with changes. In E1 each such row is a line "row n col len col
+ *     len..." with its n runs of changed pixels left to right. In E4 it is
+ *     unsigned LEB128 numbers: the gap from the row after the previous
+ *     listed row (the first gap counts from row 0), n, then for each run
+ *     the gap from two past the previous run's last column (from 0 for
+ *     the first run) and its length minus 1. A changed pixel is flipped
+ *     when the diff is applied.
+ */
+
+#ifndef EDGEDIFF_INCLUDED
+#define EDGEDIFF_INCLUDED
+
+#include <stdio.h>
+#include "bit2.h"
+#include "pbmio.h"
+
+extern void edgediff_write(FILE *out, Bit2_T changed, int raw);
+extern Pbmio_status edgediff_apply(FILE *in, FILE *diff, FILE *out, int raw,
+                                   int *images);
+
+#endif
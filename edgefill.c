@@ -0,0 +1,761 @@
+/*
+ *     edgefill.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgefill
+ *
+ *     This program holds alternative engines for removing the black
+ *     pixels that are 4-connected to the edge of a bitmap. They work on
+ *     the packed words of Bit2 rows and never malloc per pixel.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "assert.h"
+#include "bit2.h"
+#include "bitrle.h"
+#include "bitlabel.h"
+#include "edgefill.h"
+
+/* A growable array of pixels still to visit. Each entry packs a pixel
+ * as (row << 32) | col. */
+typedef struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+        size_t peak;
+} Worklist;
+
+#define WORKLIST_START 1024
+
+static void grow_row(uint64_t *seen, const uint64_t *black, int nwords);
+static int  relax_row(Bit2_T reach, Bit2_T bitmap, int row);
+static void worklist_push(Worklist *list, int row, int col);
+static void claim_pixel(Worklist *list, Bit2_T bitmap, int row, int col);
+static int  run_first(const uint64_t *words, int col);
+static int  run_last(const uint64_t *words, int nwords, int col);
+static void clear_span(uint64_t *words, int first, int last);
+static void seed_runs(Worklist *list, const uint64_t *words, int row,
+                      int first, int last);
+static uint64_t span_mask(int w, int first, int last);
+static size_t fill_runs(Bitrle_T rle, Bit2_T erase);
+static int    first_overlap(const Bitrle_run *runs, int count, int col);
+
+/*
+*  name:        edgefill_bitpar
+*  purpose:     Removes edge-connected black pixels with word-parallel
+*               shifts instead of a per-pixel stack.
+*  arguments:   A bitmap representing the 2D bit array and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      Seeds a "reachable" bitmap with the black border pixels and
+*               grows it 64 pixels at a time: inside each row along runs of
+*               black, and into the rows above and below. Rows are swept
+*               top-down and then bottom-up until a sweep changes nothing;
+*               only rows next to a row that changed are looked at again.
+*               Finally every reachable pixel is turned white. Allocates a
+*               second bitmap and two row flag arrays, all freed before
+*               returning.
+*  expects:     The bitmap pointer is not NULL. stats may be NULL.
+*/
+void edgefill_bitpar(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL);
+        int height = Bit2_height(bitmap);
+        int width = Bit2_width(bitmap);
+        int nwords = Bit2_row_words(bitmap);
+        Bit2_T reach = Bit2_new(height, width);
+
+        /* seed: whole top and bottom rows, first and last column */
+        for (int row = 0; row < height; row++) {
+                const uint64_t *black = Bit2_row(bitmap, row);
+                uint64_t *seen = Bit2_row(reach, row);
+                if (row == 0 || row == height - 1) {
+                        memcpy(seen, black, nwords * sizeof(uint64_t));
+                } else {
+                        Bit2_word_put(seen, 0, Bit2_word_get(black, 0));
+                        Bit2_word_put(seen, width - 1,
+                                      Bit2_word_get(black, width - 1));
+                        grow_row(seen, black, nwords);
+                }
+        }
+
+        /* dirty[r] says row r or one of its neighbours changed */
+        char *dirty = malloc(height);
+        char *next = malloc(height);
+        assert(dirty != NULL && next != NULL);
+        memset(dirty, 1, height);
+
+        int changed = 1;
+        while (changed) {
+                changed = 0;
+                memset(next, 0, height);
+                for (int pass = 0; pass < 2; pass++) {
+                        for (int i = 0; i < height; i++) {
+                                int row = (pass == 0) ? i : height - 1 - i;
+                                if (!dirty[row] || !relax_row(reach, bitmap,
+                                                              row)) {
+                                        continue;
+                                }
+                                changed = 1;
+                                next[row] = 1;
+                                if (row > 0) {
+                                        next[row - 1] = dirty[row - 1] = 1;
+                                }
+                                if (row < height - 1) {
+                                        next[row + 1] = dirty[row + 1] = 1;
+                                }
+                        }
+                }
+                char *tmp = dirty;
+                dirty = next;
+                next = tmp;
+        }
+
+        /* clear everything that was reached */
+        for (int row = 0; row < height; row++) {
+                uint64_t *black = Bit2_row(bitmap, row);
+                const uint64_t *seen = Bit2_row(reach, row);
+                for (int w = 0; w < nwords; w++) {
+                        black[w] &= ~seen[w];
+                }
+        }
+
+        if (stats != NULL) {
+                stats->peak_bytes = (size_t)height * nwords * sizeof(uint64_t)
+                                    + 2 * (size_t)height;
+        }
+        free(dirty);
+        free(next);
+        Bit2_free(&reach);
+}
+
+/*
+*  name:        edgefill_worklist
+*  purpose:     Removes edge-connected black pixels with a flat array of
+*               packed pixel coordinates instead of a Stack_T of mallocs.
+*  arguments:   A bitmap representing the 2D bit array and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      A pixel is turned white as soon as it is pushed, so only
+*               in-bounds black neighbours are ever pushed and each black
+*               pixel enters the list at most once. The list therefore never
+*               holds more entries than there are black pixels. It starts
+*               at WORKLIST_START entries and doubles when full; the peak
+*               size is written to stats. The list is freed before
+*               returning.
+*  expects:     The bitmap pointer is not NULL. stats may be NULL.
+*/
+void edgefill_worklist(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL);
+        int height = Bit2_height(bitmap);
+        int width = Bit2_width(bitmap);
+        Worklist list = { NULL, 0, 0, 0 };
+
+        /* top and bottom */
+        for (int col = 0; col < width; col++) {
+                claim_pixel(&list, bitmap, 0, col);
+                claim_pixel(&list, bitmap, height - 1, col);
+        }
+
+        /* sides no overlap with the corners */
+        for (int row = 1; row < height - 1; row++) {
+                claim_pixel(&list, bitmap, row, 0);
+                claim_pixel(&list, bitmap, row, width - 1);
+        }
+
+        while (list.count > 0) {
+                uint64_t pixel = list.items[--list.count];
+                int row = (int)(pixel >> 32);
+                int col = (int)(pixel & 0xffffffffu);
+
+                if (row > 0) {
+                        claim_pixel(&list, bitmap, row - 1, col);
+                }
+                if (row < height - 1) {
+                        claim_pixel(&list, bitmap, row + 1, col);
+                }
+                if (col > 0) {
+                        claim_pixel(&list, bitmap, row, col - 1);
+                }
+                if (col < width - 1) {
+                        claim_pixel(&list, bitmap, row, col + 1);
+                }
+        }
+
+        if (stats != NULL) {
+                stats->peak_bytes = list.peak * sizeof(uint64_t);
+        }
+        free(list.items);
+}
+
+/*
+*  name:        edgefill_span
+*  purpose:     Removes edge-connected black pixels with a scanline fill
+*               that clears a whole horizontal run of black at a time.
+*  arguments:   A bitmap representing the 2D bit array and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      Each seed popped from the worklist is widened to the black
+*               run around it using word scans, the run is cleared with
+*               word masks, and one seed is pushed for every black run
+*               overlapping it in the rows above and below. Long rules and
+*               borders cost a handful of word operations instead of one
+*               push per pixel. The worklist is freed before returning and
+*               its peak size is written to stats.
+*  expects:     The bitmap pointer is not NULL. stats may be NULL.
+*/
+void edgefill_span(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL);
+        int height = Bit2_height(bitmap);
+        int width = Bit2_width(bitmap);
+        int nwords = Bit2_row_words(bitmap);
+        Worklist list = { NULL, 0, 0, 0 };
+
+        /* top and bottom rows: one seed per run */
+        seed_runs(&list, Bit2_row(bitmap, 0), 0, 0, width - 1);
+        if (height > 1) {
+                seed_runs(&list, Bit2_row(bitmap, height - 1), height - 1,
+                          0, width - 1);
+        }
+
+        /* sides no overlap with the corners */
+        for (int row = 1; row < height - 1; row++) {
+                const uint64_t *words = Bit2_row(bitmap, row);
+                if (Bit2_word_get(words, 0) == 1) {
+                        worklist_push(&list, row, 0);
+                }
+                if (Bit2_word_get(words, width - 1) == 1) {
+                        worklist_push(&list, row, width - 1);
+                }
+        }
+
+        while (list.count > 0) {
+                uint64_t pixel = list.items[--list.count];
+                int row = (int)(pixel >> 32);
+                int col = (int)(pixel & 0xffffffffu);
+                uint64_t *words = Bit2_row(bitmap, row);
+
+                if (Bit2_word_get(words, col) == 0) {
+                        continue; /* already cleared by another run */
+                }
+                int first = run_first(words, col);
+                int last = run_last(words, nwords, col);
+                clear_span(words, first, last);
+
+                if (row > 0) {
+                        seed_runs(&list, Bit2_row(bitmap, row - 1), row - 1,
+                                  first, last);
+                }
+                if (row < height - 1) {
+                        seed_runs(&list, Bit2_row(bitmap, row + 1), row + 1,
+                                  first, last);
+                }
+        }
+
+        if (stats != NULL) {
+                stats->peak_bytes = list.peak * sizeof(uint64_t);
+        }
+        free(list.items);
+}
+
+/*
+*  name:        edgefill_rle
+*  purpose:     Removes edge-connected black pixels by working on the
+*               page's black runs instead of its pixels.
+*  arguments:   A bitmap representing the 2D bit array and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      Converts the page to a Bitrle_T (one pass that skips white
+*               words), runs edgefill_runs on it and clears each removed
+*               run from the bitmap with word masks. Everything after the
+*               conversion touches only ink, so a page that is mostly white
+*               costs little more than reading it. The run lists and the
+*               fill's scratch are freed before returning; their total is
+*               written to stats.
+*  expects:     The bitmap pointer is not NULL and uses BIT2_ROW_MAJOR.
+*               stats may be NULL.
+*/
+void edgefill_rle(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL);
+        Bitrle_T rle = Bitrle_from_bit2(bitmap);
+        size_t bytes = Bitrle_bytes(rle);
+        bytes += fill_runs(rle, bitmap);
+        if (stats != NULL) {
+                stats->peak_bytes = bytes;
+        }
+        Bitrle_free(&rle);
+}
+
+/*
+*  name:        edgefill_label
+*  purpose:     Removes edge-connected black pixels by labeling the
+*               page's 4-connected blobs and clearing the ones that touch
+*               an edge.
+*  arguments:   A bitmap representing the 2D bit array and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      A blob is removed exactly when one of its pixels is on
+*               the edge, so one Bitlabel_new pass with
+*               BITLABEL_CLEAR_BORDER does the whole job. Its scratch is
+*               written to stats.
+*  expects:     The bitmap pointer is not NULL. stats may be NULL.
+*/
+void edgefill_label(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL);
+        Bitlabel_T labels = Bitlabel_new(bitmap, 4, BITLABEL_CLEAR_BORDER);
+        if (stats != NULL) {
+                stats->peak_bytes = Bitlabel_bytes(labels);
+        }
+        Bitlabel_free(&labels);
+}
+
+/*
+*  name:        edgefill_runs
+*  purpose:     Removes edge-connected black runs from a run-length bitmap.
+*  arguments:   A Bitrle_T and an optional stats pointer.
+*  return type: None.
+*  effect:      A run is removed when it touches the border or overlaps a
+*               removed run in the row above or below; runs in one row
+*               never touch, so this is the same as the pixel rule. Every
+*               run is looked at a bounded number of times, so time and
+*               scratch memory go with the number of runs, not the page
+*               area. The scratch size is written to stats.
+*  expects:     rle is not NULL. stats may be NULL.
+*/
+void edgefill_runs(Bitrle_T rle, Edgefill_stats *stats)
+{
+        assert(rle != NULL);
+        size_t bytes = fill_runs(rle, NULL);
+        if (stats != NULL) {
+                stats->peak_bytes = bytes;
+        }
+}
+
+/*
+*  name:        fill_runs
+*  purpose:     Does the work of edgefill_runs, optionally clearing the
+*               removed runs from a dense copy of the page as well.
+*  arguments:   The run-length bitmap and a row-major Bit2_T of the same
+*               page, or NULL.
+*  return type: The scratch bytes used.
+*  effect:      Numbers the runs row by row, seeds a worklist with the
+*               border runs and marks every run reached from them through
+*               vertical overlaps. Runs are marked when pushed, so each is
+*               pushed at most once and the worklist never outgrows the run
+*               count. Marked runs are then dropped from their rows and,
+*               when erase is given, cleared from it.
+*  expects:     rle is not NULL; erase, if given, matches its size.
+*/
+static size_t fill_runs(Bitrle_T rle, Bit2_T erase)
+{
+        int height = Bitrle_height(rle);
+        int width = Bitrle_width(rle);
+        size_t *start = malloc(((size_t)height + 1) * sizeof(size_t));
+        assert(start != NULL);
+        start[0] = 0;
+        for (int row = 0; row < height; row++) {
+                int count;
+                Bitrle_row(rle, row, &count);
+                start[row + 1] = start[row] + count;
+        }
+        size_t total = start[height];
+        size_t bytes = ((size_t)height + 1) * sizeof(size_t)
+                       + total * (1 + sizeof(uint64_t));
+        if (total == 0) {
+                free(start);
+                return bytes;
+        }
+
+        char *gone = calloc(total, 1);
+        uint64_t *work = malloc(total * sizeof(uint64_t));
+        assert(gone != NULL && work != NULL);
+        size_t top = 0;
+
+        /* border runs: all of the top and bottom rows, and any run
+         * touching the first or last column */
+        for (int row = 0; row < height; row++) {
+                int count;
+                const Bitrle_run *runs = Bitrle_row(rle, row, &count);
+                for (int i = 0; i < count; i++) {
+                        if (row == 0 || row == height - 1 ||
+                            runs[i].first == 0 || runs[i].last == width - 1) {
+                                gone[start[row] + i] = 1;
+                                work[top++] = ((uint64_t)row << 32) | i;
+                        }
+                }
+        }
+
+        while (top > 0) {
+                uint64_t item = work[--top];
+                int row = (int)(item >> 32);
+                int count;
+                Bitrle_run run = Bitrle_row(rle, row, &count)
+                                 [item & 0xffffffffu];
+                for (int next = row - 1; next <= row + 1; next += 2) {
+                        if (next < 0 || next >= height) {
+                                continue;
+                        }
+                        const Bitrle_run *runs = Bitrle_row(rle, next,
+                                                            &count);
+                        for (int i = first_overlap(runs, count, run.first);
+                             i < count && runs[i].first <= run.last; i++) {
+                                if (!gone[start[next] + i]) {
+                                        gone[start[next] + i] = 1;
+                                        work[top++] = ((uint64_t)next << 32)
+                                                      | i;
+                                }
+                        }
+                }
+        }
+
+        /* drop the marked runs */
+        for (int row = 0; row < height; row++) {
+                int count;
+                Bitrle_run *runs = Bitrle_row(rle, row, &count);
+                int kept = 0;
+                for (int i = 0; i < count; i++) {
+                        if (!gone[start[row] + i]) {
+                                runs[kept++] = runs[i];
+                        } else if (erase != NULL) {
+                                clear_span(Bit2_row(erase, row),
+                                           runs[i].first, runs[i].last);
+                        }
+                }
+                if (kept < count) {
+                        Bitrle_set_row(rle, row, runs, kept);
+                }
+        }
+
+        free(work);
+        free(gone);
+        free(start);
+        return bytes;
+}
+
+/*
+*  name:        first_overlap
+*  purpose:     Finds the first run of a row that ends at or after a
+*               column.
+*  arguments:   The row's runs, their count and the column.
+*  return type: Index of that run, or count if there is none.
+*  effect:      None. Binary search.
+*  expects:     runs is sorted (or count is 0).
+*/
+static int first_overlap(const Bitrle_run *runs, int count, int col)
+{
+        int low = 0, high = count;
+        while (low < high) {
+                int mid = low + (high - low) / 2;
+                if (runs[mid].last < col) {
+                        low = mid + 1;
+                } else {
+                        high = mid;
+                }
+        }
+        return low;
+}
+
+/*
+*  name:        run_first
+*  purpose:     Finds the first column of the black run containing col.
+*  arguments:   The words of a row and a column holding a black pixel.
+*  return type: Integer column.
+*  effect:      None. Looks for the nearest white bit at or below col one
+*               word at a time.
+*  expects:     Bit col of words is 1.
+*/
+static int run_first(const uint64_t *words, int col)
+{
+        int w = col >> 6;
+        int bit = col & 63;
+        uint64_t white = ~words[w] & (bit == 63 ? ~(uint64_t)0
+                                      : (((uint64_t)1 << (bit + 1)) - 1));
+        while (white == 0) {
+                if (w == 0) {
+                        return 0;
+                }
+                white = ~words[--w];
+        }
+        return 64 * w + (63 - __builtin_clzll(white)) + 1;
+}
+
+/*
+*  name:        run_last
+*  purpose:     Finds the last column of the black run containing col.
+*  arguments:   The words of a row, how many words the row has and a
+*               column holding a black pixel.
+*  return type: Integer column.
+*  effect:      None. Looks for the nearest white bit above col one word at
+*               a time; the zero padding past the last column stops the
+*               search at the row's end unless the width is a multiple
+*               of 64.
+*  expects:     Bit col of words is 1.
+*/
+static int run_last(const uint64_t *words, int nwords, int col)
+{
+        int w = col >> 6;
+        uint64_t white = ~words[w] & (~(uint64_t)0 << (col & 63));
+        while (white == 0) {
+                if (w == nwords - 1) {
+                        return 64 * nwords - 1;
+                }
+                white = ~words[++w];
+        }
+        return 64 * w + __builtin_ctzll(white) - 1;
+}
+
+/*
+*  name:        span_mask
+*  purpose:     Gives the bits of word w that fall inside [first, last].
+*  arguments:   A word index and an inclusive column range.
+*  return type: A 64-bit mask.
+*  effect:      None.
+*  expects:     Word w overlaps the range.
+*/
+static uint64_t span_mask(int w, int first, int last)
+{
+        uint64_t mask = ~(uint64_t)0;
+        if (w == first >> 6) {
+                mask &= ~(uint64_t)0 << (first & 63);
+        }
+        if (w == last >> 6) {
+                mask &= ~(uint64_t)0 >> (63 - (last & 63));
+        }
+        return mask;
+}
+
+/*
+*  name:        clear_span
+*  purpose:     Turns columns [first, last] of a row white.
+*  arguments:   The words of a row and an inclusive column range.
+*  return type: None.
+*  effect:      Clears the range a word at a time.
+*  expects:     0 <= first <= last < width.
+*/
+static void clear_span(uint64_t *words, int first, int last)
+{
+        for (int w = first >> 6; w <= last >> 6; w++) {
+                words[w] &= ~span_mask(w, first, last);
+        }
+}
+
+/*
+*  name:        seed_runs
+*  purpose:     Pushes one seed for every black run of a row that overlaps
+*               columns [first, last].
+*  arguments:   The worklist, the words of the row, its row index and an
+*               inclusive column range.
+*  return type: None.
+*  effect:      A run start is a black bit whose left neighbour inside the
+*               range is white, so a run that begins left of first is
+*               seeded at first. Starts are found with shifts and walked
+*               with count-trailing-zeros.
+*  expects:     0 <= first <= last < width.
+*/
+static void seed_runs(Worklist *list, const uint64_t *words, int row,
+                      int first, int last)
+{
+        uint64_t carry = 0; /* was the previous column black and in range */
+        for (int w = first >> 6; w <= last >> 6; w++) {
+                uint64_t black = words[w] & span_mask(w, first, last);
+                uint64_t starts = black & ~((black << 1) | carry);
+                carry = black >> 63;
+                while (starts != 0) {
+                        worklist_push(list, row,
+                                      64 * w + __builtin_ctzll(starts));
+                        starts &= starts - 1;
+                }
+        }
+}
+
+/*
+*  name:        edgefill_find_runs
+*  purpose:     Lists the black runs of a row from left to right.
+*  arguments:   The words of a row, the width and an output array with room
+*               for width / 2 + 1 runs.
+*  return type: Integer, the number of runs written.
+*  effect:      Skips whole white or whole black words at a time.
+*  expects:     words and runs are not NULL.
+*/
+int edgefill_find_runs(const uint64_t *words, int width,
+                       Edgefill_run *runs)
+{
+        int n = 0;
+        int col = 0;
+        while (col < width) {
+                /* skip white */
+                uint64_t bits = words[col >> 6] >> (col & 63);
+                if (bits == 0) {
+                        col = (col | 63) + 1;
+                        continue;
+                }
+                col += __builtin_ctzll(bits);
+                if (col >= width) {
+                        break;
+                }
+                runs[n].first = col;
+
+                /* skip black */
+                for (;;) {
+                        uint64_t white = ~words[col >> 6] >> (col & 63);
+                        if (white == 0) {
+                                col = (col | 63) + 1;
+                                if (col >= width) {
+                                        break;
+                                }
+                                continue;
+                        }
+                        col += __builtin_ctzll(white);
+                        break;
+                }
+                if (col > width) {
+                        col = width;
+                }
+                runs[n].last = col - 1;
+                n++;
+        }
+        return n;
+}
+
+/*
+*  name:        claim_pixel
+*  purpose:     Turns a black pixel white and queues it so its neighbours
+*               get looked at.
+*  arguments:   The worklist, the bitmap and an in-bounds row and column.
+*  return type: None.
+*  effect:      Does nothing for white pixels.
+*  expects:     row and col are in bounds.
+*/
+static void claim_pixel(Worklist *list, Bit2_T bitmap, int row, int col)
+{
+        uint64_t *words = Bit2_row(bitmap, row);
+        if (Bit2_word_get(words, col) == 1) {
+                Bit2_word_put(words, col, 0);
+                worklist_push(list, row, col);
+        }
+}
+
+/*
+*  name:        worklist_push
+*  purpose:     Appends a pixel to the worklist.
+*  arguments:   The worklist and the pixel's row and column.
+*  return type: None.
+*  effect:      Doubles the capacity with realloc when the list is full and
+*               keeps track of the largest capacity used.
+*  expects:     list is not NULL; row and col are non-negative.
+*/
+static void worklist_push(Worklist *list, int row, int col)
+{
+        if (list->count == list->capacity) {
+                size_t capacity = list->capacity == 0 ? WORKLIST_START
+                                                      : 2 * list->capacity;
+                list->items = realloc(list->items,
+                                      capacity * sizeof(uint64_t));
+                assert(list->items != NULL);
+                list->capacity = capacity;
+                list->peak = capacity;
+        }
+        list->items[list->count++] = ((uint64_t)row << 32) | (uint32_t)col;
+}
+
+/*
+*  name:        relax_row
+*  purpose:     Pulls reachability into one row from the rows above and
+*               below, then spreads it along the row's black runs.
+*  arguments:   The reachable bitmap, the image bitmap and a row index.
+*  return type: Integer, 1 if the row of reach changed and 0 otherwise.
+*  effect:      Updates the given row of reach in place.
+*  expects:     Both bitmaps have the same size and row is in bounds.
+*/
+static int relax_row(Bit2_T reach, Bit2_T bitmap, int row)
+{
+        int height = Bit2_height(bitmap);
+        int nwords = Bit2_row_words(bitmap);
+        const uint64_t *black = Bit2_row(bitmap, row);
+        uint64_t *seen = Bit2_row(reach, row);
+        const uint64_t *above = (row > 0) ? Bit2_row(reach, row - 1) : NULL;
+        const uint64_t *below = (row < height - 1) ?
+                                Bit2_row(reach, row + 1) : NULL;
+        int grew = 0;
+
+        for (int w = 0; w < nwords; w++) {
+                uint64_t from = 0;
+                if (above != NULL) {
+                        from |= above[w];
+                }
+                if (below != NULL) {
+                        from |= below[w];
+                }
+                uint64_t add = from & black[w] & ~seen[w];
+                if (add != 0) {
+                        seen[w] |= add;
+                        grew = 1;
+                }
+        }
+
+        if (!grew) {
+                return 0;
+        }
+        grow_row(seen, black, nwords);
+        return 1;
+}
+
+/*
+*  name:        grow_row
+*  purpose:     Extends every seed bit of a row to the whole black run
+*               that contains it.
+*  arguments:   The seed words (a subset of black), the black words and the
+*               number of words in the row.
+*  return type: None.
+*  effect:      Overwrites seen. Each word is filled in six shift steps
+*               (occluded fill) per direction; a carry bit moves the fill
+*               across word boundaries. Column order is low bit to high bit,
+*               so "up" here means toward higher columns.
+*  expects:     seen and black are not NULL and seen is a subset of black.
+*/
+static void grow_row(uint64_t *seen, const uint64_t *black, int nwords)
+{
+        uint64_t carry = 0;
+        for (int w = 0; w < nwords; w++) { /* toward higher columns */
+                uint64_t g = black[w];
+                uint64_t x = seen[w] | (carry & g);
+                x |= g & (x << 1);
+                g &= g << 1;
+                x |= g & (x << 2);
+                g &= g << 2;
+                x |= g & (x << 4);
+                g &= g << 4;
+                x |= g & (x << 8);
+                g &= g << 8;
+                x |= g & (x << 16);
+                g &= g << 16;
+                x |= g & (x << 32);
+                seen[w] = x;
+                carry = x >> 63;
+        }
+
+        carry = 0;
+        for (int w = nwords - 1; w >= 0; w--) { /* toward lower columns */
+                uint64_t g = black[w];
+                uint64_t x = seen[w] | ((carry << 63) & g);
+                x |= g & (x >> 1);
+                g &= g >> 1;
+                x |= g & (x >> 2);
+                g &= g >> 2;
+                x |= g & (x >> 4);
+                g &= g >> 4;
+                x |= g & (x >> 8);
+                g &= g >> 8;
+                x |= g & (x >> 16);
+                g &= g >> 16;
+                x |= g & (x >> 32);
+                seen[w] = x;
+                carry = x & 1;
+        }
+}
@@ -0,0 +1,39 @@
+/*
+ *     edgefill.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgefill
+ *
+ *     This file holds the interface for the alternative engines that
+ *     remove edge-connected black pixels from a bitmap. Every engine
+ *     gives the same result as unblackedges() in unblackedges.c.
+ */
+
+#ifndef EDGEFILL_INCLUDED
+#define EDGEFILL_INCLUDED
+
+#include <stddef.h>
+#include "bit2.h"
+#include "bitrle.h"
+
+/* What an engine reports back about one run. Engines accept a NULL
+ * pointer when the caller does not care. */
+typedef struct {
+        size_t peak_bytes; /* most scratch memory held at one time */
+} Edgefill_stats;
+
+/* One horizontal run of black, columns first..last inclusive */
+typedef struct {
+        int first, last;
+} Edgefill_run;
+
+extern void edgefill_bitpar(Bit2_T bitmap, Edgefill_stats *stats);
+extern void edgefill_worklist(Bit2_T bitmap, Edgefill_stats *stats);
+extern void edgefill_span(Bit2_T bitmap, Edgefill_stats *stats);
+extern void edgefill_rle(Bit2_T bitmap, Edgefill_stats *stats);
+extern void edgefill_label(Bit2_T bitmap, Edgefill_stats *stats);
+extern void edgefill_runs(Bitrle_T rle, Edgefill_stats *stats);
+extern int  edgefill_find_runs(const uint64_t *words, int width,
+                               Edgefill_run *runs);
+
+#endif
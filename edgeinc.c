@@ -0,0 +1,576 @@
+/*
+ *     edgeinc.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgeinc
+ *
+ *     This program keeps a page (the original) and the page with its
+ *     edge-connected black pixels removed (the result), and brings the
+ *     result up to date after edits to the original without cleaning the
+ *     whole page again.
+ *
+ *     A black pixel of the original is reached (connected to the edge)
+ *     exactly when it is white in the result, so the two bitmaps hold
+ *     the whole state. An edit can change the answer in two ways:
+ *
+ *     - A pixel turned white that was reached may have been the only
+ *       way some reached pixels got to the edge. A breadth-first search
+ *       starts from each of its reached neighbours, and the searches
+ *       take turns one pixel at a time. Searches that run into each other
+ *       join, since their pixels are still connected; a search that meets
+ *       the edge is done, and one that runs out of pixels has found a
+ *       piece that is cut off, which goes back into the result. A pixel
+ *       that is not on the edge was reached through one of its
+ *       neighbours, so once all searches but one have joined or run out,
+ *       the last one must reach the edge and is not followed further.
+ *       Cutting a thick region therefore costs about the size of the
+ *       loop around the cut, and cutting off a small piece about the
+ *       size of the piece.
+ *     - A pixel turned black that is on the edge or next to a reached
+ *       pixel becomes reached, and so does everything black in the
+ *       result that connects to it, found with an ordinary flood fill.
+ *
+ *     Removals are settled as they are applied, and additions after all
+ *     edits are in. Until then an added pixel counts as not reached, so
+ *     every removal starts from a reached set that is right for the page
+ *     without the pending additions, and any pixel the additions newly
+ *     connect is reached through one of them. The work goes with the
+ *     edited area and the pixels that had to be looked at, not the page.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "edgeinc.h"
+
+#define PIXELS_START 1024
+#define SEARCHES 4          /* one per neighbour of a removed pixel */
+#define TABLE_START 64      /* visited table slots for a new removal */
+#define EMPTY UINT64_MAX    /* free slot of the visited table */
+
+/* A growable array of packed (row << 32) | col pixels */
+typedef struct {
+        uint64_t *items;
+        size_t count, capacity;
+} Pixels;
+
+/* Which search saw each pixel so far, an open-addressing hash table */
+typedef struct {
+        uint64_t *keys;        /* packed pixels, EMPTY where free */
+        signed char *owner;
+        size_t size;           /* slots in use, a power of two */
+        size_t capacity;       /* slots allocated */
+        size_t count;
+} Visited;
+
+/* The searches after one removal; groups are a tiny union-find */
+typedef struct {
+        int count;
+        size_t head[SEARCHES];  /* next pixel of each queue to expand */
+        int done[SEARCHES];     /* queue ran out */
+        int group[SEARCHES];
+        int escaped[SEARCHES];  /* per group root: met the edge */
+} Race;
+
+/* This struct holds a page, its cleaned version and reusable scratch */
+struct Edgeinc_T {
+        Bit2_T original;
+        Bit2_T result;          /* original minus the reached pixels */
+        int height, width;
+        Pixels added;           /* pixels the current update turned black */
+        Pixels queue[SEARCHES]; /* what each search has visited */
+        Pixels work;            /* flood stack */
+        Visited visited;
+};
+
+static void   pixels_push(Pixels *pixels, int row, int col);
+static size_t settle_removal(Edgeinc_T inc, int row, int col);
+static int    race_over(const Race *race, int on_edge);
+static int    group_of(Race *race, int search);
+static int    visit(Visited *visited, uint64_t pixel, int search);
+static void   visited_reset(Visited *visited);
+static void   visited_grow(Visited *visited);
+static size_t flood(Edgeinc_T inc, int row, int col);
+static int    on_edge(Edgeinc_T inc, int row, int col);
+static int    reached(Edgeinc_T inc, int row, int col);
+
+/*
+*  name:        edgeinc_new
+*  purpose:     Starts keeping a page and its cleaned version.
+*  arguments:   The page. It is copied, so the caller keeps it.
+*  return type: A new Edgeinc_T the caller must free with edgeinc_free.
+*  effect:      Copies the page twice into row-major bitmaps and cleans
+*               one of them with edgefill_worklist. This is the only full
+*               pass over the page.
+*  expects:     The page is not NULL.
+*/
+Edgeinc_T edgeinc_new(Bit2_T page)
+{
+        assert(page != NULL);
+        Edgeinc_T inc = malloc(sizeof(*inc));
+        assert(inc != NULL);
+        inc->height = Bit2_height(page);
+        inc->width = Bit2_width(page);
+        inc->original = Bit2_new(inc->height, inc->width);
+        inc->result = Bit2_new(inc->height, inc->width);
+        Bit2_combine(inc->original, page, BIT2_OR);
+        Bit2_combine(inc->result, page, BIT2_OR);
+        edgefill_worklist(inc->result, NULL);
+        inc->added = (Pixels){ NULL, 0, 0 };
+        inc->work = (Pixels){ NULL, 0, 0 };
+        for (int s = 0; s < SEARCHES; s++) {
+                inc->queue[s] = (Pixels){ NULL, 0, 0 };
+        }
+        inc->visited = (Visited){ NULL, NULL, 0, 0, 0 };
+        return inc;
+}
+
+/*
+*  name:        edgeinc_free
+*  purpose:     Frees an Edgeinc_T and both of its bitmaps.
+*  arguments:   A pointer to the Edgeinc_T.
+*  return type: None.
+*  effect:      Frees the memory and sets the pointer to NULL. Bitmaps got
+*               from edgeinc_original or edgeinc_result are freed too.
+*  expects:     inc and *inc are not NULL.
+*/
+void edgeinc_free(Edgeinc_T *inc)
+{
+        assert(inc != NULL && *inc != NULL);
+        Bit2_free(&(*inc)->original);
+        Bit2_free(&(*inc)->result);
+        free((*inc)->added.items);
+        free((*inc)->work.items);
+        for (int s = 0; s < SEARCHES; s++) {
+                free((*inc)->queue[s].items);
+        }
+        free((*inc)->visited.keys);
+        free((*inc)->visited.owner);
+        free(*inc);
+        *inc = NULL;
+}
+
+/*
+*  name:        edgeinc_update
+*  purpose:     Applies edits to the original and brings the result up to
+*               date.
+*  arguments:   The Edgeinc_T, an array of edits and how many there are.
+*  return type: The number of pixels looked at, a measure of the work
+*               done: every edited pixel plus every pixel a search or
+*               flood visited.
+*  effect:      Edits are applied in order, so a later one wins where two
+*               overlap. Reached pixels cut off from the edge move into the
+*               result as each removal is applied, and result pixels newly
+*               connected to the edge leave it once all edits are in, as
+*               described above. Afterwards the result
+*               is exactly what cleaning the edited original would give.
+*  expects:     inc is not NULL, edits is not NULL when count > 0, every
+*               rectangle lies inside the page and every bit is 0 or 1.
+*/
+size_t edgeinc_update(Edgeinc_T inc, const Edgeinc_edit *edits, int count)
+{
+        assert(inc != NULL && count >= 0);
+        assert(count == 0 || edits != NULL);
+        size_t touched = 0;
+        inc->added.count = 0;
+
+        for (int i = 0; i < count; i++) {
+                const Edgeinc_edit *edit = &edits[i];
+                assert(edit->bit == 0 || edit->bit == 1);
+                assert(edit->height > 0 && edit->width > 0);
+                assert(edit->row >= 0 &&
+                       edit->row + edit->height <= inc->height);
+                assert(edit->col >= 0 &&
+                       edit->col + edit->width <= inc->width);
+                for (int r = edit->row; r < edit->row + edit->height; r++) {
+                        uint64_t *page = Bit2_row(inc->original, r);
+                        uint64_t *kept = Bit2_row(inc->result, r);
+                        for (int c = edit->col; c < edit->col + edit->width;
+                             c++) {
+                                touched++;
+                                if (Bit2_word_get(page, c) == edit->bit) {
+                                        continue;
+                                }
+                                Bit2_word_put(page, c, edit->bit);
+                                if (edit->bit == 1) {
+                                        /* not reached until shown to be */
+                                        Bit2_word_put(kept, c, 1);
+                                        pixels_push(&inc->added, r, c);
+                                } else if (Bit2_word_get(kept, c) == 0) {
+                                        touched += settle_removal(inc, r, c);
+                                } else {
+                                        Bit2_word_put(kept, c, 0);
+                                }
+                        }
+                }
+        }
+
+        /* additions: flood from the ones that touch the edge's reach */
+        static const int step[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 },
+                                        { 0, 1 } };
+        for (size_t i = 0; i < inc->added.count; i++) {
+                int row = (int)(inc->added.items[i] >> 32);
+                int col = (int)(inc->added.items[i] & 0xffffffffu);
+                if (Bit2_get(inc->result, row, col) == 0) {
+                        continue; /* flooded already, or edited back */
+                }
+                int connect = on_edge(inc, row, col);
+                for (int k = 0; k < 4 && !connect; k++) {
+                        connect = reached(inc, row + step[k][0],
+                                          col + step[k][1]);
+                }
+                if (connect) {
+                        touched += flood(inc, row, col);
+                }
+        }
+        return touched;
+}
+
+/*
+*  name:        edgeinc_original
+*  purpose:     Gives the page as edited so far.
+*  arguments:   An Edgeinc_T.
+*  return type: The original bitmap, which belongs to inc.
+*  effect:      None.
+*  expects:     inc is not NULL. The caller only reads the bitmap; edits go
+*               through edgeinc_update.
+*/
+Bit2_T edgeinc_original(Edgeinc_T inc)
+{
+        assert(inc != NULL);
+        return inc->original;
+}
+
+/*
+*  name:        edgeinc_result
+*  purpose:     Gives the cleaned page.
+*  arguments:   An Edgeinc_T.
+*  return type: The result bitmap, which belongs to inc.
+*  effect:      None.
+*  expects:     inc is not NULL. The caller only reads the bitmap.
+*/
+Bit2_T edgeinc_result(Edgeinc_T inc)
+{
+        assert(inc != NULL);
+        return inc->result;
+}
+
+/*
+*  name:        settle_removal
+*  purpose:     Moves whatever a removed pixel cut off from the edge into
+*               the result.
+*  arguments:   The Edgeinc_T and the pixel, which was reached and has just
+*               been turned white in the original.
+*  return type: The number of pixels the searches visited.
+*  effect:      Races one breadth-first search per reached neighbour as
+*               described above, then sets in the result every pixel of
+*               each group that ran out without meeting the edge.
+*  expects:     Every other pixel is reached exactly when it is connected
+*               to the edge through pixels that are reached.
+*/
+static size_t settle_removal(Edgeinc_T inc, int row, int col)
+{
+        Race race;
+        int edge = on_edge(inc, row, col);
+        int near[4][2] = { { row - 1, col }, { row + 1, col },
+                           { row, col - 1 }, { row, col + 1 } };
+        race.count = 0;
+        visited_reset(&inc->visited);
+        for (int k = 0; k < 4; k++) {
+                if (reached(inc, near[k][0], near[k][1])) {
+                        int s = race.count++;
+                        inc->queue[s].count = 0;
+                        pixels_push(&inc->queue[s], near[k][0], near[k][1]);
+                        visit(&inc->visited, inc->queue[s].items[0], s);
+                        race.head[s] = 0;
+                        race.done[s] = 0;
+                        race.group[s] = s;
+                        race.escaped[s] = 0;
+                }
+        }
+
+        while (!race_over(&race, edge)) {
+                for (int s = 0; s < race.count; s++) {
+                        Pixels *queue = &inc->queue[s];
+                        if (race.done[s] || race.escaped[group_of(&race, s)]) {
+                                continue;
+                        }
+                        if (race.head[s] == queue->count) {
+                                race.done[s] = 1;
+                                continue;
+                        }
+                        uint64_t pixel = queue->items[race.head[s]++];
+                        int r = (int)(pixel >> 32);
+                        int c = (int)(pixel & 0xffffffffu);
+                        if (on_edge(inc, r, c)) {
+                                race.escaped[group_of(&race, s)] = 1;
+                                continue;
+                        }
+                        int next[4][2] = { { r - 1, c }, { r + 1, c },
+                                           { r, c - 1 }, { r, c + 1 } };
+                        for (int k = 0; k < 4; k++) {
+                                if (!reached(inc, next[k][0], next[k][1])) {
+                                        continue;
+                                }
+                                uint64_t other = ((uint64_t)next[k][0] << 32)
+                                                 | (uint32_t)next[k][1];
+                                int owner = visit(&inc->visited, other, s);
+                                if (owner < 0) {
+                                        pixels_push(queue, next[k][0],
+                                                    next[k][1]);
+                                        continue;
+                                }
+                                int a = group_of(&race, s);
+                                int b = group_of(&race, owner);
+                                if (a != b) {
+                                        race.group[b] = a;
+                                        race.escaped[a] |= race.escaped[b];
+                                }
+                        }
+                }
+        }
+
+        size_t visits = 0;
+        for (int s = 0; s < race.count; s++) {
+                Pixels *queue = &inc->queue[s];
+                visits += queue->count;
+                int g = group_of(&race, s);
+                int cut = !race.escaped[g];
+                for (int t = 0; t < race.count && cut; t++) {
+                        cut = group_of(&race, t) != g || race.done[t];
+                }
+                for (size_t i = 0; cut && i < queue->count; i++) {
+                        Bit2_put(inc->result, (int)(queue->items[i] >> 32),
+                                 (int)(queue->items[i] & 0xffffffffu), 1);
+                }
+        }
+        return visits;
+}
+
+/*
+*  name:        race_over
+*  purpose:     Tells whether the searches of a removal are settled.
+*  arguments:   The Race and whether the removed pixel is on the edge.
+*  return type: 1 if no group is still open, or if the pixel is not on
+*               the edge and exactly one group is open with none known to
+*               reach the edge (that one must); else 0.
+*  effect:      None.
+*  expects:     None.
+*/
+static int race_over(const Race *race, int on_edge)
+{
+        Race copy = *race;
+        int open = 0;
+        int escaped = 0;
+        for (int g = 0; g < copy.count; g++) {
+                if (group_of(&copy, g) != g) {
+                        continue;
+                }
+                if (copy.escaped[g]) {
+                        escaped = 1;
+                        continue;
+                }
+                int live = 0;
+                for (int s = 0; s < copy.count; s++) {
+                        live |= group_of(&copy, s) == g && !copy.done[s];
+                }
+                open += live;
+        }
+        return open == 0 || (!on_edge && !escaped && open == 1);
+}
+
+/*
+*  name:        group_of
+*  purpose:     Finds the group a search belongs to.
+*  arguments:   The Race and a search number.
+*  return type: The search number at the root of its group.
+*  effect:      Compresses the path.
+*  expects:     search < race->count.
+*/
+static int group_of(Race *race, int search)
+{
+        while (race->group[search] != search) {
+                race->group[search] = race->group[race->group[search]];
+                search = race->group[search];
+        }
+        return search;
+}
+
+/*
+*  name:        visit
+*  purpose:     Records that a search has seen a pixel, unless one already
+*               has.
+*  arguments:   The Visited table, a packed pixel and the search number.
+*  return type: -1 if the pixel was new (it now belongs to search),
+*               otherwise the search that saw it first.
+*  effect:      Grows the table past half full.
+*  expects:     The table was reset for this removal.
+*/
+static int visit(Visited *visited, uint64_t pixel, int search)
+{
+        if (2 * (visited->count + 1) > visited->size) {
+                visited_grow(visited);
+        }
+        size_t mask = visited->size - 1;
+        uint64_t hash = pixel * 0x9e3779b97f4a7c15u;
+        size_t i = (size_t)(hash ^ (hash >> 32)) & mask;
+        while (visited->keys[i] != EMPTY) {
+                if (visited->keys[i] == pixel) {
+                        return visited->owner[i];
+                }
+                i = (i + 1) & mask;
+        }
+        visited->keys[i] = pixel;
+        visited->owner[i] = (signed char)search;
+        visited->count++;
+        return -1;
+}
+
+/*
+*  name:        visited_reset
+*  purpose:     Empties the visited table for a new removal.
+*  arguments:   The Visited table.
+*  return type: None.
+*  effect:      Goes back to TABLE_START slots, reusing the allocation, so
+*               a small removal after a big one clears only a few slots.
+*  expects:     None.
+*/
+static void visited_reset(Visited *visited)
+{
+        if (visited->capacity < TABLE_START) {
+                free(visited->keys);
+                free(visited->owner);
+                visited->keys = malloc(TABLE_START * sizeof(uint64_t));
+                visited->owner = malloc(TABLE_START);
+                assert(visited->keys != NULL && visited->owner != NULL);
+                visited->capacity = TABLE_START;
+        }
+        visited->size = TABLE_START;
+        visited->count = 0;
+        memset(visited->keys, 0xff, visited->size * sizeof(uint64_t));
+}
+
+/*
+*  name:        visited_grow
+*  purpose:     Doubles the slots of the visited table in use.
+*  arguments:   The Visited table.
+*  return type: None.
+*  effect:      Moves the entries into new arrays twice the size, which
+*               replace the old allocation.
+*  expects:     None.
+*/
+static void visited_grow(Visited *visited)
+{
+        size_t old_size = visited->size;
+        uint64_t *old_keys = visited->keys;
+        signed char *old_owner = visited->owner;
+        visited->size = 2 * old_size;
+        visited->capacity = visited->size;
+        visited->keys = malloc(visited->size * sizeof(uint64_t));
+        visited->owner = malloc(visited->size);
+        assert(visited->keys != NULL && visited->owner != NULL);
+        memset(visited->keys, 0xff, visited->size * sizeof(uint64_t));
+        visited->count = 0;
+        for (size_t i = 0; i < old_size; i++) {
+                if (old_keys[i] != EMPTY) {
+                        visit(visited, old_keys[i], old_owner[i]);
+                }
+        }
+        free(old_keys);
+        free(old_owner);
+}
+
+/*
+*  name:        flood
+*  purpose:     Marks a pixel and everything black connected to it in the
+*               result as reached.
+*  arguments:   The Edgeinc_T and a pixel set in the result.
+*  return type: The number of pixels cleared.
+*  effect:      Depth-first flood fill that clears pixels from the result
+*               as they are pushed, on the work stack.
+*  expects:     The pixel is set in the result and connects to the edge.
+*/
+static size_t flood(Edgeinc_T inc, int row, int col)
+{
+        Pixels *stack = &inc->work;
+        stack->count = 0;
+        size_t cleared = 1;
+        Bit2_put(inc->result, row, col, 0);
+        pixels_push(stack, row, col);
+
+        while (stack->count > 0) {
+                uint64_t pixel = stack->items[--stack->count];
+                int r = (int)(pixel >> 32);
+                int c = (int)(pixel & 0xffffffffu);
+                int near[4][2] = { { r - 1, c }, { r + 1, c }, { r, c - 1 },
+                                   { r, c + 1 } };
+                for (int k = 0; k < 4; k++) {
+                        int nr = near[k][0];
+                        int nc = near[k][1];
+                        if (nr >= 0 && nr < inc->height && nc >= 0 &&
+                            nc < inc->width &&
+                            Bit2_get(inc->result, nr, nc) == 1) {
+                                Bit2_put(inc->result, nr, nc, 0);
+                                pixels_push(stack, nr, nc);
+                                cleared++;
+                        }
+                }
+        }
+        return cleared;
+}
+
+/*
+*  name:        on_edge
+*  purpose:     Tells whether a pixel is on the edge of the page.
+*  arguments:   The Edgeinc_T, a row and a column.
+*  return type: 1 if it is in the first or last row or column, else 0.
+*  effect:      None.
+*  expects:     The pixel is in bounds.
+*/
+static int on_edge(Edgeinc_T inc, int row, int col)
+{
+        return row == 0 || col == 0 || row == inc->height - 1 ||
+               col == inc->width - 1;
+}
+
+/*
+*  name:        reached
+*  purpose:     Tells whether a pixel is black and connected to the edge.
+*  arguments:   The Edgeinc_T, a row and a column, possibly out of bounds.
+*  return type: 1 if the pixel is in bounds, black in the original and
+*               white in the result, else 0.
+*  effect:      None.
+*  expects:     None.
+*/
+static int reached(Edgeinc_T inc, int row, int col)
+{
+        if (row < 0 || row >= inc->height || col < 0 || col >= inc->width) {
+                return 0;
+        }
+        return Bit2_get(inc->original, row, col) == 1 &&
+               Bit2_get(inc->result, row, col) == 0;
+}
+
+/*
+*  name:        pixels_push
+*  purpose:     Appends a pixel to a growable array.
+*  arguments:   The array, a row and a column.
+*  return type: None.
+*  effect:      Doubles the array when it is full.
+*  expects:     The row and column are not negative.
+*/
+static void pixels_push(Pixels *pixels, int row, int col)
+{
+        if (pixels->count == pixels->capacity) {
+                pixels->capacity = pixels->capacity == 0
+                                   ? PIXELS_START : 2 * pixels->capacity;
+                pixels->items = realloc(pixels->items, pixels->capacity
+                                                       * sizeof(uint64_t));
+                assert(pixels->items != NULL);
+        }
+        pixels->items[pixels->count++] = ((uint64_t)row << 32)
+                                         | (uint32_t)col;
+}
@@ -0,0 +1,36 @@
+/*
+ *     edgeinc.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgeinc
+ *
+ *     This file holds the interface for keeping a page and its cleaned
+ *     version side by side and updating the cleaned one after edits,
+ *     with work in proportion to what the edits change rather than to
+ *     the page.
+ */
+
+#ifndef EDGEINC_INCLUDED
+#define EDGEINC_INCLUDED
+
+#include <stddef.h>
+#include "bit2.h"
+
+typedef struct Edgeinc_T *Edgeinc_T;
+
+/* One edit: every pixel of the rectangle becomes bit. A single pixel is
+ * a 1 by 1 rectangle. */
+typedef struct {
+        int row, col;
+        int height, width;
+        int bit;
+} Edgeinc_edit;
+
+extern Edgeinc_T edgeinc_new(Bit2_T page);
+extern void      edgeinc_free(Edgeinc_T *inc);
+extern size_t    edgeinc_update(Edgeinc_T inc, const Edgeinc_edit *edits,
+                                int count);
+extern Bit2_T    edgeinc_original(Edgeinc_T inc);
+extern Bit2_T    edgeinc_result(Edgeinc_T inc);
+
+#endif
@@ -0,0 +1,762 @@
+/*
+ *     edgepar.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgepar
+ *
+ *     This program removes edge-connected black pixels on several
+ *     threads. The bitmap is cut into bands of whole rows. Every
+ *     horizontal run of black gets an id, the runs inside each band are
+ *     joined in a shared union-find, the seams between bands are merged
+ *     with compare-and-swap, and every component that touches the border
+ *     is cleared.
+ *
+ *     Run ids are handed out in row order, so the runs of a row can be
+ *     found again at any time by rescanning it. Nothing but one parent
+ *     entry and one flag per run is ever stored.
+ *
+ *     edgepar_claim is a simpler multi-seed flood fill. The border pixels
+ *     are handed out in chunks, every thread floods from its seeds with
+ *     a private stack, and a pixel belongs to whichever thread clears it
+ *     first with Bit2_test_and_clear. A thread that runs dry takes pixels
+ *     that busy threads have put in a shared pool.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "edgepar.h"
+
+#define BAND_MIN_ROWS 16   /* smallest band worth a work item */
+#define BANDS_PER_THREAD 4 /* spare bands so fast threads can steal */
+#define SEED_CHUNK 256     /* border pixels handed out at a time */
+#define SHARE_MIN 64       /* smallest stack worth splitting */
+
+/* The phases every worker walks through, separated by barriers */
+enum { COUNT, LABEL, SEAM, MARK, CLEAR, PHASES };
+
+/* Everything the workers share */
+typedef struct {
+        Bit2_T bitmap;
+        int height, width, nwords;
+        int band_rows, bands;
+        size_t *row_start;              /* id of each row's first run */
+        _Atomic uint32_t *parent;       /* union-find over run ids */
+        _Atomic unsigned char *touches; /* per root: reaches the border */
+        atomic_int next[PHASES];        /* next band each phase hands out */
+        pthread_barrier_t barrier;
+        int threads;
+        size_t run_bytes;               /* size of each run buffer */
+} Job;
+
+/* What one worker thread gets */
+typedef struct {
+        Job *job;
+        int id;
+        Edgefill_run *cur, *prev;
+} Worker;
+
+/* A growable stack of packed (row << 32) | col pixels */
+typedef struct {
+        uint64_t *items;
+        size_t count, capacity;
+} Pixels;
+
+/* Everything the threads of edgepar_claim share */
+typedef struct {
+        Bit2_T bitmap;
+        int height, width;
+        int seeds;                      /* border pixels */
+        atomic_int next_seed;           /* next chunk to hand out */
+        int threads;
+        pthread_mutex_t lock;           /* guards pool and idle */
+        pthread_cond_t wake;
+        Pixels pool;                    /* pixels given away by busy threads */
+        int idle;                       /* threads waiting on the pool */
+        atomic_int hungry;              /* copy of idle read without lock */
+} Claim;
+
+/* What one edgepar_claim thread gets */
+typedef struct {
+        Claim *claim;
+        Pixels stack;
+} Claimer;
+
+static void    *work(void *cl);
+static void    *claim_work(void *cl);
+static void     claim_seeds(Claimer *self, int chunk);
+static int      refill(Claimer *self);
+static void     share(Claimer *self);
+static void     pixels_push(Pixels *pixels, uint64_t pixel);
+static void     setup_ids(Job *job);
+static void     label_band(Job *job, int band, Worker *self);
+static void     merge_seam(Job *job, int band, Worker *self);
+static void     mark_band(Job *job, int band, Worker *self);
+static void     clear_band(Job *job, int band, Worker *self);
+static int      count_runs(const uint64_t *words, int nwords);
+static void     join_rows(Job *job, const Edgefill_run *above,
+                          int nabove, size_t above_id,
+                          const Edgefill_run *below, int nbelow,
+                          size_t below_id);
+static uint32_t find(_Atomic uint32_t *parent, uint32_t x);
+static void     unite(_Atomic uint32_t *parent, uint32_t a, uint32_t b);
+
+/*
+*  name:        edgepar_run
+*  purpose:     Removes edge-connected black pixels using several threads.
+*  arguments:   A bitmap, the number of threads to use and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      Starts threads - 1 pthreads (the caller is the last one),
+*               runs the count, label, seam, mark and clear phases and
+*               joins them again. Bands are whole rows, so two threads never
+*               write the same word. Allocates one size_t per row, plus four
+*               bytes and one flag per run; all of it is freed before
+*               returning and the total is written to stats.
+*  expects:     The bitmap pointer is not NULL and threads >= 1. The image
+*               has fewer than 2^32 - 1 black runs.
+*/
+void edgepar_run(Bit2_T bitmap, int threads, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL && threads >= 1);
+        Job job;
+        job.bitmap = bitmap;
+        job.height = Bit2_height(bitmap);
+        job.width = Bit2_width(bitmap);
+        job.nwords = Bit2_row_words(bitmap);
+        job.threads = threads;
+
+        int bands = threads * BANDS_PER_THREAD;
+        job.band_rows = (job.height + bands - 1) / bands;
+        if (job.band_rows < BAND_MIN_ROWS) {
+                job.band_rows = BAND_MIN_ROWS;
+        }
+        job.bands = (job.height + job.band_rows - 1) / job.band_rows;
+
+        job.row_start = calloc(job.height + 1, sizeof(size_t));
+        assert(job.row_start != NULL);
+        job.parent = NULL;
+        job.touches = NULL;
+        for (int phase = 0; phase < PHASES; phase++) {
+                atomic_init(&job.next[phase], 0);
+        }
+        job.run_bytes = ((size_t)job.width / 2 + 1) * sizeof(Edgefill_run);
+        pthread_barrier_init(&job.barrier, NULL, threads);
+
+        pthread_t *tids = malloc(threads * sizeof(pthread_t));
+        Worker *workers = malloc(threads * sizeof(Worker));
+        assert(tids != NULL && workers != NULL);
+        for (int i = 0; i < threads; i++) {
+                workers[i].job = &job;
+                workers[i].id = i;
+                workers[i].cur = malloc(job.run_bytes);
+                workers[i].prev = malloc(job.run_bytes);
+                assert(workers[i].cur != NULL && workers[i].prev != NULL);
+        }
+        for (int i = 1; i < threads; i++) {
+                int err = pthread_create(&tids[i], NULL, work, &workers[i]);
+                assert(err == 0);
+        }
+        work(&workers[0]);
+        for (int i = 1; i < threads; i++) {
+                pthread_join(tids[i], NULL);
+        }
+
+        size_t runs = job.row_start[job.height];
+        if (stats != NULL) {
+                stats->peak_bytes = (job.height + 1) * sizeof(size_t)
+                                    + runs * (sizeof(uint32_t) + 1)
+                                    + 2 * threads * job.run_bytes;
+        }
+        for (int i = 0; i < threads; i++) {
+                free(workers[i].cur);
+                free(workers[i].prev);
+        }
+        free(workers);
+        free(tids);
+        pthread_barrier_destroy(&job.barrier);
+        free((void *)job.parent);
+        free((void *)job.touches);
+        free(job.row_start);
+}
+
+/*
+*  name:        work
+*  purpose:     The body of every worker thread.
+*  arguments:   A Worker pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      For each phase, takes bands from the phase's shared counter
+*               until none are left, then waits at the barrier. Between
+*               counting and labelling, worker 0 alone turns the counts
+*               into run ids.
+*  expects:     All workers of a job run work() exactly once.
+*/
+static void *work(void *cl)
+{
+        Worker *self = cl;
+        Job *job = self->job;
+
+        for (int phase = 0; phase < PHASES; phase++) {
+                int band;
+                while ((band = atomic_fetch_add(&job->next[phase], 1))
+                       < job->bands) {
+                        int top = band * job->band_rows;
+                        int end = top + job->band_rows;
+                        if (end > job->height) {
+                                end = job->height;
+                        }
+                        switch (phase) {
+                        case COUNT:
+                                for (int row = top; row < end; row++) {
+                                        job->row_start[row + 1] = count_runs(
+                                                Bit2_row(job->bitmap, row),
+                                                job->nwords);
+                                }
+                                break;
+                        case LABEL:
+                                label_band(job, band, self);
+                                break;
+                        case SEAM:
+                                merge_seam(job, band, self);
+                                break;
+                        case MARK:
+                                mark_band(job, band, self);
+                                break;
+                        case CLEAR:
+                                clear_band(job, band, self);
+                                break;
+                        }
+                }
+
+                pthread_barrier_wait(&job->barrier);
+                if (phase == COUNT) {
+                        if (self->id == 0) {
+                                setup_ids(job);
+                        }
+                        pthread_barrier_wait(&job->barrier);
+                }
+        }
+        return NULL;
+}
+
+/*
+*  name:        setup_ids
+*  purpose:     Turns the per-row run counts into the id of each row's
+*               first run and allocates the union-find.
+*  arguments:   The job, whose row_start[r + 1] holds the count of row r.
+*  return type: None.
+*  effect:      Prefix-sums row_start in place and allocates parent and
+*               touches with one entry per run.
+*  expects:     Called by one thread while the others wait.
+*/
+static void setup_ids(Job *job)
+{
+        for (int row = 0; row < job->height; row++) {
+                job->row_start[row + 1] += job->row_start[row];
+        }
+        size_t runs = job->row_start[job->height];
+        assert(runs < UINT32_MAX);
+        job->parent = malloc((runs + 1) * sizeof(uint32_t));
+        job->touches = calloc(runs + 1, 1);
+        assert(job->parent != NULL && job->touches != NULL);
+}
+
+/*
+*  name:        label_band
+*  purpose:     Gives every run in a band its own set and joins the runs
+*               that overlap between neighbouring rows of the band.
+*  arguments:   The job, a band index and the calling worker.
+*  return type: None.
+*  effect:      Writes the parent entries of the band's runs. Only ids that
+*               belong to this band are linked, so bands do not interfere.
+*  expects:     setup_ids has run.
+*/
+static void label_band(Job *job, int band, Worker *self)
+{
+        int top = band * job->band_rows;
+        int end = top + job->band_rows < job->height ?
+                  top + job->band_rows : job->height;
+        int nprev = 0;
+
+        for (int row = top; row < end; row++) {
+                int ncur = edgefill_find_runs(Bit2_row(job->bitmap, row),
+                                              job->width, self->cur);
+                size_t id = job->row_start[row];
+                for (int i = 0; i < ncur; i++) {
+                        atomic_store_explicit(&job->parent[id + i],
+                                              (uint32_t)(id + i),
+                                              memory_order_relaxed);
+                }
+                if (row > top) {
+                        join_rows(job, self->prev, nprev,
+                                  job->row_start[row - 1], self->cur, ncur,
+                                  id);
+                }
+                Edgefill_run *tmp = self->prev;
+                self->prev = self->cur;
+                self->cur = tmp;
+                nprev = ncur;
+        }
+}
+
+/*
+*  name:        merge_seam
+*  purpose:     Joins the runs across the seam on top of a band.
+*  arguments:   The job, a band index and the calling worker.
+*  return type: None.
+*  effect:      Several seams are merged at once, so the links are made
+*               with compare-and-swap in unite.
+*  expects:     Every band has been labelled.
+*/
+static void merge_seam(Job *job, int band, Worker *self)
+{
+        int row = band * job->band_rows;
+        if (row == 0) {
+                return;
+        }
+        int nabove = edgefill_find_runs(Bit2_row(job->bitmap, row - 1),
+                                        job->width, self->prev);
+        int nbelow = edgefill_find_runs(Bit2_row(job->bitmap, row),
+                                        job->width, self->cur);
+        join_rows(job, self->prev, nabove, job->row_start[row - 1],
+                  self->cur, nbelow, job->row_start[row]);
+}
+
+/*
+*  name:        mark_band
+*  purpose:     Flags the component of every run in the band that touches
+*               the image border.
+*  arguments:   The job, a band index and the calling worker.
+*  return type: None.
+*  effect:      Sets touches[root] for those runs. Many threads may set the
+*               same flag; they all store the same value.
+*  expects:     All seams are merged.
+*/
+static void mark_band(Job *job, int band, Worker *self)
+{
+        int top = band * job->band_rows;
+        int end = top + job->band_rows < job->height ?
+                  top + job->band_rows : job->height;
+
+        for (int row = top; row < end; row++) {
+                int n = edgefill_find_runs(Bit2_row(job->bitmap, row),
+                                           job->width, self->cur);
+                size_t id = job->row_start[row];
+                int edge_row = (row == 0 || row == job->height - 1);
+                for (int i = 0; i < n; i++) {
+                        if (edge_row || self->cur[i].first == 0 ||
+                            self->cur[i].last == job->width - 1) {
+                                uint32_t root = find(job->parent,
+                                                     (uint32_t)(id + i));
+                                atomic_store_explicit(&job->touches[root], 1,
+                                                      memory_order_relaxed);
+                        }
+                }
+        }
+}
+
+/*
+*  name:        clear_band
+*  purpose:     Turns white every run in the band whose component touches
+*               the border.
+*  arguments:   The job, a band index and the calling worker.
+*  return type: None.
+*  effect:      Modifies only the band's own rows of the bitmap.
+*  expects:     Marking is finished.
+*/
+static void clear_band(Job *job, int band, Worker *self)
+{
+        int top = band * job->band_rows;
+        int end = top + job->band_rows < job->height ?
+                  top + job->band_rows : job->height;
+
+        for (int row = top; row < end; row++) {
+                uint64_t *words = Bit2_row(job->bitmap, row);
+                int n = edgefill_find_runs(words, job->width, self->cur);
+                size_t id = job->row_start[row];
+                for (int i = 0; i < n; i++) {
+                        uint32_t root = find(job->parent, (uint32_t)(id + i));
+                        if (!atomic_load_explicit(&job->touches[root],
+                                                  memory_order_relaxed)) {
+                                continue;
+                        }
+                        for (int col = self->cur[i].first;
+                             col <= self->cur[i].last; ) {
+                                if ((col & 63) == 0 &&
+                                    col + 63 <= self->cur[i].last) {
+                                        words[col >> 6] = 0;
+                                        col += 64;
+                                } else {
+                                        Bit2_word_put(words, col, 0);
+                                        col++;
+                                }
+                        }
+                }
+        }
+}
+
+/*
+*  name:        count_runs
+*  purpose:     Counts the black runs in a row.
+*  arguments:   The words of a row and how many there are.
+*  return type: Integer count.
+*  effect:      None. A run starts at every black bit whose left
+*               neighbour is white; those are found with shifts and
+*               counted with popcount.
+*  expects:     words is not NULL.
+*/
+static int count_runs(const uint64_t *words, int nwords)
+{
+        int count = 0;
+        uint64_t carry = 0;
+        for (int w = 0; w < nwords; w++) {
+                uint64_t starts = words[w] & ~((words[w] << 1) | carry);
+                carry = words[w] >> 63;
+                count += __builtin_popcountll(starts);
+        }
+        return count;
+}
+
+/*
+*  name:        join_rows
+*  purpose:     Unites every pair of runs that share a column between two
+*               neighbouring rows.
+*  arguments:   The job, the runs of the upper row with their count and the
+*               id of the first one, and the same for the lower row.
+*  return type: None.
+*  effect:      Walks both sorted run lists together once.
+*  expects:     The parent entries of both rows are initialised.
+*/
+static void join_rows(Job *job, const Edgefill_run *above, int nabove,
+                      size_t above_id, const Edgefill_run *below,
+                      int nbelow, size_t below_id)
+{
+        int i = 0, j = 0;
+        while (i < nabove && j < nbelow) {
+                if (above[i].last < below[j].first) {
+                        i++;
+                } else if (below[j].last < above[i].first) {
+                        j++;
+                } else {
+                        unite(job->parent, (uint32_t)(above_id + i),
+                              (uint32_t)(below_id + j));
+                        if (above[i].last < below[j].last) {
+                                i++;
+                        } else {
+                                j++;
+                        }
+                }
+        }
+}
+
+/*
+*  name:        find
+*  purpose:     Returns the root of a run's set.
+*  arguments:   The parent array and a run id.
+*  return type: The root id.
+*  effect:      Halves the path on the way up. Parents only ever point to
+*               smaller ids, so swinging x to its grandparent with a
+*               compare-and-swap is safe while other threads link roots;
+*               a lost race just skips the shortcut.
+*  expects:     x is a valid id.
+*/
+static uint32_t find(_Atomic uint32_t *parent, uint32_t x)
+{
+        uint32_t p = atomic_load_explicit(&parent[x], memory_order_acquire);
+        while (p != x) {
+                uint32_t gp = atomic_load_explicit(&parent[p],
+                                                   memory_order_acquire);
+                if (gp != p) {
+                        uint32_t expected = p;
+                        atomic_compare_exchange_weak_explicit(
+                                &parent[x], &expected, gp,
+                                memory_order_acq_rel, memory_order_relaxed);
+                }
+                x = p;
+                p = gp;
+        }
+        return x;
+}
+
+/*
+*  name:        unite
+*  purpose:     Merges the sets of two runs.
+*  arguments:   The parent array and two run ids.
+*  return type: None.
+*  effect:      Links the larger root under the smaller one with a
+*               compare-and-swap that only succeeds if the larger root is
+*               still a root; otherwise finds the roots again and retries.
+*               Lock-free, and safe to call from many threads at once.
+*  expects:     a and b are valid ids.
+*/
+static void unite(_Atomic uint32_t *parent, uint32_t a, uint32_t b)
+{
+        for (;;) {
+                a = find(parent, a);
+                b = find(parent, b);
+                if (a == b) {
+                        return;
+                }
+                if (a < b) {
+                        uint32_t tmp = a;
+                        a = b;
+                        b = tmp;
+                }
+                uint32_t expected = a;
+                if (atomic_compare_exchange_strong_explicit(
+                            &parent[a], &expected, b,
+                            memory_order_acq_rel, memory_order_acquire)) {
+                        return;
+                }
+        }
+}
+
+/*
+*  name:        edgepar_claim
+*  purpose:     Removes edge-connected black pixels with a flood fill that
+*               several threads run at once from different seeds.
+*  arguments:   A bitmap, the number of threads to use and an optional
+*               stats pointer.
+*  return type: None.
+*  effect:      Starts threads - 1 pthreads (the caller is the last one).
+*               Each takes SEED_CHUNK border pixels at a time and floods
+*               from them with its own stack. Pixels are cleared with
+*               Bit2_test_and_clear before they are pushed, so every black
+*               pixel is pushed by exactly one thread. Threads with a deep
+*               stack give half of it to a shared pool while another
+*               thread is idle; the fill ends when every thread is idle
+*               and the pool is empty. The largest total of the stacks and
+*               the pool is written to stats.
+*  expects:     The bitmap pointer is not NULL and threads >= 1. No other
+*               thread touches the bitmap during the call.
+*/
+void edgepar_claim(Bit2_T bitmap, int threads, Edgefill_stats *stats)
+{
+        assert(bitmap != NULL && threads >= 1);
+        Claim claim;
+        claim.bitmap = bitmap;
+        claim.height = Bit2_height(bitmap);
+        claim.width = Bit2_width(bitmap);
+        claim.seeds = claim.height == 1 ? claim.width
+                      : 2 * claim.width + 2 * (claim.height - 2);
+        atomic_init(&claim.next_seed, 0);
+        claim.threads = threads;
+        pthread_mutex_init(&claim.lock, NULL);
+        pthread_cond_init(&claim.wake, NULL);
+        claim.pool = (Pixels){ NULL, 0, 0 };
+        claim.idle = 0;
+        atomic_init(&claim.hungry, 0);
+
+        pthread_t *tids = malloc(threads * sizeof(pthread_t));
+        Claimer *team = malloc(threads * sizeof(Claimer));
+        assert(tids != NULL && team != NULL);
+        for (int i = 0; i < threads; i++) {
+                team[i].claim = &claim;
+                team[i].stack = (Pixels){ NULL, 0, 0 };
+        }
+        for (int i = 1; i < threads; i++) {
+                int err = pthread_create(&tids[i], NULL, claim_work,
+                                         &team[i]);
+                assert(err == 0);
+        }
+        claim_work(&team[0]);
+        for (int i = 1; i < threads; i++) {
+                pthread_join(tids[i], NULL);
+        }
+
+        size_t bytes = claim.pool.capacity * sizeof(uint64_t);
+        for (int i = 0; i < threads; i++) {
+                bytes += team[i].stack.capacity * sizeof(uint64_t);
+                free(team[i].stack.items);
+        }
+        if (stats != NULL) {
+                stats->peak_bytes = bytes;
+        }
+        free(claim.pool.items);
+        pthread_mutex_destroy(&claim.lock);
+        pthread_cond_destroy(&claim.wake);
+        free(team);
+        free(tids);
+}
+
+/*
+*  name:        claim_work
+*  purpose:     The body of every edgepar_claim thread.
+*  arguments:   A Claimer pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Floods from the top of its stack, refilling it from the
+*               seed chunks and then from the pool, until refill says the
+*               whole fill is done.
+*  expects:     All threads of a claim run claim_work exactly once.
+*/
+static void *claim_work(void *cl)
+{
+        Claimer *self = cl;
+        Claim *claim = self->claim;
+        Bit2_T bitmap = claim->bitmap;
+        static const int dr[4] = { -1, 1, 0, 0 };
+        static const int dc[4] = { 0, 0, -1, 1 };
+
+        for (;;) {
+                if (self->stack.count == 0 && !refill(self)) {
+                        return NULL;
+                }
+                uint64_t pixel = self->stack.items[--self->stack.count];
+                int row = (int)(pixel >> 32);
+                int col = (int)(pixel & 0xffffffffu);
+                for (int k = 0; k < 4; k++) {
+                        int nr = row + dr[k], nc = col + dc[k];
+                        if (nr < 0 || nr >= claim->height || nc < 0 ||
+                            nc >= claim->width) {
+                                continue;
+                        }
+                        if (Bit2_test_and_clear(bitmap, nr, nc)) {
+                                pixels_push(&self->stack,
+                                            ((uint64_t)nr << 32)
+                                            | (uint32_t)nc);
+                        }
+                }
+                if (self->stack.count >= SHARE_MIN &&
+                    atomic_load_explicit(&claim->hungry,
+                                         memory_order_relaxed) > 0) {
+                        share(self);
+                }
+        }
+}
+
+/*
+*  name:        refill
+*  purpose:     Finds more work for a thread whose stack is empty.
+*  arguments:   The thread's Claimer.
+*  return type: 1 if the stack has pixels again, 0 if the fill is done.
+*  effect:      Takes seed chunks until one yields a black pixel. After the
+*               seeds run out, waits on the pool: takes half of it when it
+*               has pixels, or returns 0 once every thread is waiting and
+*               the pool is empty, waking the others so they see it too.
+*  expects:     The thread's stack is empty.
+*/
+static int refill(Claimer *self)
+{
+        Claim *claim = self->claim;
+        int chunks = (claim->seeds + SEED_CHUNK - 1) / SEED_CHUNK;
+        int chunk;
+        while ((chunk = atomic_fetch_add(&claim->next_seed, 1)) < chunks) {
+                claim_seeds(self, chunk);
+                if (self->stack.count > 0) {
+                        return 1;
+                }
+        }
+
+        pthread_mutex_lock(&claim->lock);
+        claim->idle++;
+        atomic_store(&claim->hungry, claim->idle);
+        while (claim->pool.count == 0 && claim->idle < claim->threads) {
+                pthread_cond_wait(&claim->wake, &claim->lock);
+        }
+        if (claim->pool.count == 0) { /* everyone is idle: done */
+                pthread_cond_broadcast(&claim->wake);
+                pthread_mutex_unlock(&claim->lock);
+                return 0;
+        }
+        claim->idle--;
+        atomic_store(&claim->hungry, claim->idle);
+        size_t take = (claim->pool.count + 1) / 2;
+        for (size_t i = 0; i < take; i++) {
+                pixels_push(&self->stack,
+                            claim->pool.items[--claim->pool.count]);
+        }
+        pthread_mutex_unlock(&claim->lock);
+        return 1;
+}
+
+/*
+*  name:        share
+*  purpose:     Gives half of a thread's stack to the shared pool.
+*  arguments:   The thread's Claimer.
+*  return type: None.
+*  effect:      Moves the bottom half of the stack, the pixels furthest
+*               from where the thread is working, and wakes one waiting
+*               thread.
+*  expects:     The stack holds at least SHARE_MIN pixels.
+*/
+static void share(Claimer *self)
+{
+        Claim *claim = self->claim;
+        Pixels *stack = &self->stack;
+        size_t give = stack->count / 2;
+
+        pthread_mutex_lock(&claim->lock);
+        for (size_t i = 0; i < give; i++) {
+                pixels_push(&claim->pool, stack->items[i]);
+        }
+        pthread_cond_signal(&claim->wake);
+        pthread_mutex_unlock(&claim->lock);
+
+        memmove(stack->items, stack->items + give,
+                (stack->count - give) * sizeof(uint64_t));
+        stack->count -= give;
+}
+
+/*
+*  name:        claim_seeds
+*  purpose:     Claims the black pixels of one chunk of the border.
+*  arguments:   The thread's Claimer and the chunk number.
+*  return type: None.
+*  effect:      Border pixels are numbered along the top row, the bottom
+*               row, then the first and last columns without the corners.
+*               Each one this thread clears is pushed on its stack.
+*  expects:     chunk is a valid chunk number.
+*/
+static void claim_seeds(Claimer *self, int chunk)
+{
+        Claim *claim = self->claim;
+        int width = claim->width, height = claim->height;
+        int end = (chunk + 1) * SEED_CHUNK;
+        if (end > claim->seeds) {
+                end = claim->seeds;
+        }
+        for (int i = chunk * SEED_CHUNK; i < end; i++) {
+                int row, col;
+                if (i < width) {
+                        row = 0;
+                        col = i;
+                } else if (i < 2 * width) {
+                        row = height - 1;
+                        col = i - width;
+                } else {
+                        row = 1 + (i - 2 * width) / 2;
+                        col = (i % 2 == 0) ? 0 : width - 1;
+                }
+                if (Bit2_test_and_clear(claim->bitmap, row, col)) {
+                        pixels_push(&self->stack, ((uint64_t)row << 32)
+                                                  | (uint32_t)col);
+                }
+        }
+}
+
+/*
+*  name:        pixels_push
+*  purpose:     Pushes a packed pixel on a growable stack.
+*  arguments:   The stack and the pixel.
+*  return type: None.
+*  effect:      Doubles the capacity with realloc when it is full.
+*  expects:     pixels is not NULL.
+*/
+static void pixels_push(Pixels *pixels, uint64_t pixel)
+{
+        if (pixels->count == pixels->capacity) {
+                pixels->capacity = pixels->capacity == 0
+                                   ? 1024 : 2 * pixels->capacity;
+                pixels->items = realloc(pixels->items, pixels->capacity
+                                                       * sizeof(uint64_t));
+                assert(pixels->items != NULL);
+        }
+        pixels->items[pixels->count++] = pixel;
+}
@@ -0,0 +1,22 @@
+/*
+ *     edgepar.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgepar
+ *
+ *     This file holds the interface for the multithreaded engines that
+ *     remove edge-connected black pixels. Their result is identical to
+ *     the serial engines in edgefill.h.
+ */
+
+#ifndef EDGEPAR_INCLUDED
+#define EDGEPAR_INCLUDED
+
+#include "bit2.h"
+#include "edgefill.h"
+
+extern void edgepar_run(Bit2_T bitmap, int threads, Edgefill_stats *stats);
+extern void edgepar_claim(Bit2_T bitmap, int threads,
+                          Edgefill_stats *stats);
+
+#endif
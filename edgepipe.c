@@ -0,0 +1,348 @@
+/*
+ *     edgepipe.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgepipe
+ *
+ *     This program removes edge-connected black pixels from every image
+ *     of a PBM stream as a three-stage pipeline: the calling thread
+ *     parses images, one or more worker threads clean them and a writer
+ *     thread prints them. While one image is being written the next can
+ *     be cleaned and the one after that read.
+ *
+ *     The stages pass slot numbers through three bounded queues. A slot
+ *     owns one Bit2_T that is resized and reused for every image that
+ *     passes through it, so after the first few images nothing is
+ *     allocated. The free queue starts with every slot in it, which is
+ *     what keeps the parser from running ahead of the writer. Workers may
+ *     finish out of order; the writer holds early images back until the
+ *     ones before them are written.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "pbmio.h"
+#include "edgepipe.h"
+
+#define SLOTS_PER_WORKER 2 /* images in flight for every worker */
+
+/* A bounded FIFO of slot numbers */
+typedef struct {
+        int *items;
+        int capacity, head, count;
+        int closed;
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty, not_full;
+} Queue;
+
+/* One reusable image buffer and where it falls in the stream */
+typedef struct {
+        Bit2_T bitmap;
+        int seq;
+} Slot;
+
+/* Everything the stages share */
+typedef struct {
+        Slot *slots;
+        int nslots;
+        Queue free, work, done;
+        void (*engine)(Bit2_T bitmap, Edgefill_stats *stats);
+        void (*write)(FILE *out, Bit2_T bitmap, int raw);
+        FILE *out;
+        int raw;
+        atomic_int workers_left;
+} Pipe;
+
+/* What one worker thread gets, and the most scratch memory it used */
+typedef struct {
+        Pipe *pipe;
+        size_t peak_bytes;
+} Worker;
+
+static void *work(void *cl);
+static void *write_images(void *cl);
+static void  queue_init(Queue *queue, int capacity);
+static void  queue_free(Queue *queue);
+static void  queue_push(Queue *queue, int item);
+static int   queue_pop(Queue *queue);
+static void  queue_close(Queue *queue);
+
+/*
+*  name:        edgepipe_run
+*  purpose:     Removes edge-connected black pixels from every image of a
+*               PBM stream, keeping their order.
+*  arguments:   The input and output streams, the engine to run on each
+*               image, the function that writes each cleaned image (such
+*               as Pbmio_write), the number of worker threads, whether to
+*               write raw (nonzero) or plain output, where to store how
+*               many images were written, and an optional stats pointer.
+*  return type: PBMIO_END when the whole stream was read, or
+*               PBMIO_BADFORMAT or PBMIO_COUNT when an image was bad.
+*  effect:      Starts workers + 1 pthreads and parses on the calling
+*               thread. Every image before a bad one is still cleaned and
+*               written; reading stops at the bad one. The largest
+*               peak_bytes any single image needed is written to stats.
+*  expects:     in, out, write and images are not NULL and workers >= 1.
+*/
+Pbmio_status edgepipe_run(FILE *in, FILE *out,
+                          void engine(Bit2_T bitmap, Edgefill_stats *stats),
+                          void write(FILE *out, Bit2_T bitmap, int raw),
+                          int workers, int raw, int *images,
+                          Edgefill_stats *stats)
+{
+        assert(in != NULL && out != NULL && write != NULL && images != NULL);
+        assert(workers >= 1);
+        Pipe pipe;
+        pipe.nslots = SLOTS_PER_WORKER * workers + 2;
+        pipe.slots = malloc(pipe.nslots * sizeof(Slot));
+        assert(pipe.slots != NULL);
+        queue_init(&pipe.free, pipe.nslots);
+        queue_init(&pipe.work, pipe.nslots);
+        queue_init(&pipe.done, pipe.nslots);
+        for (int i = 0; i < pipe.nslots; i++) {
+                pipe.slots[i].bitmap = NULL;
+                pipe.slots[i].seq = -1;
+                queue_push(&pipe.free, i);
+        }
+        pipe.engine = engine;
+        pipe.write = write;
+        pipe.out = out;
+        pipe.raw = raw;
+        atomic_init(&pipe.workers_left, workers);
+
+        pthread_t writer;
+        pthread_t *tids = malloc(workers * sizeof(pthread_t));
+        Worker *team = malloc(workers * sizeof(Worker));
+        assert(tids != NULL && team != NULL);
+        int err = pthread_create(&writer, NULL, write_images, &pipe);
+        assert(err == 0);
+        for (int i = 0; i < workers; i++) {
+                team[i].pipe = &pipe;
+                team[i].peak_bytes = 0;
+                err = pthread_create(&tids[i], NULL, work, &team[i]);
+                assert(err == 0);
+        }
+
+        Pbmio_T reader = Pbmio_new(in);
+        Pbmio_status status;
+        int seq = 0;
+        for (;;) {
+                int slot = queue_pop(&pipe.free);
+                status = Pbmio_load(reader, &pipe.slots[slot].bitmap);
+                if (status != PBMIO_IMAGE) {
+                        queue_push(&pipe.free, slot);
+                        break;
+                }
+                pipe.slots[slot].seq = seq++;
+                queue_push(&pipe.work, slot);
+        }
+        queue_close(&pipe.work);
+        Pbmio_free(&reader);
+
+        for (int i = 0; i < workers; i++) {
+                pthread_join(tids[i], NULL);
+        }
+        pthread_join(writer, NULL);
+
+        *images = seq;
+        if (stats != NULL) {
+                stats->peak_bytes = 0;
+                for (int i = 0; i < workers; i++) {
+                        if (team[i].peak_bytes > stats->peak_bytes) {
+                                stats->peak_bytes = team[i].peak_bytes;
+                        }
+                }
+        }
+        for (int i = 0; i < pipe.nslots; i++) {
+                if (pipe.slots[i].bitmap != NULL) {
+                        Bit2_free(&pipe.slots[i].bitmap);
+                }
+        }
+        queue_free(&pipe.free);
+        queue_free(&pipe.work);
+        queue_free(&pipe.done);
+        free(pipe.slots);
+        free(team);
+        free(tids);
+        return status;
+}
+
+/*
+*  name:        work
+*  purpose:     The body of every worker thread.
+*  arguments:   A Worker pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Cleans the images of slots taken from the work queue and
+*               passes them to the done queue. The last worker to finish
+*               closes the done queue.
+*  expects:     cl is a Worker whose pipe is set up.
+*/
+static void *work(void *cl)
+{
+        Worker *self = cl;
+        Pipe *pipe = self->pipe;
+        Edgefill_stats stats = { 0 };
+
+        int slot;
+        while ((slot = queue_pop(&pipe->work)) >= 0) {
+                pipe->engine(pipe->slots[slot].bitmap, &stats);
+                if (stats.peak_bytes > self->peak_bytes) {
+                        self->peak_bytes = stats.peak_bytes;
+                }
+                queue_push(&pipe->done, slot);
+        }
+        if (atomic_fetch_sub(&pipe->workers_left, 1) == 1) {
+                queue_close(&pipe->done);
+        }
+        return NULL;
+}
+
+/*
+*  name:        write_images
+*  purpose:     The body of the writer thread.
+*  arguments:   The Pipe pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Takes cleaned slots from the done queue and writes them in
+*               stream order, parking any that arrive early by sequence
+*               number. Each written slot goes back on the free queue.
+*  expects:     cl is a Pipe that is set up.
+*/
+static void *write_images(void *cl)
+{
+        Pipe *pipe = cl;
+        int *parked = malloc(pipe->nslots * sizeof(int));
+        assert(parked != NULL);
+        for (int i = 0; i < pipe->nslots; i++) {
+                parked[i] = -1;
+        }
+
+        int next = 0;
+        int slot;
+        while ((slot = queue_pop(&pipe->done)) >= 0) {
+                /* no more than nslots images are in flight at once */
+                parked[pipe->slots[slot].seq % pipe->nslots] = slot;
+                int ready;
+                while ((ready = parked[next % pipe->nslots]) >= 0) {
+                        parked[next % pipe->nslots] = -1;
+                        pipe->write(pipe->out, pipe->slots[ready].bitmap,
+                                    pipe->raw);
+                        queue_push(&pipe->free, ready);
+                        next++;
+                }
+        }
+        fflush(pipe->out);
+        free(parked);
+        return NULL;
+}
+
+/*
+*  name:        queue_init
+*  purpose:     Sets up an empty queue.
+*  arguments:   The queue and the most items it can hold.
+*  return type: None.
+*  effect:      Allocates the item array and the lock and conditions.
+*  expects:     capacity >= 1.
+*/
+static void queue_init(Queue *queue, int capacity)
+{
+        assert(queue != NULL && capacity >= 1);
+        queue->items = malloc(capacity * sizeof(int));
+        assert(queue->items != NULL);
+        queue->capacity = capacity;
+        queue->head = 0;
+        queue->count = 0;
+        queue->closed = 0;
+        pthread_mutex_init(&queue->lock, NULL);
+        pthread_cond_init(&queue->not_empty, NULL);
+        pthread_cond_init(&queue->not_full, NULL);
+}
+
+/*
+*  name:        queue_free
+*  purpose:     Releases a queue's storage.
+*  arguments:   The queue.
+*  return type: None.
+*  effect:      Frees the items and destroys the lock and conditions.
+*  expects:     No thread is using the queue.
+*/
+static void queue_free(Queue *queue)
+{
+        assert(queue != NULL);
+        free(queue->items);
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_cond_destroy(&queue->not_full);
+}
+
+/*
+*  name:        queue_push
+*  purpose:     Adds an item to the back of a queue.
+*  arguments:   The queue and the item.
+*  return type: None.
+*  effect:      Waits while the queue is full, then wakes one waiting pop.
+*  expects:     item >= 0 and the queue is not closed.
+*/
+static void queue_push(Queue *queue, int item)
+{
+        assert(queue != NULL && item >= 0);
+        pthread_mutex_lock(&queue->lock);
+        assert(!queue->closed);
+        while (queue->count == queue->capacity) {
+                pthread_cond_wait(&queue->not_full, &queue->lock);
+        }
+        queue->items[(queue->head + queue->count) % queue->capacity] = item;
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+}
+
+/*
+*  name:        queue_pop
+*  purpose:     Takes the item at the front of a queue.
+*  arguments:   The queue.
+*  return type: The item, or -1 once the queue is closed and empty.
+*  effect:      Waits while the queue is empty and open, then wakes one
+*               waiting push.
+*  expects:     queue is not NULL.
+*/
+static int queue_pop(Queue *queue)
+{
+        assert(queue != NULL);
+        pthread_mutex_lock(&queue->lock);
+        while (queue->count == 0 && !queue->closed) {
+                pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        int item = -1;
+        if (queue->count > 0) {
+                item = queue->items[queue->head];
+                queue->head = (queue->head + 1) % queue->capacity;
+                queue->count--;
+                pthread_cond_signal(&queue->not_full);
+        }
+        pthread_mutex_unlock(&queue->lock);
+        return item;
+}
+
+/*
+*  name:        queue_close
+*  purpose:     Marks that nothing more will be pushed.
+*  arguments:   The queue.
+*  return type: None.
+*  effect:      Wakes every waiting pop so it can see the queue is done.
+*  expects:     queue is not NULL.
+*/
+static void queue_close(Queue *queue)
+{
+        assert(queue != NULL);
+        pthread_mutex_lock(&queue->lock);
+        queue->closed = 1;
+        pthread_cond_broadcast(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,28 @@
+/*
+ *     edgepipe.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgepipe
+ *
+ *     This file holds the interface for removing edge-connected black
+ *     pixels from a stream of concatenated PBM images, with reading,
+ *     cleaning and writing running at the same time.
+ */
+
+#ifndef EDGEPIPE_INCLUDED
+#define EDGEPIPE_INCLUDED
+
+#include <stdio.h>
+#include "bit2.h"
+#include "edgefill.h"
+#include "pbmio.h"
+
+extern Pbmio_status edgepipe_run(FILE *in, FILE *out,
+                                 void engine(Bit2_T bitmap,
+                                             Edgefill_stats *stats),
+                                 void write(FILE *out, Bit2_T bitmap,
+                                            int raw),
+                                 int workers, int raw, int *images,
+                                 Edgefill_stats *stats);
+
+#endif
@@ -0,0 +1,625 @@
+/*
+ *     edgeserve.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgeserve
+ *
+ *     This program keeps unblackedges resident behind a Unix domain
+ *     socket, so a small image costs one round trip instead of a process
+ *     start, a reader setup and an exit. The framing is described in
+ *     edgeserve.h.
+ *
+ *     A fixed pool of threads all wait in accept on the one listening
+ *     socket, and a thread serves the connection it gets until the client
+ *     closes it. Every worker keeps its Pbmio reader, its Bit2_T, its
+ *     request buffer and its reply stream for its whole life, so once the
+ *     pages settle into a size a request makes no large allocations. A
+ *     request that cannot be read as a PBM is answered with an error and
+ *     the connection goes on; a header that makes no sense ends the
+ *     connection, since the stream cannot be trusted after it. Workers
+ *     read with Pbmio_load and never raise (see pbmio.h).
+ *
+ *     A payload (or file) may hold several concatenated images; all of
+ *     them are cleaned and the reply holds them in order, as unblackedges
+ *     writes them. Path requests let anyone who can connect read files as
+ *     the server's user, so they are refused unless the server was given
+ *     a root directory, and then only paths that resolve (following
+ *     symbolic links) to a file under it are opened.
+ *
+ *     EDGESERVE_QUIT stops the server: the listening socket is shut down,
+ *     which wakes the workers waiting in accept, and the reading side of
+ *     every other open connection is shut down too, so a worker waiting
+ *     on an idle client sees the end of its stream. A worker in the middle
+ *     of a request still sends that reply before it stops.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "assert.h"
+#include "bit2.h"
+#include "edgefill.h"
+#include "pbmio.h"
+#include "edgeserve.h"
+
+/* Everything the workers share */
+typedef struct {
+        int listener;
+        void (*engine)(Bit2_T bitmap, Edgefill_stats *stats);
+        char *root; /* resolved path request root, or NULL if refused */
+        atomic_int stop;
+        pthread_mutex_t lock; /* guards clients, and stop being set */
+        int *clients;         /* each worker's connection, or -1 */
+        int workers;
+} Server;
+
+/* What one worker thread keeps between requests, and what it did */
+typedef struct {
+        Server *server;
+        int slot;              /* index into server->clients */
+        Pbmio_T reader;
+        Bit2_T bitmap;
+        unsigned char *payload;
+        size_t capacity;
+        FILE *out;             /* memory stream the reply is written to */
+        char *reply;
+        size_t reply_size;
+        Edgeserve_report report;
+} Worker;
+
+static void *work(void *cl);
+static void  serve(Worker *self, int fd);
+static void  stop_server(Worker *self);
+static Edgeserve_status clean(Worker *self, int kind, int flags,
+                              size_t len, size_t *reply_len);
+static FILE *open_in_root(const char *root, const char *path);
+static int   send_reply(int fd, Edgeserve_status status, const void *data,
+                        size_t len);
+static int   bind_socket(const char *socket_path);
+static int   send_full(int fd, const void *data, size_t len);
+static int   recv_full(int fd, void *data, size_t len);
+static void  put_header(unsigned char *header, int first, int second,
+                        size_t len);
+
+/*
+*  name:        edgeserve_run
+*  purpose:     Serves edge removal on a Unix domain socket until a client
+*               sends EDGESERVE_QUIT.
+*  arguments:   The socket path, the engine to run on each image, the
+*               number of worker threads, the directory path requests are
+*               confined to (NULL refuses them all) and a report to fill
+*               in.
+*  return type: 1 if the server ran, 0 if the socket could not be set up
+*               or path_root cannot be resolved.
+*  effect:      Removes whatever is at socket_path, binds and listens
+*               there, starts workers - 1 pthreads (the caller is the last
+*               one) and removes the socket again at the end. The report
+*               sums what the workers did. Setup failures are printed to
+*               stderr.
+*  expects:     socket_path and report are not NULL, workers >= 1, and the
+*               engine may be run by several threads at once.
+*/
+int edgeserve_run(const char *socket_path,
+                  void engine(Bit2_T bitmap, Edgefill_stats *stats),
+                  int workers, const char *path_root,
+                  Edgeserve_report *report)
+{
+        assert(socket_path != NULL && report != NULL && workers >= 1);
+        Server server;
+        server.root = NULL;
+        if (path_root != NULL) {
+                server.root = realpath(path_root, NULL);
+                if (server.root == NULL) {
+                        perror(path_root);
+                        return 0;
+                }
+        }
+        server.listener = bind_socket(socket_path);
+        if (server.listener < 0) {
+                free(server.root);
+                return 0;
+        }
+        server.engine = engine;
+        atomic_init(&server.stop, 0);
+        pthread_mutex_init(&server.lock, NULL);
+        server.clients = malloc(workers * sizeof(int));
+        server.workers = workers;
+
+        pthread_t *tids = malloc(workers * sizeof(pthread_t));
+        Worker *pool = calloc(workers, sizeof(Worker));
+        assert(server.clients != NULL && tids != NULL && pool != NULL);
+        for (int i = 0; i < workers; i++) {
+                server.clients[i] = -1;
+                pool[i].server = &server;
+                pool[i].slot = i;
+        }
+        for (int i = 1; i < workers; i++) {
+                int err = pthread_create(&tids[i], NULL, work, &pool[i]);
+                assert(err == 0);
+        }
+        work(&pool[0]);
+        for (int i = 1; i < workers; i++) {
+                pthread_join(tids[i], NULL);
+        }
+
+        *report = (Edgeserve_report){ 0, 0, 0 };
+        for (int i = 0; i < workers; i++) {
+                report->requests += pool[i].report.requests;
+                report->failed += pool[i].report.failed;
+                report->connections += pool[i].report.connections;
+        }
+        close(server.listener);
+        unlink(socket_path);
+        pthread_mutex_destroy(&server.lock);
+        free(server.clients);
+        free(server.root);
+        free(pool);
+        free(tids);
+        return 1;
+}
+
+/*
+*  name:        work
+*  purpose:     The body of every worker thread.
+*  arguments:   A Worker pointer passed as the pthread closure.
+*  return type: NULL.
+*  effect:      Accepts connections and serves each one until the server
+*               is stopped, then frees the worker's buffers. The open
+*               connection is registered in the server's clients so that
+*               a QUIT can wake the worker.
+*  expects:     cl is a zeroed Worker whose server is set up.
+*/
+static void *work(void *cl)
+{
+        Worker *self = cl;
+        Server *server = self->server;
+
+        while (!atomic_load(&server->stop)) {
+                int fd = accept(server->listener, NULL, NULL);
+                if (fd < 0) {
+                        continue; /* interrupted, or stopped: checked above */
+                }
+                pthread_mutex_lock(&server->lock);
+                int stopped = atomic_load(&server->stop);
+                if (!stopped) {
+                        server->clients[self->slot] = fd;
+                }
+                pthread_mutex_unlock(&server->lock);
+                if (stopped) { /* accepted just as a QUIT came in */
+                        close(fd);
+                        break;
+                }
+                self->report.connections++;
+                serve(self, fd);
+
+                pthread_mutex_lock(&server->lock); /* before fd is reused */
+                server->clients[self->slot] = -1;
+                pthread_mutex_unlock(&server->lock);
+                close(fd);
+        }
+
+        if (self->reader != NULL) {
+                Pbmio_free(&self->reader);
+        }
+        if (self->bitmap != NULL) {
+                Bit2_free(&self->bitmap);
+        }
+        if (self->out != NULL) {
+                fclose(self->out);
+        }
+        free(self->reply);
+        free(self->payload);
+        return NULL;
+}
+
+/*
+*  name:        serve
+*  purpose:     Answers the requests of one connection.
+*  arguments:   The worker and the connected socket.
+*  return type: None.
+*  effect:      Reads requests and sends replies until the client hangs up,
+*               a send fails, a header is bad or a QUIT comes in. QUIT
+*               stops the server and is answered with an empty
+*               EDGESERVE_OK.
+*  expects:     self and fd are valid.
+*/
+static void serve(Worker *self, int fd)
+{
+        unsigned char header[EDGESERVE_HEADER];
+        while (recv_full(fd, header, sizeof(header))) {
+                int kind = header[0];
+                int flags = header[1];
+                size_t len = (size_t)header[4] << 24 | header[5] << 16 |
+                             header[6] << 8 | header[7];
+                if ((kind != EDGESERVE_IMAGE && kind != EDGESERVE_PATH &&
+                     kind != EDGESERVE_QUIT) || (flags & ~EDGESERVE_RAW) ||
+                    header[2] != 0 || header[3] != 0 ||
+                    len > EDGESERVE_MAX_PAYLOAD) {
+                        self->report.failed++;
+                        send_reply(fd, EDGESERVE_BADREQUEST, NULL, 0);
+                        return;
+                }
+
+                if (len + 1 > self->capacity) { /* + 1 ends a path */
+                        free(self->payload);
+                        self->capacity = len + 1;
+                        self->payload = malloc(self->capacity);
+                        assert(self->payload != NULL);
+                }
+                if (!recv_full(fd, self->payload, len)) {
+                        return;
+                }
+
+                if (kind == EDGESERVE_QUIT) {
+                        stop_server(self);
+                        send_reply(fd, EDGESERVE_OK, NULL, 0);
+                        return;
+                }
+                size_t reply_len = 0;
+                Edgeserve_status status = clean(self, kind, flags, len,
+                                                &reply_len);
+                if (status == EDGESERVE_OK) {
+                        self->report.requests++;
+                } else {
+                        self->report.failed++;
+                }
+                if (!send_reply(fd, status, self->reply, reply_len)) {
+                        return;
+                }
+        }
+}
+
+/*
+*  name:        stop_server
+*  purpose:     Carries out a QUIT.
+*  arguments:   The worker that received it.
+*  return type: None.
+*  effect:      Sets stop, shuts the listening socket down and shuts down
+*               the reading side of every other worker's connection, so
+*               workers blocked in accept or in recv return. Replies
+*               already being written still go out.
+*  expects:     self is the worker serving the QUIT's connection.
+*/
+static void stop_server(Worker *self)
+{
+        Server *server = self->server;
+        pthread_mutex_lock(&server->lock);
+        atomic_store(&server->stop, 1);
+        shutdown(server->listener, SHUT_RDWR);
+        for (int i = 0; i < server->workers; i++) {
+                if (i != self->slot && server->clients[i] >= 0) {
+                        shutdown(server->clients[i], SHUT_RD);
+                }
+        }
+        pthread_mutex_unlock(&server->lock);
+}
+
+/*
+*  name:        clean
+*  purpose:     Runs one image or path request.
+*  arguments:   The worker, the request kind and flags, the payload length
+*               (the payload is in self->payload) and where to put the
+*               reply length.
+*  return type: EDGESERVE_OK with the cleaned images in self->reply, or
+*               the error to answer with: EDGESERVE_BADREQUEST for a path
+*               request when the server has no root or for a result too
+*               big for one reply, EDGESERVE_NOFILE for a path that cannot
+*               be opened or is outside the root, and the Pbmio errors if
+*               any image is bad.
+*  effect:      Reads every image of the payload (or of the file it
+*               names), runs the engine on each and writes them in order
+*               to the reply stream, reusing the worker's reader, bitmap
+*               and stream.
+*  expects:     self->payload has room for len + 1 bytes.
+*/
+static Edgeserve_status clean(Worker *self, int kind, int flags,
+                              size_t len, size_t *reply_len)
+{
+        FILE *in;
+        if (kind == EDGESERVE_PATH) {
+                if (self->server->root == NULL) {
+                        return EDGESERVE_BADREQUEST;
+                }
+                self->payload[len] = '\0';
+                if (strlen((char *)self->payload) != len) {
+                        return EDGESERVE_NOFILE; /* a NUL inside the path */
+                }
+                in = open_in_root(self->server->root,
+                                  (char *)self->payload);
+                if (in == NULL) {
+                        return EDGESERVE_NOFILE;
+                }
+        } else if (len == 0) {
+                return EDGESERVE_BADFORMAT;
+        } else {
+                in = fmemopen(self->payload, len, "rb");
+                assert(in != NULL);
+        }
+        if (self->reader == NULL) {
+                self->reader = Pbmio_new(in);
+        } else {
+                Pbmio_reset(self->reader, in);
+        }
+        if (self->out == NULL) {
+                self->out = open_memstream(&self->reply, &self->reply_size);
+                assert(self->out != NULL);
+        }
+        fseeko(self->out, 0, SEEK_SET);
+
+        int images = 0;
+        Pbmio_status status;
+        while ((status = Pbmio_load(self->reader, &self->bitmap)) ==
+               PBMIO_IMAGE) {
+                self->server->engine(self->bitmap, NULL);
+                Pbmio_write(self->out, self->bitmap, flags & EDGESERVE_RAW);
+                images++;
+        }
+        fclose(in);
+        if (status == PBMIO_COUNT) {
+                return EDGESERVE_COUNT;
+        } else if (status != PBMIO_END || images == 0) {
+                return EDGESERVE_BADFORMAT;
+        }
+        fflush(self->out);
+        *reply_len = (size_t)ftello(self->out);
+        if (*reply_len > EDGESERVE_MAX_PAYLOAD) {
+                *reply_len = 0; /* a plain reply can outgrow the frame */
+                return EDGESERVE_BADREQUEST;
+        }
+        return EDGESERVE_OK;
+}
+
+/*
+*  name:        open_in_root
+*  purpose:     Opens the file a path request names, if it is under the
+*               server's root.
+*  arguments:   The resolved root and the requested path, relative to the
+*               root or absolute.
+*  return type: The open file, or NULL if the path has a ".." component,
+*               does not resolve, resolves outside the root or cannot be
+*               opened.
+*  effect:      Resolves the path with realpath, so a symbolic link that
+*               leads out of the root is refused too.
+*  expects:     root is an absolute path without a trailing '/' (other
+*               than "/" itself) and path is not NULL.
+*/
+static FILE *open_in_root(const char *root, const char *path)
+{
+        for (const char *part = path; *part != '\0'; ) {
+                size_t span = strcspn(part, "/");
+                if (span == 2 && part[0] == '.' && part[1] == '.') {
+                        return NULL;
+                }
+                part += span + (part[span] == '/');
+        }
+
+        char *joined = NULL;
+        if (path[0] != '/') {
+                size_t size = strlen(root) + 1 + strlen(path) + 1;
+                joined = malloc(size);
+                assert(joined != NULL);
+                snprintf(joined, size, "%s/%s", root, path);
+        }
+        char *resolved = realpath(joined != NULL ? joined : path, NULL);
+        free(joined);
+        if (resolved == NULL) {
+                return NULL;
+        }
+        size_t root_len = strlen(root);
+        if (root_len == 1) {
+                root_len = 0; /* the root is "/" */
+        }
+        FILE *in = NULL;
+        if (strncmp(resolved, root, root_len) == 0 &&
+            resolved[root_len] == '/') {
+                in = fopen(resolved, "rb");
+        }
+        free(resolved);
+        return in;
+}
+
+/*
+*  name:        send_reply
+*  purpose:     Sends one reply.
+*  arguments:   The socket, the status and the payload with its length.
+*  return type: 1 if it was sent, 0 if the connection failed.
+*  effect:      Sends the header, then the payload unless len is 0.
+*  expects:     data is not NULL if len > 0.
+*/
+static int send_reply(int fd, Edgeserve_status status, const void *data,
+                      size_t len)
+{
+        unsigned char header[EDGESERVE_HEADER];
+        put_header(header, status, 0, len);
+        return send_full(fd, header, sizeof(header)) &&
+               (len == 0 || send_full(fd, data, len));
+}
+
+/*
+*  name:        bind_socket
+*  purpose:     Makes the listening socket.
+*  arguments:   The socket path.
+*  return type: The listening descriptor, or -1 on failure.
+*  effect:      Removes a stale socket file at the path first. Prints the
+*               failing call to stderr.
+*  expects:     socket_path is not NULL.
+*/
+static int bind_socket(const char *socket_path)
+{
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "%s: socket path too long\n", socket_path);
+                return -1;
+        }
+        strcpy(addr.sun_path, socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+                perror("socket");
+                return -1;
+        }
+        unlink(socket_path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+                perror(socket_path);
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/*
+*  name:        edgeserve_connect
+*  purpose:     Connects a client to a server.
+*  arguments:   The socket path.
+*  return type: The connected descriptor, or -1 if there is no server.
+*  effect:      None beyond the connection.
+*  expects:     socket_path is not NULL.
+*/
+int edgeserve_connect(const char *socket_path)
+{
+        assert(socket_path != NULL);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                return -1;
+        }
+        strcpy(addr.sun_path, socket_path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+                return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/*
+*  name:        edgeserve_call
+*  purpose:     Sends one request and waits for its reply.
+*  arguments:   A connected descriptor, the request kind and flags, the
+*               payload with its length and the reply to fill in.
+*  return type: 1 if a reply came back, 0 if the connection failed.
+*  effect:      On success reply->data holds a malloced copy of the reply
+*               payload (NULL if it is empty), which the caller frees.
+*  expects:     reply is not NULL, payload is not NULL if len > 0 and
+*               len <= EDGESERVE_MAX_PAYLOAD.
+*/
+int edgeserve_call(int fd, int kind, int flags, const void *payload,
+                   size_t len, Edgeserve_reply *reply)
+{
+        assert(reply != NULL && (payload != NULL || len == 0));
+        assert(len <= EDGESERVE_MAX_PAYLOAD);
+        unsigned char header[EDGESERVE_HEADER];
+        put_header(header, kind, flags, len);
+        if (!send_full(fd, header, sizeof(header)) ||
+            (len > 0 && !send_full(fd, payload, len)) ||
+            !recv_full(fd, header, sizeof(header))) {
+                return 0;
+        }
+
+        reply->status = header[0];
+        reply->len = (size_t)header[4] << 24 | header[5] << 16 |
+                     header[6] << 8 | header[7];
+        reply->data = NULL;
+        if (reply->len > 0) {
+                reply->data = malloc(reply->len);
+                assert(reply->data != NULL);
+                if (!recv_full(fd, reply->data, reply->len)) {
+                        free(reply->data);
+                        reply->data = NULL;
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/*
+*  name:        send_full
+*  purpose:     Sends a whole buffer.
+*  arguments:   The socket and the buffer with its length.
+*  return type: 1 if all of it was sent, 0 if the connection failed.
+*  effect:      Retries short and interrupted sends. Uses MSG_NOSIGNAL so
+*               a client that hung up does not kill the server with
+*               SIGPIPE.
+*  expects:     data is not NULL.
+*/
+static int send_full(int fd, const void *data, size_t len)
+{
+        const unsigned char *bytes = data;
+        while (len > 0) {
+                ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (sent <= 0) {
+                        return 0;
+                }
+                bytes += sent;
+                len -= sent;
+        }
+        return 1;
+}
+
+/*
+*  name:        recv_full
+*  purpose:     Receives exactly len bytes.
+*  arguments:   The socket and the buffer with its length.
+*  return type: 1 if all of it came, 0 on end of stream or failure.
+*  effect:      Retries short and interrupted receives.
+*  expects:     data is not NULL.
+*/
+static int recv_full(int fd, void *data, size_t len)
+{
+        unsigned char *bytes = data;
+        while (len > 0) {
+                ssize_t got = recv(fd, bytes, len, 0);
+                if (got < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (got <= 0) {
+                        return 0;
+                }
+                bytes += got;
+                len -= got;
+        }
+        return 1;
+}
+
+/*
+*  name:        put_header
+*  purpose:     Fills in a request or reply header.
+*  arguments:   The 8-byte header, its first two bytes (kind and flags, or
+*               status and 0) and the payload length.
+*  return type: None.
+*  effect:      Writes the length big-endian in the last four bytes.
+*  expects:     len <= EDGESERVE_MAX_PAYLOAD.
+*/
+static void put_header(unsigned char *header, int first, int second,
+                       size_t len)
+{
+        header[0] = (unsigned char)first;
+        header[1] = (unsigned char)second;
+        header[2] = 0;
+        header[3] = 0;
+        header[4] = (unsigned char)(len >> 24);
+        header[5] = (unsigned char)(len >> 16);
+        header[6] = (unsigned char)(len >> 8);
+        header[7] = (unsigned char)len;
+}
@@ -0,0 +1,74 @@
+/*
+ *     edgeserve.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgeserve
+ *
+ *     This file holds the interface for a resident unblackedges server on
+ *     a Unix domain socket, and the client side of its protocol.
+ *
+ *     Every request and reply is an 8-byte header and then a payload.
+ *     Request: kind (one byte, below), flags (one byte, EDGESERVE_RAW for
+ *     P4 output), two zero bytes, payload length (4 bytes, big-endian).
+ *     The payload is one or more concatenated PBM images for
+ *     EDGESERVE_IMAGE, the path of a file holding them for EDGESERVE_PATH,
+ *     and empty for EDGESERVE_QUIT. A path is looked up under the root
+ *     directory the server was started with (an absolute path must lead
+ *     there too); a server without a root answers every path request
+ *     with EDGESERVE_BADREQUEST, and a path outside the root gets
+ *     EDGESERVE_NOFILE. Reply: status (one byte, below), three zero bytes,
+ *     payload length (4 bytes, big-endian), then the cleaned images, in
+ *     order, if the status is EDGESERVE_OK and nothing otherwise. A
+ *     connection carries any number of requests, each answered in order,
+ *     and holds one server worker until it is closed.
+ */
+
+#ifndef EDGESERVE_INCLUDED
+#define EDGESERVE_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bit2.h"
+#include "edgefill.h"
+
+/* Request kinds */
+#define EDGESERVE_IMAGE 'I'
+#define EDGESERVE_PATH  'P'
+#define EDGESERVE_QUIT  'Q'
+
+/* Request flags */
+#define EDGESERVE_RAW 1
+
+/* Reply statuses; the middle two match Pbmio_status's errors */
+typedef enum {
+        EDGESERVE_OK, EDGESERVE_BADFORMAT, EDGESERVE_COUNT,
+        EDGESERVE_NOFILE, EDGESERVE_BADREQUEST
+} Edgeserve_status;
+
+#define EDGESERVE_HEADER 8
+#define EDGESERVE_MAX_PAYLOAD (1u << 30) /* larger requests are refused */
+
+/* What a server did before it was told to quit */
+typedef struct {
+        uint64_t requests; /* requests answered with EDGESERVE_OK */
+        uint64_t failed;   /* requests answered with an error */
+        uint64_t connections;
+} Edgeserve_report;
+
+/* One reply as the client sees it */
+typedef struct {
+        Edgeserve_status status;
+        unsigned char *data; /* the cleaned images, malloced */
+        size_t len;
+} Edgeserve_reply;
+
+extern int  edgeserve_run(const char *socket_path,
+                          void engine(Bit2_T bitmap, Edgefill_stats *stats),
+                          int workers, const char *path_root,
+                          Edgeserve_report *report);
+
+extern int  edgeserve_connect(const char *socket_path);
+extern int  edgeserve_call(int fd, int kind, int flags, const void *payload,
+                           size_t len, Edgeserve_reply *reply);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ *     edgestack.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgestack
+ *
+ *     This program holds the original unblackedges() engine, which
+ *     removes edge-connected black pixels with a Hanson Stack_T of
+ *     malloced pixels. It is the reference the faster engines are
+ *     checked against, by unblackedges -e stack and by benchedges.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "assert.h"
+#include "bit2.h"
+#include "stack.h"
+#include "edgestack.h"
+
+/* These are entries of black pixels to put in a stack. */
+typedef struct {
+        int row, col;
+} BlackPixels;
+
+/*
+*  name:        swap_color
+*  purpose:     Iterates through a stack of black pixels and changes them
+*               to white (0), ensuring all connected black pixels are also
+*               processed.
+*  arguments:   A stack containing black pixels to process and a bitmap
+*               representing the 2D bit array.
+*  return type: None.
+*  effect:      Iterates through the stack and changes black pixels (1) to
+*               white (0) in the bit map. Pushes adjacent black pixels to
+*               the stack for further processing. Frees dynamically allocated
+*               memory for each processed pixel, since they are allocated
+*               structs.
+*  expects:     Bitmap and pixels are not NULL and the pixels in the stack
+*               contain valid row and column indices.
+*/
+void swap_color(Stack_T pixels, Bit2_T bitmap)
+{
+        assert(bitmap != NULL && pixels != NULL);
+    
+        while (!Stack_empty(pixels)) {
+                BlackPixels *curr_pixel = Stack_pop(pixels);
+                int row  = curr_pixel->row;
+                int col = curr_pixel->col;
+                free(curr_pixel);
+
+                /* push_pixels only hands out in-bounds pixels */
+                uint64_t *words = Bit2_row(bitmap, row);
+                if (Bit2_word_get(words, col) == 1) {  
+                        Bit2_word_put(words, col, 0);
+                        push_pixels(pixels, bitmap, row, col);
+                }
+        }
+    
+}
+
+/*
+*  name:        unblackedges
+*  purpose:     Iteratively removes black pixels (1s) that are connected 
+*               to the edges of the bitmap using a stack.
+*  arguments:   A bitmap representing the 2D bit array.
+*  return type: None.
+*  effect:      Allocates memory for a new stack and then frees it
+*               at the end. Calls other functions that allocate memory, but
+*               that will also be freed in their respective functions.
+*  expects:     The bitmap pointer is not NULL.
+*/
+void unblackedges(Bit2_T bitmap)
+{
+        assert(bitmap != NULL);
+        Stack_T pixels = Stack_new(); /* create the stack */
+        int width = Bit2_width(bitmap);
+        int height = Bit2_height(bitmap);
+
+        /* top and bottom */
+        for (int col = 0; col < width; col++) {
+                edgepix_to_stack(pixels, bitmap, 0, col);
+                edgepix_to_stack(pixels, bitmap, height - 1, col);
+        }
+
+        /* sides no overlap with the corners */
+        for (int row = 1; row < height - 1; row++) {
+                edgepix_to_stack(pixels, bitmap, row, 0);
+                edgepix_to_stack(pixels, bitmap, row, width - 1);
+        }
+
+        swap_color(pixels, bitmap); /* process our stack */
+        Stack_free(&pixels); /* free the stack */
+}
+
+/*
+*  name:        push_pixels
+*  purpose:     Identifies the four adjacent pixels (up, down, left, right) 
+*               and pushes them onto the stack for processing.
+*  arguments:   A stack containing black pixels to process and a bitmap
+*               representing the 2D bit array, as well as two ints
+*               represnting an index in the bitmap.
+*  return type: None.
+*  effect:      Dynamically allocates memory for up to four BlackPixels
+*               structs, then pushes those onto a stack. If one is invalid
+*               it is freed, otherwise the clients need to call swap_color
+*               to free the rest in the stack.
+*  expects:     Pixels and bitmap are not NULL. and row + col are valid bounds
+*/
+void push_pixels(Stack_T pixels, Bit2_T bitmap, int row, int col)
+{
+        assert(pixels != NULL && bitmap != NULL);
+
+        BlackPixels *connected[4];
+        for (int i = 0; i < 4; i++) {
+                connected[i] = malloc(sizeof(BlackPixels));
+                assert(connected[i] != NULL);
+        }
+
+        connected[0]->row = row - 1; /* up */
+        connected[0]->col = col; /* up */
+        connected[1]->row = row + 1; /* down */
+        connected[1]->col = col;  /* down */
+        connected[2]->row = row; /* left */
+        connected[2]->col = col - 1; /* left */
+        connected[3]->row = row; /* right */
+        connected[3]->col = col + 1; /* right */
+
+        for (int i = 0; i < 4; i++) { /* make sure they're in bounds */
+                if (valid_index(bitmap, connected[i]->row, connected[i]->col)) {
+                        Stack_push(pixels, connected[i]);
+                } else {
+                        free(connected[i]); /* free if not */
+                }
+        }
+}
+
+/*
+*  name:        edgepix_to_stack
+*  purpose:     Checks if a given edge pixel is black (1) and pushes
+*               it onto the stack.
+*  arguments:   A stack containing black pixels to process and a bitmap
+*               representing the 2D bit array, as well as two ints
+*               represnting an index in the bitmap.
+*  return type: None.
+*  effect:      Dynamically allocates space fro BlackPixel structs if
+*               an edge is black and pushes it onto a stack. These
+*               will be freed when swap_color is called.
+*  expects:     Pixels and bitmap are not NULL. and row + col are valid bounds
+*/
+void edgepix_to_stack(Stack_T pixels, Bit2_T bitmap, int row, int col)
+{
+        if (Bit2_get(bitmap, row, col) == 1) {
+                BlackPixels *curr_pixel = malloc(sizeof(BlackPixels));
+                curr_pixel->row = row;
+                curr_pixel->col = col;
+                Stack_push(pixels, curr_pixel);
+        }
+}
@@ -0,0 +1,23 @@
+/*
+ *     edgestack.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgestack
+ *
+ *     This file holds the interface for the original stack-based
+ *     edge-removal engine, kept as the reference for the other engines.
+ */
+
+#ifndef EDGESTACK_INCLUDED
+#define EDGESTACK_INCLUDED
+
+#include "bit2.h"
+#include "stack.h"
+
+extern void swap_color(Stack_T pixels, Bit2_T bitmap);
+extern void push_pixels(Stack_T pixels, Bit2_T bitmap, int row, int col);
+extern void unblackedges(Bit2_T bitmap);
+extern void edgepix_to_stack(Stack_T pixels, Bit2_T bitmap, int row,
+                             int col);
+
+#endif
@@ -0,0 +1,524 @@
+/*
+ *     edgestream.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgestream
+ *
+ *     This program removes edge-connected black pixels from a PBM image
+ *     while holding only two rows of it in memory, so images larger than
+ *     RAM can be processed.
+ *
+ *     The first pass reads the image one row at a time with pbmio and
+ *     labels the black runs: a run joins the labels of the runs it
+ *     overlaps in the row above, and a union-find remembers which labels
+ *     reach the border. Every row's runs are spooled to a temporary file
+ *     with the id of their label.
+ *
+ *     Only the labels of the last two rows are kept in memory. Each one
+ *     sits in a slot, and at the end of every row each slot that no run
+ *     of the row uses is given up. Before it goes, its fate is written to
+ *     a second temporary file, at the offset of its id. A root whose
+ *     component has ended gets the component's border decision. Any other
+ *     label gets the id of its root, which is always smaller, since a
+ *     union keeps the smaller id as the root. Ids are never reused, so
+ *     the spooled ids stay valid after their slots are.
+ *
+ *     The second pass replays the spool and writes each run out black only
+ *     if its label's fate, followed up through any merges, says that its
+ *     component never reached the border. Resolved chains are written back
+ *     as decisions, and each slot remembers the last id it resolved, so
+ *     runs that go on from the row above need no lookup. The fate file is
+ *     read and written through a small direct-mapped cache of 4 KB pages;
+ *     ids are handed out in order and most labels end soon after they
+ *     start, so both passes mostly hit the same few pages.
+ *
+ *     Memory is a few arrays sized by the width and the fixed fate cache.
+ *     The spool (24 bytes per black run) and the fate file (8 bytes per
+ *     label) are on disk.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "assert.h"
+#include "except.h"
+#include "pnmrdr.h"
+#include "edgefill.h"
+#include "edgestream.h"
+#include "pbmio.h"
+
+/* Fates; any odd fate is the id a label was merged into, times 2, plus 1 */
+#define FATE_INSIDE 2 /* the component never reached the border */
+#define FATE_BORDER 4 /* the component reached the border */
+
+#define FATE_PAGE 512 /* fates per cached page */
+#define FATE_PAGES 64 /* pages in the cache */
+
+/* The fate file and its cache; page i of the cache holds the file page
+ * tag[i], which is always congruent to i mod FATE_PAGES */
+typedef struct {
+        int fd;
+        uint64_t *cache;
+        uint64_t tag[FATE_PAGES]; /* UINT64_MAX for none */
+        unsigned char dirty[FATE_PAGES];
+} Fates;
+
+/* What a slot is doing */
+#define SLOT_FREE 0
+#define SLOT_USED 1
+#define SLOT_KEPT 2 /* used by a run of the row being finished */
+
+/* The union-find over the labels of the last two rows. Everything but
+ * ids and the fate file is indexed by slot; parent holds slots. */
+typedef struct {
+        int *parent;
+        uint64_t *id;
+        unsigned char *touches; /* border flag, kept on roots */
+        unsigned char *state;
+        int *free_slots;        /* a stack of the SLOT_FREE slots */
+        int nfree, nslots;
+        uint64_t next_id;
+        Fates *fates;
+} Labels;
+
+/* How one run is stored in the spool file */
+typedef struct {
+        uint64_t id;
+        int32_t first, last;
+        int32_t slot;
+} Spooled;
+
+static void     read_row(Pbmio_T reader, uint64_t *words);
+static void     label_row(Labels *labels, const Edgefill_run *above,
+                          const int *above_label, int nabove,
+                          const Edgefill_run *cur, int *cur_label,
+                          int ncur, int edge_row, int width);
+static void     retire(Labels *labels, int *cur_label, int ncur);
+static int      new_label(Labels *labels);
+static int      find(Labels *labels, int x);
+static int      unite(Labels *labels, int a, int b);
+static void     write_rows(FILE *spool, FILE *out, Fates *fates,
+                           int nslots, int width, int height, int raw,
+                           Spooled *runs, uint64_t *words);
+static int      on_border(Fates *fates, uint64_t id);
+static uint64_t *fate_of(Fates *fates, uint64_t id);
+
+/*
+*  name:        edgestream_run
+*  purpose:     Reads a PBM image, removes its edge-connected black pixels
+*               and writes the result, without building a Bit2_T.
+*  arguments:   The input PBM stream, the output stream, whether to write
+*               raw P4 (nonzero) or plain P1, and an optional stats
+*               pointer.
+*  return type: None.
+*  effect:      Reads the first image of in and writes it to out with
+*               pbmio. A tmpfile() spool of 24 bytes per black run and a
+*               tmpfile() of 8 bytes per label are gone once the function
+*               returns. The memory held, which depends only on the width,
+*               is written to stats. Raises Pnmrdr_Badformat or
+*               Pnmrdr_Count on bad input, as Pbmio_read does.
+*  expects:     in and out are open streams.
+*/
+void edgestream_run(FILE *in, FILE *out, int raw, Edgefill_stats *stats)
+{
+        assert(in != NULL && out != NULL);
+        Pbmio_T reader = Pbmio_new(in);
+        int width, height;
+        if (Pbmio_read_header(reader, &width, &height) != PBMIO_IMAGE) {
+                RAISE(Pnmrdr_Badformat);
+        }
+        int nwords = (width + 63) / 64;
+        size_t max_runs = (size_t)width / 2 + 1;
+
+        uint64_t *words = malloc(nwords * sizeof(uint64_t));
+        Edgefill_run *above = malloc(max_runs * sizeof(Edgefill_run));
+        Edgefill_run *cur = malloc(max_runs * sizeof(Edgefill_run));
+        int *above_label = malloc(max_runs * sizeof(int));
+        int *cur_label = malloc(max_runs * sizeof(int));
+        Spooled *spooled = malloc(max_runs * sizeof(Spooled));
+        assert(words != NULL && above != NULL && cur != NULL);
+        assert(above_label != NULL && cur_label != NULL && spooled != NULL);
+        FILE *spool = tmpfile();
+        FILE *fate = tmpfile();
+        assert(spool != NULL && fate != NULL);
+        Fates fates;
+        fates.fd = fileno(fate);
+        fates.cache = malloc(FATE_PAGES * FATE_PAGE * sizeof(uint64_t));
+        assert(fates.cache != NULL);
+        for (int i = 0; i < FATE_PAGES; i++) {
+                fates.tag[i] = UINT64_MAX;
+                fates.dirty[i] = 0;
+        }
+
+        /* a row's live labels and the next row's new ones */
+        Labels labels;
+        labels.nslots = 2 * max_runs;
+        labels.parent = malloc(labels.nslots * sizeof(int));
+        labels.id = malloc(labels.nslots * sizeof(uint64_t));
+        labels.touches = malloc(labels.nslots);
+        labels.state = calloc(labels.nslots, 1);
+        labels.free_slots = malloc(labels.nslots * sizeof(int));
+        assert(labels.parent != NULL && labels.id != NULL);
+        assert(labels.touches != NULL && labels.state != NULL);
+        assert(labels.free_slots != NULL);
+        for (int i = 0; i < labels.nslots; i++) {
+                labels.free_slots[i] = labels.nslots - 1 - i;
+        }
+        labels.nfree = labels.nslots;
+        labels.next_id = 0;
+        labels.fates = &fates;
+
+        int nabove = 0;
+        for (int row = 0; row < height; row++) {
+                read_row(reader, words);
+                int ncur = edgefill_find_runs(words, width, cur);
+                label_row(&labels, above, above_label, nabove, cur,
+                          cur_label, ncur, row == 0 || row == height - 1,
+                          width);
+                retire(&labels, cur_label, ncur);
+
+                int32_t count = ncur;
+                for (int i = 0; i < ncur; i++) {
+                        spooled[i].id = labels.id[cur_label[i]];
+                        spooled[i].first = cur[i].first;
+                        spooled[i].last = cur[i].last;
+                        spooled[i].slot = cur_label[i];
+                }
+                size_t ok = fwrite(&count, sizeof(count), 1, spool);
+                assert(ok == 1);
+                ok = fwrite(spooled, sizeof(Spooled), ncur, spool);
+                assert(ok == (size_t)ncur);
+
+                Edgefill_run *tmp_runs = above;
+                above = cur;
+                cur = tmp_runs;
+                int *tmp_labels = above_label;
+                above_label = cur_label;
+                cur_label = tmp_labels;
+                nabove = ncur;
+        }
+        retire(&labels, NULL, 0); /* every component has ended */
+        Pbmio_free(&reader);
+
+        rewind(spool);
+        write_rows(spool, out, &fates, labels.nslots, width, height, raw,
+                   spooled, words);
+
+        if (stats != NULL) {
+                /* the Labels arrays and write_rows' two per slot */
+                size_t slot_bytes = 2 * sizeof(int) + 2 * sizeof(uint64_t)
+                                    + 3;
+                stats->peak_bytes = labels.nslots * slot_bytes
+                                    + nwords * sizeof(uint64_t)
+                                    + max_runs * (2 * sizeof(Edgefill_run)
+                                                  + 2 * sizeof(int)
+                                                  + sizeof(Spooled))
+                                    + Pbmio_line_bytes(width, raw)
+                                    + FATE_PAGES * FATE_PAGE
+                                      * sizeof(uint64_t);
+        }
+        fclose(spool);
+        fclose(fate);
+        free(fates.cache);
+        free(labels.parent);
+        free(labels.id);
+        free(labels.touches);
+        free(labels.state);
+        free(labels.free_slots);
+        free(words);
+        free(above);
+        free(cur);
+        free(above_label);
+        free(cur_label);
+        free(spooled);
+}
+
+/*
+*  name:        read_row
+*  purpose:     Reads the next row of pixels into packed words.
+*  arguments:   The reader and the row words.
+*  return type: None.
+*  effect:      Overwrites words, leaving the padding bits 0. Raises
+*               Pnmrdr_Count if the pixels run out and Pnmrdr_Badformat
+*               for bad pixel data.
+*  expects:     The reader's image has a row left.
+*/
+static void read_row(Pbmio_T reader, uint64_t *words)
+{
+        Pbmio_status status = Pbmio_read_row(reader, words);
+        if (status == PBMIO_COUNT) {
+                RAISE(Pnmrdr_Count);
+        } else if (status != PBMIO_IMAGE) {
+                RAISE(Pnmrdr_Badformat);
+        }
+}
+
+/*
+*  name:        label_row
+*  purpose:     Gives every run of a row a label, joining the labels of
+*               the runs it overlaps in the row above.
+*  arguments:   The labels, the runs of the row above with their label
+*               slots and count, the runs of this row with room for their
+*               slots and their count, whether this is the top or bottom
+*               row, and the width.
+*  return type: None.
+*  effect:      Adds and unites labels, and flags the root of every run that
+*               touches the border.
+*  expects:     Both run lists are sorted left to right.
+*/
+static void label_row(Labels *labels, const Edgefill_run *above,
+                      const int *above_label, int nabove,
+                      const Edgefill_run *cur, int *cur_label,
+                      int ncur, int edge_row, int width)
+{
+        int first_above = 0; /* first run above that may still overlap */
+        for (int j = 0; j < ncur; j++) {
+                while (first_above < nabove &&
+                       above[first_above].last < cur[j].first) {
+                        first_above++;
+                }
+
+                int label = -1;
+                for (int i = first_above;
+                     i < nabove && above[i].first <= cur[j].last; i++) {
+                        if (label >= 0) {
+                                label = unite(labels, label, above_label[i]);
+                        } else {
+                                label = find(labels, above_label[i]);
+                        }
+                }
+                if (label < 0) {
+                        label = new_label(labels);
+                }
+                if (edge_row || cur[j].first == 0 ||
+                    cur[j].last == width - 1) {
+                        labels->touches[label] = 1;
+                }
+                cur_label[j] = label;
+        }
+}
+
+/*
+*  name:        retire
+*  purpose:     Gives up every slot the finished row does not use.
+*  arguments:   The labels and the finished row's label slots and count
+*               (NULL and 0 after the last row).
+*  return type: None.
+*  effect:      Points each of the row's runs at its root. Every other slot
+*               in use is freed after its fate is written: the border
+*               decision if it is a root, since its component has no run in
+*               this row and so has ended, or its root's id otherwise.
+*  expects:     labels is not NULL.
+*/
+static void retire(Labels *labels, int *cur_label, int ncur)
+{
+        for (int j = 0; j < ncur; j++) {
+                cur_label[j] = find(labels, cur_label[j]);
+                labels->state[cur_label[j]] = SLOT_KEPT;
+        }
+        /* freed slots keep their parents until the next row reuses them,
+         * so find still works through them here */
+        for (int slot = 0; slot < labels->nslots; slot++) {
+                if (labels->state[slot] == SLOT_KEPT) {
+                        labels->state[slot] = SLOT_USED;
+                        continue;
+                } else if (labels->state[slot] == SLOT_FREE) {
+                        continue;
+                }
+                int root = find(labels, slot);
+                uint64_t value;
+                if (root == slot) {
+                        value = labels->touches[slot] ? FATE_BORDER
+                                                      : FATE_INSIDE;
+                } else {
+                        value = labels->id[root] << 1 | 1;
+                }
+                *fate_of(labels->fates, labels->id[slot]) = value;
+                labels->state[slot] = SLOT_FREE;
+                labels->free_slots[labels->nfree++] = slot;
+        }
+}
+
+/*
+*  name:        new_label
+*  purpose:     Makes a fresh label that is its own root.
+*  arguments:   The labels.
+*  return type: The new label's slot.
+*  effect:      Takes a free slot and gives it the next id.
+*  expects:     A slot is free, which holds as there are two per run of a
+*               row.
+*/
+static int new_label(Labels *labels)
+{
+        assert(labels->nfree > 0);
+        int slot = labels->free_slots[--labels->nfree];
+        labels->parent[slot] = slot;
+        labels->id[slot] = labels->next_id++;
+        labels->touches[slot] = 0;
+        labels->state[slot] = SLOT_USED;
+        return slot;
+}
+
+/*
+*  name:        find
+*  purpose:     Returns the root of a label.
+*  arguments:   The labels and a label's slot.
+*  return type: The root's slot.
+*  effect:      Halves the path on the way up.
+*  expects:     x is a slot that is in use, or was freed this row.
+*/
+static int find(Labels *labels, int x)
+{
+        while (labels->parent[x] != x) {
+                labels->parent[x] = labels->parent[labels->parent[x]];
+                x = labels->parent[x];
+        }
+        return x;
+}
+
+/*
+*  name:        unite
+*  purpose:     Merges two labels' sets.
+*  arguments:   The labels and two labels' slots.
+*  return type: The root of the merged set.
+*  effect:      Links the root with the larger id under the one with the
+*               smaller id and carries the border flag over.
+*  expects:     a and b are slots in use.
+*/
+static int unite(Labels *labels, int a, int b)
+{
+        a = find(labels, a);
+        b = find(labels, b);
+        if (a == b) {
+                return a;
+        }
+        if (labels->id[a] > labels->id[b]) {
+                int tmp = a;
+                a = b;
+                b = tmp;
+        }
+        labels->parent[b] = a;
+        labels->touches[a] |= labels->touches[b];
+        return a;
+}
+
+/*
+*  name:        write_rows
+*  purpose:     Replays the spool and writes the cleaned image.
+*  arguments:   The spool (rewound), the output stream, the fates, the
+*               number of label slots, the image size, the
+*               output format flag, a buffer with room for one row of runs
+*               and one row of words.
+*  return type: None.
+*  effect:      Rebuilds each row's words from the runs whose component
+*               never reached the border and writes it with pbmio.
+*  expects:     The spool holds exactly height rows and every label's
+*               fate has been written.
+*/
+static void write_rows(FILE *spool, FILE *out, Fates *fates, int nslots,
+                       int width, int height, int raw, Spooled *runs,
+                       uint64_t *words)
+{
+        int nwords = (width + 63) / 64;
+        unsigned char *line = malloc(Pbmio_line_bytes(width, raw));
+        uint64_t *known_id = malloc(nslots * sizeof(uint64_t));
+        unsigned char *known_border = malloc(nslots);
+        assert(line != NULL && known_id != NULL && known_border != NULL);
+        for (int i = 0; i < nslots; i++) {
+                known_id[i] = UINT64_MAX;
+        }
+
+        Pbmio_write_header(out, width, height, raw);
+        for (int row = 0; row < height; row++) {
+                int32_t count;
+                size_t ok = fread(&count, sizeof(count), 1, spool);
+                assert(ok == 1);
+                ok = fread(runs, sizeof(Spooled), count, spool);
+                assert(ok == (size_t)count);
+
+                memset(words, 0, nwords * sizeof(uint64_t));
+                for (int i = 0; i < count; i++) {
+                        int slot = runs[i].slot;
+                        if (known_id[slot] != runs[i].id) {
+                                known_id[slot] = runs[i].id;
+                                known_border[slot] = on_border(fates,
+                                                               runs[i].id);
+                        }
+                        if (known_border[slot]) {
+                                continue;
+                        }
+                        for (int col = runs[i].first; col <= runs[i].last;
+                             col++) {
+                                Bit2_word_put(words, col, 1);
+                        }
+                }
+                Pbmio_write_row(out, words, width, raw, line);
+        }
+        free(line);
+        free(known_id);
+        free(known_border);
+}
+
+/*
+*  name:        on_border
+*  purpose:     Tells whether a label's component reached the border.
+*  arguments:   The fates and the label's id.
+*  return type: Integer, 1 if it did and 0 if not.
+*  effect:      Follows the merges up to a decision, then writes the
+*               decision over every fate on the way so no chain is
+*               followed twice.
+*  expects:     Every label's fate has been written.
+*/
+static int on_border(Fates *fates, uint64_t id)
+{
+        uint64_t value = *fate_of(fates, id);
+        while (value & 1) {
+                value = *fate_of(fates, value >> 1);
+        }
+        assert(value == FATE_INSIDE || value == FATE_BORDER);
+
+        uint64_t *fate = fate_of(fates, id);
+        while (*fate & 1) {
+                uint64_t next = *fate >> 1;
+                *fate = value;
+                fate = fate_of(fates, next);
+        }
+        return value == FATE_BORDER;
+}
+
+/*
+*  name:        fate_of
+*  purpose:     Finds one label's fate in the cache.
+*  arguments:   The fates and the label's id.
+*  return type: A pointer to the fate, valid until the next call. A fate
+*               never written reads as 0.
+*  effect:      On a miss, writes the page it replaces back to the file if
+*               it was changed (every fate handed out is taken to be) and
+*               reads the label's page in with one pread.
+*  expects:     fates is not NULL.
+*/
+static uint64_t *fate_of(Fates *fates, uint64_t id)
+{
+        uint64_t page = id / FATE_PAGE;
+        int i = page % FATE_PAGES;
+        uint64_t *cached = fates->cache + (size_t)i * FATE_PAGE;
+        size_t bytes = FATE_PAGE * sizeof(uint64_t);
+        if (fates->tag[i] != page) {
+                if (fates->dirty[i]) {
+                        ssize_t put = pwrite(fates->fd, cached, bytes,
+                                             (off_t)(fates->tag[i] * bytes));
+                        assert(put == (ssize_t)bytes);
+                }
+                ssize_t got = pread(fates->fd, cached, bytes,
+                                    (off_t)(page * bytes));
+                assert(got >= 0);
+                memset((char *)cached + got, 0, bytes - got); /* past EOF */
+                fates->tag[i] = page;
+        }
+        fates->dirty[i] = 1;
+        return cached + id % FATE_PAGE;
+}
@@ -0,0 +1,20 @@
+/*
+ *     edgestream.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     edgestream
+ *
+ *     This file holds the interface for removing edge-connected black
+ *     pixels from a PBM stream without loading the whole image.
+ */
+
+#ifndef EDGESTREAM_INCLUDED
+#define EDGESTREAM_INCLUDED
+
+#include <stdio.h>
+#include "edgefill.h"
+
+extern void edgestream_run(FILE *in, FILE *out, int raw,
+                           Edgefill_stats *stats);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ *     hugemem.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     hugemem
+ *
+ *     This program allocates zeroed buffers. Small ones come from
+ *     aligned_alloc and start on a cache line, so threads working on
+ *     line-aligned parts of a buffer never share a line.
+ *     Ones of HUGEMEM_MIN bytes or more are mapped straight from the
+ *     kernel, aligned to a 2 MB huge page and marked with
+ *     madvise(MADV_HUGEPAGE), so a multi-gigabyte bitmap needs one TLB
+ *     entry per 2 MB instead of one per 4 KB. Mapped pages also start out
+ *     zero without being touched, so a huge buffer costs nothing until
+ *     it is used.
+ *
+ *     Which path a buffer took depends only on its size, so the caller
+ *     passes the same size back to Hugemem_free.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "assert.h"
+#include "hugemem.h"
+
+#define HUGEMEM_PAGE ((size_t)2 << 20)     /* one x86-64 huge page */
+#define HUGEMEM_MIN  (2 * HUGEMEM_PAGE)    /* smallest mapped buffer */
+#define HUGEMEM_LINE ((size_t)64)          /* cache line */
+
+static size_t mapped_bytes(size_t bytes);
+
+/*
+*  name:        Hugemem_alloc
+*  purpose:     Allocates a zeroed buffer, huge-page backed when large.
+*  arguments:   The size in bytes.
+*  return type: Pointer to the buffer, which the caller frees with
+*               Hugemem_free and the same size.
+*  effect:      Buffers of HUGEMEM_MIN bytes or more are mmapped with one
+*               spare huge page, trimmed to start on a huge page boundary
+*               and advised as huge-page memory. Others are allocated on a
+*               cache line boundary and zeroed.
+*  expects:     bytes > 0. Fails an assert if memory runs out.
+*/
+void *Hugemem_alloc(size_t bytes)
+{
+        assert(bytes > 0);
+        if (bytes < HUGEMEM_MIN) {
+                size_t rounded = (bytes + HUGEMEM_LINE - 1)
+                                 & ~(HUGEMEM_LINE - 1);
+                void *ptr = aligned_alloc(HUGEMEM_LINE, rounded);
+                assert(ptr != NULL);
+                memset(ptr, 0, rounded);
+                return ptr;
+        }
+
+        size_t length = mapped_bytes(bytes);
+        assert(length + HUGEMEM_PAGE > length); /* no wraparound */
+        char *raw = mmap(NULL, length + HUGEMEM_PAGE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(raw != MAP_FAILED);
+
+        /* keep the huge-page-aligned part and give the rest back */
+        uintptr_t start = ((uintptr_t)raw + HUGEMEM_PAGE - 1)
+                          & ~(uintptr_t)(HUGEMEM_PAGE - 1);
+        char *ptr = (char *)start;
+        size_t head = ptr - raw;
+        size_t tail = HUGEMEM_PAGE - head;
+        if (head > 0) {
+                munmap(raw, head);
+        }
+        if (tail > 0) {
+                munmap(ptr + length, tail);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, length, MADV_HUGEPAGE); /* only a hint */
+#endif
+        return ptr;
+}
+
+/*
+*  name:        Hugemem_free
+*  purpose:     Frees a buffer from Hugemem_alloc.
+*  arguments:   The buffer and the size it was allocated with.
+*  return type: None.
+*  effect:      Unmaps or frees it, whichever Hugemem_alloc did.
+*  expects:     bytes is the size given to Hugemem_alloc. NULL is ignored.
+*/
+void Hugemem_free(void *ptr, size_t bytes)
+{
+        if (ptr == NULL) {
+                return;
+        }
+        if (bytes < HUGEMEM_MIN) {
+                free(ptr);
+                return;
+        }
+        int err = munmap(ptr, mapped_bytes(bytes));
+        assert(err == 0);
+}
+
+/*
+*  name:        mapped_bytes
+*  purpose:     Rounds a mapped buffer's size up to whole huge pages.
+*  arguments:   The requested size.
+*  return type: The size that is actually mapped.
+*  effect:      None.
+*  expects:     bytes >= HUGEMEM_MIN.
+*/
+static size_t mapped_bytes(size_t bytes)
+{
+        return (bytes + HUGEMEM_PAGE - 1) & ~(HUGEMEM_PAGE - 1);
+}
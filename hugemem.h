@@ -0,0 +1,20 @@
+/*
+ *     hugemem.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     hugemem
+ *
+ *     This file holds the interface for allocating the zeroed backing
+ *     store of Bit2 and UArray2. Large buffers are mapped on huge-page
+ *     boundaries so the kernel can back them with transparent huge pages.
+ */
+
+#ifndef HUGEMEM_INCLUDED
+#define HUGEMEM_INCLUDED
+
+#include <stddef.h>
+
+extern void *Hugemem_alloc(size_t bytes);
+extern void  Hugemem_free(void *ptr, size_t bytes);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ *     mappool.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     mappool
+ *
+ *     This program keeps one process-wide pool of pthreads for the
+ *     parallel map functions. A map cuts its rows into bands and calls
+ *     Mappool_run, which wakes enough pool threads, lets them and the
+ *     calling thread take bands from an atomic counter and returns once
+ *     every band is done. Pool threads then go back to sleep on a
+ *     condition variable, so a second map pays no pthread_create.
+ *
+ *     One Mappool_run runs at a time; other callers wait for it. A task
+ *     that itself calls Mappool_run gets its tasks run serially on its
+ *     own thread, so nested maps cannot deadlock the pool.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "assert.h"
+#include "mappool.h"
+
+#define MAPPOOL_MAX 256      /* most threads one run may use */
+#define BANDS_PER_THREAD 4   /* spare bands so fast threads can steal */
+
+/* The run being worked on and the pool's bookkeeping, all under lock */
+static struct {
+        pthread_mutex_t lock;
+        pthread_cond_t start, done;
+        pthread_mutex_t run_lock;   /* one Mappool_run at a time */
+        int threads;                /* pool threads made so far */
+        unsigned long generation;   /* bumped for every run */
+        int wanted;                 /* threads taking part, caller too */
+        int pending;                /* pool threads still in this run */
+        void (*task)(int index, int worker, void *cl);
+        void *cl;
+        int tasks;
+        atomic_int next;            /* next task to hand out */
+} pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .start = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+        .run_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* set on pool threads and on a caller while its run is going */
+static _Thread_local int in_run = 0;
+
+static void *pool_thread(void *cl);
+static void  take_tasks(int worker);
+
+/*
+*  name:        Mappool_threads
+*  purpose:     Turns a requested thread count into the one a map uses.
+*  arguments:   The count asked for; 0 or less means one per online CPU.
+*  return type: Integer between 1 and MAPPOOL_MAX.
+*  effect:      None.
+*  expects:     None.
+*/
+int Mappool_threads(int requested)
+{
+        if (requested <= 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                requested = cpus > 0 ? (int)cpus : 1;
+        }
+        return requested > MAPPOOL_MAX ? MAPPOOL_MAX : requested;
+}
+
+/*
+*  name:        Mappool_band_rows
+*  purpose:     Picks how many rows go in each band of a parallel map.
+*  arguments:   The number of rows, the bytes each row takes, the fewest
+*               rows a band may have (bands are always a multiple of it)
+*               and the thread count.
+*  return type: Rows per band.
+*  effect:      Aims at BANDS_PER_THREAD bands per thread, then rounds up
+*               so every band starts on a cache line (given that row 0
+*               does). Threads writing their own bands then never share a
+*               line.
+*  expects:     rows, min_rows and threads are positive.
+*/
+int Mappool_band_rows(int rows, size_t row_bytes, int min_rows, int threads)
+{
+        assert(rows > 0 && min_rows > 0 && threads > 0);
+        /* smallest multiple of min_rows whose bytes fill whole lines */
+        int granule = min_rows;
+        for (int k = 1; k <= MAPPOOL_LINE; k++) {
+                if ((size_t)k * min_rows * row_bytes % MAPPOOL_LINE == 0) {
+                        granule = k * min_rows;
+                        break;
+                }
+        }
+        long bands = (long)threads * BANDS_PER_THREAD;
+        long band = (rows + bands - 1) / bands;
+        band = (band + granule - 1) / granule * granule;
+        return band > rows ? rows : (int)band;
+}
+
+/*
+*  name:        Mappool_run
+*  purpose:     Runs tasks 0..tasks - 1 on the calling thread and up to
+*               threads - 1 pool threads.
+*  arguments:   The number of tasks, the number of threads, the task
+*               function (task index, worker number, closure) and the
+*               closure.
+*  return type: None.
+*  effect:      Makes any pool threads that do not exist yet, wakes them
+*               and hands tasks out in increasing order from an atomic
+*               counter. The caller is worker 0 and pool threads are 1 to
+*               threads - 1; each task runs exactly once, on one worker.
+*               Returns when every task has finished.
+*  expects:     tasks >= 0, 1 <= threads <= MAPPOOL_MAX and task is not
+*               NULL.
+*/
+void Mappool_run(int tasks, int threads,
+                 void task(int index, int worker, void *cl), void *cl)
+{
+        assert(tasks >= 0 && task != NULL);
+        assert(threads >= 1 && threads <= MAPPOOL_MAX);
+        if (threads > tasks) {
+                threads = tasks;
+        }
+        if (threads <= 1 || in_run) {
+                for (int i = 0; i < tasks; i++) {
+                        task(i, 0, cl);
+                }
+                return;
+        }
+
+        pthread_mutex_lock(&pool.run_lock);
+        pthread_mutex_lock(&pool.lock);
+        while (pool.threads < threads - 1) {
+                pthread_t tid;
+                long id = ++pool.threads; /* pool threads are 1, 2... */
+                int err = pthread_create(&tid, NULL, pool_thread,
+                                         (void *)id);
+                assert(err == 0);
+                pthread_detach(tid);
+        }
+        pool.task = task;
+        pool.cl = cl;
+        pool.tasks = tasks;
+        pool.wanted = threads;
+        pool.pending = threads - 1;
+        atomic_store(&pool.next, 0);
+        pool.generation++;
+        pthread_cond_broadcast(&pool.start);
+        pthread_mutex_unlock(&pool.lock);
+
+        in_run = 1;
+        take_tasks(0);
+        in_run = 0;
+
+        pthread_mutex_lock(&pool.lock);
+        while (pool.pending > 0) {
+                pthread_cond_wait(&pool.done, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+        pthread_mutex_unlock(&pool.run_lock);
+}
+
+/*
+*  name:        pool_thread
+*  purpose:     The body of every pool thread.
+*  arguments:   The thread's worker number, cast to a pointer.
+*  return type: Never returns.
+*  effect:      Sleeps until a run starts; if its number is below the
+*               run's thread count it takes tasks, then reports back.
+*  expects:     Started by Mappool_run.
+*/
+static void *pool_thread(void *cl)
+{
+        int id = (int)(long)cl;
+        unsigned long seen = 0;
+        in_run = 1;
+
+        pthread_mutex_lock(&pool.lock);
+        for (;;) {
+                while (pool.generation == seen) {
+                        pthread_cond_wait(&pool.start, &pool.lock);
+                }
+                seen = pool.generation;
+                if (id >= pool.wanted) {
+                        continue;
+                }
+                pthread_mutex_unlock(&pool.lock);
+                take_tasks(id);
+                pthread_mutex_lock(&pool.lock);
+                if (--pool.pending == 0) {
+                        pthread_cond_signal(&pool.done);
+                }
+        }
+        return NULL;
+}
+
+/*
+*  name:        take_tasks
+*  purpose:     Runs tasks of the current run until none are left.
+*  arguments:   The worker number to pass to the task function.
+*  return type: None.
+*  effect:      Claims task indexes from the shared counter.
+*  expects:     A run is in progress.
+*/
+static void take_tasks(int worker)
+{
+        int index;
+        while ((index = atomic_fetch_add(&pool.next, 1)) < pool.tasks) {
+                pool.task(index, worker, pool.cl);
+        }
+}
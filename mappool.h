@@ -0,0 +1,26 @@
+/*
+ *     mappool.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     mappool
+ *
+ *     This file holds the interface for the thread pool behind the
+ *     parallel map functions of Bit2 and UArray2. The threads are made
+ *     the first time they are needed and then reused by every later map.
+ */
+
+#ifndef MAPPOOL_INCLUDED
+#define MAPPOOL_INCLUDED
+
+#include <stddef.h>
+
+#define MAPPOOL_LINE 64 /* bytes per cache line */
+
+extern int  Mappool_threads(int requested);
+extern int  Mappool_band_rows(int rows, size_t row_bytes, int min_rows,
+                              int threads);
+extern void Mappool_run(int tasks, int threads,
+                        void task(int index, int worker, void *cl),
+                        void *cl);
+
+#endif
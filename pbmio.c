@@ -0,0 +1,617 @@
+/*
+ *     pbmio.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     pbmio
+ *
+ *     This program reads PBM images straight into the packed words of a
+ *     Bit2_T. The input is read in large blocks into the reader's own
+ *     buffer and the header is parsed once. Raw (P4) rows are copied a
+ *     byte at a time with the bit order flipped, since PBM puts the
+ *     leftmost pixel in the high bit and Bit2 puts it in the low bit.
+ *     Plain (P1) pixels are scanned eight bytes at a time when the text
+ *     has the usual "0 1 0 1 " or "01010101" shape.
+ *
+ *     An image is read a row at a time (Pbmio_read_header, then
+ *     Pbmio_read_row), so a caller that cannot hold the image, such as
+ *     edgestream, gets the same decoder. Pbmio_load reads every row
+ *     straight into the bitmap's own words.
+ *
+ *     Writing goes the other way: each row is built in a line buffer,
+ *     eight pixels per table lookup, and handed to fwrite in one call.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "assert.h"
+#include "except.h"
+#include "pnmrdr.h"
+#include "bit2.h"
+#include "pbmio.h"
+
+#define PBMIO_BUFSIZE (1 << 20)
+
+/* A reader keeps its buffer between images so several images can be
+ * read from one stream */
+struct Pbmio_T {
+        FILE *fp;
+        unsigned char *buf;
+        size_t pos, len;
+        int raw;           /* the image being read: its format, */
+        int width, height; /* its size */
+        int row;           /* and the next row to read */
+        uint64_t carry;    /* P1 pixels decoded past the end of a row */
+        int ncarry;
+};
+
+static unsigned char reverse[256]; /* reverse[b] is b with bits flipped */
+static char plain[256][16];        /* plain[b] is b as "b0 b1 ... b7 " */
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void     build_tables(void);
+static void     fill_tables(void);
+static int      refill(Pbmio_T reader);
+static int      next_byte(Pbmio_T reader);
+static int      skip_space(Pbmio_T reader);
+static unsigned read_number(Pbmio_T reader);
+static Pbmio_status read_raw(Pbmio_T reader, uint64_t *words);
+static Pbmio_status read_plain(Pbmio_T reader, uint64_t *words);
+static void     put_bits(Pbmio_T reader, uint64_t *words, int *col,
+                         uint64_t bits, int n);
+static int      is_space(int c);
+
+/*
+*  name:        Pbmio_new
+*  purpose:     Creates a reader for PBM images on a stream.
+*  arguments:   An open FILE pointer.
+*  return type: A Pbmio_T the caller frees with Pbmio_free.
+*  effect:      Allocates the reader and its PBMIO_BUFSIZE buffer. The
+*               reader may read ahead of the image it returns, so the
+*               stream should only be read through it from now on.
+*  expects:     fp is not NULL.
+*/
+Pbmio_T Pbmio_new(FILE *fp)
+{
+        assert(fp != NULL);
+        build_tables();
+
+        Pbmio_T reader = malloc(sizeof(*reader));
+        assert(reader != NULL);
+        reader->buf = malloc(PBMIO_BUFSIZE);
+        assert(reader->buf != NULL);
+        reader->fp = fp;
+        reader->pos = 0;
+        reader->len = 0;
+        reader->height = 0;
+        reader->row = 0;
+        return reader;
+}
+
+/*
+*  name:        Pbmio_free
+*  purpose:     Frees a reader.
+*  arguments:   A pointer to a Pbmio_T.
+*  return type: None.
+*  effect:      Frees the buffer and the reader and sets it to NULL. The
+*               stream is not closed.
+*  expects:     reader and *reader are not NULL.
+*/
+void Pbmio_free(Pbmio_T *reader)
+{
+        assert(reader != NULL && *reader != NULL);
+        free((*reader)->buf);
+        free(*reader);
+        *reader = NULL;
+}
+
+/*
+*  name:        Pbmio_reset
+*  purpose:     Points a reader at another stream.
+*  arguments:   A reader and an open FILE pointer.
+*  return type: None.
+*  effect:      Drops whatever was buffered from the old stream and keeps
+*               the buffer, so one reader can be used for many files.
+*  expects:     reader and fp are not NULL.
+*/
+void Pbmio_reset(Pbmio_T reader, FILE *fp)
+{
+        assert(reader != NULL && fp != NULL);
+        reader->fp = fp;
+        reader->pos = 0;
+        reader->len = 0;
+        reader->height = 0;
+        reader->row = 0;
+}
+
+/*
+*  name:        Pbmio_read
+*  purpose:     Reads the next PBM image from the stream into a bitmap.
+*  arguments:   A reader.
+*  return type: A new Bit2_T the caller must free, or NULL if the stream
+*               has no more images.
+*  effect:      Consumes the image from the stream.
+*  expects:     The next image is a P1 or P4 PBM. Raises
+*               Pnmrdr_Badformat for anything else or for bad pixel
+*               data, and Pnmrdr_Count if the pixels run out early.
+*/
+Bit2_T Pbmio_read(Pbmio_T reader)
+{
+        Bit2_T bitmap = NULL;
+        Pbmio_status status = Pbmio_load(reader, &bitmap);
+        if (status == PBMIO_IMAGE) {
+                return bitmap;
+        }
+        if (bitmap != NULL) {
+                Bit2_free(&bitmap);
+        }
+        if (status == PBMIO_BADFORMAT) {
+                RAISE(Pnmrdr_Badformat);
+        } else if (status == PBMIO_COUNT) {
+                RAISE(Pnmrdr_Count);
+        }
+        return NULL;
+}
+
+/*
+*  name:        Pbmio_load
+*  purpose:     Reads the next PBM image without raising, for callers that
+*               cannot use exceptions (such as worker threads) or that
+*               want to reuse a bitmap.
+*  arguments:   A reader and a pointer to a bitmap. If *bitmap is not NULL
+*               it is resized with Bit2_resize and reused; otherwise a new
+*               one is made.
+*  return type: PBMIO_IMAGE when *bitmap holds the image, PBMIO_END when
+*               the stream has no more images, PBMIO_BADFORMAT or
+*               PBMIO_COUNT when Pbmio_read would have raised
+*               Pnmrdr_Badformat or Pnmrdr_Count.
+*  effect:      Consumes the image from the stream. After an error *bitmap
+*               may hold a bitmap (partly filled) the caller still owns.
+*  expects:     reader and bitmap are not NULL.
+*/
+Pbmio_status Pbmio_load(Pbmio_T reader, Bit2_T *bitmap)
+{
+        assert(reader != NULL && bitmap != NULL);
+        int width, height;
+        Pbmio_status status = Pbmio_read_header(reader, &width, &height);
+        if (status != PBMIO_IMAGE) {
+                return status;
+        }
+        if (*bitmap == NULL) {
+                *bitmap = Bit2_new(height, width);
+        } else {
+                Bit2_resize(*bitmap, height, width);
+        }
+        for (int row = 0; row < height; row++) {
+                status = Pbmio_read_row(reader, Bit2_row(*bitmap, row));
+                if (status != PBMIO_IMAGE) {
+                        return status;
+                }
+        }
+        return PBMIO_IMAGE;
+}
+
+/*
+*  name:        Pbmio_read_header
+*  purpose:     Starts reading the next PBM image a row at a time.
+*  arguments:   A reader and where to put the image's width and height.
+*  return type: PBMIO_IMAGE when the header was read and the rows can be
+*               read with Pbmio_read_row, PBMIO_END when the stream has no
+*               more images, or PBMIO_BADFORMAT.
+*  effect:      Consumes the header. Any rows of the previous image that
+*               were not read are left in the stream.
+*  expects:     reader, width and height are not NULL.
+*/
+Pbmio_status Pbmio_read_header(Pbmio_T reader, int *width, int *height)
+{
+        assert(reader != NULL && width != NULL && height != NULL);
+        reader->height = 0;
+        reader->row = 0;
+        reader->ncarry = 0;
+        int c = skip_space(reader);
+        if (c == EOF) {
+                return PBMIO_END;
+        }
+        int kind = next_byte(reader);
+        if (c != 'P' || (kind != '1' && kind != '4')) {
+                return PBMIO_BADFORMAT;
+        }
+
+        unsigned w = read_number(reader);
+        unsigned h = read_number(reader);
+        if (w == 0 || h == 0) {
+                return PBMIO_BADFORMAT;
+        }
+        /* for P4, read_number ate the one byte after height */
+        reader->raw = kind == '4';
+        reader->width = *width = w;
+        reader->height = *height = h;
+        return PBMIO_IMAGE;
+}
+
+/*
+*  name:        Pbmio_read_row
+*  purpose:     Reads the next row of the image Pbmio_read_header started.
+*  arguments:   A reader and the row's words, (width + 63) / 64 of them.
+*  return type: PBMIO_IMAGE when words holds the row, PBMIO_COUNT if the
+*               stream ends early or PBMIO_BADFORMAT for bad pixel data.
+*  effect:      Overwrites words, leaving the padding bits 0, and consumes
+*               the row from the stream.
+*  expects:     reader and words are not NULL, and a row of the image is
+*               left to read.
+*/
+Pbmio_status Pbmio_read_row(Pbmio_T reader, uint64_t *words)
+{
+        assert(reader != NULL && words != NULL);
+        assert(reader->row < reader->height);
+        memset(words, 0, ((reader->width + 63) / 64) * sizeof(uint64_t));
+        Pbmio_status status = reader->raw ? read_raw(reader, words)
+                                          : read_plain(reader, words);
+        reader->row++;
+        if (reader->row == reader->height) {
+                reader->ncarry = 0; /* pixels past the image are dropped */
+        }
+        return status;
+}
+
+/*
+*  name:        read_raw
+*  purpose:     Reads one row of a P4 image.
+*  arguments:   The reader, positioned at the row's first byte, and the
+*               row's words, all 0.
+*  return type: PBMIO_IMAGE, or PBMIO_COUNT if the stream ends early.
+*  effect:      The row is (width + 7) / 8 bytes. Every byte is bit-flipped
+*               through a table and ORed into place, eight to a word; the
+*               pad bits past the last column are cleared.
+*  expects:     None.
+*/
+static Pbmio_status read_raw(Pbmio_T reader, uint64_t *words)
+{
+        int width = reader->width;
+        int nwords = (width + 63) / 64;
+        size_t row_bytes = ((size_t)width + 7) / 8;
+
+        for (size_t i = 0; i < row_bytes; i++) {
+                if (reader->pos == reader->len && !refill(reader)) {
+                        return PBMIO_COUNT;
+                }
+                uint64_t b = reverse[reader->buf[reader->pos++]];
+                words[i >> 3] |= b << (8 * (i & 7));
+        }
+        if (width % 64 != 0) {
+                words[nwords - 1] &= ((uint64_t)1 << (width % 64)) - 1;
+        }
+        return PBMIO_IMAGE;
+}
+
+/*
+*  name:        read_plain
+*  purpose:     Reads one row of a P1 image.
+*  arguments:   The reader and the row's words, all 0.
+*  return type: PBMIO_IMAGE, PBMIO_BADFORMAT for a byte that is not '0',
+*               '1', whitespace or a comment, or PBMIO_COUNT if the stream
+*               ends early.
+*  effect:      Starts with the pixels the last row decoded past its end.
+*               Whenever eight buffered bytes are all pixels, or are four
+*               pixels each followed by one space, they are decoded at
+*               once with word operations. Everything else, such as line
+*               ends, comments and other spacing, goes one byte at a time.
+*  expects:     None.
+*/
+static Pbmio_status read_plain(Pbmio_T reader, uint64_t *words)
+{
+        const uint64_t ones = 0x0101010101010101ull;
+        int col = 0;
+        int ncarry = reader->ncarry;
+        reader->ncarry = 0;
+        put_bits(reader, words, &col, reader->carry, ncarry);
+
+        while (col < reader->width) {
+                if (reader->len - reader->pos >= 8) {
+                        const unsigned char *p = reader->buf + reader->pos;
+                        uint64_t x = 0;
+                        for (int i = 0; i < 8; i++) { /* little-endian */
+                                x |= (uint64_t)p[i] << (8 * i);
+                        }
+                        uint64_t t = x ^ (0x30 * ones); /* '0' -> 0 */
+                        if ((t & (0xfe * ones)) == 0) {
+                                /* "01101001": gather the low bits */
+                                uint64_t bits = (t * 0x0102040810204080ull)
+                                                >> 56;
+                                put_bits(reader, words, &col, bits, 8);
+                                reader->pos += 8;
+                                continue;
+                        }
+                        const uint64_t spaces = 0xff00ff00ff00ff00ull;
+                        if ((x & spaces) == (0x20 * ones & spaces) &&
+                            (t & (0xfe * ones) & ~spaces) == 0) {
+                                /* "0 1 1 0 " */
+                                uint64_t bits = (t & 1) | ((t >> 15) & 2)
+                                                | ((t >> 30) & 4)
+                                                | ((t >> 45) & 8);
+                                put_bits(reader, words, &col, bits, 4);
+                                reader->pos += 8;
+                                continue;
+                        }
+                }
+
+                int c = next_byte(reader);
+                if (c == '0' || c == '1') {
+                        put_bits(reader, words, &col, c - '0', 1);
+                } else if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = next_byte(reader);
+                        }
+                } else if (c == EOF) {
+                        return PBMIO_COUNT;
+                } else if (!is_space(c)) {
+                        return PBMIO_BADFORMAT;
+                }
+        }
+        return PBMIO_IMAGE;
+}
+
+/*
+*  name:        put_bits
+*  purpose:     Stores the next n pixels of a P1 row.
+*  arguments:   The reader, the row's words, the next column, the pixels
+*               (first pixel in bit 0) and how many there are.
+*  return type: None.
+*  effect:      ORs the pixels that fit into the row and advances *col.
+*               The rest are kept in the reader's carry for the next row.
+*  expects:     0 <= n <= 8 and the carry is empty.
+*/
+static void put_bits(Pbmio_T reader, uint64_t *words, int *col,
+                     uint64_t bits, int n)
+{
+        int room = reader->width - *col;
+        int k = n < room ? n : room;
+        if (k > 0) {
+                uint64_t chunk = bits & (((uint64_t)1 << k) - 1);
+                int shift = *col & 63;
+                words[*col >> 6] |= chunk << shift;
+                if (shift + k > 64) { /* straddles two words */
+                        words[(*col >> 6) + 1] |= chunk >> (64 - shift);
+                }
+                *col += k;
+        }
+        reader->carry = bits >> k;
+        reader->ncarry = n - k;
+}
+
+/*
+*  name:        Pbmio_write
+*  purpose:     Writes a bitmap as a PBM image.
+*  arguments:   The output stream, the bitmap and whether to write raw P4
+*               (nonzero) or plain P1 (zero).
+*  return type: None.
+*  effect:      Writes the header and every row. The P1 output is byte for
+*               byte what the old printf("%d ", ...) loop produced.
+*  expects:     out and bitmap are not NULL.
+*/
+void Pbmio_write(FILE *out, Bit2_T bitmap, int raw)
+{
+        assert(out != NULL && bitmap != NULL);
+        int width = Bit2_width(bitmap);
+        int height = Bit2_height(bitmap);
+        unsigned char *line = malloc(Pbmio_line_bytes(width, raw));
+        assert(line != NULL);
+
+        Pbmio_write_header(out, width, height, raw);
+        for (int row = 0; row < height; row++) {
+                Pbmio_write_row(out, Bit2_row(bitmap, row), width, raw, line);
+        }
+        free(line);
+}
+
+/*
+*  name:        Pbmio_write_header
+*  purpose:     Writes the PBM header.
+*  arguments:   The output stream, the image size and the format flag.
+*  return type: None.
+*  effect:      Writes "P1" or "P4", a newline, then "width height" and a
+*               newline.
+*  expects:     out is not NULL.
+*/
+void Pbmio_write_header(FILE *out, int width, int height, int raw)
+{
+        assert(out != NULL);
+        fprintf(out, "%s\n%d %d\n", raw ? "P4" : "P1", width, height);
+}
+
+/*
+*  name:        Pbmio_line_bytes
+*  purpose:     Tells how big a line buffer Pbmio_write_row needs.
+*  arguments:   The width and the format flag.
+*  return type: Size in bytes.
+*  effect:      None.
+*  expects:     width > 0.
+*/
+size_t Pbmio_line_bytes(int width, int raw)
+{
+        return raw ? ((size_t)width + 7) / 8 : 2 * (size_t)width + 16;
+}
+
+/*
+*  name:        Pbmio_write_row
+*  purpose:     Writes one row of packed pixels.
+*  arguments:   The output stream, the row words, the width, the format
+*               flag and a line buffer of Pbmio_line_bytes(width, raw).
+*  return type: None.
+*  effect:      For P4, every 8 pixels become one bit-flipped byte. For P1,
+*               every 8 pixels become 16 characters from the plain table,
+*               then the row ends with a newline. One fwrite per row.
+*  expects:     out, words and line are not NULL; the padding bits of the
+*               row are 0.
+*/
+void Pbmio_write_row(FILE *out, const uint64_t *words, int width, int raw,
+                     unsigned char *line)
+{
+        assert(out != NULL && words != NULL && line != NULL);
+        build_tables();
+        size_t nbytes = ((size_t)width + 7) / 8;
+        size_t len;
+
+        if (raw) {
+                for (size_t i = 0; i < nbytes; i++) {
+                        line[i] = reverse[(words[i >> 3] >> (8 * (i & 7)))
+                                          & 0xff];
+                }
+                len = nbytes;
+        } else {
+                for (size_t i = 0; i < nbytes; i++) {
+                        unsigned b = (words[i >> 3] >> (8 * (i & 7))) & 0xff;
+                        memcpy(line + 16 * i, plain[b], 16);
+                }
+                len = 2 * (size_t)width;
+                line[len++] = '\n';
+        }
+        size_t ok = fwrite(line, 1, len, out);
+        assert(ok == len);
+}
+
+/*
+*  name:        build_tables
+*  purpose:     Makes sure the bit flip and P1 text tables are filled.
+*  arguments:   None.
+*  return type: None.
+*  effect:      Fills them on the first call from any thread; pthread_once
+*               makes concurrent first calls safe.
+*  expects:     None.
+*/
+static void build_tables(void)
+{
+        pthread_once(&tables_once, fill_tables);
+}
+
+/*
+*  name:        fill_tables
+*  purpose:     Fills the bit flip and P1 text tables.
+*  arguments:   None.
+*  return type: None.
+*  effect:      Writes reverse and plain.
+*  expects:     Only called through build_tables.
+*/
+static void fill_tables(void)
+{
+        for (int b = 0; b < 256; b++) {
+                int r = 0;
+                for (int i = 0; i < 8; i++) {
+                        r |= ((b >> i) & 1) << (7 - i);
+                        plain[b][2 * i] = '0' + ((b >> i) & 1);
+                        plain[b][2 * i + 1] = ' ';
+                }
+                reverse[b] = r;
+        }
+}
+
+/*
+*  name:        read_number
+*  purpose:     Reads a decimal header field, skipping whitespace and
+*               comments in front of it.
+*  arguments:   The reader.
+*  return type: The value, or 0 if no well-formed number is there (0 is
+*               never a valid width or height).
+*  effect:      Consumes the digits and the byte after them, which must be
+*               whitespace (or a comment start).
+*  expects:     None.
+*/
+static unsigned read_number(Pbmio_T reader)
+{
+        int c = skip_space(reader);
+        if (c < '0' || c > '9') {
+                return 0;
+        }
+        unsigned long value = 0;
+        while (c >= '0' && c <= '9') {
+                value = value * 10 + (c - '0');
+                if (value > 0x7fffffff) {
+                        return 0;
+                }
+                c = next_byte(reader);
+        }
+        if (c == '#') {
+                while (c != '\n' && c != EOF) {
+                        c = next_byte(reader);
+                }
+        } else if (!is_space(c)) {
+                return 0;
+        }
+        return value;
+}
+
+/*
+*  name:        skip_space
+*  purpose:     Skips whitespace and '#' comments.
+*  arguments:   The reader.
+*  return type: The first other byte (consumed), or EOF.
+*  effect:      Consumes input.
+*  expects:     reader is not NULL.
+*/
+static int skip_space(Pbmio_T reader)
+{
+        int c = next_byte(reader);
+        for (;;) {
+                if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = next_byte(reader);
+                        }
+                } else if (!is_space(c)) {
+                        return c;
+                }
+                c = next_byte(reader);
+        }
+}
+
+/*
+*  name:        next_byte
+*  purpose:     Returns the next input byte.
+*  arguments:   The reader.
+*  return type: The byte as an unsigned char, or EOF.
+*  effect:      Refills the buffer when it is empty.
+*  expects:     reader is not NULL.
+*/
+static int next_byte(Pbmio_T reader)
+{
+        if (reader->pos == reader->len && !refill(reader)) {
+                return EOF;
+        }
+        return reader->buf[reader->pos++];
+}
+
+/*
+*  name:        refill
+*  purpose:     Reads the next block of the stream into the buffer.
+*  arguments:   The reader.
+*  return type: Integer, 0 at end of stream and 1 otherwise.
+*  effect:      Moves any unread bytes to the front of the buffer and
+*               reads up to PBMIO_BUFSIZE bytes after them with one fread.
+*  expects:     reader is not NULL.
+*/
+static int refill(Pbmio_T reader)
+{
+        size_t left = reader->len - reader->pos;
+        memmove(reader->buf, reader->buf + reader->pos, left);
+        reader->pos = 0;
+        reader->len = left + fread(reader->buf + left, 1,
+                                   PBMIO_BUFSIZE - left, reader->fp);
+        return reader->len > left;
+}
+
+/*
+*  name:        is_space
+*  purpose:     Tells whether a byte is PBM whitespace.
+*  arguments:   A byte or EOF.
+*  return type: Integer, 1 for whitespace and 0 otherwise.
+*  effect:      None.
+*  expects:     None.
+*/
+static int is_space(int c)
+{
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' ||
+               c == '\v' || c == '\f';
+}
@@ -0,0 +1,47 @@
+/*
+ *     pbmio.h
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     pbmio
+ *
+ *     This file holds the interface for a PBM reader and writer that work
+ *     on Bit2 words directly. The reader takes plain (P1) and raw (P4)
+ *     PBM and raises the same exceptions as Pnmrdr on bad input. The
+ *     writer emits either format, one buffered write per row.
+ */
+
+#ifndef PBMIO_INCLUDED
+#define PBMIO_INCLUDED
+
+#include <stdio.h>
+#include "bit2.h"
+
+typedef struct Pbmio_T *Pbmio_T;
+
+/* What Pbmio_load found; the errors match Pnmrdr's exceptions */
+typedef enum {
+        PBMIO_IMAGE, PBMIO_END, PBMIO_BADFORMAT, PBMIO_COUNT
+} Pbmio_status;
+
+extern Pbmio_T Pbmio_new(FILE *fp);
+extern Bit2_T  Pbmio_read(Pbmio_T reader);
+/* Pbmio_load (and Pbmio_read_row) report bad input as a status instead
+ * of raising. Threads other than the main one must use them: Hanson's
+ * except.c keeps a single stack of TRY frames for the whole process, so
+ * a RAISE on a worker unwinds into whatever TRY another thread last
+ * entered, or aborts. A worker has to deal with the status where the
+ * call returns it, since no handler further up can catch it for it. */
+extern Pbmio_status Pbmio_load(Pbmio_T reader, Bit2_T *bitmap);
+extern Pbmio_status Pbmio_read_header(Pbmio_T reader, int *width,
+                                      int *height);
+extern Pbmio_status Pbmio_read_row(Pbmio_T reader, uint64_t *words);
+extern void    Pbmio_reset(Pbmio_T reader, FILE *fp);
+extern void    Pbmio_free(Pbmio_T *reader);
+
+extern void    Pbmio_write(FILE *out, Bit2_T bitmap, int raw);
+extern void    Pbmio_write_header(FILE *out, int width, int height, int raw);
+extern size_t  Pbmio_line_bytes(int width, int raw);
+extern void    Pbmio_write_row(FILE *out, const uint64_t *words, int width,
+                               int raw, unsigned char *line);
+
+#endif
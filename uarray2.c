@@ -5,13 +5,24 @@
  *     uarray2
  *
  *     The implementation file for a UArray2
+ *
+ *     The elements live in one flat buffer indexed with size_t, so the
+ *     array may hold more than 2^31 elements (Hanson's UArray counts its
+ *     length in an int). The buffer comes from Hugemem_alloc, which backs
+ *     large arrays with huge pages.
+ *
+ *     UArray2_map_row_major_parallel runs a row-major map on the shared
+ *     Mappool threads, one band of rows at a time.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include "uarray.h"
+#include <stddef.h>
+#include <string.h>
 #include "uarray2.h"
+#include "hugemem.h"
+#include "mappool.h"
 
 
 #define ERR_ROW_OUT_OF_BOUNDS "Error: Row index is out of bounds " \
@@ -20,18 +31,33 @@
                             "(width = %d).\n"
 #define ERR_WIDTH "Error: Width must be positive (got %d).\n"
 #define ERR_HEIGHT "Error: Height must be positive (got %d).\n"
+#define ERR_SIZE "Error: Element size must be positive (got %d).\n"
 
 
-/* The struct contains a one dimensional UArray as well as the dimensions
+/* The struct contains the flat element buffer as well as the dimensions
 of the matrix*/
 struct UArray2
 {
-    UArray_T UArray;
+    char *elems;
+    size_t bytes;
     int width;
     int height;
+    int size;
 };
 
 
+/* A UArray2_map_row_major_parallel call, shared by its workers */
+typedef struct {
+    UArray2_T matrix;
+    void (*apply)(int col, int row, UArray2_T matrix, void *elem, void *cl);
+    void *cl;
+    char *slots;
+    size_t stride;
+    int band_rows;
+} Par_map;
+
+static void map_band(int band, int worker, void *cl);
+
 static void report_error_and_exit(const char *message, int val)
 {
         fprintf(stderr, message, val);
@@ -45,15 +71,15 @@ static void report_error_and_exit(const char *message, int val)
                 heigth * width. It us used as a helper function.
 *  arguments:   The coordinates of the matrix element (row and col), as well as
                 UArray2 width. Everything is passed as integers.
-*  return type: Integer
-*  effect:      Determines the index in the original one dimensional UArray
-                where the element can be stored. The formula is:
-                index_original_UArray = row * width + col
+*  return type: size_t, so the index cannot overflow
+*  effect:      Determines the index in the flat element buffer where the
+                element can be stored. The formula is:
+                index = row * width + col
 *  expects:     - The row argument must be smaller than the height of the 
                 matrix. Otherwise it would be out of bounds.
                 - All the arguments passed must be non-negative.
 */
-int return_index(int col, int row, int width, int height)
+size_t return_index(int col, int row, int width, int height)
 {
         if (row >= height || row < 0) {
                 report_error_and_exit(ERR_ROW_OUT_OF_BOUNDS, height);
@@ -63,7 +89,7 @@ int return_index(int col, int row, int width, int height)
                 report_error_and_exit(ERR_COL_OUT_OF_BOUNDS, width);
         }
 
-        return row * width + col;
+        return (size_t)row * width + col;
 }
 
 /*
@@ -73,11 +99,12 @@ int return_index(int col, int row, int width, int height)
  *  arguments:   int width (columns), int height (rows),
  *               int size (bytes per element)
  *  return type: UArray2_T
- *  effect:      Allocates memory for the UArray2 and its underlying UArray for
- *               width*height elements. The caller is responsible for freeing 
- *               the memory using UArray2_free.
- *  expects:     - Non-negative width/height, positive size.
- *               - Returns NULL on allocation failure
+ *  effect:      Allocates memory for the UArray2 and a zeroed buffer for
+ *               width*height elements (huge-page backed when large). The
+ *               caller is responsible for freeing the memory using
+ *               UArray2_free.
+ *  expects:     - Positive width/height and size.
+ *               - Exits on allocation failure
  */
 UArray2_T UArray2_new(int width, int height, int size)
 {
@@ -89,6 +116,10 @@ UArray2_T UArray2_new(int width, int height, int size)
                 report_error_and_exit(ERR_HEIGHT, height);
         }
 
+        if (size <= 0) {
+                report_error_and_exit(ERR_SIZE, size);
+        }
+
         UArray2_T matrix = malloc(sizeof(struct UArray2));
         if (matrix == NULL) {
                 fprintf(stderr, 
@@ -96,16 +127,11 @@ UArray2_T UArray2_new(int width, int height, int size)
                 exit(EXIT_FAILURE);
         }
 
-        matrix->UArray = UArray_new(width * height, size);
-        if (matrix->UArray == NULL) {
-                free(matrix);
-                fprintf(stderr, 
-                        "Error: Failed to allocate memory for UArray.\n");
-                exit(EXIT_FAILURE);
-        }
-
+        matrix->bytes = (size_t)width * height * size;
+        matrix->elems = Hugemem_alloc(matrix->bytes);
         matrix->width = width;
         matrix->height = height;
+        matrix->size = size;
 
         return matrix;
 }
@@ -115,7 +141,7 @@ UArray2_T UArray2_new(int width, int height, int size)
  *  purpose:     Deallocates a UArray2_T and its underlying storage
  *  arguments:   UArray2_T* (double pointer to matrix structure)
  *  return type: void
- *  effect:      - Frees both the container struct and contained UArray.
+ *  effect:      - Frees both the container struct and its element buffer.
  *               - Nulls the pointer
  *  expects:     - Safe to call with NULL
  *               - Undefined behavior if matrix is already freed
@@ -123,7 +149,7 @@ UArray2_T UArray2_new(int width, int height, int size)
 void UArray2_free(UArray2_T *matrix)
 {
         if (matrix != NULL && *matrix != NULL) {
-                UArray_free(&(*matrix)->UArray);
+                Hugemem_free((*matrix)->elems, (*matrix)->bytes);
                 free(*matrix);
                 *matrix = NULL;
         }
@@ -139,8 +165,8 @@ void UArray2_free(UArray2_T *matrix)
  */
 void *UArray2_at(UArray2_T matrix, int col, int row)
 {
-        return UArray_at(matrix->UArray,
-                         return_index(col, row, matrix->width, matrix->height));
+        return matrix->elems + return_index(col, row, matrix->width,
+                                            matrix->height) * matrix->size;
 }
 
 /*
@@ -174,12 +200,12 @@ int UArray2_width(UArray2_T matrix)
  *  purpose:     Returns size in bytes of each element
  *  arguments:   UArray2_T matrix
  *  return type: int
- *  effect:      Delegates to UArray_size on underlying storage
+ *  effect:      Pure accessor function
  *  expects:     Valid initialized matrix
  */
 int UArray2_size(UArray2_T matrix)
 {
-        return UArray_size(matrix->UArray);
+        return matrix->size;
 }
 
 /*
@@ -207,6 +233,103 @@ void UArray2_map_row_major(UArray2_T matrix,
         }
 }
 
+/*
+*  name:        UArray2_map_row_major_parallel
+*  purpose:     Applies function to every element like UArray2_map_row_major,
+                but on several threads
+*  arguments:   UArray2_T matrix, apply function, void* closure, the
+                closure's size in bytes, a reduce function and the thread
+                count (0 or less for one per online CPU)
+*  return type: void
+*  effect:      - Cuts the rows into bands that start on a cache line and
+                maps them on the shared Mappool threads. Inside a band the
+                order is row-major; bands run in no fixed order.
+                - With cl_size 0 every thread is handed cl itself.
+                Otherwise each thread gets its own copy of *cl and, once
+                all bands are done, reduce(cl, copy) is called on the
+                calling thread for every copy, so *cl should start as
+                reduce's identity.
+*  expects:     - apply non-NULL, and reduce non-NULL when cl_size > 0
+                - reduce is associative and commutative
+                - apply writes only the element it is given
+*/
+void UArray2_map_row_major_parallel(UArray2_T matrix,
+    void apply(int col, int row,
+               UArray2_T matrix, void *elem, void *cl),
+    void *cl, size_t cl_size, void reduce(void *cl, const void *part),
+    int threads)
+{
+        if (apply == NULL || (cl_size > 0 && (cl == NULL || reduce == NULL))) {
+                fprintf(stderr, "Error: parallel map needs apply, and a "
+                        "closure and reduce when cl_size > 0.\n");
+                exit(EXIT_FAILURE);
+        }
+        threads = Mappool_threads(threads);
+        Par_map job;
+        job.matrix = matrix;
+        job.apply = apply;
+        job.cl = cl;
+        job.band_rows = Mappool_band_rows(matrix->height,
+                                          (size_t)matrix->width
+                                          * matrix->size, 1, threads);
+        int bands = (matrix->height + job.band_rows - 1) / job.band_rows;
+
+        job.slots = NULL;
+        job.stride = (cl_size + MAPPOOL_LINE - 1) / MAPPOOL_LINE
+                     * MAPPOOL_LINE;
+        if (cl_size > 0) {
+                job.slots = aligned_alloc(MAPPOOL_LINE,
+                                          job.stride * threads);
+                if (job.slots == NULL) {
+                        fprintf(stderr, "Error: Failed to allocate memory "
+                                "for the parallel map.\n");
+                        exit(EXIT_FAILURE);
+                }
+                for (int i = 0; i < threads; i++) {
+                        memcpy(job.slots + i * job.stride, cl, cl_size);
+                }
+        }
+
+        Mappool_run(bands, threads, map_band, &job);
+
+        if (cl_size > 0) {
+                for (int i = 0; i < threads; i++) {
+                        reduce(cl, job.slots + i * job.stride);
+                }
+                free(job.slots);
+        }
+}
+
+/*
+*  name:        map_band
+*  purpose:     Maps one band of a UArray2_map_row_major_parallel call
+*  arguments:   The band number, the worker running it and the Par_map
+*  return type: void
+*  effect:      Invokes apply on each element of the band's rows with the
+                worker's closure
+*  expects:     Called by Mappool_run
+*/
+static void map_band(int band, int worker, void *cl)
+{
+        Par_map *job = cl;
+        UArray2_T matrix = job->matrix;
+        int first = band * job->band_rows;
+        int last = first + job->band_rows;
+        if (last > matrix->height) {
+                last = matrix->height;
+        }
+        void *slot = job->slots == NULL ? job->cl
+                                        : job->slots + worker * job->stride;
+        for (int i = first; i < last; i++) {
+                char *elem = matrix->elems
+                             + (size_t)i * matrix->width * matrix->size;
+                for (int j = 0; j < matrix->width; j++) {
+                        job->apply(j, i, matrix, elem, slot);
+                        elem += matrix->size;
+                }
+        }
+}
+
 /*
 *  name:        UArray2_map_col_major
 *  purpose:     Applies function to elements in column-major order
@@ -18,6 +18,7 @@
  #ifndef UARRAY2_INCLUDED
  #define UARRAY2_INCLUDED
  
+ #include <stddef.h>
  #include "uarray.h"
  
  #define UArray2_T UArray2
@@ -41,10 +42,18 @@
                                               void *elem, void *cl),
                                    void *cl);
  
+ extern void UArray2_map_row_major_parallel(UArray2_T matrix,
+                                   void apply(int col, int row,
+                                              UArray2_T matrix,
+                                              void *elem, void *cl),
+                                   void *cl, size_t cl_size,
+                                   void reduce(void *cl, const void *part),
+                                   int threads);
+ 
  extern void UArray2_map_col_major(UArray2_T matrix,
                                    void apply(int col, int row,
                                               UArray2_T matrix,
                                               void *elem, void *cl),
                                    void *cl);
  
- #endif
\ No newline at end of file
+ #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+/*
+ *     unblackclient.c
+ *     Darius-Stefan Iavorschi, Evren Uluer,
+ *     1/28/25
+ *     unblackclient
+ *
+ *     This program sends one PBM image to an unblackedges server
+ *     (./unblackedges -d socket) and writes the cleaned image it gets
+ *     back, or tells the server to quit.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "assert.h"
+#include "edgeserve.h"
+
+static unsigned char *read_all(FILE *in, size_t *len);
+static void           usage(void);
+
+/*
+*  name:        main
+*  purpose:     Runs one request against a server.
+*  arguments:   The command line: ./unblackclient socket [-r] [-p] [-q]
+*               [inputfile.pbm].
+*  return type: EXIT_SUCCESS if the server answered with EDGESERVE_OK,
+*               EXIT_FAILURE otherwise.
+*  effect:      Sends the image (from the file or standard input) and
+*               writes the reply to stdout. -r asks for raw P4 instead of
+*               plain P1. -p sends the file's absolute path instead of its
+*               bytes, so the server reads it itself; that works only if
+*               the server was started with -P and the file is under its
+*               root. -q sends QUIT and nothing else. Errors are printed
+*               to stderr.
+*  expects:     A server is listening on the socket.
+*/
+int main(int argc, char *argv[])
+{
+        const char *socket_path = NULL;
+        const char *filename = NULL;
+        int flags = 0;
+        int kind = EDGESERVE_IMAGE;
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-r") == 0) {
+                        flags |= EDGESERVE_RAW;
+                } else if (strcmp(argv[i], "-p") == 0) {
+                        kind = EDGESERVE_PATH;
+                } else if (strcmp(argv[i], "-q") == 0) {
+                        kind = EDGESERVE_QUIT;
+                } else if (socket_path == NULL) {
+                        socket_path = argv[i];
+                } else if (filename == NULL) {
+                        filename = argv[i];
+                } else {
+                        usage();
+                }
+        }
+        if (socket_path == NULL || (kind == EDGESERVE_PATH &&
+                                    filename == NULL)) {
+                usage();
+        }
+
+        unsigned char *payload = NULL;
+        size_t len = 0;
+        char path[PATH_MAX];
+        if (kind == EDGESERVE_PATH) {
+                if (realpath(filename, path) == NULL) {
+                        fprintf(stderr, "%s: no such file\n", filename);
+                        exit(EXIT_FAILURE);
+                }
+                payload = (unsigned char *)strdup(path);
+                assert(payload != NULL);
+                len = strlen(path);
+        } else if (kind == EDGESERVE_IMAGE) {
+                FILE *in = stdin;
+                if (filename != NULL) {
+                        in = fopen(filename, "rb");
+                        if (in == NULL) {
+                                fprintf(stderr, "Cannot read %s\n",
+                                        filename);
+                                exit(EXIT_FAILURE);
+                        }
+                }
+                payload = read_all(in, &len);
+                if (in != stdin) {
+                        fclose(in);
+                }
+                if (len > EDGESERVE_MAX_PAYLOAD) {
+                        fprintf(stderr, "Image too large to send\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        int fd = edgeserve_connect(socket_path);
+        if (fd < 0) {
+                fprintf(stderr, "No server at %s\n", socket_path);
+                exit(EXIT_FAILURE);
+        }
+        Edgeserve_reply reply;
+        int ok = edgeserve_call(fd, kind, flags, payload, len, &reply);
+        close(fd);
+        free(payload);
+        if (!ok) {
+                fprintf(stderr, "Server hung up\n");
+                exit(EXIT_FAILURE);
+        }
+
+        static const char *const reasons[] = {
+                "ok", "not a PBM image", "image data ends early",
+                "server cannot open the file", "bad request"
+        };
+        if (reply.status != EDGESERVE_OK) {
+                fprintf(stderr, "Server: %s\n",
+                        reply.status <= EDGESERVE_BADREQUEST ?
+                        reasons[reply.status] : "unknown error");
+                free(reply.data);
+                exit(EXIT_FAILURE);
+        }
+        fwrite(reply.data, 1, reply.len, stdout);
+        free(reply.data);
+        return EXIT_SUCCESS;
+}
+
+/*
+*  name:        read_all
+*  purpose:     Reads a whole stream into memory.
+*  arguments:   The stream and where to put the length.
+*  return type: A malloced buffer the caller frees.
+*  effect:      Reads until end of file, doubling the buffer as needed.
+*  expects:     in and len are not NULL.
+*/
+static unsigned char *read_all(FILE *in, size_t *len)
+{
+        size_t capacity = 1 << 16;
+        unsigned char *data = malloc(capacity);
+        assert(data != NULL);
+        *len = 0;
+        size_t got;
+        while ((got = fread(data + *len, 1, capacity - *len, in)) > 0) {
+                *len += got;
+                if (*len == capacity) {
+                        capacity *= 2;
+                        data = realloc(data, capacity);
+                        assert(data != NULL);
+                }
+        }
+        return data;
+}
+
+/*
+*  name:        usage
+*  purpose:     Prints how to run the program and exits.
+*  arguments:   None.
+*  return type: None.
+*  effect:      Exits with EXIT_FAILURE.
+*  expects:     None.
+*/
+static void usage(void)
+{
+        fprintf(stderr, "Usage: ./unblackclient socket [-r] [-p] [-q] "
+                "[inputfile.pbm]\n");
+        exit(EXIT_FAILURE);
+}
@@ -11,27 +11,100 @@
 #include "bit2.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
 #include "assert.h"
+#include "except.h"
 #include "pnmrdr.h"
-#include "stack.h"
+#include "edgefill.h"
+#include "edgestack.h"
+#include "bitlabel.h"
+#include "edgepar.h"
+#include "edgestream.h"
+#include "edgebatch.h"
+#include "edgepipe.h"
+#include "edgeserve.h"
+#include "edgecache.h"
+#include "edgediff.h"
+#include "pbmio.h"
 
-/* These are entries of black pixels to put in a stack. */
+/* Every edge-removal engine has this shape */
+typedef void (*Engine)(Bit2_T bitmap, Edgefill_stats *stats);
+
+static void stack_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void parallel_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void claim_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void post_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void cache_engine(Bit2_T bitmap, Edgefill_stats *stats);
+static void diff_engine(Bit2_T bitmap, Edgefill_stats *stats);
+
+/* How many threads the parallel engines use, set with -j */
+static int thread_count = 1;
+
+/* One post-processing step, given with -m */
 typedef struct {
-        int row, col;
-} BlackPixels;
+        Bit2_morph_op op;
+        Bit2_se se;
+} Morph_step;
+
+#define MORPH_STEPS 16 /* most -m options */
+
+/* The -m steps in order, and the engine post_engine runs before them */
+static Morph_step morph_steps[MORPH_STEPS];
+static int morph_count = 0;
+static Engine edge_engine;
+
+/* The -k result cache, the engine cache_engine runs on a miss and the
+ * seed that keys results by the -m steps as well as by the page */
+static Edgecache_T cache = NULL;
+static Engine cached_engine;
+static uint64_t cache_seed;
+
+#define CACHE_FORMAT 1 /* bump when a result for the same input changes */
+
+/* The engine diff_engine runs before it turns the page into the pixels
+ * that changed, for -D */
+static Engine diffed_engine;
+
+/* Where -c writes the blobs left on each image, and the image count */
+static FILE *blob_out = NULL;
+static int blob_images = 0;
 
+/* The edge-removal engines that can be picked with -e. The first one is
+ * the default. The stack engine (edgestack.c) is the reference the others
+ * are checked against. */
+static const struct {
+        const char *name;
+        Engine run;
+} engines[] = {
+        { "worklist", edgefill_worklist },
+        { "stack",    stack_engine },
+        { "bitpar",   edgefill_bitpar },
+        { "span",     edgefill_span },
+        { "rle",      edgefill_rle },
+        { "parallel", parallel_engine },
+        { "claim",    claim_engine },
+        { "label",    edgefill_label },
+};
 
-Bit2_T pbmread(FILE *inputfp);
-void   pbmwrite(Bit2_T bitmap);
-void   swap_color(Stack_T pixels, Bit2_T bitmap);
-void   push_pixels(Stack_T pixels, Bit2_T bitmap, int row, int col);
-void   unblackedges(Bit2_T bitmap);
-void   edgepix_to_stack(Stack_T pixels, Bit2_T bitmap, int row, int col);
+static Engine find_engine(const char *name);
+static void   add_morph_step(const char *step);
+static void   open_cache(const char *dir, const char *megabytes);
+static void   close_cache(int verbose);
+static void   write_blobs(Bitlabel_T labels);
+static int    run_batch(char **paths, int npaths, const char *outdir,
+                        Engine engine, int raw);
+static int    run_server(const char *socket_path, const char *path_root,
+                         Engine engine, int workers);
+static int    apply_diff(FILE *inputfp, const char *diff_path, int raw);
 
 /*
 *  name:        main
 *  purpose:     Reads a PBM file, removes edge-connected black pixels, 
-*               and outputs the modified bitmap.
+*               and outputs the modified bitmap. A file (or standard input)
+*               may hold several concatenated images; each one is cleaned
+*               and written in turn.
 *  arguments:   An integer argc representing the number of command-line arguments,
 *               and an array of character pointers argv representing 
 *               the arguments.
@@ -39,228 +112,695 @@ void   edgepix_to_stack(Stack_T pixels, Bit2_T bitmap, int row, int col);
 *  effect:      - Reads a PBM file from a given filename or standard input.
 *               - Modifies the bitmap by removing edge-connected black pixels.
 *               - Outputs the modified bitmap in PBM format to stdout.
-*               - Allocates memory for the bitmap, which is freed before exiting.
-*  expects:     - argc is either 1 (read from stdin) or 2 (read from file).
-*               - If argc == 2, argv[1] must be a valid PBM file path.
+*               - Images are read, cleaned and written by the overlapping
+*                 stages of edgepipe_run, which frees its bitmaps at the end.
+*  expects:     - Usage is ./unblackedges [-e engine] [-j threads] [-w workers]
+*                 [-m op:element]... [-c blobfile] [-k cachedir]
+*                 [-K megabytes] [-D] [-s] [-r] [-v] [inputfile.pbm], or
+*                 ./unblackedges -A difffile [-r] [inputfile.pbm], or
+*                 ./unblackedges -b outdir [-e engine] [-j threads]
+*                 [-m op:element]... [-k cachedir] [-K megabytes] [-r]
+*                 input..., or
+*                 ./unblackedges -d socket [-P rootdir] [-e engine]
+*                 [-j threads] [-w workers] [-m op:element]...
+*                 [-k cachedir] [-K megabytes]
+*               - Without a file name the image is read from standard input.
+*               - The engine is one of the names in the engines table.
+*               - -j sets the thread count and picks the parallel engine
+*                 unless -e names another one. With -b it sets the number
+*                 of files worked on at once instead.
+*               - -w sets how many images are cleaned at once (default 1).
+*               - Each -m adds a morphology step run on every image after
+*                 its edges are cleaned, in the order given; see
+*                 add_morph_step. It cannot be used with -s.
+*               - -c writes the label, area, bounding box and centroid of
+*                 every blob left on each image to blobfile; see
+*                 write_blobs. It picks the label engine unless -e or -j
+*                 is given, so the blobs are measured by the same pass
+*                 that clears the edges. It needs one worker and cannot
+*                 be used with -s or -b.
+*               - -k keeps cleaned pages in cachedir, keyed by a hash of
+*                 the page and the -m steps, and reads a page seen before
+*                 back instead of cleaning it; see edgecache.c. -K caps
+*                 the directory at that many megabytes (default 1024) by
+*                 dropping the least recently used results. -k works in
+*                 every mode but -s and cannot be used with -c.
+*               - -D writes, for each image, only the pixels cleaning
+*                 changed, as the runs of a diff (E4 with -r, E1 without;
+*                 see edgediff.h) instead of the cleaned image. Without
+*                 -m those are exactly the black pixels turned white. It
+*                 cannot be used with -s, -b or -d.
+*               - -A rebuilds the cleaned images from the original images
+*                 (inputfile.pbm or standard input) and the diffs -D wrote
+*                 for them to difffile, and writes them out. It cleans
+*                 nothing itself, so -e, -j and -w do nothing with it and
+*                 the options that change what is cleaned are refused.
+*               - -b runs a batch: every input file (or every file in an
+*                 input directory) is cleaned and written to outdir under
+*                 the same name, and the throughput is printed to stderr.
+*               - -d serves requests on the Unix domain socket at the
+*                 given path with -w workers until a client sends QUIT;
+*                 see edgeserve.h and unblackclient. A worker serves one
+*                 connection at a time. The output format is chosen per
+*                 request, so -r does not apply. Requests that name a
+*                 file instead of carrying the image are refused unless
+*                 -P gives a directory; then only files under it can be
+*                 read, since any process that can reach the socket may
+*                 send one.
+*               - -s streams the image through edgestream_run instead of
+*                 loading it, so memory depends only on its width. Only
+*                 the first image of the input is used.
+*               - -r writes raw P4 output instead of plain P1.
+*               - -v reports the engine's peak scratch memory on stderr.
 *               - The PBM file must be properly formatted.
 *               - If too many arguments are provided, the program exits with an error.
 */
 int main(int argc, char *argv[])
 {   
-        if (argc == 2) { /* read from a file */   
-                FILE *inputfp = fopen(argv[1], "r");
-                assert(inputfp != NULL);
+        const char *engine_name = engines[0].name;
+        Engine engine = engines[0].run;
+        int verbose = 0;
+        int chosen = 0; /* was -e given */
+        int streaming = 0;
+        int raw = 0;
+        int threads_given = 0;
+        int workers = 1; /* set by -w */
+        char *outdir = NULL; /* set by -b */
+        char *socket_path = NULL; /* set by -d */
+        char *path_root = NULL; /* set by -P */
+        char *cache_dir = NULL; /* set by -k */
+        char *cache_megabytes = "1024"; /* set by -K */
+        int diff_output = 0; /* set by -D */
+        char *diff_path = NULL; /* set by -A */
+        char **paths = malloc(argc * sizeof(char *));
+        int npaths = 0;
+        assert(paths != NULL);
 
-                Bit2_T bitmap = pbmread(inputfp);
-                assert(bitmap != NULL);
-                fclose(inputfp);
-                unblackedges(bitmap);
-                pbmwrite(bitmap);
-                Bit2_free(&bitmap); /* free */         
-        } else if (argc == 1) { /* read from standard input */
-                Bit2_T bitmap = pbmread(stdin);
-                assert(bitmap != NULL);
-                unblackedges(bitmap);
-                pbmwrite(bitmap);
-                Bit2_free(&bitmap); /* free */
-        } else {
-                /* there should only ever be max two arguments */
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+                        engine_name = argv[++i];
+                        engine = find_engine(engine_name);
+                        chosen = 1;
+                } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                        thread_count = atoi(argv[++i]);
+                        if (thread_count < 1) {
+                                fprintf(stderr, "-j needs a positive "
+                                        "thread count\n");
+                                exit(EXIT_FAILURE);
+                        }
+                        threads_given = 1;
+                } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+                        workers = atoi(argv[++i]);
+                        if (workers < 1) {
+                                fprintf(stderr, "-w needs a positive "
+                                        "worker count\n");
+                                exit(EXIT_FAILURE);
+                        }
+                } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+                        add_morph_step(argv[++i]);
+                } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+                        blob_out = fopen(argv[++i], "w");
+                        if (blob_out == NULL) {
+                                fprintf(stderr, "Cannot write %s\n",
+                                        argv[i]);
+                                exit(EXIT_FAILURE);
+                        }
+                } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+                        outdir = argv[++i];
+                } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+                        socket_path = argv[++i];
+                } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+                        path_root = argv[++i];
+                } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+                        cache_dir = argv[++i];
+                } else if (strcmp(argv[i], "-K") == 0 && i + 1 < argc) {
+                        cache_megabytes = argv[++i];
+                } else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc) {
+                        diff_path = argv[++i];
+                } else if (strcmp(argv[i], "-D") == 0) {
+                        diff_output = 1;
+                } else if (strcmp(argv[i], "-s") == 0) {
+                        streaming = 1;
+                } else if (strcmp(argv[i], "-r") == 0) {
+                        raw = 1;
+                } else if (strcmp(argv[i], "-v") == 0) {
+                        verbose = 1;
+                } else {
+                        paths[npaths++] = argv[i];
+                }
+        }
+
+        if (diff_path != NULL &&
+            (diff_output || streaming || outdir != NULL ||
+             socket_path != NULL || morph_count > 0 || blob_out != NULL ||
+             cache_dir != NULL)) {
+                fprintf(stderr, "-A cannot be used with -D, -s, -b, -d, "
+                        "-m, -c or -k\n");
+                exit(EXIT_FAILURE);
+        }
+        if (threads_given && !chosen && outdir == NULL) {
+                engine_name = "parallel";
+                engine = parallel_engine;
+        }
+        if (blob_out != NULL) {
+                if (streaming || outdir != NULL || socket_path != NULL ||
+                    workers > 1) {
+                        fprintf(stderr, "-c cannot be used with -s, -b, "
+                                "-d or -w\n");
+                        exit(EXIT_FAILURE);
+                }
+                if (!chosen && !threads_given) {
+                        engine_name = "label";
+                        engine = edgefill_label;
+                }
+        }
+        if (morph_count > 0 || blob_out != NULL) {
+                if (streaming) {
+                        fprintf(stderr, "-m cannot be used with -s\n");
+                        exit(EXIT_FAILURE);
+                }
+                edge_engine = engine;
+                engine = post_engine;
+        }
+        if (cache_dir != NULL) {
+                if (streaming || blob_out != NULL) {
+                        fprintf(stderr, "-k cannot be used with -s or "
+                                "-c\n");
+                        exit(EXIT_FAILURE);
+                }
+                open_cache(cache_dir, cache_megabytes);
+                cached_engine = engine;
+                engine = cache_engine;
+        }
+        if (diff_output) {
+                if (streaming || outdir != NULL || socket_path != NULL) {
+                        fprintf(stderr, "-D cannot be used with -s, -b or "
+                                "-d\n");
+                        exit(EXIT_FAILURE);
+                }
+                diffed_engine = engine;
+                engine = diff_engine;
+        }
+        if (socket_path != NULL) {
+                if (streaming || outdir != NULL || npaths > 0) {
+                        fprintf(stderr, "-d takes no input and cannot be "
+                                "used with -s or -b\n");
+                        exit(EXIT_FAILURE);
+                }
+                free(paths);
+                int ok = run_server(socket_path, path_root, engine,
+                                    workers);
+                close_cache(verbose);
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (path_root != NULL) {
+                fprintf(stderr, "-P is only used with -d\n");
+                exit(EXIT_FAILURE);
+        }
+        if (outdir != NULL) {
+                if (streaming) {
+                        fprintf(stderr, "-s cannot be used with -b\n");
+                        exit(EXIT_FAILURE);
+                }
+                int ok = run_batch(paths, npaths, outdir, engine, raw);
+                free(paths);
+                close_cache(verbose);
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (npaths > 1) {
+                /* there should only ever be one file name */
                 printf("Too many arguments\n");
                 exit(EXIT_FAILURE);
         }
-        
+        char *filename = npaths == 1 ? paths[0] : NULL;
+        free(paths);
+
+        FILE *inputfp = stdin; /* read from standard input by default */
+        if (filename != NULL) { /* read from a file */
+                inputfp = fopen(filename, "r");
+                assert(inputfp != NULL);
+        }
+
+        if (diff_path != NULL) {
+                int ok = apply_diff(inputfp, diff_path, raw);
+                if (inputfp != stdin) {
+                        fclose(inputfp);
+                }
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        Edgefill_stats stats = { 0 };
+        if (streaming) {
+                edgestream_run(inputfp, stdout, raw, &stats);
+                if (verbose) {
+                        fprintf(stderr, "stream: peak memory %zu bytes\n",
+                                stats.peak_bytes);
+                }
+                if (inputfp != stdin) {
+                        fclose(inputfp);
+                }
+                return EXIT_SUCCESS;
+        }
+
+        int images;
+        Pbmio_status status = edgepipe_run(inputfp, stdout, engine,
+                                           diff_output ? edgediff_write
+                                                       : Pbmio_write,
+                                           workers, raw, &images, &stats);
+        if (inputfp != stdin) {
+                fclose(inputfp);
+        }
+        if (blob_out != NULL) {
+                fclose(blob_out);
+        }
+        close_cache(verbose);
+        if (verbose) {
+                fprintf(stderr, "%s: %d images, peak scratch memory %zu "
+                        "bytes\n", engine_name, images, stats.peak_bytes);
+        }
+        if (status == PBMIO_COUNT) {
+                RAISE(Pnmrdr_Count);
+        } else if (status == PBMIO_BADFORMAT || images == 0) {
+                RAISE(Pnmrdr_Badformat);
+        }
+
         return EXIT_SUCCESS;
 }
 
 /*
-*  name:        pbmread
-*  purpose:     Reads a PBM file and stores it as a 2D bit map.
-*  arguments:   A FILE pointer representing the input PBM file.
-*  return type: Bit2_T (a 2D bit map).
-*  effect:      Allocates memory for a Bit2_T structure that must be freed
-*               later.
-*  expects:     The input file pointer is valid and points to a properly 
-*               formatted PBM file.
+*  name:        find_engine
+*  purpose:     Looks up an edge-removal engine by its command-line name.
+*  arguments:   The name given after -e.
+*  return type: Pointer to the engine function.
+*  effect:      Prints the known engines to stderr and exits with
+*               EXIT_FAILURE if the name is unknown.
+*  expects:     name is not NULL.
 */
-Bit2_T pbmread(FILE *inputfp)
+static Engine find_engine(const char *name)
 {
-        assert(inputfp != NULL);
-
-        /* get the information of the pbm by using pnmrdr */
-        Pnmrdr_T rdr = Pnmrdr_new(inputfp);
-        Pnmrdr_mapdata map = Pnmrdr_data(rdr);
+        assert(name != NULL);
+        int count = sizeof(engines) / sizeof(engines[0]);
+        for (int i = 0; i < count; i++) {
+                if (strcmp(engines[i].name, name) == 0) {
+                        return engines[i].run;
+                }
+        }
 
-        Bit2_T bitmap = Bit2_new(map.height, map.width);
+        fprintf(stderr, "Unknown engine: %s (choose from", name);
+        for (int i = 0; i < count; i++) {
+                fprintf(stderr, " %s", engines[i].name);
+        }
+        fprintf(stderr, ")\n");
+        exit(EXIT_FAILURE);
+}
 
-        /* make sure to read the whole file */
-        for (unsigned row = 0; row < map.height; row++) {
-                for (unsigned col = 0; col < map.width; col++) {
-                    int bit = Pnmrdr_get(rdr);
-                    Bit2_put(bitmap, row, col, bit);
+/*
+*  name:        add_morph_step
+*  purpose:     Parses one -m argument into a morphology step.
+*  arguments:   The argument, op:element. op is erode, dilate, open or
+*               close. element is square (3x3), cross (3x3 plus), HxW (a
+*               filled rectangle H rows by W columns) or crossHxW (a plus
+*               with arms H and W long).
+*  return type: None.
+*  effect:      Appends the step to morph_steps. Prints the accepted forms
+*               to stderr and exits with EXIT_FAILURE if the argument is
+*               not one of them or there are too many steps.
+*  expects:     step is not NULL.
+*/
+static void add_morph_step(const char *step)
+{
+        static const struct {
+                const char *name;
+                Bit2_morph_op op;
+        } ops[] = {
+                { "erode:", BIT2_ERODE }, { "dilate:", BIT2_DILATE },
+                { "open:", BIT2_OPEN },   { "close:", BIT2_CLOSE },
+        };
+        assert(step != NULL);
+        int count = sizeof(ops) / sizeof(ops[0]);
+        const char *element = NULL;
+        Morph_step parsed;
+        for (int i = 0; i < count && element == NULL; i++) {
+                size_t len = strlen(ops[i].name);
+                if (strncmp(step, ops[i].name, len) == 0) {
+                        parsed.op = ops[i].op;
+                        element = step + len;
                 }
         }
 
-        Pnmrdr_free(&rdr);
-        return bitmap;
+        int ok = element != NULL && morph_count < MORPH_STEPS;
+        if (ok && strcmp(element, "square") == 0) {
+                parsed.se = BIT2_SE_SQUARE3;
+        } else if (ok && strcmp(element, "cross") == 0) {
+                parsed.se = BIT2_SE_CROSS3;
+        } else if (ok) {
+                parsed.se.shape = BIT2_SE_RECT;
+                if (strncmp(element, "cross", 5) == 0) {
+                        parsed.se.shape = BIT2_SE_CROSS;
+                        element += 5;
+                }
+                char extra;
+                ok = sscanf(element, "%dx%d%c", &parsed.se.height,
+                            &parsed.se.width, &extra) == 2 &&
+                     parsed.se.height >= 1 &&
+                     parsed.se.height <= BIT2_MORPH_MAX &&
+                     parsed.se.width >= 1 &&
+                     parsed.se.width <= BIT2_MORPH_MAX;
+        }
+        if (!ok) {
+                fprintf(stderr, "Bad -m step: %s (use erode, dilate, open "
+                        "or close, then :square, :cross, :HxW or "
+                        ":crossHxW with sides up to %d; at most %d "
+                        "steps)\n", step, BIT2_MORPH_MAX, MORPH_STEPS);
+                exit(EXIT_FAILURE);
+        }
+        morph_steps[morph_count++] = parsed;
 }
 
 /*
-*  name:        swap_color
-*  purpose:     Iterates through a stack of black pixels and changes them
-*               to white (0), ensuring all connected black pixels are also
-*               processed.
-*  arguments:   A stack containing black pixels to process and a bitmap
-*               representing the 2D bit array.
+*  name:        open_cache
+*  purpose:     Opens the -k result cache and works out its seed.
+*  arguments:   The directory and the -K size in megabytes, as given.
 *  return type: None.
-*  effect:      Iterates through the stack and changes black pixels (1) to
-*               white (0) in the bit map. Pushes adjacent black pixels to
-*               the stack for further processing. Frees dynamically allocated
-*               memory for each processed pixel, since they are allocated
-*               structs.
-*  expects:     Bitmap and pixels are not NULL and the pixels in the stack
-*               contain valid row and column indices.
+*  effect:      Sets cache and cache_seed. The seed mixes CACHE_FORMAT and
+*               every -m step, so pages cleaned with different steps never
+*               share a result. Prints the problem to stderr and exits
+*               with EXIT_FAILURE if the size is not a positive number or
+*               the directory cannot be used.
+*  expects:     dir and megabytes are not NULL; the -m steps are parsed.
 */
-void swap_color(Stack_T pixels, Bit2_T bitmap)
+static void open_cache(const char *dir, const char *megabytes)
 {
-        assert(bitmap != NULL && pixels != NULL);
-    
-        while (!Stack_empty(pixels)) {
-                BlackPixels *curr_pixel = Stack_pop(pixels);
-                int row  = curr_pixel->row;
-                int col = curr_pixel->col;
-                free(curr_pixel);
-
-                if (Bit2_get(bitmap, row, col) == 1) {  
-                        Bit2_put(bitmap, row, col, 0);
-                        push_pixels(pixels, bitmap, row, col);
+        char extra;
+        double size;
+        if (sscanf(megabytes, "%lf%c", &size, &extra) != 1 || size <= 0) {
+                fprintf(stderr, "-K needs a positive size in megabytes\n");
+                exit(EXIT_FAILURE);
+        }
+        cache = edgecache_open(dir, (uint64_t)(size * 1024 * 1024));
+        if (cache == NULL) {
+                fprintf(stderr, "Cannot use %s as a cache directory\n",
+                        dir);
+                exit(EXIT_FAILURE);
+        }
+
+        cache_seed = CACHE_FORMAT;
+        for (int i = 0; i < morph_count; i++) {
+                int fields[4] = { morph_steps[i].op, morph_steps[i].se.shape,
+                                  morph_steps[i].se.height,
+                                  morph_steps[i].se.width };
+                for (int f = 0; f < 4; f++) {
+                        /* FNV-1a over the step fields */
+                        cache_seed = (cache_seed ^ (uint64_t)fields[f])
+                                     * 0x100000001b3u;
                 }
         }
-    
 }
 
 /*
-*  name:        unblackedges
-*  purpose:     Iteratively removes black pixels (1s) that are connected 
-*               to the edges of the bitmap using a stack.
-*  arguments:   A bitmap representing the 2D bit array.
+*  name:        close_cache
+*  purpose:     Closes the -k result cache, if there is one.
+*  arguments:   Whether -v was given.
 *  return type: None.
-*  effect:      Allocates memory for a new stack and then frees it
-*               at the end. Calls other functions that allocate memory, but
-*               that will also be freed in their respective functions.
-*  expects:     The bitmap pointer is not NULL.
+*  effect:      With -v prints the hits, misses and evictions and what the
+*               cache holds to stderr, then closes it.
+*  expects:     No engine is running.
 */
-void unblackedges(Bit2_T bitmap)
+static void close_cache(int verbose)
 {
-        assert(bitmap != NULL);
-        Stack_T pixels = Stack_new(); /* create the stack */
-        int width = Bit2_width(bitmap);
-        int height = Bit2_height(bitmap);
+        if (cache == NULL) {
+                return;
+        }
+        if (verbose) {
+                Edgecache_stats stats = edgecache_stats(cache);
+                fprintf(stderr, "cache: %" PRIu64 " hits, %" PRIu64
+                        " misses, %" PRIu64 " evicted, %" PRIu64
+                        " results in %" PRIu64 " bytes\n", stats.hits,
+                        stats.misses, stats.evictions, stats.entries,
+                        stats.bytes);
+        }
+        edgecache_close(&cache);
+}
 
-        /* top and bottom */
-        for (int col = 0; col < width; col++) {
-                edgepix_to_stack(pixels, bitmap, 0, col);
-                edgepix_to_stack(pixels, bitmap, height - 1, col);
+/*
+*  name:        run_batch
+*  purpose:     Runs batch mode and prints its throughput.
+*  arguments:   The input paths and their count, the output directory, the
+*               engine and the output format flag.
+*  return type: 1 if every file was written, 0 if any failed.
+*  effect:      Cleans the inputs on thread_count workers with
+*               edgebatch_run, then prints the page count, pages per second
+*               and megapixels per second to stderr.
+*  expects:     paths and outdir are not NULL.
+*/
+static int run_batch(char **paths, int npaths, const char *outdir,
+                     Engine engine, int raw)
+{
+        assert(paths != NULL && outdir != NULL);
+        if (npaths == 0) {
+                fprintf(stderr, "-b needs at least one input\n");
+                exit(EXIT_FAILURE);
         }
+        Edgebatch_report report = edgebatch_run(paths, npaths, outdir,
+                                                engine, thread_count, raw);
+        double seconds = report.seconds > 0 ? report.seconds : 1e-9;
+        fprintf(stderr, "batch: %d pages, %d failed, %.3f s, "
+                "%.1f pages/s, %.1f MPixel/s\n", report.pages,
+                report.failed, report.seconds, report.pages / seconds,
+                report.pixels / seconds / 1e6);
+        return report.failed == 0;
+}
 
-        /* sides no overlap with the corners */
-        for (int row = 1; row < height - 1; row++) {
-                edgepix_to_stack(pixels, bitmap, row, 0);
-                edgepix_to_stack(pixels, bitmap, row, width - 1);
+/*
+*  name:        run_server
+*  purpose:     Runs server mode and prints what it did.
+*  arguments:   The socket path, the directory path requests are confined
+*               to (NULL to refuse them), the engine and the number of
+*               workers.
+*  return type: 1 if the server ran, 0 if its socket or root could not be
+*               set up.
+*  effect:      Serves requests with edgeserve_run until a client sends
+*               QUIT, then prints the request, failure and connection
+*               counts to stderr.
+*  expects:     socket_path is not NULL and workers >= 1.
+*/
+static int run_server(const char *socket_path, const char *path_root,
+                      Engine engine, int workers)
+{
+        Edgeserve_report report;
+        if (!edgeserve_run(socket_path, engine, workers, path_root,
+                           &report)) {
+                return 0;
         }
+        fprintf(stderr, "serve: %" PRIu64 " requests, %" PRIu64 " failed, "
+                "%" PRIu64 " connections\n", report.requests, report.failed,
+                report.connections);
+        return 1;
+}
 
-        swap_color(pixels, bitmap); /* process our stack */
-        Stack_free(&pixels); /* free the stack */
+/*
+*  name:        apply_diff
+*  purpose:     Runs -A: rebuilds cleaned images from originals and diffs.
+*  arguments:   The stream of original images, the path of the diff file
+*               -D wrote for them and whether to write raw P4 output.
+*  return type: 1 if every image was rebuilt, 0 if the diff file cannot be
+*               opened.
+*  effect:      Writes the rebuilt images to stdout with edgediff_apply.
+*               Raises Pnmrdr_Count or Pnmrdr_Badformat, as cleaning does,
+*               if an image or its diff is bad or the two do not match.
+*  expects:     inputfp and diff_path are not NULL.
+*/
+static int apply_diff(FILE *inputfp, const char *diff_path, int raw)
+{
+        assert(inputfp != NULL && diff_path != NULL);
+        FILE *difffp = fopen(diff_path, "rb");
+        if (difffp == NULL) {
+                fprintf(stderr, "Cannot read %s\n", diff_path);
+                return 0;
+        }
+        int images;
+        Pbmio_status status = edgediff_apply(inputfp, difffp, stdout, raw,
+                                             &images);
+        fclose(difffp);
+        if (status == PBMIO_COUNT) {
+                RAISE(Pnmrdr_Count);
+        } else if (status == PBMIO_BADFORMAT || images == 0) {
+                RAISE(Pnmrdr_Badformat);
+        }
+        return 1;
 }
 
 /*
-*  name:        pbmwrite
-*  purpose:     Writes a 2D bit map in PBM format to standard output.
-*  arguments:   A Bit2_T representing the bitmap.
+*  name:        stack_engine
+*  purpose:     Lets the reference unblackedges() be used from the engines
+*               table.
+*  arguments:   A bitmap and an optional stats pointer.
 *  return type: None.
-*  effect:      Prints the PBM representation of the bitmap to stdout.
+*  effect:      Runs unblackedges(). The Stack_T nodes and BlackPixels
+*               structs it mallocs are not tracked, so peak_bytes is 0.
 *  expects:     The bitmap pointer is not NULL.
 */
-void pbmwrite(Bit2_T bitmap)
+static void stack_engine(Bit2_T bitmap, Edgefill_stats *stats)
 {
-        assert(bitmap != NULL);
-        int width = Bit2_width(bitmap);
-        int height = Bit2_height(bitmap);
+        unblackedges(bitmap);
+        if (stats != NULL) {
+                stats->peak_bytes = 0;
+        }
+}
+
+/*
+*  name:        parallel_engine
+*  purpose:     Lets edgepar_run be used from the engines table.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Runs edgepar_run with the thread count given by -j.
+*  expects:     The bitmap pointer is not NULL.
+*/
+static void parallel_engine(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        edgepar_run(bitmap, thread_count, stats);
+}
+
+/*
+*  name:        claim_engine
+*  purpose:     Lets edgepar_claim be used from the engines table.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Runs edgepar_claim with the thread count given by -j.
+*  expects:     The bitmap pointer is not NULL.
+*/
+static void claim_engine(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        edgepar_claim(bitmap, thread_count, stats);
+}
+
+/*
+*  name:        post_engine
+*  purpose:     Runs the chosen engine, then the -m morphology steps and
+*               the -c blob report.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Runs edge_engine, then every step of morph_steps in order
+*               on the cleaned bitmap, sharing one scratch bitmap between
+*               them; the scratch counts towards peak_bytes. With -c the
+*               blobs left are labeled and written out. When edge_engine
+*               is the label engine and there are no -m steps, the
+*               labeling that clears the edges is the one reported, so
+*               the page is only scanned once.
+*  expects:     The bitmap pointer is not NULL and edge_engine is set.
+*/
+static void post_engine(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        Bitlabel_T labels = NULL;
+        if (blob_out != NULL && edge_engine == edgefill_label &&
+            morph_count == 0) {
+                labels = Bitlabel_new(bitmap, 4, BITLABEL_CLEAR_BORDER);
+                if (stats != NULL) {
+                        stats->peak_bytes = Bitlabel_bytes(labels);
+                }
+        } else {
+                edge_engine(bitmap, stats);
+        }
 
-        /* print the header */
-        printf("P1\n");
-        printf("%d %d\n", width, height);
+        if (morph_count > 0) {
+                int height = Bit2_height(bitmap);
+                int width = Bit2_width(bitmap);
+                Bit2_T scratch = Bit2_new(height, width);
+                for (int i = 0; i < morph_count; i++) {
+                        Bit2_morph(bitmap, morph_steps[i].op,
+                                   morph_steps[i].se, scratch);
+                }
+                Bit2_free(&scratch);
 
-        /* print the data */
-        for (int row = 0; row < height; row++) {
-                for (int col = 0; col < width; col++) {
-                        printf("%d ", Bit2_get(bitmap, row, col));
+                size_t bytes = (size_t)height * ((width + 63) / 64)
+                               * sizeof(uint64_t);
+                if (stats != NULL && bytes > stats->peak_bytes) {
+                        stats->peak_bytes = bytes;
                 }
+        }
 
-                printf("\n");
+        if (blob_out != NULL) {
+                if (labels == NULL) {
+                        labels = Bitlabel_new(bitmap, 4, 0);
+                }
+                write_blobs(labels);
+                Bitlabel_free(&labels);
         }
 }
 
 /*
-*  name:        push_pixels
-*  purpose:     Identifies the four adjacent pixels (up, down, left, right) 
-*               and pushes them onto the stack for processing.
-*  arguments:   A stack containing black pixels to process and a bitmap
-*               representing the 2D bit array, as well as two ints
-*               represnting an index in the bitmap.
+*  name:        cache_engine
+*  purpose:     Runs cached_engine through the -k result cache.
+*  arguments:   A bitmap and an optional stats pointer.
 *  return type: None.
-*  effect:      Dynamically allocates memory for up to four BlackPixels
-*               structs, then pushes those onto a stack. If one is invalid
-*               it is freed, otherwise the clients need to call swap_color
-*               to free the rest in the stack.
-*  expects:     Pixels and bitmap are not NULL. and row + col are valid bounds
+*  effect:      Hashes the page with Bit2_hash and cache_seed. On a hit the
+*               page is replaced by the stored result and peak_bytes is 0;
+*               on a miss cached_engine cleans it and the result is
+*               stored under the hash of the page as it came in.
+*  expects:     The bitmap pointer is not NULL, cache and cached_engine
+*               are set.
 */
-void push_pixels(Stack_T pixels, Bit2_T bitmap, int row, int col)
+static void cache_engine(Bit2_T bitmap, Edgefill_stats *stats)
 {
-        assert(pixels != NULL && bitmap != NULL);
-
-        BlackPixels *connected[4];
-        for (int i = 0; i < 4; i++) {
-                connected[i] = malloc(sizeof(BlackPixels));
-                assert(connected[i] != NULL);
-        }
-
-        connected[0]->row = row - 1; /* up */
-        connected[0]->col = col; /* up */
-        connected[1]->row = row + 1; /* down */
-        connected[1]->col = col;  /* down */
-        connected[2]->row = row; /* left */
-        connected[2]->col = col - 1; /* left */
-        connected[3]->row = row; /* right */
-        connected[3]->col = col + 1; /* right */
-
-        for (int i = 0; i < 4; i++) { /* make sure they're in bounds */
-                if (valid_index(bitmap, connected[i]->row, connected[i]->col)) {
-                        Stack_push(pixels, connected[i]);
-                } else {
-                        free(connected[i]); /* free if not */
+        uint64_t key = Bit2_hash(bitmap, cache_seed);
+        if (edgecache_get(cache, key, bitmap)) {
+                if (stats != NULL) {
+                        stats->peak_bytes = 0;
                 }
+                return;
+        }
+        cached_engine(bitmap, stats);
+        edgecache_put(cache, key, bitmap);
+}
+
+/*
+*  name:        diff_engine
+*  purpose:     Runs diffed_engine and leaves the pixels it changed.
+*  arguments:   A bitmap and an optional stats pointer.
+*  return type: None.
+*  effect:      Copies the page, cleans it with diffed_engine and XORs the
+*               copy back in, so a 1 bit marks a pixel that changed. The
+*               copy counts towards peak_bytes.
+*  expects:     The bitmap pointer is not NULL and diffed_engine is set.
+*/
+static void diff_engine(Bit2_T bitmap, Edgefill_stats *stats)
+{
+        int height = Bit2_height(bitmap);
+        int width = Bit2_width(bitmap);
+        Bit2_T original = Bit2_new(height, width);
+        Bit2_combine(original, bitmap, BIT2_OR);
+        diffed_engine(bitmap, stats);
+        Bit2_combine(bitmap, original, BIT2_XOR);
+        Bit2_free(&original);
+
+        size_t bytes = (size_t)height * ((width + 63) / 64)
+                       * sizeof(uint64_t);
+        if (stats != NULL) {
+                stats->peak_bytes += bytes;
         }
 }
 
 /*
-*  name:        edgepix_to_stack
-*  purpose:     Checks if a given edge pixel is black (1) and pushes
-*               it onto the stack.
-*  arguments:   A stack containing black pixels to process and a bitmap
-*               representing the 2D bit array, as well as two ints
-*               represnting an index in the bitmap.
+*  name:        write_blobs
+*  purpose:     Writes the blobs of one image to the -c file.
+*  arguments:   The image's labels.
 *  return type: None.
-*  effect:      Dynamically allocates space fro BlackPixel structs if
-*               an edge is black and pushes it onto a stack. These
-*               will be freed when swap_color is called.
-*  expects:     Pixels and bitmap are not NULL. and row + col are valid bounds
+*  effect:      Writes a line "image N: K blobs" (N counting from 0), then
+*               one line per blob: label, area, top, left, bottom and right
+*               (inclusive), and the centroid's row and column.
+*  expects:     labels is not NULL and blob_out is open. Images come in
+*               stream order, which one worker guarantees.
 */
-void edgepix_to_stack(Stack_T pixels, Bit2_T bitmap, int row, int col)
+static void write_blobs(Bitlabel_T labels)
 {
-        if (Bit2_get(bitmap, row, col) == 1) {
-                BlackPixels *curr_pixel = malloc(sizeof(BlackPixels));
-                curr_pixel->row = row;
-                curr_pixel->col = col;
-                Stack_push(pixels, curr_pixel);
+        assert(labels != NULL && blob_out != NULL);
+        int count = Bitlabel_count(labels);
+        const Bitlabel_blob *blobs = Bitlabel_blobs(labels);
+        fprintf(blob_out, "image %d: %d blobs\n", blob_images++, count);
+        for (int i = 0; i < count; i++) {
+                fprintf(blob_out, "%d %" PRIu64 " %d %d %d %d %.2f %.2f\n",
+                        blobs[i].label, blobs[i].area, blobs[i].top,
+                        blobs[i].left, blobs[i].bottom, blobs[i].right,
+                        blobs[i].row, blobs[i].col);
         }
 }